@@ -30,49 +30,50 @@
 
 /* -- global variables -- */
 
-INFO info;
-struct SYMBOL *sym;		/* (points to the symbols of the current voice) */
+TLS INFO info;
+TLS struct SYMBOL *sym;		/* (points to the symbols of the current voice) */
 
-int tunenum;			/* number of current tune */
-int pagenum = 1;		/* current page in output file */
+TLS int tunenum;			/* number of current tune */
+TLS int pagenum = 1;		/* current page in output file */
 
 				/* switches modified by command line flags: */
-int quiet;			/* quiet mode */
-int secure;			/* secure mode */
-int annotate;			/* output source references */
-int pagenumbers;		/* write page numbers */
-int epsf;			/* 1: EPSF, 2: SVG, 3: embedded ABC */
-int svg;			/* 1: SVG, 2: XHTML */
-int showerror;			/* show the errors */
-int pipeformat = 0;		/* format for bagpipes regardless of key */
-
-char outfn[FILENAME_MAX];	/* output file name */
-int file_initialized;		/* for output file */
-FILE *fout;			/* output file */
-char *in_fname;			/* current input file name */
-time_t mtime;			/* last modification time of the input file */
-static time_t fmtime;		/*	"	"	of all files */
-
-int s_argc;			/* command line arguments */
-char **s_argv;
-
-struct tblt_s *tblts[MAXTBLT];
-struct cmdtblt_s cmdtblts[MAXCMDTBLT];
-int ncmdtblt;
+TLS int quiet;			/* quiet mode */
+TLS int secure;			/* secure mode */
+TLS int annotate;			/* output source references */
+TLS int pagenumbers;		/* write page numbers */
+TLS int epsf;			/* 1: EPSF, 2: SVG, 3: embedded ABC */
+TLS int svg;			/* 1: SVG, 2: XHTML, 3: PDF */
+TLS int showerror;			/* show the errors */
+TLS int pipeformat = 0;		/* format for bagpipes regardless of key */
+
+TLS char outfn[FILENAME_MAX];	/* output file name */
+TLS int file_initialized;		/* for output file */
+TLS FILE *fout;			/* output file */
+TLS char *in_fname;			/* current input file name */
+TLS time_t mtime;			/* last modification time of the input file */
+static TLS time_t fmtime;		/*	"	"	of all files */
+static TLS long fmtime_ns;		/* (nanoseconds) */
+
+TLS int s_argc;			/* command line arguments */
+TLS char **s_argv;
+
+TLS struct tblt_s *tblts[MAXTBLT];
+TLS struct cmdtblt_s cmdtblts[MAXCMDTBLT];
+TLS int ncmdtblt;
 
 /* -- local variables -- */
 
-static char *styd = DEFAULT_FDIR; /* format search directory */
-static int def_fmt_done = 0;	/* default format read */
-static struct SYMBOL notitle;
+static TLS char *styd = DEFAULT_FDIR; /* format search directory */
+static TLS int def_fmt_done = 0;	/* default format read */
+static TLS char *serve_path;		/* socket of the daemon ('--serve') */
+static TLS struct SYMBOL notitle;
 
 /* memory arena (for clrarena, lvlarena & getarena) */
 #define MAXAREAL 3		/* max area levels:
 				 * 0; global, 1: tune, 2: generation */
 #define AREANASZ 8192		/* standard allocation size */
-#define MAXAREANASZ 0x20000	/* biggest allocation size */
-static int str_level;		/* current arena level */
-static struct str_a {
+static TLS int str_level;		/* current arena level */
+static TLS struct str_a {
 	struct str_a *n;	/* next area */
 	char	*p;		/* pointer in area */
 	int	r;		/* remaining space in area */
@@ -111,6 +112,14 @@ FILE *open_file(char *fn,	/* file name */
 	char *p;
 	int l;
 
+	/* the library and the daemon requests may read
+	 * only the format files of the format directory */
+	if (lib_abc || serve_req) {
+		if (strchr(fn, '/') || strchr(fn, DIRSEP) || *fn == '.')
+			return NULL;
+		goto fmtdir;
+	}
+
 	/* if there was some ABC file, try its directory */
 	if (in_fname && in_fname != fn
 	 && (p = strrchr(in_fname, DIRSEP)) != NULL) {
@@ -125,6 +134,7 @@ FILE *open_file(char *fn,	/* file name */
 	strcpy(rfn, fn);
 	if ((fp = open_ext(rfn, ext)) != NULL)
 		return fp;
+fmtdir:
 
 	/* try a format in the format directory */
 	if (*ext != 'f' || *styd == '\0')
@@ -139,32 +149,24 @@ FILE *open_file(char *fn,	/* file name */
 
 /* -- read a whole input file -- */
 /* the real/full file name is put in tex_buf[] */
-static char *read_file(char *fn, char *ext)
+/* when the file is mapped, '*map_sz' is set to the size of the mapping */
+static char *read_file(char *fn, char *ext, size_t *map_sz)
 {
 	size_t fsize;
 	FILE *fin;
 	char *file;
 
-	if (*fn == '\0') {
-		strcpy(tex_buf, "stdin");
-		fsize = 0;
-		file = malloc(8192);
-		for (;;) {
-			int l;
+	*map_sz = 0;
 
-			l = fread(&file[fsize], 1, 8192, stdin);
-			fsize += l;
-			if (l != 8192)
-				break;
-			file = realloc(file, fsize + 8192);
-		}
-		if (ferror(stdin) != 0) {
-			free(file);
-			return 0;
-		}
-		if (fsize % 8192 == 0)
-			file = realloc(file, fsize + 2);
+	if (*fn == '\0' && lib_abc) {		/* library */
+		strcpy(tex_buf, "stdin");
+		fsize = lib_abclen;
+		file = malloc(fsize + 2);
+		if (!file)
+			return NULL;
+		memcpy(file, lib_abc, fsize);
 		time(&fmtime);
+		fmtime_ns = 0;
 	} else {
 		struct stat sbuf;
 
@@ -177,6 +179,28 @@ static char *read_file(char *fn, char *ext)
 		}
 		fsize = ftell(fin);
 		rewind(fin);
+		fstat(fileno(fin), &sbuf);
+		memcpy(&fmtime, &sbuf.st_mtime, sizeof fmtime);
+#if defined(__APPLE__)
+		fmtime_ns = sbuf.st_mtimespec.tv_nsec;
+#elif defined(unix) || defined(__unix__)
+		fmtime_ns = sbuf.st_mtim.tv_nsec;
+#else
+		fmtime_ns = 0;
+#endif
+#ifdef HAVE_MMAP
+		/* map the file when the end of its last page
+		 * gives the null byte at end of text */
+		if (fsize % sysconf(_SC_PAGESIZE) != 0) {
+			file = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE,
+					fileno(fin), 0);
+			if (file != MAP_FAILED) {
+				fclose(fin);
+				*map_sz = fsize;
+				return file;
+			}
+		}
+#endif
 		if ((file = malloc(fsize + 2)) == NULL) {
 			fclose(fin);
 			return NULL;
@@ -187,8 +211,6 @@ static char *read_file(char *fn, char *ext)
 			free(file);
 			return NULL;
 		}
-		fstat(fileno(fin), &sbuf);
-		memcpy(&fmtime, &sbuf.st_mtime, sizeof fmtime);
 		fclose(fin);
 	}
 	file[fsize] = '\0';
@@ -198,7 +220,7 @@ static char *read_file(char *fn, char *ext)
 /* call back to handle %%format/%%abc-include - see front.c */
 void include_file(unsigned char *fn)
 {
-	static int nbfiles;
+	static TLS int nbfiles;
 
 	if (nbfiles > 2) {
 		error(1, NULL, "Too many included files");
@@ -215,26 +237,41 @@ static void treat_file(char *fn, char *ext)
 {
 	char *file;
 	char *abc_fn;
+	size_t map_sz;
 	int file_type, l;
 
 	/* initialize if not already done */
 	if (!fout)
 		read_def_format();
 
+	/* treat the ABC text from stdin tune by tune */
+	if (*fn == '\0' && !lib_abc) {
+		abc_fn = "stdin";
+		if (!quiet)
+			fprintf(err_out(), "File %s\n", abc_fn);
+		in_fname = abc_fn;
+		time(&fmtime);
+		mtime = fmtime;
+		frontend_stream(stdin, abc_fn);
+		job_file_end();
+		clrarena(1);		/* clear previous tunes */
+		return;
+	}
+
 	/* read the file into memory */
 	/* the real/full file name is in tex_buf[] */
-	if ((file = read_file(fn, ext)) == NULL) {
+	if ((file = read_file(fn, ext, &map_sz)) == NULL) {
 		if (strcmp(fn, "default.fmt") != 0) {
 			error(1, NULL, "Cannot read the input file '%s'", fn);
 #if defined(unix) || defined(__unix__)
-			perror("    read_file");
+			fprintf(err_out(), "    read_file: %s\n", strerror(errno));
 #endif
 		}
 		return;
 	}
 	abc_fn = strdup(tex_buf);
 	if (!quiet)
-		fprintf(stderr, "File %s\n", abc_fn);
+		fprintf(err_out(), "File %s\n", abc_fn);
 
 	/* convert the strings */
 	l = strlen(abc_fn);
@@ -248,17 +285,28 @@ static void treat_file(char *fn, char *ext)
 		file_type = FE_ABC;
 		in_fname = abc_fn;
 		mtime = fmtime;
+		idx_open(abc_fn, file,
+			map_sz ? map_sz : strlen(file), fmtime, fmtime_ns);
 	}
 
 	frontend((unsigned char *) file, file_type,
 				abc_fn, 0);
-	free(file);
+	if (file_type == FE_ABC)
+		idx_close();
+#ifdef HAVE_MMAP
+	if (map_sz)
+		munmap(file, map_sz);
+	else
+#endif
+		free(file);
 
 	if (file_type == FE_PS)			/* PostScript file */
 		frontend((unsigned char *) "%%endps", FE_ABC,
 				abc_fn, 0);
-	if (file_type == FE_ABC)	/* if ABC file */
+	if (file_type == FE_ABC) {	/* if ABC file */
+		job_file_end();
 		clrarena(1);		/* clear previous tunes */
+	}
 }
 
 /* -- treat an ABC input file and generate the music -- */
@@ -266,13 +314,10 @@ static void treat_file(char *fn, char *ext)
 static void treat_abc_file(char *fn)
 {
 	FILE *fin;
-	char *file, *file_tmp;
-	char *abc_fn, *p, *q;
-	size_t fsize, l, l2;
-	int linenum;
-#ifdef HAVE_MMAP
-	int fd;
-#endif
+	char *file, *e;
+	char *abc_fn, *p, *q, c;
+	size_t fsize;
+	int linenum, nl, mapped;
 
 	lvlarena(0);
 	parse.abc_state = ABC_S_GLOBAL;
@@ -284,7 +329,7 @@ static void treat_abc_file(char *fn)
 
 	if (*fn == '\0') {
 		error(1, NULL, "cannot use stdin with -z - aborting");
-		exit(EXIT_FAILURE);
+		fatal_exit(EXIT_FAILURE);
 	}
 
 	fin = open_file(fn, "abc", tex_buf);
@@ -296,99 +341,101 @@ static void treat_abc_file(char *fn)
 	}
 	fsize = ftell(fin);
 	rewind(fin);
+
+	/* the ABC sequences are given to the front end in place,
+	 * so the file must be writable and followed by a null byte */
+	file = NULL;
+	mapped = 0;
 #ifdef HAVE_MMAP
-	fd = fileno(fin);
-	file = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fd, 0);
-	if (!file)
-		goto err;
-#else
-	file = malloc(fsize);
-	if (!file)
-		goto err;
-	if (fread(file, 1, fsize, fin) != fsize) {
-		free(file);
-		goto err;
+	if (fsize % sysconf(_SC_PAGESIZE) != 0) {
+		file = mmap(NULL, fsize, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+				fileno(fin), 0);
+		if (file == MAP_FAILED)
+			file = NULL;
+		else
+			mapped = 1;
 	}
-	fclose(fin);
 #endif
+	if (!file) {
+		file = malloc(fsize + 1);
+		if (!file) {
+			fclose(fin);
+			goto err;
+		}
+		if (fread(file, 1, fsize, fin) != fsize) {
+			fclose(fin);
+			free(file);
+			goto err;
+		}
+		file[fsize] = '\0';
+	}
+	fclose(fin);
 
 	/* copy the HTML/XML/XHTML file and generate the music */
 	abc_fn = strdup(tex_buf);
-	l = fsize;
 	p = file;
+	e = file + fsize;
 	linenum = 0;
-	while (l > 0) {
+	while (p < e) {
 
 		/* search the start of ABC lines */
-#if 1
-		for (q = p, l2 = l - 10; l2 > 0; l2--, q++) {
-			if (strncmp(q, "\n%abc2", 6) == 0
-//			 || strncmp(q, "\n%%", 3) == 0
-			 || strncmp(q, "\nX:", 3) == 0)
+		q = p;
+		for (;;) {
+			q = memchr(q, '\n', e - q);
+			if (!q)
 				break;
-		}
-#else
-		for (q = p, l2 = l - 5; l2 > 0; l2--, q++)
-			if (strncmp(q, "<abc>", 5) == 0)
+			q++;
+			linenum++;
+			if ((e - q >= 5 && strncmp(q, "%abc2", 5) == 0)
+//			 || (e - q >= 2 && strncmp(q, "%%", 2) == 0)
+			 || (e - q >= 2 && strncmp(q, "X:", 2) == 0))
 				break;
-#endif
-		if (l2 <= 0) {
-			fwrite(p, 1, l, fout);
+		}
+		if (!q) {
+			fwrite(p, 1, e - p, fout);
 			break;
 		}
-		q++;
 		fwrite(p, 1, q - p, fout);
-		l -= q - p;
-		while (p != q) {
-			if (*p++ == '\n')
-				linenum++;
-		}
+		p = q;
 
 		/* search the end of ABC lines */
-		for (q = p, l2 = l - 10; l2 > 0; l2--, q++)
-			if (*q == '\n' && q[1] == '<')
+		nl = 0;
+		for (;;) {
+			q = memchr(q, '\n', e - q);
+			if (!q) {
+				error(1, NULL, "no end of ABC sequence");
+				q = e;
+				break;
+			}
+			q++;
+			nl++;
+			if (q < e && *q == '<')
 				break;
-		if (l2 <= 0) {
-			error(1, NULL, "no end of ABC sequence");
-			q += 9;
-//			break;
-		}
-		q++;
-
-		/* must copy ... :( */
-		l2 = q - p;
-		file_tmp = malloc(l2 + 1);
-		if (!file_tmp) {
-			error(1, NULL, "out of memory");
-			break;
 		}
-		memcpy(file_tmp, p, l2);
-		file_tmp[l2] = '\0';
 
-		frontend((unsigned char *) file_tmp, FE_ABC,
+		c = *q;
+		*q = '\0';
+		frontend((unsigned char *) p, FE_ABC,
 						abc_fn, linenum);
-		free(file_tmp);
+		*q = c;
 
 		clrarena(1);			/* clear previous tunes */
 		file_initialized = -1;	/* don't put <br/> before first image */
 
-		l -= q - p;
-		while (p != q) {
-			if (*p++ == '\n')
-				linenum++;
-		}
+		linenum += nl;
+		p = q;
 	}
 
 #ifdef HAVE_MMAP
-	munmap(file, fsize);
-	fclose(fin);
-#else
-	free(file);
+	if (mapped)
+		munmap(file, fsize);
+	else
 #endif
+		free(file);
 	return;
 err:
 	error(1, NULL, "input file %s error %s - aborting", fn, strerror(errno));
-	exit(EXIT_FAILURE);
+	fatal_exit(EXIT_FAILURE);
 }
 
 /* -- read the default format -- */
@@ -417,7 +464,7 @@ void strext(char *fn, char *ext)
 /* -- write the program version -- */
 static void display_version(int full)
 {
-	fputs("abcm2ps-" VERSION " (" VDATE ")\n", stderr);
+	fputs("abcm2ps-" VERSION " (" VDATE ")\n", err_out());
 	if (!full)
 		return;
 	fputs("Compiled: " __DATE__ "\n"
@@ -434,16 +481,16 @@ static void display_version(int full)
 #if !defined(A4_FORMAT) && !defined(DECO_IS_ROLL) && !defined(HAVE_PANGO)
 		" NONE"
 #endif
-		"\n", stderr);
+		"\n", err_out());
 	if (styd[0] != '\0')
-		fprintf(stderr, "Default format directory: %s\n", styd);
+		fprintf(err_out(), "Default format directory: %s\n", styd);
 }
 
 /* -- display usage and exit -- */
 static void usage(void)
 {
 	display_version(0);
-	printf(	"ABC to Postscript/SVG translator.\n"
+	printf(	"ABC to Postscript/SVG/PDF translator.\n"
 		"Usage: abcm2ps [options] file [file_options] ..\n"
 		"where:\n"
 		" file        input ABC file, or '-'\n"
@@ -454,10 +501,20 @@ static void usage(void)
 		"     -v      produce SVG output, one page per file\n"
 		"     -X      produce SVG output in one XHTML file\n"
 		"     -z      produce SVG output from embedded ABC\n"
+		"     -P      produce PDF output\n"
 		"     -O fff  set outfile name to fff\n"
 		"     -O =    make outfile name from infile/title\n"
+		"     --sprite fff\n"
+		"             with -g or -v, put the symbols in the shared file fff\n"
+		"     --cairo png|pdf\n"
+		"             draw the pages by cairo, PNG one page per file or PDF\n"
+		"     --stats fff\n"
+		"             write the timing and the memory usage in the JSON file fff\n"
+		"     --trace fff\n"
+		"             write the timeline of the generation in the file fff\n"
 		"     -i      indicate where are the errors\n"
-		"     -k kk   size of the PS output buffer in Kibytes\n"
+		"     -k kk   size of the output buffer chunks in Kibytes\n"
+		"     -J n    render the tunes with n threads\n"
 		"  .output formatting:\n"
 		"     -s xx   set scale factor to xx\n"
 		"     -w xx   set staff width (cm/in/pt)\n"
@@ -487,13 +544,17 @@ static void usage(void)
 		"  .input file selection/options:\n"
 		"     -e pattern\n"
 		"             tune selection\n"
+		"     -y      write the tune index files (.idx)\n"
 		"  .help/configuration:\n"
 		"     -V      show program version\n"
 		"     -h      show this command summary\n"
 		"     -H      show the format parameters\n"
 		"     -S      secure mode\n"
-		"     -q      quiet mode\n");
-	exit(EXIT_SUCCESS);
+		"     -q      quiet mode\n"
+		"  .daemon:\n"
+		"     --serve sss\n"
+		"             render the requests of the Unix socket sss\n");
+	fatal_exit(EXIT_SUCCESS);
 }
 
 #ifdef linux
@@ -555,7 +616,7 @@ static struct cmdtblt_s *cmdtblt_parse(char *p)
 /* set a command line option */
 static void set_opt(char *w, char *v)
 {
-	static char prefix = '%';	/* pseudo-comment prefix */
+	static TLS char prefix = '%';	/* pseudo-comment prefix */
 
 	if (!v)
 		v = "";
@@ -571,14 +632,17 @@ static void set_opt(char *w, char *v)
 			"cmd_line", 0);
 }
 
-/* -- main program -- */
-int main(int argc, char **argv)
+/* -- main program (also called by the library) -- */
+int abcm2ps_main(int argc, char **argv)
 {
 	unsigned j;
+	int done;
 	char *p, c, *aaa;
 
 	if (argc <= 1)
 		usage();
+	if (!job_mode && !lib_out)
+		job_args(argc, argv);
 
 	outfn[0] = '\0';
 	init_outbuf(64);
@@ -593,6 +657,33 @@ int main(int argc, char **argv)
 		if (*p != '-' || p[1] == '-') {
 			if (*p == '+' && p[1] == 'F')	/* +F : no default format */
 				def_fmt_done = 1;
+			else if (strcmp(p, "--serve") == 0 && argc > 1)
+				serve_path = argv[1];
+			else if (strcmp(p, "--sprite") == 0 && argc > 1)
+				svg_sprite = argv[1];
+			else if (strcmp(p, "--stats") == 0 && argc > 1)
+				stats_file = argv[1];
+			else if (strcmp(p, "--trace") == 0 && argc > 1)
+				trace_file = argv[1];
+			else if (strcmp(p, "--cairo") == 0 && argc > 1) {
+#ifdef HAVE_PANGO
+				if (strcmp(argv[1], "png") == 0) {
+					cairo_out = 1;
+				} else if (strcmp(argv[1], "pdf") == 0) {
+					cairo_out = 2;
+				} else {
+					error(1, NULL,
+						"Bad value for '--cairo': %s",
+						argv[1]);
+					return EXIT_FAILURE;
+				}
+				svg = 3;	/* PDF translation */
+				epsf = 0;
+#else
+				error(1, NULL, "No cairo support - abort");
+				return EXIT_FAILURE;
+#endif
+			}
 			continue;
 		}
 		while ((c = *++p) != '\0') {	/* '-xxx' */
@@ -627,6 +718,11 @@ int main(int argc, char **argv)
 				svg = 2;	/* SVG/XHTML */
 				epsf = 0;
 				break;
+			case 'P':
+				svg = 3;	/* PDF */
+				epsf = 0;
+				cairo_out = 0;
+				break;
 			case 'k': {
 				int kbsz;
 
@@ -667,33 +763,45 @@ int main(int argc, char **argv)
 				svg = 0;
 				break;
 			default:
-				if (strchr("aBbDdeFfIjmNOsTw", c)) /* if with arg */
+				if (strchr("aBbDdeFfIJjmNOsTw", c)) /* if with arg */
 					p += strlen(p) - 1;	/* skip */
 				break;
 			}
 		}
 	}
+	if (job_mode)
+		quiet = 1;
+	if (serve_req)
+		serve_check();		/* may pass the request to the image */
+	else if (serve_path)
+		serve_init();		/* create the image of the daemon */
 	if (!quiet)
 		display_version(0);
+	stats_init();
 
 	/* initialize */
-	clrarena(0);				/* global */
-	clrarena(1);				/* tunes */
-	clrarena(2);				/* generation */
-//	memset(&info, 0, sizeof info);
-	info['T' - 'A'] = &notitle;
-	notitle.text = "T:";
-	set_format();
-	init_deco();
+	done = 0;
+	if (serve_req) {			/* already done by the daemon */
+		done = serve_nargs;
+	} else {
+		clrarena(0);			/* global */
+		clrarena(1);			/* tunes */
+		clrarena(2);			/* generation */
+//		memset(&info, 0, sizeof info);
+		info['T' - 'A'] = &notitle;
+		notitle.text = "T:";
+		set_format();
+		init_deco();
 
 #ifdef linux
-	/* if not set, try to find where is the default format directory */
-	if (styd[0] == '\0')
-		wherefmtdir();
+		/* if not set, try to find where is the default format directory */
+		if (styd[0] == '\0')
+			wherefmtdir();
 #endif
 #ifdef HAVE_PANGO
-	pg_init();
+		pg_init();
 #endif
+	}
 
 	/* if ABC embedded in XML, open the output file */
 	if (epsf == 3) {
@@ -702,8 +810,8 @@ int main(int argc, char **argv)
 	}
 
 	/* parse the arguments - finding a new file, treat the previous one */
-	argc = s_argc;
-	argv = s_argv;
+	argc = s_argc - done;
+	argv = s_argv + done;
 	while (--argc > 0) {
 		argv++;
 		p = *argv;
@@ -821,7 +929,12 @@ int main(int argc, char **argv)
 					return EXIT_FAILURE;
 				}
 				argv++;
-				set_opt(p, *argv);
+				if (strcmp(p, "serve") != 0
+				 && strcmp(p, "sprite") != 0
+				 && strcmp(p, "stats") != 0
+				 && strcmp(p, "trace") != 0
+				 && strcmp(p, "cairo") != 0)
+					set_opt(p, *argv);
 				continue;
 			}
 			while ((c = *++p) != '\0') {
@@ -848,6 +961,8 @@ int main(int argc, char **argv)
 				case 'g':
 					break;
 				case 'H':
+					if (job_mode)
+						return EXIT_SUCCESS;
 					if (!fout) {
 						read_def_format();
 						make_font_list();
@@ -868,6 +983,7 @@ int main(int argc, char **argv)
 				case 'q':
 				case 'S':
 					break;
+				case 'P':
 				case 'v':
 				case 'X':
 				case 'z':
@@ -876,6 +992,9 @@ int main(int argc, char **argv)
 					cfmt.fields[0] |= 1 << ('X' - 'A');
 					lock_fmt(&cfmt.fields);
 					break;
+				case 'y':
+					idx_write = 1;
+					break;
 				case '0':
 					cfmt.splittune = 1;
 					lock_fmt(&cfmt.splittune);
@@ -903,6 +1022,7 @@ int main(int argc, char **argv)
 				case 'e':
 				case 'F':
 				case 'I':
+				case 'J':
 				case 'j':
 				case 'k':
 				case 'L':
@@ -925,7 +1045,7 @@ int main(int argc, char **argv)
 						p += strlen(p) - 1;	/* stop */
 					}
 
-					if (strchr("BbfjkNs", c)) {	/* check num args */
+					if (strchr("BbfJjkNs", c)) {	/* check num args */
 						for (j = 0; j < strlen(aaa); j++) {
 							if (!strchr("0123456789.",
 								    aaa[j])) {
@@ -966,6 +1086,16 @@ int main(int argc, char **argv)
 					case 'I':
 						set_opt("indent", aaa);
 						break;
+					case 'J':
+#ifdef HAVE_PTHREAD
+						sscanf(aaa, "%d", &jobs);
+						if (jobs < 1)
+							jobs = 1;
+#else
+						error(0, NULL,
+							"No thread support - '-J' ignored");
+#endif
+						break;
 					case 'j':
 						sscanf(aaa, "%d", &cfmt.measurenb);
 						lock_fmt(&cfmt.measurenb);
@@ -992,7 +1122,7 @@ int main(int argc, char **argv)
 					case 'O':
 						if (strlen(aaa) >= sizeof outfn) {
 							error(1, NULL, "'-O' too large - aborting");
-							exit(EXIT_FAILURE);
+							fatal_exit(EXIT_FAILURE);
 						}
 						strcpy(outfn, aaa);
 						break;
@@ -1021,6 +1151,10 @@ int main(int argc, char **argv)
 			continue;
 		}
 
+		if (serve_path) {
+			error(1, NULL, "No ABC file with '--serve': %s", p);
+			return EXIT_FAILURE;
+		}
 		if (in_fname) {
 			treat_abc_file(in_fname);
 			frontend((unsigned char *) "select\n", FE_ABC,
@@ -1029,8 +1163,13 @@ int main(int argc, char **argv)
 		in_fname = p;
 	}
 
+	if (serve_path && !serve_req) {
+		read_def_format();
+		return serve(serve_path, s_argc, s_argv);
+	}
 	if (in_fname)
 		treat_abc_file(in_fname);
+	job_stop();
 	if (multicol_start != 0) {		/* lack of %%multicol end */
 		error(1, NULL, "Lack of %%%%multicol end");
 		multicol_start = 0;
@@ -1044,6 +1183,8 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 	close_output_file();
+	svg_sprite_write();
+	stats_write();
 	return severity == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -1056,10 +1197,29 @@ void clrarena(int level)
 		str_r[level] = a_p = malloc(sizeof *str_r[0] + AREANASZ - 2);
 		a_p->sz = AREANASZ;
 		a_p->n = 0;
+		mem_tb[level].sys += AREANASZ;
+		PROBE2(arena__alloc, level, AREANASZ);
 	}
 	str_c[level] = a_p;
 	a_p->p = a_p->str;
 	a_p->r = sizeof a_p->str;
+	mem_tb[level].used = 0;
+}
+
+/* -- free all the arenas -- */
+void freearena(void)
+{
+	struct str_a *a_p, *a_n;
+	int level;
+
+	for (level = 0; level < MAXAREAL; level++) {
+		for (a_p = str_r[level]; a_p; a_p = a_n) {
+			a_n = a_p->n;
+			free(a_p);
+		}
+		str_r[level] = str_c[level] = NULL;
+		memset(&mem_tb[level], 0, sizeof mem_tb[0]);
+	}
 }
 
 int lvlarena(int level)
@@ -1077,15 +1237,33 @@ void *getarena(int len)
 {
 	char *p;
 	struct str_a *a_p;
+	struct mem_st *m;
 
 	a_p = str_c[str_level];
 	len = (len + 7) & ~7;		/* align at 64 bits boundary */
+
+	/* account the usage (--stats) */
+	m = &mem_tb[str_level];
+	m->used += len;
+	if (m->used > m->tmax) {
+		m->tmax = m->used;
+		if (m->tmax > m->max)
+			m->max = m->tmax;
+	}
+	if (len > m->tbig) {
+		m->tbig = len;
+		if (len > m->big)
+			m->big = len;
+	}
+	if (len > MAXAREANASZ / 2)		/* near the abort */
+		m->near++;
+
 	if (len > a_p->r) {
 		if (len > MAXAREANASZ) {
 			error(1, NULL,
 				"getarena - data too wide %d - aborting",
 				len);
-			exit(EXIT_FAILURE);
+			fatal_exit(EXIT_FAILURE);
 		}
 		if (len > AREANASZ) {			/* big allocation */
 			struct str_a *a_n;
@@ -1094,10 +1272,14 @@ void *getarena(int len)
 			a_p->n = malloc(sizeof *str_r[0] + len - 2);
 			a_p->n->n = a_n;
 			a_p->n->sz = len;
+			m->sys += len;
+			PROBE2(arena__alloc, str_level, len);
 		} else if (a_p->n == 0) {		/* standard allocation */
 			a_p->n = malloc(sizeof *str_r[0] + AREANASZ - 2);
 			a_p->n->n = 0;
 			a_p->n->sz = AREANASZ;
+			m->sys += AREANASZ;
+			PROBE2(arena__alloc, str_level, AREANASZ);
 		}
 		str_c[str_level] = a_p = a_p->n;
 		a_p->p = a_p->str;
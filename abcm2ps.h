@@ -1,10 +1,41 @@
 /* -- general macros -- */
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <time.h>
 
 #include "config.h"
 
+/* storage class of the variables which hold the rendering state
+ * (each thread has its own copy, so that many tunes may be
+ *  rendered at the same time in a same process)
+ * without thread-local storage, the state is shared, so no thread
+ * is started: '-J' is ignored and the library does not render */
+#if defined(_MSC_VER)
+#define TLS __declspec(thread)
+#elif defined(__GNUC__)
+#define TLS __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L \
+	&& !defined(__STDC_NO_THREADS__)
+#define TLS _Thread_local
+#else
+#define TLS
+#undef HAVE_PTHREAD
+#endif
+
+/* static probes (USDT) for the tracers (bpftrace, perf, systemtap..)
+ * they are just a 'nop' instruction when no tracer is attached */
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+#define PROBE1(n, a) DTRACE_PROBE1(abcm2ps, n, a)
+#define PROBE2(n, a, b) DTRACE_PROBE2(abcm2ps, n, a, b)
+#define PROBE4(n, a, b, c, d) DTRACE_PROBE4(abcm2ps, n, a, b, c, d)
+#else
+#define PROBE1(n, a)
+#define PROBE2(n, a, b)
+#define PROBE4(n, a, b, c, d)
+#endif
+
 #define MAXVOICE 32	/* max number of voices */
 
 #define MAXHD	8	/* max heads in a chord */
@@ -49,6 +80,7 @@ enum accidentals {
 #define strncasecmp _strnicmp
 #define strdup _strdup
 #define snprintf _snprintf
+#define localtime_r(t, tm) (localtime_s(tm, t) ? NULL : (tm))
 #ifdef _MSC_VER
 #define fileno _fileno
 #endif
@@ -156,7 +188,7 @@ struct map {		/* voice mapping */
 	char *name;
 	struct note_map *notes;	/* mapping of the notes */
 };
-extern struct map *maps; /* note mappings */
+extern TLS struct map *maps; /* note mappings */
 
 struct note {		/* note head */
 	short len;		/* note duration (# pts in [1] if space) */
@@ -183,16 +215,16 @@ struct notes {		/* note chord or rest */
 	struct decos dc;	/* decorations */
 };
 
-extern int severity;
+extern TLS int severity;
 
-extern char *deco[256];
+extern TLS char *deco[256];
 
 struct FONTSPEC {
 	int fnum;		/* index to font tables in format.c */
 	float size;
 	float swfac;
 };
-extern char *fontnames[MAXFONTS];	/* list of font names */
+extern TLS char *fontnames[MAXFONTS];	/* list of font names */
 
 /* lyrics */
 #define LY_HYPH	0x10	/* replacement character for hyphen */
@@ -481,14 +513,15 @@ struct SYMBOL { 		/* struct for a drawable symbol */
 #define B_DASH 0x04		/* :	dashed bar */
 
 /* parse definition */
-struct {
+struct parse_s {
 	struct SYMBOL *first_sym; /* first symbol */
 	struct SYMBOL *last_sym; /* last symbol */
 	int abc_vers;		/* ABC version = (H << 16) + (M << 8) + L */
 	char *deco_tb[DC_NAME_SZ]; /* decoration names */
 	unsigned short micro_tb[MAXMICRO]; /* microtone values [ (n-1) | (d-1) ] */
 	int abc_state;		/* parser state */
-} parse;
+};
+extern TLS struct parse_s parse;
 
 #define	FONT_UMAX 10		/* max number of user fonts 0..9 */
 enum e_fonts {
@@ -549,42 +582,43 @@ struct FORMAT { 		/* struct for page layout */
 	struct posit_s posit;
 };
 
-extern struct FORMAT cfmt;	/* current format */
-extern struct FORMAT dfmt;	/* global format */
+extern TLS struct FORMAT cfmt;	/* current format */
+extern TLS struct FORMAT dfmt;	/* global format */
 
 typedef struct SYMBOL *INFO[26]; /* information fields ('A' .. 'Z') */
-extern INFO info;
-
-extern char *outbuf;		/* output buffer.. should hold one tune */
-extern char *mbf;		/* where to PUTx() */
-extern int use_buffer;		/* 1 if lines are being accumulated */
-
-extern int outft;		/* last font in the output file */
-extern int tunenum;		/* number of current tune */
-extern int pagenum;		/* current page number */
-extern int nbar;		/* current measure number */
-extern int in_page;
-extern int defl;		/* decoration flags */
+extern TLS INFO info;
+
+extern TLS char *outbuf;		/* output buffer */
+extern TLS char *mbf;		/* where to PUTx() */
+extern TLS int use_buffer;		/* 1 if lines are being accumulated */
+extern TLS int out_side;		/* output in the side buffer */
+
+extern TLS int outft;		/* last font in the output file */
+extern TLS int tunenum;		/* number of current tune */
+extern TLS int pagenum;		/* current page number */
+extern TLS int nbar;		/* current measure number */
+extern TLS int in_page;
+extern TLS int defl;		/* decoration flags */
 #define DEF_NOST 0x01		/* long deco with no start */
 #define DEF_NOEN 0x02		/* long deco with no end */
 #define DEF_STEMUP 0x04		/* stem up (1) or down (0) */
 
 		/* switches modified by flags: */
-extern int quiet;		/* quiet mode */
-extern int secure;		/* secure mode */
-extern int annotate;		/* output source references */
-extern int pagenumbers; 	/* write page numbers */
-extern int epsf;		/* 1: EPSF, 2: SVG, 3: embedded ABC */
-extern int svg;			/* 1: SVG, 2: XHTML */
-extern int showerror;		/* show the errors */
-extern int pipeformat;		/* format for bagpipes */
-
-extern char outfn[FILENAME_MAX]; /* output file name */
-extern char *in_fname;		/* current input file name */
-extern time_t mtime;		/* last modification time of the input file */
-
-extern int file_initialized;	/* for output file */
-extern FILE *fout;		/* output file */
+extern TLS int quiet;		/* quiet mode */
+extern TLS int secure;		/* secure mode */
+extern TLS int annotate;		/* output source references */
+extern TLS int pagenumbers; 	/* write page numbers */
+extern TLS int epsf;		/* 1: EPSF, 2: SVG, 3: embedded ABC */
+extern TLS int svg;			/* 1: SVG, 2: XHTML */
+extern TLS int showerror;		/* show the errors */
+extern TLS int pipeformat;		/* format for bagpipes */
+
+extern TLS char outfn[FILENAME_MAX]; /* output file name */
+extern TLS char *in_fname;		/* current input file name */
+extern TLS time_t mtime;		/* last modification time of the input file */
+
+extern TLS int file_initialized;	/* for output file */
+extern TLS FILE *fout;		/* output file */
 
 #define MAXTBLT 8
 struct tblt_s {
@@ -597,7 +631,7 @@ struct tblt_s {
 	short pitch;		/* pitch when no associated 'w:' / 0 */
 	char instr[2];		/* instrument pitch */
 };
-extern struct tblt_s *tblts[MAXTBLT];
+extern TLS struct tblt_s *tblts[MAXTBLT];
 
 #define MAXCMDTBLT	4	/* max number of -T in command line */
 struct cmdtblt_s {
@@ -605,11 +639,11 @@ struct cmdtblt_s {
 	short active;		/* activate or not */
 	char *vn;		/* voice name */
 };
-extern struct cmdtblt_s cmdtblts[MAXCMDTBLT];
-extern int ncmdtblt;
+extern TLS struct cmdtblt_s cmdtblts[MAXCMDTBLT];
+extern TLS int ncmdtblt;
 
-extern int s_argc;		/* command line arguments */
-extern char **s_argv;
+extern TLS int s_argc;		/* command line arguments */
+extern TLS char **s_argv;
 
 struct STAFF_S {
 	struct SYMBOL *s_clef;	/* clef at start of music line */
@@ -620,8 +654,8 @@ struct STAFF_S {
 	float y;		/* y position */
 	float top[YSTEP], bot[YSTEP];	/* top/bottom y offsets */
 };
-extern struct STAFF_S staff_tb[MAXSTAFF];
-extern int nstaff;		/* (0..MAXSTAFF-1) */
+extern TLS struct STAFF_S staff_tb[MAXSTAFF];
+extern TLS int nstaff;		/* (0..MAXSTAFF-1) */
 
 struct VOICE_S {
 	char id[VOICE_ID_SZ];	/* voice id */
@@ -676,16 +710,16 @@ struct VOICE_S {
 	unsigned char microscale;	/* microtone scale */
 	unsigned char mvoice;		/* main voice when voice overlay */
 };
-extern struct VOICE_S voice_tb[MAXVOICE]; /* voice table */
-extern struct VOICE_S *first_voice; /* first_voice */
+extern TLS struct VOICE_S voice_tb[MAXVOICE]; /* voice table */
+extern TLS struct VOICE_S *first_voice; /* first_voice */
 
-extern struct SYMBOL *tsfirst;	/* first symbol in the time linked list */
-extern struct SYMBOL *tsnext;	/* next line when cut */
-extern float realwidth;		/* real staff width while generating */
+extern TLS struct SYMBOL *tsfirst;	/* first symbol in the time linked list */
+extern TLS struct SYMBOL *tsnext;	/* next line when cut */
+extern TLS float realwidth;		/* real staff width while generating */
 
 #define NFLAGS_SZ 10		/* size of note flags tables */
 #define C_XFLAGS 5		/* index of crotchet in flags tables */
-extern float space_tb[NFLAGS_SZ]; /* note spacing */
+extern TLS float space_tb[NFLAGS_SZ]; /* note spacing */
 extern float hw_tb[];		// width of note heads
 
 struct SYSTEM {			/* staff system */
@@ -722,12 +756,14 @@ struct SYSTEM {			/* staff system */
 //		struct clef_s clef;
 	} voice[MAXVOICE];
 };
-struct SYSTEM *cursys;		/* current staff system */
+extern TLS struct SYSTEM *cursys; /* current staff system */
 
 /* -- external routines -- */
 /* abcm2ps.c */
+int abcm2ps_main(int argc, char **argv);
 void include_file(unsigned char *fn);
 void clrarena(int level);
+void freearena(void);
 int lvlarena(int level);
 void *getarena(int len);
 void strext(char *fid, char *ext);
@@ -747,18 +783,28 @@ void a2b(char *fmt, ...)
 	__attribute__ ((format (printf, 1, 2)))
 #endif
 	;
+void a2b_txt(char *p, int l);
+int vfmt(char *buf, int size, const char *fmt, va_list args);
+int fmt_fprintf(FILE *f, const char *fmt, ...)
+#ifdef __GNUC__
+	__attribute__ ((format (printf, 2, 3)))
+#endif
+	;
 void block_put(void);
 void buffer_eob(int eot);
 void marg_init(void);
 void bskip(float h);
-void check_buffer(void);
 void init_outbuf(int kbsz);
+void free_outbuf(void);
+void outbuf_reset(void);
+char *outbuf_side(int on);
+void outbuf_side_put(void);
 void close_output_file(void);
 void close_page(void);
 float get_bposy(void);
 void open_fout(void);
 void write_buffer(void);
-int (*output)(FILE *out, const char *fmt, ...)
+extern TLS int (*output)(FILE *out, const char *fmt, ...)
 #ifdef __GNUC__
 	__attribute__ ((format (printf, 2, 3)))
 #endif
@@ -798,6 +844,8 @@ void draw_all_symb(void);
 float draw_systems(float indent);
 void output_ps(struct SYMBOL *s, int color);
 struct SYMBOL *prev_scut(struct SYMBOL *s);
+void get_draw_state(float *st);
+void set_draw_state(float *st);
 void putf(float f);
 void putx(float x);
 void puty(float y);
@@ -810,8 +858,10 @@ void set_v_color(int v);
 void define_fonts(void);
 int get_textopt(char *p);
 int get_font_encoding(int ft);
+int font_state(char **lock, int *nlock);
 int get_bool(char *p);
 void interpret_fmt_line(char *w, char *p, int lock);
+int is_fmt_param(char *w);
 void lock_fmt(void *fmt);
 void make_font_list(void);
 FILE *open_file(char *fn,
@@ -830,15 +880,68 @@ void frontend(unsigned char *s,
 		int ftype,
 		char *fname,
 		int linenum);
+void frontend_stream(FILE *f, char *fname);
+void frontend_free(void);
+int sel_xnum(int xnum);
 /* glyph.c */
 char *glyph_out(char *p);
 void glyph_add(char *p);
+/* index.c */
+extern TLS int idx_write;
+void idx_open(char *fn, char *file, long size,
+		time_t mtime, long mtime_ns);
+void idx_close(void);
+unsigned char *idx_tune_end(unsigned char *s, int *linenum);
+/* jobs.c */
+extern TLS int jobs;		/* number of rendering threads */
+extern TLS int job_mode;	/* 0: main thread */
+#define JOB_WORKER 1		/* worker thread */
+#define JOB_CAPT 2		/* worker thread capturing a tune */
+#define EV_BSKIP 0		/* events of the captured tunes */
+#define EV_FONT 1
+#define EV_DEFL 2
+#define EV_BLOCK 3		/* (page functions from EV_BLOCK to EV_EPS) */
+#define EV_EOB 4
+#define EV_WRITE 5
+#define EV_CLOSE 6
+#define EV_EPS 7
+#define EV_MSG 8
+#define EV_STRFT 9		/* font change in a string */
+#define OUTFT_UNSURE(ft) (-2 - (ft))	/* output font 'ft' or none */
+#define OUTFT_UNKNOWN OUTFT_UNSURE(MAXFONTS)
+void job_args(int argc, char **argv);
+int job_capt(void);
+FILE *job_err(void);
+void job_event(int type, int arg, float v);
+void job_file_end(void);
+void job_font(int ft, int type);
+void job_invalid(void);
+void job_msg(int sev, char *msg);
+int job_quiet(void);
+int job_redo(void);
+void job_side(int base);
+void job_skeleton(void);
+int job_skip(unsigned char *s, int l, char *prefix);
+void job_stop(void);
+int job_tune(void);
+int job_tune_start(struct SYMBOL *s);
+void job_tune_end(void);
+struct tstats;
+void job_stats(struct tstats *t);
+/* lib.c */
+extern TLS FILE *lib_out;	/* output of the library (instead of stdout) */
+extern TLS FILE *lib_err;	/* messages of the library (instead of stderr) */
+extern TLS const char *lib_abc;	/* ABC text of the library */
+extern TLS int lib_abclen;
+FILE *err_out(void);
+void fatal_exit(int status);
+int args_check(char **args);
 /* music.c */
 void output_music(void);
 void reset_gen(void);
 void unlksym(struct SYMBOL *s);
 /* parse.c */
-extern float multicol_start;
+extern TLS float multicol_start;
 void do_tune(void);
 void identify_note(struct SYMBOL *s,
 		int len,
@@ -848,6 +951,89 @@ void identify_note(struct SYMBOL *s,
 void sort_pitch(struct SYMBOL *s);
 struct SYMBOL *sym_add(struct VOICE_S *p_voice,
 			int type);
+/* cairo.c */
+#ifdef HAVE_PANGO
+void pg_cairo_page(FILE *f, char *s, int len, float w, float h);
+void pg_cairo_close(void);
+#endif
+/* pdf.c */
+enum {					/* drawing operations of cairo */
+	CR_SAVE, CR_RESTORE, CR_MATRIX,
+	CR_MOVE, CR_LINE, CR_CURVE, CR_RECT, CR_CLOSE,
+	CR_FILL, CR_EOFILL, CR_STROKE, CR_FILLSTROKE, CR_EOFILLSTROKE,
+	CR_FILLRGB, CR_STROKERGB, CR_LW, CR_DASH, CR_CAP,
+	CR_BT, CR_FONT, CR_SPACE, CR_TEXT, CR_ET,
+	CR_FORM,
+	CR_N
+};
+extern TLS int cairo_out;
+void pdf_new_page(void);
+void pdf_page(float w, float h, char *bg);
+void pdf_g(float lw, float sx, float sy, float tx, float ty, float rot,
+	int rgb, char *font, float fsize);
+void pdf_g_end(void);
+void pdf_defs(char *def);
+void pdf_use(char *id, float x, float y);
+void pdf_path(int op, int n, float *v);
+void pdf_arc(float x1, float y1, float r, int sweep, float x2, float y2);
+void pdf_circle(float x, float y, float r);
+void pdf_paint(int op, float lw, char *dash);
+void pdf_close_page(void);
+void pdf_close(void);
+char *pdf_form(int n, int *len);
+/* serve.c */
+extern int serve_req;		/* treating a request of the daemon */
+extern int serve_nargs;		/* number of arguments of the daemon */
+int serve(char *path, int argc, char **argv);
+void serve_check(void);
+void serve_init(void);
+/* stats.c */
+enum {					/* phases */
+	ST_FRONTEND, ST_ABC_PARSE, ST_DO_TUNE,
+	ST_SORT_ALL, ST_VOICE_COMPRESS, ST_SET_BAR_NUM,
+	ST_OUTPUT_MUSIC, ST_COMBINE_VOICES, ST_SET_BEAMS, ST_SET_STEMS,
+	ST_SET_OVERLAP, ST_SET_ALLSYMWIDTH, ST_CUT_TUNE, ST_SET_SYM_GLUE,
+	ST_DRAW_SYM_NEAR, ST_DRAW_SYSTEMS, ST_DRAW_ALL_SYMB, ST_DRAW_ALL_DECO,
+	ST_SVG_WRITE, ST_WRITE_BUFFER,
+	ST_N
+};
+enum {					/* trace spans */
+	SP_TUNE, SP_LINE, SP_PAGE, SP_FLUSH,
+	SP_N
+};
+#define MAXAREANASZ 0x20000		/* biggest arena allocation (abcm2ps.c) */
+enum {					/* memory pools */
+	MEM_ARENA0, MEM_ARENA1, MEM_ARENA2,	/* arena levels (getarena) */
+	MEM_OUTBUF,			/* output buffer */
+	MEM_TEXT,			/* text of the ABC lines (front.c) */
+	MEM_SVG,			/* PS elements of the SVG output */
+	MEM_N
+};
+struct mem_st {				/* memory usage of a pool */
+	long used;			/* bytes in use */
+	long max, tmax;			/* high-water marks of the run and the tune */
+	long tstart;			/* bytes in use at start of the tune */
+	long sys;			/* bytes got from the system */
+	long big, tbig;			/* biggest requests of the run and the tune */
+	long near;			/* number of requests near the limit */
+};
+extern TLS struct mem_st mem_tb[MEM_N];
+extern TLS char *stats_file;
+extern TLS char *trace_file;
+void stats_init(void);
+void stats_begin(int ph);
+void stats_end(int ph);
+void stats_count(int ph);
+void stats_mem(int m, long used, long sys);
+void stats_symbols(void);
+void trace_begin(int sp, int arg);
+void trace_end(int sp);
+void trace_mark(const char *name, int linenum);
+void stats_tune_start(char *p, int linenum);
+void stats_tune_end(void);
+void stats_tune_add(struct tstats *t);
+void stats_merge(void);
+void stats_write(void);
 /* subs.c */
 void bug(char *msg, int fatal);
 void error(int sev, struct SYMBOL *s, char *fmt, ...);
@@ -872,16 +1058,29 @@ void str_font(int ft);
 void str_out(char *p, int action);
 void put_str(char *str, int action);
 float tex_str(char *s);
-extern char tex_buf[];	/* result of tex_str() */
+void free_tex_cache(void);
+extern TLS char tex_buf[];	/* result of tex_str() */
 #define TEX_BUF_SZ 512
 char *trim_title(char *p, struct SYMBOL *title);
 void user_ps_add(char *s, char use);
 void user_ps_write(void);
+void user_ps_used(void);
 void write_title(struct SYMBOL *s);
 void write_heading(void);
 void write_user_ps(void);
 void write_text(char *cmd, char *s, int job);
 /* svg.c */
+#define NV_MARK '\002'			/* native SVG record (see draw.c) */
+enum nv_op {				/* native SVG operations */
+	NV_hd, NV_Hd, NV_HD, NV_HDD, NV_ghd,	/* x y: note heads */
+	NV_hl, NV_hl1, NV_hl2, NV_ghl,		/* x y: ledger lines */
+	NV_su, NV_sd, NV_gu, NV_gd,		/* h: stems */
+	NV_dt,					/* dx dy: dot */
+	NV_bar,					/* h x y: bar */
+	NV_bm,					/* h dx dy x y: beam */
+	NV_N
+};
+#define NV_MAXVAL 5			/* max number of values of a record */
 void define_svg_symbols(char *title, int num, float w, float h);
 void svg_def_id(char *id, int idsz);
 int svg_output(FILE *out, const char *fmt, ...)
@@ -891,6 +1090,11 @@ int svg_output(FILE *out, const char *fmt, ...)
 	;
 void svg_write(char *buf, int len);
 void svg_close();
+void svg_sprite_write(void);
+extern TLS char *svg_sprite;
 /* syms.c */
 void define_font(char *name, int num, int enc);
 void define_symbols(void);
+void ps_used_init(void);
+void ps_used(char *p, int len);
+void free_symbols(void);
@@ -19,33 +19,34 @@
 #include "abcm2ps.h"
 
 /* global values */
-int severity;			/* error severity */
-
-static short ulen;		/* unit note length set by M: or L: */
-static short meter;		/* upper value of time sig for n-plets */
-static unsigned char microscale; /* current microtone scale */
-static signed char vover;	/* voice overlay (1: single bar, -1: multi-bar */
-static char lyric_started;	/* lyric started */
-static char *gchord;		/* guitar chord */
-static struct decos dc;		/* decorations */
-static struct SYMBOL *deco_start; /* 1st note of the line for d: / s: */
-static struct SYMBOL *deco_cont; /* current symbol when d: / s: continuation */
-
-static int g_abc_vers, g_ulen, g_microscale;
-static char g_char_tb[128];
-static char *g_deco_tb[128];		/* global decoration names */
-static unsigned short g_micro_tb[MAXMICRO]; /* global microtone values */
+TLS struct parse_s parse;		/* parse definition */
+TLS int severity;			/* error severity */
+
+static TLS short ulen;		/* unit note length set by M: or L: */
+static TLS short meter;		/* upper value of time sig for n-plets */
+static TLS unsigned char microscale; /* current microtone scale */
+static TLS signed char vover;	/* voice overlay (1: single bar, -1: multi-bar */
+static TLS char lyric_started;	/* lyric started */
+static TLS char *gchord;		/* guitar chord */
+static TLS struct decos dc;		/* decorations */
+static TLS struct SYMBOL *deco_start; /* 1st note of the line for d: / s: */
+static TLS struct SYMBOL *deco_cont; /* current symbol when d: / s: continuation */
+
+static TLS int g_abc_vers, g_ulen, g_microscale;
+static TLS char g_char_tb[128];
+static TLS char *g_deco_tb[128];		/* global decoration names */
+static TLS unsigned short g_micro_tb[MAXMICRO]; /* global microtone values */
 
 #define VOICE_NAME_SZ 64	/* max size of a voice name */
 
-static char *abc_fn;		/* current source file name */
-static int linenum;		/* current source line number */
-static int colnum;		/* current source column number */
-static char *abc_line;		/* line being parsed */
-static struct SYMBOL *last_sym;	/* last symbol for errors */
+static TLS char *abc_fn;		/* current source file name */
+static TLS int linenum;		/* current source line number */
+static TLS int colnum;		/* current source column number */
+static TLS char *abc_line;		/* line being parsed */
+static TLS struct SYMBOL *last_sym;	/* last symbol for errors */
 
-static short nvoice;		/* number of voices (0..n-1) */
-static struct VOICE_S *curvoice;
+static TLS short nvoice;		/* number of voices (0..n-1) */
+static TLS struct VOICE_S *curvoice;
 
 /* char table for note line parsing */
 #define CHAR_BAD 0
@@ -67,7 +68,7 @@ static struct VOICE_S *curvoice;
 #define CHAR_SLASH 16
 #define CHAR_GR_EN 17
 #define CHAR_LINEBREAK 18
-static char char_tb[256] = {
+static TLS char char_tb[256] = {
 	0, 0, 0, 0, 0, 0, 0, 0,				/* 00 - 07 */
 	0, CHAR_SPAC, CHAR_LINEBREAK, 0, 0, 0, 0, 0,	/* 08 - 0f */
 	0, 0, 0, 0, 0, 0, 0, 0,				/* 10 - 17 */
@@ -121,10 +122,12 @@ static void vover_new(void);
 /* -- abcMIDI like errors -- */
 static void print_error(char *s, int col)
 {
+	if (job_quiet())
+		return;
 	if (col >= 0)
-		fprintf(stderr, "%s:%d:%d: error: %s\n", abc_fn, linenum, col, s);
+		fprintf(err_out(), "%s:%d:%d: error: %s\n", abc_fn, linenum, col, s);
 	else
-		fprintf(stderr, "%s:%d: error: %s\n", abc_fn, linenum, s);
+		fprintf(err_out(), "%s:%d: error: %s\n", abc_fn, linenum, s);
 }
 
 /* -- new symbol -- */
@@ -165,6 +168,7 @@ void abc_parse(char *p, char *fname, int ln)
 	/* parse the music line */
 	switch (parse_line(p)) {
 	case 2:				/* start of tune (X:) */
+		stats_tune_start(p, ln);
 		g_abc_vers = parse.abc_vers;
 		g_ulen = ulen;
 		g_microscale = microscale;
@@ -176,7 +180,9 @@ void abc_parse(char *p, char *fname, int ln)
 		break;
 	case 1:				/* end of tune */
 		if (parse.first_sym) {
+			stats_begin(ST_DO_TUNE);
 			do_tune();
+			stats_end(ST_DO_TUNE);
 			parse.first_sym = parse.last_sym = NULL;
 		}
 		parse.abc_state = ABC_S_GLOBAL;
@@ -199,13 +205,19 @@ void abc_eof(void)
 {
 //	if (parse.abc_state == ABC_S_HEAD)
 //		severity = 1;
+	stats_begin(ST_DO_TUNE);
 	do_tune();
+	stats_end(ST_DO_TUNE);
 	parse.first_sym = parse.last_sym = NULL;
 	if (parse.abc_state != ABC_S_GLOBAL) {
+		parse.abc_state = ABC_S_GLOBAL;
 		parse.abc_vers = g_abc_vers;
 		ulen = g_ulen;
 		microscale = g_microscale;
 		memcpy(char_tb, g_char_tb, sizeof g_char_tb);
+		memcpy(parse.deco_tb, g_deco_tb, sizeof parse.deco_tb);
+		memcpy(parse.micro_tb, g_micro_tb, sizeof parse.micro_tb);
+		lvlarena(0);
 	}
 }
 
@@ -2584,10 +2596,15 @@ static void syntax(char *msg,
 	len = strlen(abc_line);
 	if ((unsigned) n > (unsigned) len)
 		n = -1;
+	if (job_quiet()) {
+		if (n >= 0 && last_sym)
+			last_sym->flags |= ABC_F_ERROR;
+		return;
+	}
 	print_error(msg, n);
 	if (n < 0) {
 		if (q && *q != '\0')
-			fprintf(stderr, " (near '%s')\n", q);
+			fprintf(err_out(), " (near '%s')\n", q);
 		return;
 	}
 	m1 = 0;
@@ -2603,19 +2620,19 @@ static void syntax(char *msg,
 		}
 	}
 
-	fprintf(stderr, "%4d ", linenum);
+	fprintf(err_out(), "%4d ", linenum);
 	pp = 6;
 	if (m1 > 0) {
-		fprintf(stderr, "...");
+		fprintf(err_out(), "...");
 		pp += 3;
 	}
-	fprintf(stderr, "%.*s", m2 - m1, &abc_line[m1]);
+	fprintf(err_out(), "%.*s", m2 - m1, &abc_line[m1]);
 	if (m2 < len)
-		fprintf(stderr, "...");
-	fprintf(stderr, "\n");
+		fprintf(err_out(), "...");
+	fprintf(err_out(), "\n");
 
 	if ((unsigned) n < 200)
-		fprintf(stderr, "%*s\n", n + pp - m1, "^");
+		fprintf(err_out(), "%*s\n", n + pp - m1, "^");
 
 	if (last_sym)
 		last_sym->flags |= ABC_F_ERROR;
@@ -0,0 +1,250 @@
+#!/bin/sh
+# Create the corpus of the benchmark.
+#
+# usage: mkcorpus.sh <source directory> <corpus directory>
+#
+# The tunes are built by a pseudo-random generator with a fixed seed,
+# so that the corpus is always the same:
+#	folk.abc	single voice folk tunes (reels, jigs, waltzes)
+#	scores.abc	dense scores of 6 voices on 6 staves (%%staves)
+#	songs.abc	songs with 2 lines of lyrics per music line
+#	deco.abc	tunes with many decorations, slurs and grace notes
+#	tab.abc		tablatures (accordion.abc and sample4.abc)
+#	text.abc	pages of text with non latin characters (pango)
+
+src=${1:-.}
+dir=${2:-bench/corpus}
+
+mkdir -p $dir || exit 1
+
+gen() {
+	awk -v kind=$1 -v ntunes=$2 '
+# Park-Miller generator (exact with the double precision of awk)
+function rnd(n) {
+	seed = (seed * 16807) % 2147483647
+	return seed % n
+}
+function pick(s,	a, n) {
+	n = split(s, a, " ")
+	return a[rnd(n) + 1]
+}
+function pickl(s,	a, n) {
+	n = split(s, a, "|")
+	return a[rnd(n) + 1]
+}
+
+# one bar of notes of total length "len" (in units of L:)
+function bar(notes, len,	s, l, d, n) {
+	n = split(notes, tb, " ")
+	s = ""
+	l = 0
+	while (l < len) {
+		d = 1
+		if (len - l >= 2 && rnd(5) == 0)
+			d = 2
+		s = s tb[rnd(n) + 1] (d == 1 ? "" : d)
+		l += d
+	}
+	return s
+}
+
+# one bar of chords of the right hand
+function chords(len,	s, l) {
+	s = ""
+	for (l = 0; l < len; l += 2)
+		s = s "[" pick("C E G c") pick("e g") "]2"
+	return s
+}
+
+function folk(x,	m, len, i, p) {
+	m = pick("reel jig waltz")
+	print "X:" x
+	print "T:" pickl("The Silver Spear|Farewell to Erin|The Banks of Lough Gowna|Morrison|The Mountain Road|Kesh|Drowsy Maggie|Merry Blacksmith")
+	print "T:" m " number " x
+	print "R:" m
+	if (m == "reel") {
+		print "M:C|"
+		len = 8
+	} else if (m == "jig") {
+		print "M:6/8"
+		len = 6
+	} else {
+		print "M:3/4"
+		len = 6
+	}
+	print "L:1/8"
+	print "K:" pick("G D A Em Dmix Ador Bm C")
+	for (p = 0; p < 2; p++) {
+		for (i = 0; i < 8; i++) {
+			printf "%s\"%s\"%s", (i == 0 ? "|:" : ""),
+				pick("G D Em C Am Bm"),
+				bar("D E F G A B c d e f g a", len)
+			if (i == 6)
+				printf "|1 "
+			else if (i == 7)
+				printf ":|2 %s|]\n", bar("G A B c d", len)
+			else if (i % 4 == 3)
+				printf "|\n"
+			else
+				printf "|"
+		}
+	}
+	print ""
+}
+
+function score(x,	i, l, b, v, nv) {
+	print "X:" x
+	print "T:Score number " x
+	print "C:" pickl("Anonymous|Traditional|After an old choral")
+	print "M:4/4"
+	print "L:1/8"
+	print "Q:1/4=" (60 + rnd(60))
+	print "%%staves [(S A) (T B)] {RH LH}"
+	print "V:S clef=treble name=\"Soprano\" sname=\"S\""
+	print "V:A clef=treble name=\"Alto\" sname=\"A\""
+	print "V:T clef=treble-8 name=\"Tenor\" sname=\"T\""
+	print "V:B clef=bass name=\"Bass\" sname=\"B\""
+	print "V:RH clef=treble name=\"Piano\""
+	print "V:LH clef=bass"
+	print "K:" pick("C G F D Bb Am Dm")
+	nv = split("S A T B RH LH", v, " ")
+	for (l = 0; l < 8; l++) {
+		for (i = 1; i <= nv; i++) {
+			printf "[V:%s] ", v[i]
+			for (b = 0; b < 4; b++) {
+				if (v[i] == "S")
+					printf "%s|", bar("c d e f g a", 8)
+				else if (v[i] == "A")
+					printf "%s|", bar("G A B c d e", 8)
+				else if (v[i] == "T")
+					printf "%s|", bar("C D E F G A", 8)
+				else if (v[i] == "B")
+					printf "%s|", bar("C, D, E, F, G, A,", 8)
+				else if (v[i] == "RH")
+					printf "%s|", chords(8)
+				else
+					printf "%s|", bar("C,, G,, C, E, G,", 8)
+			}
+			printf "\n"
+		}
+	}
+	print ""
+}
+
+function lyrics(n,	s, i) {
+	s = ""
+	for (i = 0; i < n; i++)
+		s = s (i ? " " : "") pick("la ti- do re mi fa sol- love heart- ache sing the a- way night day a- gain my")
+	return s
+}
+
+function song(x,	l, b) {
+	print "X:" x
+	print "T:Song number " x
+	print "C:" pickl("Traditional|Anonymous")
+	print "M:3/4"
+	print "L:1/4"
+	print "K:" pick("F G D Am")
+	for (l = 0; l < 6; l++) {
+		for (b = 0; b < 4; b++)
+			printf "%s%s%s|", pick("A B c d e f"),
+				pick("A B c d e f"), pick("A B c d e f")
+		printf "\n"
+		print "w:" lyrics(12)
+		print "w:" lyrics(12)
+	}
+	print "W:" lyrics(12)
+	print "W:" lyrics(12)
+	print ""
+}
+
+function deco(x,	l, b, i, s) {
+	print "X:" x
+	print "T:Decorations number " x
+	print "M:2/4"
+	print "L:1/16"
+	print "K:" pick("D G A")
+	for (l = 0; l < 8; l++) {
+		for (b = 0; b < 4; b++) {
+			s = ""
+			for (i = 0; i < 4; i++) {
+				if (rnd(3) == 0)
+					s = s "{" pick("g a b") "}"
+				s = s pick("!trill! !fermata! !mordent! !accent! !tenuto! !turn! !upbow! !downbow! . ~ !>! !p! !f! !mf! !segno! !coda! !1! !2! !3! !4! !5! !wedge! !snap! !roll!")
+				if (i == 0)
+					s = s "("
+				s = s pick("d e f g a b c\047") "2"
+				if (i == 3)
+					s = s ")"
+				if (i == 1)
+					s = s " "
+			}
+			if (b == 0)
+				s = "!crescendo(!" s
+			else if (b == 1)
+				s = s "!crescendo)!"
+			printf "%s|", s
+		}
+		printf "\n"
+	}
+	print ""
+}
+
+function text(x,	l, i) {
+	print "X:" x
+	print "T:" pickl("Chanson à boire|Pieśń wieczorna|Ελληνικό τραγούδι|Песня о море|中国民歌|Übermut|Canción del río") " (" x ")"
+	print "M:4/4"
+	print "L:1/8"
+	print "K:C"
+	print bar("C D E F G A B c", 8) "|" bar("C D E F G A B c", 8) "|]"
+	print "%%begintext justify"
+	for (l = 0; l < 12; l++) {
+		for (i = 0; i < 10; i++)
+			printf "%s%s", (i ? " " : "%%"),
+				pick("élève garçon œuvre façade naïve Straße Mädchen łódź źrebię Ελλάδα μουσική музыка песня 音乐 歌曲 the music of the night and the day")
+		printf "\n"
+	}
+	print "%%endtext"
+	for (l = 0; l < 4; l++)
+		print "%%center " pickl("Fin|Konec|Τέλος|Конец|结束|Ende")
+	print ""
+}
+
+BEGIN {
+	seed = 20160825
+	print "%abc-2.1"
+	print "% corpus of the abcm2ps benchmark - created by mkcorpus.sh"
+	print ""
+	if (kind == "text") {
+		print "%%textfont Times-Roman 13"
+		print ""
+	}
+	for (x = 1; x <= ntunes; x++) {
+		if (kind == "folk")
+			folk(x)
+		else if (kind == "scores")
+			score(x)
+		else if (kind == "songs")
+			song(x)
+		else if (kind == "deco")
+			deco(x)
+		else
+			text(x)
+	}
+}' > $dir/$1.abc
+}
+
+gen folk 2000
+gen scores 60
+gen songs 600
+gen deco 300
+gen text 150
+
+# the tablatures are the ones of the sources
+: > $dir/tab.abc
+i=0
+while [ $i -lt 40 ]; do
+	cat $src/accordion.abc $src/sample4.abc >> $dir/tab.abc
+	echo >> $dir/tab.abc
+	i=$((i + 1))
+done
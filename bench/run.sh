@@ -0,0 +1,102 @@
+#!/bin/sh
+# Run the benchmark.
+#
+# usage: run.sh [<abcm2ps binary>]
+#
+# Each file of the corpus is rendered in each output format (PostScript,
+# SVG one file per page '-v', SVG one file per tune '-g', XHTML '-X' and
+# EPS '-E'). The best wall time of BENCH_RUNS runs (default 3) is kept,
+# with the peak memory (RSS) of the process.
+# The results go to bench/results.txt. When the file bench/baseline.txt
+# exists (see 'make bench-baseline'), the results are compared to it:
+# the column 'speedup' is the baseline time divided by the new time.
+# Extra options may be given in BENCH_OPTS (ex: BENCH_OPTS=-J4).
+
+bin=${1:-./abcm2ps}
+runs=${BENCH_RUNS:-3}
+dir=bench
+out=$dir/out
+res=$dir/results.txt
+base=$dir/baseline.txt
+
+if [ ! -x $dir/timeit ]; then
+	echo "$dir/timeit not found - run 'make bench'" >&2
+	exit 1
+fi
+if [ ! -f $dir/corpus/folk.abc ]; then
+	sh $dir/mkcorpus.sh . $dir/corpus || exit 1
+fi
+
+: > $res.tmp
+for c in folk scores songs deco tab text; do
+	f=$dir/corpus/$c.abc
+	ntunes=`grep -c '^X:' $f`
+	for m in ps v g X E; do
+		if [ $m = ps ]; then
+			opt=
+		else
+			opt=-$m
+		fi
+		best=
+		rss=0
+		i=0
+		while [ $i -lt $runs ]; do
+			rm -rf $out
+			mkdir -p $out
+			set -- `$dir/timeit $bin -q $BENCH_OPTS $opt -O $out/ $f`
+			if [ "$3" != 0 ]; then
+				echo "$c $m: exit status $3" >&2
+			fi
+			best=`awk -v a="$best" -v b=$1 \
+				'BEGIN {print (a == "" || b < a) ? b : a}'`
+			[ $2 -gt $rss ] && rss=$2
+			i=$((i + 1))
+		done
+		size=`cat $out/* | wc -c`
+		echo "$c $m $best $ntunes $size $rss" >> $res.tmp
+	done
+done
+rm -rf $out
+
+# display the results
+awk -v base=$base '
+BEGIN {
+	while ((getline l < base) > 0) {
+		split(l, a, " ")
+		if (a[1] ~ /^#/)
+			continue
+		bt[a[1] " " a[2]] = a[3]
+		br[a[1] " " a[2]] = a[6]
+		nb++
+	}
+	printf "%-7s %-4s %9s %10s %8s %9s", "corpus", "mode",
+		"time (s)", "tunes/s", "MB/s", "RSS (KiB)"
+	if (nb > 0)
+		printf " %8s %8s", "speedup", "RSS"
+	printf "\n"
+}
+{
+	k = $1 " " $2
+	t = $3 > 0 ? $3 : 1e-4
+	printf "%-7s %-4s %9.3f %10.1f %8.2f %9d", $1, $2, $3,
+		$4 / t, $5 / t / 1048576, $6
+	if (k in bt) {
+		printf " %8.3f %8.3f", bt[k] / t, $6 / br[k]
+		st += bt[k]
+		sn += $3
+	}
+	printf "\n"
+	tt += $3
+}
+END {
+	printf "total %15.3f", tt
+	if (sn > 0)
+		printf "   speedup %.3f", st / sn
+	printf "\n"
+}' $res.tmp
+
+{
+	echo "# corpus mode time tunes bytes rss - `$bin -V 2>&1 | head -1`"
+	cat $res.tmp
+} > $res
+rm -f $res.tmp
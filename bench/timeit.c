@@ -0,0 +1,81 @@
+/*
+ * Run a command and display its wall time and its peak memory usage.
+ *
+ * This file is part of abcm2ps.
+ *
+ * Copyright (C) 2016 Jean-François Moine
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * usage: timeit <command> [<argument>..]
+ * The standard output and the standard error of the command are
+ * discarded. The output is the line:
+ *	<wall time in seconds> <peak RSS in KiB> <exit status>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/* -- get the wall time -- */
+static double wall_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+	struct rusage ru;
+	double t0, t1;
+	pid_t pid;
+	long rss;
+	int fd, status;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: timeit <command> [<argument>..]\n");
+		return EXIT_FAILURE;
+	}
+	t0 = wall_time();
+	pid = fork();
+	if (pid < 0) {
+		perror("timeit: fork");
+		return EXIT_FAILURE;
+	}
+	if (pid == 0) {
+		fd = open("/dev/null", O_WRONLY);
+		if (fd >= 0) {
+			dup2(fd, 1);
+			dup2(fd, 2);
+			close(fd);
+		}
+		execvp(argv[1], &argv[1]);
+		_exit(127);
+	}
+	if (wait4(pid, &status, 0, &ru) < 0) {
+		perror("timeit: wait4");
+		return EXIT_FAILURE;
+	}
+	t1 = wall_time();
+	rss = ru.ru_maxrss;
+#ifdef __APPLE__
+	rss /= 1024;				/* (in bytes) */
+#endif
+	printf("%.4f %ld %d\n", t1 - t0, rss,
+		WIFEXITED(status) ? WEXITSTATUS(status) : 128);
+	return EXIT_SUCCESS;
+}
@@ -19,33 +19,70 @@
 
 #include "abcm2ps.h" 
 
+#ifdef HAVE_WRITEV
+#include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+#define WRITEV_MIN 16384	/* min size of the buffered lines for writev() */
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#endif
+
 #define PPI_96_72 0.75		// convert page format to 72 PPI
-#define BUFFLN	80		/* max number of lines in output buffer */
-
-static int ln_num;		/* number of lines in buffer */
-static float ln_pos[BUFFLN];	/* vertical positions of buffered lines */
-static char *ln_buf[BUFFLN];	/* buffer location of buffered lines */
-static float ln_lmarg[BUFFLN];	/* left margin of buffered lines */
-static float ln_scale[BUFFLN];	/* scale of buffered lines */
-static signed char ln_font[BUFFLN];	/* font of buffered lines */
-static float cur_lmarg = 0;	/* current left margin */
-static float min_lmarg, max_rmarg;	/* margins for -E/-g */
-static float cur_scale = 1.0;	/* current scale */
-static float maxy;		/* usable vertical space in page */
-static float remy;		/* remaining vertical space in page */
-static float bposy;		/* current position in buffered data */
-static int nepsf;		/* counter for -E/-g output files */
-static int nbpages;		/* number of pages in the output file */
-static int outbufsz;		/* size of outbuf */
-static char outfnam[FILENAME_MAX]; /* internal file name for open/close */
-static struct FORMAT *p_fmt;	/* current format while treating a new page */
-
-int (*output)(FILE *out, const char *fmt, ...);
-
-int in_page;			/* filling a PostScript page */
-char *outbuf;			/* output buffer.. should hold one tune */
-char *mbf;			/* where to a2b() */
-int use_buffer;			/* 1 if lines are being accumulated */
+
+/*
+ * The output buffer is a list of chunks. The buffered lines (blocks)
+ * are never moved: when a chunk is full, the text after the last
+ * block is copied to the next chunk. When there is no buffered line,
+ * the first chunk is enlarged instead, so that the text of a captured
+ * tune (jobs.c) is always contiguous from 'outbuf'.
+ * With SVG output, the buffer may contain the binary records of draw.c
+ * (NV_MARK) in which any byte may be '\0': its text must be copied
+ * with its length (a2b_txt, fwrite, svg_write), never as a C string.
+ */
+struct obuf_s {			/* output buffer chunk */
+	struct obuf_s *next;
+	int size;
+	char buf[1];
+};
+static TLS struct obuf_s *ob_head, *ob_cur;	/* first and current chunks */
+static TLS struct obuf_s *ob_side;	/* side buffer */
+static TLS char *ob_end;		/* end of the current chunk */
+static TLS char *ob_pend;		/* start of the text after the last block */
+static TLS int ob_chunksz;		/* size of the chunks (-k) */
+static TLS char *side_mbf;		/* main 'mbf' while in the side buffer */
+static TLS int side_len;		/* length of the text in the side buffer */
+
+static TLS struct line_s {	/* buffered line */
+	char *beg, *end;	/* text */
+	float pos;		/* vertical position */
+	float lmarg;		/* left margin */
+	float scale;
+	signed char font;
+} *ln_tb;
+static TLS int ln_num;		/* number of lines in buffer */
+static TLS int ln_max;		/* size of ln_tb */
+static TLS float cur_lmarg = 0;	/* current left margin */
+static TLS float min_lmarg, max_rmarg;	/* margins for -E/-g */
+static TLS float cur_scale = 1.0;	/* current scale */
+static TLS float maxy;		/* usable vertical space in page */
+static TLS float remy;		/* remaining vertical space in page */
+static TLS float bposy;		/* current position in buffered data */
+static TLS int nepsf;		/* counter for -E/-g output files */
+static TLS int nbpages;		/* number of pages in the output file */
+static TLS char outfnam[FILENAME_MAX]; /* internal file name for open/close */
+static TLS struct FORMAT *p_fmt;	/* current format while treating a new page */
+
+TLS int (*output)(FILE *out, const char *fmt, ...);
+
+TLS int in_page;			/* filling a PostScript page */
+TLS char *outbuf;			/* output buffer */
+TLS char *mbf;			/* where to a2b() */
+TLS int use_buffer;			/* 1 if lines are being accumulated */
+TLS int out_side;			/* output in the side buffer */
+
+static void job_out(int type, int arg);
 
 /* -- cut off extension on a file identifier -- */
 static void cutext(char *fid)
@@ -67,7 +104,8 @@ void open_fout(void)
 	strcpy(fnm, outfn);
 	i = strlen(fnm) - 1;
 	if (i < 0) {
-		strcpy(fnm, svg || epsf > 1 ? "Out.xhtml" : OUTPUTFILE);
+		strcpy(fnm, svg == 3 ? "Out.pdf"
+			: svg || epsf > 1 ? "Out.xhtml" : OUTPUTFILE);
 	} else if (i != 0 || fnm[0] != '-') {
 		if (fnm[i] == '=' && in_fname) {
 			char *p;
@@ -77,23 +115,25 @@ void open_fout(void)
 			else
 				p++;
 			strcpy(&fnm[i], p);
-			strext(fnm, svg || epsf > 1 ? "xhtml" : "ps");
+			strext(fnm, svg == 3 ? "pdf"
+				: svg || epsf > 1 ? "xhtml" : "ps");
 		} else if (fnm[i] == DIRSEP) {
-			strcpy(&fnm[i + 1],
-				svg || epsf > 1 ? "Out.xhtml" : OUTPUTFILE);
+			strcpy(&fnm[i + 1], svg == 3 ? "Out.pdf"
+				: svg || epsf > 1 ? "Out.xhtml" : OUTPUTFILE);
 		}
 #if 0
 /*fixme: fnm may be a directory*/
 		else	...
 #endif
 	}
-	if (svg == 1
+	if ((svg == 1 || (svg == 3 && cairo_out == 1))	/* -v or PNG */
 	 && (i != 0 || fnm[0] != '-')) {
 		cutext(fnm);
 		i = strlen(fnm) - 1;
 		if (strncmp(fnm, outfnam, i) != 0)
 			nepsf = 0;
-		sprintf(&fnm[i + 1], "%03d.svg", ++nepsf);
+		sprintf(&fnm[i + 1], "%03d.%s", ++nepsf,
+			svg == 1 ? "svg" : "png");
 	} else if (strcmp(fnm, outfnam) == 0) {
 		return;				/* same output file */
 	}
@@ -103,10 +143,10 @@ void open_fout(void)
 	if (i != 0 || fnm[0] != '-') {
 		if ((fout = fopen(fnm, "w")) == NULL) {
 			error(1, NULL, "Cannot create output file %s - abort", fnm);
-			exit(EXIT_FAILURE);
+			fatal_exit(EXIT_FAILURE);
 		}
 	} else {
-		fout = stdout;
+		fout = lib_out ? lib_out : stdout;
 	}
 }
 
@@ -114,10 +154,11 @@ void open_fout(void)
 static void cnv_date(time_t *ltime)
 {
 	char buf[TEX_BUF_SZ];
+	struct tm tm;
 
 	tex_str(cfmt.dateformat);
 	strcpy(buf, tex_buf);
-	strftime(tex_buf, TEX_BUF_SZ, buf, localtime(ltime));
+	strftime(tex_buf, TEX_BUF_SZ, buf, localtime_r(ltime, &tm));
 }
 
 /* initialize the min/max margin values */
@@ -132,6 +173,7 @@ void marg_init(void)
 static void init_ps(char *str)
 {
 	time_t ltime;
+	struct tm tm;
 	unsigned i;
 	char version[32];
 
@@ -154,9 +196,9 @@ static void init_ps(char *str)
 	fprintf(fout, "%%%%Title: %s\n", str);
 	time(&ltime);
 #ifndef WIN32
-	strftime(tex_buf, TEX_BUF_SZ, "%b %e, %Y %H:%M", localtime(&ltime));
+	strftime(tex_buf, TEX_BUF_SZ, "%b %e, %Y %H:%M", localtime_r(&ltime, &tm));
 #else
-	strftime(tex_buf, TEX_BUF_SZ, "%b %#d, %Y %H:%M", localtime(&ltime));
+	strftime(tex_buf, TEX_BUF_SZ, "%b %#d, %Y %H:%M", localtime_r(&ltime, &tm));
 #endif
 	fprintf(fout, "%%%%Creator: abcm2ps-" VERSION "\n"
 		"%%%%CreationDate: %s\n", tex_buf);
@@ -208,6 +250,15 @@ static void init_ps(char *str)
 		"/dlw{0.7 SLW}!\n"
 
 		"%s\n", version);
+	if (epsf) {				/* output only the used symbols */
+		struct line_s *ln;
+		int l;
+
+		ps_used_init();
+		for (l = 0, ln = ln_tb; l < ln_num; l++, ln++)
+			ps_used(ln->beg, ln->end - ln->beg);
+		user_ps_used();
+	}
 	define_symbols();
 	output = fprintf;
 	user_ps_write();
@@ -228,7 +279,7 @@ static void init_svg(char *str)
 	output = svg_output;
 #if 1 //fixme:test
 	if (file_initialized > 0)
-		fprintf(stderr, "??? init_svg: file_initialized\n");
+		fprintf(err_out(), "??? init_svg: file_initialized\n");
 #endif
 	define_svg_symbols(str, nepsf,
 		(p_fmt->landscape ? p_fmt->pageheight : p_fmt->pagewidth)
@@ -242,16 +293,16 @@ static void close_fout(void)
 {
 	long m;
 
-	if (fout == stdout)
+	if (fout == stdout || fout == lib_out)
 		goto out2;
 	if (quiet)
 		goto out1;
 	m = ftell(fout);
-	if (epsf || svg == 1)
-		fprintf(stderr, "Output written on %s (%ld bytes)\n",
+	if (epsf || svg == 1 || (svg == 3 && cairo_out == 1))
+		fprintf(err_out(), "Output written on %s (%ld bytes)\n",
 			outfnam, m);
 	else
-		fprintf(stderr,
+		fprintf(err_out(),
 			"Output written on %s (%d page%s, %d title%s, %ld bytes)\n",
 			outfnam,
 			nbpages, nbpages == 1 ? "" : "s",
@@ -289,9 +340,13 @@ void close_output_file(void)
 	case 2:				/* -X */
 		fputs("</body>\n"
 			"</html>\n", fout);
-	case 3:				/* -z */
 		close_fout();
 		break;
+	case 3:				/* -P or --cairo */
+		pdf_close();
+		if (fout)		/* (the PNG files are closed by page) */
+			close_fout();
+		break;
 //	default:
 //	case 1:				/* -v */
 //		'fout' is closed in close_page
@@ -304,13 +359,26 @@ void close_output_file(void)
 /* -- close the PS / SVG page -- */
 void close_page(void)
 {
+	if (job_mode) {
+		job_out(EV_CLOSE, 0);
+		return;
+	}
 	if (!in_page)
 		return;
 	in_page = 0;
+	trace_end(SP_PAGE);
 	if (svg) {
 		svg_close();
-		if (svg == 1 && fout != stdout)
+		if (svg == 1 && fout != stdout && fout != lib_out)
 			close_fout();
+		else if (svg == 3) {
+			pdf_close_page();
+			if (cairo_out == 1		/* PNG */
+			 && fout != stdout && fout != lib_out) {
+				pdf_close();
+				close_fout();
+			}
+		}
 //		else
 //			fputs("</p>\n", fout);
 	} else {
@@ -410,11 +478,11 @@ static float headfooter(int header,
 			float pheight)
 {
 	char tmp[2048], str[TEX_BUF_SZ + 512];
-	char *p, *q, *r, *outbuf_sav, *mbf_sav;
+	char *p, *q, *r;
 	float size, y, wsize;
 	struct FONTSPEC *f, f_sav;
 
-	int cft_sav, dft_sav, outbufsz_sav;
+	int cft_sav, dft_sav;
 
 	if (header) {
 		p = cfmt.header;
@@ -447,11 +515,7 @@ static float headfooter(int header,
 		wsize += size;
 		*r = '\0';
 	}
-	mbf_sav = mbf;
-	outbuf_sav = outbuf;
-	outbufsz_sav = outbufsz;
-	outbuf = tmp;
-	outbufsz = sizeof tmp;
+	outbuf_side(1);
 	for (;;) {
 		tex_str(p);
 		strcpy(tmp, tex_buf);
@@ -464,13 +528,13 @@ static float headfooter(int header,
 				*q = '\0';
 				output(fout, "%.1f %.1f M ",
 					p_fmt->leftmargin, y);
-				mbf = tmp;
+				mbf = outbuf;
 				str_out(p, A_LEFT);
 				a2b("\n");
 				if (svg)
-					svg_write(tmp, strlen(tmp));
+					svg_write(outbuf, mbf - outbuf);
 				else
-					fputs(tmp, fout);
+					fwrite(outbuf, 1, mbf - outbuf, fout);
 			}
 			p = q + 1;
 		}
@@ -481,13 +545,13 @@ static float headfooter(int header,
 		if (q != p) {
 			output(fout, "%.1f %.1f M ",
 				pwidth * 0.5, y);
-			mbf = tmp;
+			mbf = outbuf;
 			str_out(p, A_CENTER);
 			a2b("\n");
 			if (svg)
-				svg_write(tmp, strlen(tmp));
+				svg_write(outbuf, mbf - outbuf);
 			else
-				fputs(tmp, fout);
+				fwrite(outbuf, 1, mbf - outbuf, fout);
 		}
 
 		/* right side */
@@ -496,13 +560,13 @@ static float headfooter(int header,
 			if (*p != '\0') {
 				output(fout, "%.1f %.1f M ",
 					pwidth - p_fmt->rightmargin, y);
-				mbf = tmp;
+				mbf = outbuf;
 				str_out(p, A_RIGHT);
 				a2b("\n");
 				if (svg)
-					svg_write(tmp, strlen(tmp));
+					svg_write(outbuf, mbf - outbuf);
 				else
-					fputs(tmp, fout);
+					fwrite(outbuf, 1, mbf - outbuf, fout);
 			}
 		}
 		if (!r)
@@ -514,9 +578,7 @@ static float headfooter(int header,
 	}
 
 	/* restore the buffer and fonts */
-	outbuf = outbuf_sav;
-	outbufsz = outbufsz_sav;
-	mbf = mbf_sav;
+	outbuf_side(0);
 	memcpy(&cfmt.font_tb[0], &f_sav, sizeof cfmt.font_tb[0]);
 	set_str_font(cft_sav, dft_sav);
 	return wsize;
@@ -531,16 +593,21 @@ static void init_page(void)
 	p_fmt = !info['X' - 'A'] ? &cfmt : &dfmt;	/* global format */
 
 	nbpages++;
+	trace_begin(SP_PAGE, nbpages);
 	if (svg) {
 		if (file_initialized <= 0) {
 			if (!fout)
 				open_fout();
+			if (svg == 3)
+				pdf_new_page();
 			define_svg_symbols(in_fname, nbpages,
 				cfmt.landscape ? p_fmt->pageheight : p_fmt->pagewidth,
 				cfmt.landscape ? p_fmt->pagewidth : p_fmt->pageheight);
 			file_initialized = 1;
 			output = svg_output;
 		} else {
+			if (svg == 3)
+				pdf_new_page();
 			define_svg_symbols(in_fname, nbpages,
 				cfmt.landscape ? p_fmt->pageheight : p_fmt->pagewidth,
 				cfmt.landscape ? p_fmt->pagewidth : p_fmt->pageheight);
@@ -655,6 +722,10 @@ void write_eps(void)
 	unsigned i;
 	char *p, title[80];
 
+	if (job_mode) {
+		job_out(EV_EPS, 0);
+		return;
+	}
 	if (mbf == outbuf
 	 || !info['X' - 'A'])
 		return;
@@ -668,11 +739,11 @@ void write_eps(void)
 		cutext(outfnam);
 		i = strlen(outfnam) - 1;
 		if (i == 0 && outfnam[0] == '-') {
-			if (epsf == 1) {
+			if (epsf == 1 && !lib_out && !serve_req) {
 				error(1, NULL, "Cannot use stdout with '-E' - abort");
-				exit(EXIT_FAILURE);
+				fatal_exit(EXIT_FAILURE);
 			}
-			fout = stdout;
+			fout = lib_out ? lib_out : stdout;
 		} else {
 			if (outfnam[i] == '=') {
 				p = &info['T' - 'A']->text[2];
@@ -690,7 +761,7 @@ void write_eps(void)
 			if ((fout = fopen(outfnam, "w")) == NULL) {
 				error(1, NULL, "Cannot open output file %s - abort",
 						outfnam);
-				exit(EXIT_FAILURE);
+				fatal_exit(EXIT_FAILURE);
 			}
 		}
 	}
@@ -717,24 +788,319 @@ void write_eps(void)
 
 /*  subroutines to handle output buffer  */
 
+/* -- treat the page functions in a worker thread (see jobs.c) -- */
+static void job_out(int type, int arg)
+{
+	if (job_mode == JOB_CAPT) {
+		job_event(type, arg, 0);
+		return;
+	}
+
+	/* not capturing: drop the output */
+	if (mbf == outbuf)
+		return;
+	if (!svg && !epsf)
+		file_initialized = 1;		/* as init_ps() */
+	outbuf_reset();
+}
+
+/* -- reset the output buffer (worker thread) -- */
+void outbuf_reset(void)
+{
+	ob_cur = ob_head;
+	ob_end = ob_head->buf + ob_head->size;
+	mbf = ob_pend = outbuf;
+	*mbf = '\0';
+	bposy = 0;
+	ln_num = 0;
+	use_buffer = 0;
+}
+
+/* -- get room for 'len' bytes in the output buffer -- */
+static void outbuf_room(int len)
+{
+	struct obuf_s *ob, **p_ob;
+	int l, sz;
+
+	if (out_side) {
+		p_ob = &ob_side;
+		l = mbf - outbuf;
+	} else if (ln_num == 0) {
+		p_ob = &ob_head;
+		l = mbf - outbuf;
+	} else {
+		p_ob = NULL;
+		l = mbf - ob_pend;
+	}
+	sz = (l + len) * 2;
+	if (sz < ob_chunksz)
+		sz = ob_chunksz;
+
+	/* no buffered line: enlarge the buffer */
+	if (p_ob) {
+		ob = realloc(*p_ob, sizeof *ob + sz);
+		if (!ob) {
+			error(1, NULL, "Out of memory for outbuf - abort");
+			fatal_exit(EXIT_FAILURE);
+		}
+		ob->size = sz;
+		*p_ob = ob;
+		outbuf = ob->buf;
+		mbf = outbuf + l;
+		ob_end = outbuf + sz;
+		if (!out_side) {
+			ob_cur = ob;
+			ob_pend = outbuf;
+		}
+		return;
+	}
+
+	/* move the text after the last block to the next chunk */
+	ob = ob_cur->next;
+	if (!ob || ob->size < l + len) {
+		ob = malloc(sizeof *ob + sz);
+		if (!ob) {
+			error(1, NULL, "Out of memory for outbuf - abort");
+			fatal_exit(EXIT_FAILURE);
+		}
+		ob->size = sz;
+		ob->next = ob_cur->next;
+		ob_cur->next = ob;
+	}
+	memcpy(ob->buf, ob_pend, l);
+	ob_cur = ob;
+	ob_pend = ob->buf;
+	mbf = ob_pend + l;
+	*mbf = '\0';
+	ob_end = ob->buf + ob->size;
+}
+
+/* -- redirect the output to the side buffer (on != 0) or back -- */
+/* return the text of the side buffer */
+char *outbuf_side(int on)
+{
+	if (on) {
+		side_mbf = mbf;
+		if (!ob_side) {
+			ob_side = malloc(sizeof *ob_side + BSIZE * 4);
+			if (!ob_side) {
+				error(1, NULL, "Out of memory for outbuf - abort");
+				fatal_exit(EXIT_FAILURE);
+			}
+			ob_side->size = BSIZE * 4;
+			ob_side->next = NULL;
+		}
+		outbuf = mbf = ob_side->buf;
+		*mbf = '\0';
+		ob_end = outbuf + ob_side->size;
+		out_side = 1;
+		return outbuf;
+	}
+	side_len = mbf - outbuf;
+	out_side = 0;
+	outbuf = ob_head->buf;
+	mbf = side_mbf;
+	ob_end = ob_cur->buf + ob_cur->size;
+	return ob_side->buf;
+}
+
+/* -- put the text of the side buffer in the output buffer -- */
+void outbuf_side_put(void)
+{
+	if (job_mode == JOB_CAPT)
+		job_side(mbf - outbuf);		/* (move the side events) */
+	a2b_txt(ob_side->buf, side_len);
+}
+
+/* -- fast formatting of the output -- */
+
+static const char digits2[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/* output an unsigned integer with at least 'ndig' digits */
+static char *fmt_uint(char *p, unsigned n, int ndig)
+{
+	char tmp[16], *q;
+
+	q = &tmp[sizeof tmp];
+	while (n >= 100) {
+		q -= 2;
+		memcpy(q, &digits2[(n % 100) * 2], 2);
+		n /= 100;
+		ndig -= 2;
+	}
+	if (n >= 10 || ndig >= 2) {
+		q -= 2;
+		memcpy(q, &digits2[n * 2], 2);
+		ndig -= 2;
+	} else {
+		*--q = '0' + n;
+		ndig--;
+	}
+	while (--ndig >= 0)
+		*--q = '0';
+	memcpy(p, q, &tmp[sizeof tmp] - q);
+	return p + (&tmp[sizeof tmp] - q);
+}
+
+/* output a float value as "%.<prec>f" (prec <= 3)
+ * return NULL when the rounding is not sure (half-way values) */
+static char *fmt_float(char *p, double v, int prec)
+{
+	static const unsigned pw[4] = {1, 10, 100, 1000};
+	double r, f;
+	unsigned n;
+
+	if (v < 0 || (v == 0 && 1 / v < 0)) {	/* (-0.0 is "-0.0") */
+		*p++ = '-';
+		v = -v;
+	}
+	r = v * pw[prec];
+	if (!(r < 1e9))			/* big value or NaN */
+		return NULL;
+	n = r;
+	f = r - n;
+	if (f > 0.5 - 1e-6 && f < 0.5 + 1e-6)
+		return NULL;
+	if (f > 0.5)
+		n++;
+	if (prec == 0)
+		return fmt_uint(p, n, 1);
+	p = fmt_uint(p, n / pw[prec], 1);
+	*p++ = '.';
+	return fmt_uint(p, n % pw[prec], prec);
+}
+
+/* format as vsnprintf() with a fast path for the conversions
+ * %d, %s, %c, %% and %.<n>f (n <= 3) */
+int vfmt(char *buf, int size, const char *fmt, va_list args)
+{
+	va_list args2;
+	const char *f;
+	char *p, *e, *s;
+	int d, l;
+
+	va_copy(args2, args);
+	p = buf;
+	e = buf + size - 1;		/* (room for the '\0') */
+	f = fmt;
+	for (;;) {
+		while (*f != '%' && *f != '\0') {
+			if (p >= e)
+				goto slow;
+			*p++ = *f++;
+		}
+		if (*f == '\0')
+			break;
+		if (p + 24 > e)
+			goto slow;
+		switch (f[1]) {
+		case '%':
+			*p++ = '%';
+			f += 2;
+			continue;
+		case 'c':
+			*p++ = va_arg(args, int);
+			f += 2;
+			continue;
+		case 'd':
+			d = va_arg(args, int);
+			if (d < 0) {
+				*p++ = '-';
+				p = fmt_uint(p, -(unsigned) d, 1);
+			} else {
+				p = fmt_uint(p, d, 1);
+			}
+			f += 2;
+			continue;
+		case 's':
+			s = va_arg(args, char *);
+			l = strlen(s);
+			if (p + l > e)
+				goto slow;
+			memcpy(p, s, l);
+			p += l;
+			f += 2;
+			continue;
+		case '.':
+			if (f[2] >= '0' && f[2] <= '3' && f[3] == 'f') {
+				p = fmt_float(p, va_arg(args, double), f[2] - '0');
+				if (!p)
+					goto slow;
+				f += 4;
+				continue;
+			}
+			break;
+		}
+		goto slow;
+	}
+	*p = '\0';
+	va_end(args2);
+	return p - buf;
+
+slow:
+	l = vsnprintf(buf, size, fmt, args2);
+	va_end(args2);
+	return l;
+}
+
+/* -- fprintf() with the fast formatting -- */
+int fmt_fprintf(FILE *f, const char *fmt, ...)
+{
+	va_list args;
+	char tmp[1024];
+	int l;
+
+	va_start(args, fmt);
+	l = vfmt(tmp, sizeof tmp, fmt, args);
+	va_end(args);
+	if (l < sizeof tmp) {
+		fwrite(tmp, 1, l, f);
+	} else {
+		va_start(args, fmt);
+		l = vfprintf(f, fmt, args);
+		va_end(args);
+	}
+	return l;
+}
+
 /* -- update the output buffer pointer -- */
 void a2b(char *fmt, ...)
 {
 	va_list args;
+	int l;
 
-	if (mbf + BSIZE > outbuf + outbufsz) {
-		if (epsf) {
-			error(1, NULL, "Output buffer overflow - increase outbufsz");
-			fprintf(stderr, "*** abort\n");
-			exit(EXIT_FAILURE);
-		}
-		error(0, NULL, "Possible buffer overflow");
-		write_buffer();
-//		use_buffer = 0;
-	}
+	if (mbf + BSIZE > ob_end)
+		outbuf_room(BSIZE);
 	va_start(args, fmt);
-	mbf += vsnprintf(mbf, outbuf + outbufsz - mbf, fmt, args);
+	l = vfmt(mbf, ob_end - mbf, fmt, args);
 	va_end(args);
+	if (mbf + l >= ob_end) {		/* truncated */
+		outbuf_room(l + 1);
+		va_start(args, fmt);
+		vfmt(mbf, ob_end - mbf, fmt, args);
+		va_end(args);
+	}
+	mbf += l;
+}
+
+/* -- put some text of known length -- */
+void a2b_txt(char *p, int l)
+{
+	if (mbf + l >= ob_end)
+		outbuf_room(l + 1);
+	memcpy(mbf, p, l);
+	mbf += l;
+	*mbf = '\0';
 }
 
 /* -- translate down by 'h' scaled points in output buffer -- */
@@ -742,6 +1108,10 @@ void bskip(float h)
 {
 	if (h == 0)
 		return;
+	if (job_mode == JOB_CAPT) {
+		job_event(EV_BSKIP, 0, h);	/* (position in the page) */
+		return;
+	}
 	bposy -= h * cfmt.scale;
 	a2b("0 %.2f T\n", -h);
 }
@@ -749,86 +1119,203 @@ void bskip(float h)
 /* -- initialize the output buffer -- */
 void init_outbuf(int kbsz)
 {
-	if (outbuf)
-		free(outbuf);
-	outbufsz = kbsz * 1024;
-//	if (outbufsz < 0x10000)
-//		outbufsz = 0x10000;
-	outbuf = malloc(outbufsz);
-	if (!outbuf) {
+	free_outbuf();
+	ob_chunksz = kbsz * 1024;
+	if (ob_chunksz < BSIZE * 2)
+		ob_chunksz = BSIZE * 2;
+	ob_head = malloc(sizeof *ob_head + ob_chunksz);
+	if (!ob_head) {
 		error(1, NULL, "Out of memory for outbuf - abort");
-		exit(EXIT_FAILURE);
+		fatal_exit(EXIT_FAILURE);
 	}
-	bposy = 0;
-	ln_num = 0;
-	mbf = outbuf;
+	ob_head->next = NULL;
+	ob_head->size = ob_chunksz;
+	outbuf = ob_head->buf;
+	outbuf_reset();
+}
+
+/* -- free the output buffer -- */
+void free_outbuf(void)
+{
+	struct obuf_s *ob;
+
+	while (ob_head) {
+		ob = ob_head->next;
+		free(ob_head);
+		ob_head = ob;
+	}
+	free(ob_side);
+	ob_side = NULL;
+	free(ln_tb);
+	ln_tb = NULL;
+	ln_max = 0;
+	outbuf = mbf = NULL;
+}
+
+#ifdef HAVE_WRITEV
+/* -- write the buffered lines from the chunks -- */
+static void write_lines(struct iovec *iov, int n, int sz)
+{
+	ssize_t l;
+	int fd;
+
+	if (n == 0)
+		return;
+	fd = sz >= WRITEV_MIN ? fileno(fout) : -1;
+	if (fd >= 0 && fflush(fout) == 0) {
+		while (n > 0) {
+			l = writev(fd, iov, n > IOV_MAX ? IOV_MAX : n);
+			if (l < 0)
+				break;		/* (error on fclose) */
+			while (n > 0 && l >= (ssize_t) iov->iov_len) {
+				l -= iov->iov_len;
+				iov++;
+				n--;
+			}
+			if (n > 0) {
+				iov->iov_base = (char *) iov->iov_base + l;
+				iov->iov_len -= l;
+			}
+		}
+		if (n == 0)
+			return;
+	}
+	while (--n >= 0) {
+		fwrite(iov->iov_base, 1, iov->iov_len, fout);
+		iov++;
+	}
+}
+#endif
+
+/* -- account the usage of the output buffer (--stats) -- */
+/* return the number of pending bytes */
+static int outbuf_stats(void)
+{
+	struct obuf_s *ob;
+	struct line_s *ln;
+	long sys;
+	int l, used;
+
+	used = mbf - ob_pend;
+	for (l = 0, ln = ln_tb; l < ln_num; l++, ln++)
+		used += ln->end - ln->beg;
+	if (stats_file) {
+		sys = ln_max * sizeof *ln_tb;
+		for (ob = ob_head; ob; ob = ob->next)
+			sys += sizeof *ob + ob->size;
+		if (ob_side)
+			sys += sizeof *ob_side + ob_side->size;
+		stats_mem(MEM_OUTBUF, used, sys);
+	}
+	return used;
 }
 
 /* -- write buffer contents, break at full pages -- */
 void write_buffer(void)
 {
+	struct line_s *ln;
 	char *p_buf;
-	int l, np;
+	int l, np, used;
 	float p1, dp;
 	int outft_sav;
+#ifdef HAVE_WRITEV
+	struct iovec *iov;
+	int niov, iovsz;
 
-	if (mbf == outbuf || multicol_start != 0)
+	iov = NULL;
+	niov = iovsz = 0;
+#endif
+
+	used = outbuf_stats();
+	if (job_mode) {
+		job_out(EV_WRITE, 0);		/* (counted when replayed) */
 		return;
+	}
+	stats_begin(ST_WRITE_BUFFER);
+	if (mbf == outbuf || multicol_start != 0) {
+		stats_end(ST_WRITE_BUFFER);
+		return;
+	}
+	trace_begin(SP_FLUSH, used);
+	PROBE1(flush__start, used);
 	if (!in_page && !epsf)
 		init_page();
 	outft_sav = outft;
 	p1 = 0;
-	p_buf = outbuf;
-	for (l = 0; l < ln_num; l++) {
-		if (ln_pos[l] > 0) {		/* if in multicol */
+#ifdef HAVE_WRITEV
+	if (!epsf && !svg)
+		iov = malloc(ln_num * sizeof *iov);
+#define FLUSH_LINES() \
+	if (iov) { \
+		write_lines(iov, niov, iovsz); \
+		niov = iovsz = 0; \
+	}
+#else
+#define FLUSH_LINES()
+#endif
+	for (l = 0, ln = ln_tb; l < ln_num; l++, ln++) {
+		if (ln->pos > 0) {		/* if in multicol */
 			int ll;
 			float pos;
 
 			for (ll = l + 1; ll < ln_num; ll++) {
-				if (ln_pos[ll] <= 0) {
-					pos = ln_pos[ll];
+				if (ln_tb[ll].pos <= 0) {
+					pos = ln_tb[ll].pos;
 					while (--ll >= l)
-						ln_pos[ll] = pos;
+						ln_tb[ll].pos = pos;
 					break;
 				}
 			}
 		}
-		dp = ln_pos[l] - p1;
+		dp = ln->pos - p1;
 		np = remy + dp < 0 && !epsf;
+		if (np
+		 || ln->scale != cur_scale
+		 || ln->lmarg != cur_lmarg)
+			FLUSH_LINES();
 		if (np) {
 			close_page();
 			init_page();
-			if (ln_font[l] >= 0) {
+			if (ln->font >= 0) {
 				struct FONTSPEC *f;
 
-				f = &cfmt.font_tb[ln_font[l]];
+				f = &cfmt.font_tb[ln->font];
 				output(fout, "%.1f F%d\n",
 					f->size, f->fnum);
 			}
 		}
-		if (ln_scale[l] != cur_scale) {
+		if (ln->scale != cur_scale) {
 			output(fout, "%.3f dup scale\n",
-				ln_scale[l] / cur_scale);
-			cur_scale = ln_scale[l];
+				ln->scale / cur_scale);
+			cur_scale = ln->scale;
 		}
-		if (ln_lmarg[l] != cur_lmarg) {
+		if (ln->lmarg != cur_lmarg) {
 			output(fout, "%.2f 0 T\n",
-				(ln_lmarg[l] - cur_lmarg) / cur_scale);
-			cur_lmarg = ln_lmarg[l];
+				(ln->lmarg - cur_lmarg) / cur_scale);
+			cur_lmarg = ln->lmarg;
 		}
 		if (np) {
 			output(fout, "0 %.2f T\n", -cfmt.topspace);
 			remy -= cfmt.topspace * cfmt.scale;
 		}
+		p_buf = ln->beg;
 		if (*p_buf != '\001') {
-			if (epsf > 1 || svg)
-				svg_write(p_buf, ln_buf[l] - p_buf);
-			else
-				fwrite(p_buf, 1, ln_buf[l] - p_buf, fout);
+			if (epsf > 1 || svg) {
+				svg_write(p_buf, ln->end - p_buf);
+#ifdef HAVE_WRITEV
+			} else if (iov) {
+				iov[niov].iov_base = p_buf;
+				iov[niov++].iov_len = ln->end - p_buf;
+				iovsz += ln->end - p_buf;
+#endif
+			} else {
+				fwrite(p_buf, 1, ln->end - p_buf, fout);
+			}
 		} else {			/* %%EPS - see parse.c */
 			FILE *f;
 			char line[BSIZE], *p, *q;
 
+			FLUSH_LINES();
 			p = strchr(p_buf + 1, '\n');
 			fwrite(p_buf + 1, 1, p - p_buf, fout);
 			p_buf = p + 1;
@@ -867,63 +1354,77 @@ void write_buffer(void)
 				fclose(f);
 			}
 		}
-		p_buf = ln_buf[l];
 		remy += dp;
-		p1 = ln_pos[l];
-	}
-#if 1 //fixme:test
-	if (*p_buf != '\0') {
-//		fprintf(stderr, "??? bug - buffer not empty:\n%s\n", p_buf);
-		memcpy(outbuf, p_buf, strlen(p_buf) + 1);
-		mbf = &outbuf[strlen(outbuf)];
-	} else {
-		mbf = outbuf;
+		p1 = ln->pos;
 	}
+	FLUSH_LINES();
+#undef FLUSH_LINES
+#ifdef HAVE_WRITEV
+	free(iov);
 #endif
+
+	/* keep the text after the last block at start of buffer */
+	p_buf = ob_pend;
+	l = mbf - p_buf;
+	ln_num = 0;
+	if (p_buf != outbuf) {
+		if (l >= ob_head->size) {	/* (not in the first chunk) */
+			ob_cur = ob_head;
+			mbf = outbuf;
+			outbuf_room(l + 1);
+		}
+		memmove(outbuf, p_buf, l);
+	}
+	ob_cur = ob_head;
+	ob_end = outbuf + ob_head->size;
+	ob_pend = outbuf;
+	mbf = outbuf + l;
+	*mbf = '\0';
 	outft = outft_sav;
 	bposy = 0;
-	ln_num = 0;
 	use_buffer = 0;
+	PROBE1(flush__end, used);
+	trace_end(SP_FLUSH);
+	stats_end(ST_WRITE_BUFFER);
 }
 
 /* -- add a block of commmon margins / scale in the output buffer -- */
 void block_put(void)
 {
-	if (mbf == outbuf)
+	struct line_s *ln;
+
+	if (job_mode) {
+		job_out(EV_BLOCK, 0);
 		return;
+	}
+	if (mbf == ob_pend)
+		return;				/* no data */
 //fixme: should be done sooner and should be adjusted when cfmt change...
 	if (remy == 0)
 		remy = maxy = (cfmt.landscape ? cfmt.pagewidth : cfmt.pageheight)
 			- cfmt.topmargin - cfmt.botmargin;
-	if (ln_num > 0 && mbf == ln_buf[ln_num - 1])
-		return;				/* no data */
-	if (ln_num >= BUFFLN) {
-		char c, *p;
-
-		error(1, NULL, "max number of buffer lines exceeded"
-				" -- check BUFFLN");
-		multicol_start = 0;
-		p = ln_buf[ln_num - 1];
-		c = *p;				/* (avoid "buffer not empty") */
-		*p = '\0';
-		write_buffer();
-		multicol_start = remy + bposy;
-		*p = c;
-		strcpy(outbuf, p);
-//		use_buffer = 0;
+	if (ln_num >= ln_max) {
+		ln_max = ln_max ? ln_max * 2 : 64;
+		ln_tb = realloc(ln_tb, ln_max * sizeof *ln_tb);
+		if (!ln_tb) {
+			error(1, NULL, "Out of memory for outbuf - abort");
+			fatal_exit(EXIT_FAILURE);
+		}
 	}
-	ln_buf[ln_num] = mbf;
-	ln_pos[ln_num] = multicol_start == 0 ? bposy : 1;
-	ln_lmarg[ln_num] = cfmt.leftmargin;
+	ln = &ln_tb[ln_num++];
+	ln->beg = ob_pend;
+	ln->end = mbf;
+	ob_pend = mbf;
+	ln->pos = multicol_start == 0 ? bposy : 1;
+	ln->lmarg = cfmt.leftmargin;
 	if (epsf) {
 		if (cfmt.leftmargin < min_lmarg)
 			min_lmarg = cfmt.leftmargin;
 		if (cfmt.rightmargin < max_rmarg)
 			max_rmarg = cfmt.rightmargin;
 	}
-	ln_scale[ln_num] = cfmt.scale;
-	ln_font[ln_num] = outft;
-	ln_num++;
+	ln->scale = cfmt.scale;
+	ln->font = outft;
 
 	if (!use_buffer)
 		write_buffer();
@@ -934,6 +1435,10 @@ void block_put(void)
    after page break and change buffer handling mode to pass though */
 void buffer_eob(int eot)
 {
+	if (job_mode) {
+		job_out(EV_EOB, eot);
+		return;
+	}
 	block_put();
 	if (epsf) {
 		if (epsf == 3)
@@ -986,19 +1491,9 @@ void buffer_eob(int eot)
 #endif
 }
 
-/* -- dump buffer if not enough place for a music line -- */
-void check_buffer(void)
-{
-	if (mbf + 5000 > outbuf + outbufsz) { /* assume music line < 5000 bytes */
-		error(0, NULL,
-		      "Possibly bad page breaks, outbufsz exceeded");
-		write_buffer();
-//		use_buffer = 0;
-	}
-}
-
 /* -- return the current vertical offset in the page -- */
 float get_bposy(void)
 {
+	job_invalid();			/* depends on the previous tunes */
 	return remy + bposy;
 }
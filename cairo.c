@@ -0,0 +1,371 @@
+/*
+ * PNG and PDF output by cairo (option '--cairo').
+ *
+ * This file is part of abcm2ps.
+ *
+ * Copyright (C) 2016 Jean-François Moine
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * The SVG pages are translated by pdf.c into lists of binary drawing
+ * operations (CR_xxx - see pdf.c), the symbols being kept as forms.
+ * Here, these lists are played on a cairo surface, the texts going
+ * through pango.
+ * The PNG images have the size of the SVG images (96 DPI).
+ */
+
+#ifdef HAVE_PANGO
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <cairo.h>
+#include <cairo-pdf.h>
+#include <pango/pangocairo.h>
+
+#include "abcm2ps.h"
+
+#define PNG_SCALE (96. / 72)		/* PDF points to PNG pixels */
+
+#define MAXOP 16			/* max number of values */
+#define MAXSAVE 32			/* max depth of save/restore */
+#define MAXDEPTH 8			/* max depth of the forms */
+
+/* graphic state not kept by cairo */
+struct cgstate {
+	double fill[3], stroke[3];
+};
+
+/* text being built between BT and ET */
+struct ctext {
+	PangoLayout *layout;
+	GString *str;			/* UTF-8 text */
+	PangoAttrList *attrs;
+	int anchor;
+	float length;			/* textLength - 0 if none */
+	double x, y;			/* origin */
+	int font;
+	float size;
+};
+
+static char *font_family[3] = {"Times", "Helvetica", "Courier"};
+
+static TLS cairo_surface_t *pdf_surface;	/* PDF file */
+static TLS cairo_t *pdf_cr;
+
+/* -- write the output of cairo -- */
+static cairo_status_t cr_write(void *closure,
+			const unsigned char *data,
+			unsigned int length)
+{
+	if (fwrite(data, 1, length, (FILE *) closure) != length)
+		return CAIRO_STATUS_WRITE_ERROR;
+	return CAIRO_STATUS_SUCCESS;
+}
+
+/* -- draw the text built between CR_BT and CR_ET -- */
+static void text_draw(cairo_t *cr, struct ctext *t, struct cgstate *gs)
+{
+	PangoRectangle r;
+	double x, w;
+
+	if (t->str->len == 0)
+		return;
+	pango_layout_set_text(t->layout, t->str->str, t->str->len);
+	pango_layout_set_attributes(t->layout, t->attrs);
+	pango_layout_get_extents(t->layout, NULL, &r);
+	w = (double) r.width / PANGO_SCALE;
+
+	cairo_save(cr);
+	cairo_translate(cr, t->x, t->y);
+	cairo_scale(cr, 1, -1);			/* (back to the SVG space) */
+	x = 0;
+	if (t->length > 0 && w > 0) {
+		cairo_scale(cr, t->length / w, 1);
+	} else if (t->anchor == 1) {
+		x = -w / 2;
+	} else if (t->anchor == 2) {
+		x = -w;
+	}
+	cairo_set_source_rgb(cr, gs->fill[0], gs->fill[1], gs->fill[2]);
+	cairo_move_to(cr, x,
+		-(double) pango_layout_get_baseline(t->layout) / PANGO_SCALE);
+	pango_cairo_update_layout(cr, t->layout);
+	pango_cairo_show_layout(cr, t->layout);
+	cairo_restore(cr);
+}
+
+/* -- add a text to the layout -- */
+static void text_add(struct ctext *t, char *s, int len)
+{
+	PangoFontDescription *desc;
+	PangoAttribute *attr;
+	int start;
+
+	start = t->str->len;
+	g_string_append_len(t->str, s, len);
+	desc = pango_font_description_new();
+	pango_font_description_set_family(desc, font_family[t->font / 4]);
+	pango_font_description_set_weight(desc,
+		t->font & 1 ? PANGO_WEIGHT_BOLD : PANGO_WEIGHT_NORMAL);
+	pango_font_description_set_style(desc,
+		t->font & 2 ? PANGO_STYLE_ITALIC : PANGO_STYLE_NORMAL);
+	pango_font_description_set_absolute_size(desc,
+		t->size * PANGO_SCALE);
+	attr = pango_attr_font_desc_new(desc);
+	attr->start_index = start;
+	attr->end_index = t->str->len;
+	pango_attr_list_insert(t->attrs, attr);
+	pango_font_description_free(desc);
+}
+
+/* -- add a horizontal space to the text -- */
+static void text_space(struct ctext *t, float dx)
+{
+	PangoRectangle r;
+	PangoAttribute *attr;
+	int start;
+
+	if (dx <= 0)
+		return;
+	start = t->str->len;
+	g_string_append(t->str, "\xe2\x80\x8b");	/* zero width space */
+	r.x = r.y = r.height = 0;
+	r.width = dx * PANGO_SCALE;
+	attr = pango_attr_shape_new(&r, &r);
+	attr->start_index = start;
+	attr->end_index = t->str->len;
+	pango_attr_list_insert(t->attrs, attr);
+}
+
+/* -- set a color -- */
+static void set_rgb(double *c, float *v)
+{
+	c[0] = v[0];
+	c[1] = v[1];
+	c[2] = v[2];
+}
+
+/* -- draw a list of operations -- */
+static void draw(cairo_t *cr, char *p, int len, struct cgstate *gs0,
+		int depth)
+{
+	struct cgstate gs, save[MAXSAVE];
+	struct ctext t;
+	cairo_matrix_t m;
+	char *e, *s;
+	float v[MAXOP];
+	double dash[MAXOP];
+	int op, n, nsave, i, l;
+
+	gs = *gs0;
+	nsave = 0;
+	memset(&t, 0, sizeof t);
+	t.layout = pango_cairo_create_layout(cr);
+	t.str = g_string_sized_new(64);
+	e = p + len;
+	while (p + 2 <= e) {
+		op = (unsigned char) *p++;
+		n = (unsigned char) *p++;
+		if (n > MAXOP || p + n * sizeof *v > e)
+			break;
+		memcpy(v, p, n * sizeof *v);
+		p += n * sizeof *v;
+		switch (op) {
+		case CR_SAVE:
+			if (nsave < MAXSAVE) {
+				cairo_save(cr);
+				save[nsave++] = gs;
+			}
+			break;
+		case CR_RESTORE:
+			if (nsave > 0) {
+				cairo_restore(cr);
+				gs = save[--nsave];
+			}
+			break;
+		case CR_MATRIX:
+			cairo_matrix_init(&m, v[0], v[1], v[2], v[3], v[4], v[5]);
+			cairo_transform(cr, &m);
+			break;
+		case CR_MOVE:
+			cairo_move_to(cr, v[0], v[1]);
+			break;
+		case CR_LINE:
+			cairo_line_to(cr, v[0], v[1]);
+			break;
+		case CR_CURVE:
+			cairo_curve_to(cr, v[0], v[1], v[2], v[3], v[4], v[5]);
+			break;
+		case CR_RECT:
+			cairo_rectangle(cr, v[0], v[1], v[2], v[3]);
+			break;
+		case CR_CLOSE:
+			cairo_close_path(cr);
+			break;
+		case CR_FILL:
+		case CR_EOFILL:
+		case CR_FILLSTROKE:
+		case CR_EOFILLSTROKE:
+			cairo_set_fill_rule(cr,
+				op == CR_EOFILL || op == CR_EOFILLSTROKE
+					? CAIRO_FILL_RULE_EVEN_ODD
+					: CAIRO_FILL_RULE_WINDING);
+			cairo_set_source_rgb(cr, gs.fill[0], gs.fill[1],
+						gs.fill[2]);
+			if (op == CR_FILL || op == CR_EOFILL) {
+				cairo_fill(cr);
+				break;
+			}
+			cairo_fill_preserve(cr);
+			/* fall thru */
+		case CR_STROKE:
+			cairo_set_source_rgb(cr, gs.stroke[0], gs.stroke[1],
+						gs.stroke[2]);
+			cairo_stroke(cr);
+			break;
+		case CR_FILLRGB:
+			set_rgb(gs.fill, v);
+			break;
+		case CR_STROKERGB:
+			set_rgb(gs.stroke, v);
+			break;
+		case CR_LW:
+			cairo_set_line_width(cr, v[0]);
+			break;
+		case CR_DASH:
+			for (i = 0; i < n; i++)
+				dash[i] = v[i];
+			cairo_set_dash(cr, dash, n, 0);
+			break;
+		case CR_CAP:
+			cairo_set_line_cap(cr,
+				v[0] == 1 ? CAIRO_LINE_CAP_ROUND
+				: v[0] == 2 ? CAIRO_LINE_CAP_SQUARE
+				: CAIRO_LINE_CAP_BUTT);
+			break;
+		case CR_BT:
+			g_string_truncate(t.str, 0);
+			if (t.attrs)
+				pango_attr_list_unref(t.attrs);
+			t.attrs = pango_attr_list_new();
+			t.anchor = v[0];
+			t.length = v[1];
+			t.x = v[2];
+			t.y = v[3];
+			break;
+		case CR_FONT:
+			t.font = v[0];
+			if (t.font < 0 || t.font >= 12)
+				t.font = 0;
+			t.size = v[1];
+			break;
+		case CR_SPACE:
+			if (t.attrs)
+				text_space(&t, v[0]);
+			break;
+		case CR_TEXT:
+			l = v[0];
+			if (l < 0 || p + l > e) {
+				p = e;
+				break;
+			}
+			if (t.attrs)
+				text_add(&t, p, l);
+			p += l;
+			break;
+		case CR_ET:
+			if (t.attrs)
+				text_draw(cr, &t, &gs);
+			break;
+		case CR_FORM:
+			if (depth >= MAXDEPTH)
+				break;
+			s = pdf_form(v[0], &l);
+			if (!s)
+				break;
+			cairo_save(cr);
+			draw(cr, s, l, &gs, depth + 1);
+			cairo_restore(cr);
+			break;
+		}
+	}
+	while (nsave > 0) {
+		cairo_restore(cr);
+		nsave--;
+	}
+	if (t.attrs)
+		pango_attr_list_unref(t.attrs);
+	g_string_free(t.str, TRUE);
+	g_object_unref(t.layout);
+}
+
+/* -- initialize the drawing of a page -- */
+static void page_init(cairo_t *cr, float h)
+{
+	cairo_set_line_width(cr, 1);
+	cairo_translate(cr, 0, h);		/* PDF coordinates */
+	cairo_scale(cr, 1, -1);
+}
+
+/* -- draw a page -- */
+/* 'f' is the output file, 's' the list of operations and w, h the size
+ * of the page in points */
+void pg_cairo_page(FILE *f, char *s, int len, float w, float h)
+{
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	struct cgstate gs;
+
+	memset(&gs, 0, sizeof gs);
+	if (cairo_out == 1) {				/* PNG */
+		surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+				ceil(w * PNG_SCALE), ceil(h * PNG_SCALE));
+		cr = cairo_create(surface);
+		cairo_set_source_rgb(cr, 1, 1, 1);	/* white background */
+		cairo_paint(cr);
+		cairo_scale(cr, PNG_SCALE, PNG_SCALE);
+		page_init(cr, h);
+		draw(cr, s, len, &gs, 0);
+		cairo_destroy(cr);
+		if (cairo_surface_write_to_png_stream(surface, cr_write, f)
+					!= CAIRO_STATUS_SUCCESS)
+			error(1, NULL, "Cannot write the PNG image");
+		cairo_surface_destroy(surface);
+		return;
+	}
+
+	/* PDF */
+	if (!pdf_surface) {
+		pdf_surface = cairo_pdf_surface_create_for_stream(cr_write, f,
+					w, h);
+		pdf_cr = cairo_create(pdf_surface);
+	} else {
+		cairo_pdf_surface_set_size(pdf_surface, w, h);
+	}
+	cr = pdf_cr;
+	cairo_save(cr);
+	page_init(cr, h);
+	draw(cr, s, len, &gs, 0);
+	cairo_restore(cr);
+	cairo_show_page(cr);
+}
+
+/* -- end of the PDF file -- */
+void pg_cairo_close(void)
+{
+	if (!pdf_surface)
+		return;
+	cairo_destroy(pdf_cr);
+	cairo_surface_finish(pdf_surface);
+	if (cairo_surface_status(pdf_surface) != CAIRO_STATUS_SUCCESS)
+		error(1, NULL, "Cannot write the PDF file");
+	cairo_surface_destroy(pdf_surface);
+	pdf_cr = NULL;
+	pdf_surface = NULL;
+}
+#endif /* HAVE_PANGO */
@@ -9,6 +9,21 @@
 /* comment if you have not mmap() */
 #define HAVE_MMAP 1
 
+/* comment if you have not the POSIX threads (option '-J') */
+#define HAVE_PTHREAD 1
+
+/* uncomment to have the static probes for the tracers
+ * (needs <sys/sdt.h> - set by 'configure' when found) */
+//#define HAVE_SDT 1
+
+/* uncomment to write the output buffer by writev()
+ * (needs <sys/uio.h> - set by 'configure' when found) */
+#define HAVE_WRITEV 1
+
+/* uncomment to compress the PDF streams (option '-P')
+ * (needs zlib - set by 'configure' when found) */
+//#define HAVE_ZLIB 1
+
 /* default directory to search for format files */
 #define DEFAULT_FDIR "/usr/local/share/abcm2ps"
 
@@ -22,10 +22,10 @@
 
 #include "abcm2ps.h"
 
-int defl;		/* decoration flags */
-char *deco[256];	/* decoration names */
+TLS int defl;		/* decoration flags */
+TLS char *deco[256];	/* decoration names */
 
-static struct deco_elt {
+static TLS struct deco_elt {
 	struct deco_elt *next, *prev;	/* next/previous decoration */
 	struct SYMBOL *s;	/* symbol */
 	struct deco_elt *start;	/* start a long decoration ending here */
@@ -53,7 +53,7 @@ static draw_f d_arp, d_cresc, d_near, d_slide, d_upstaff,
 
 /* decoration table */
 /* !! don't change the order of the numbered items !! */
-static struct deco_def_s {
+static TLS struct deco_def_s {
 	char *name;
 	unsigned char func;	/* function index */
 	signed char ps_func;	/* postscript function index */
@@ -81,9 +81,9 @@ static const short f_note = (1 << 3) | (1 << 4) | (1 << 5);
 static const short f_staff = (1 << 6) | (1 << 7);
 
 /* postscript function table */
-static char *ps_func_tb[128];
+static TLS char *ps_func_tb[128];
 
-static char *str_tb[32];
+static TLS char *str_tb[32];
 
 /* standard decorations */
 static char *std_deco_tb[] = {
@@ -178,7 +178,7 @@ static char *std_deco_tb[] = {
 };
 
 /* user decorations */
-static struct u_deco {
+static TLS struct u_deco {
 	struct u_deco *next;
 	char text[2];
 } *user_deco;
@@ -2509,6 +2509,11 @@ void set_defl(int new_defl)
 {
 	if (defl == new_defl)
 		return;
+	if (defl < 0 && job_mode == JOB_CAPT) { /* unknown (jobs.c) */
+		job_event(EV_DEFL, new_defl, 0);
+		defl = new_defl;
+		return;
+	}
 	defl = new_defl;
 	a2b("/defl %d def ", new_defl);
 }
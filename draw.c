@@ -15,6 +15,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
 
 #include "abcm2ps.h"
 
@@ -27,11 +28,11 @@ struct BEAM {			/* packages info on one beam */
 static char *acc_tb[] = { "", "sh", "nt", "ft", "dsh", "dft" };
 
 /* scaling stuff */
-static int scale_voice;		/* staff (0) or voice(1) scaling */
-static float cur_scale = 1;	/* voice or staff scale */
-static float cur_trans = 0;	/* != 0 when scaled staff */
-static float cur_staff = 1;	/* current scaled staff */
-static int cur_color = 0;	/* current color */
+static TLS int scale_voice;		/* staff (0) or voice(1) scaling */
+static TLS float cur_scale = 1;	/* voice or staff scale */
+static TLS float cur_trans = 0;	/* != 0 when scaled staff */
+static TLS float cur_staff = 1;	/* current scaled staff */
+static TLS int cur_color = 0;	/* current color */
 
 static void draw_note(float x,
 		      struct SYMBOL *s,
@@ -54,6 +55,79 @@ void set_v_color(int v)
 			(float) (cur_color & 0xff) / 255);
 }
 
+/* -- native SVG records -- */
+/* With SVG output, the most frequent drawing operations are put
+ * in the output buffer as binary records which are treated by svg.c
+ * without the PostScript interpreter:
+ *	NV_MARK, 'A' + operation (enum nv_op), values (float), '\n'
+ * The values are the ones of the PostScript operators, rounded
+ * as in the PostScript output.
+ * The other operations stay in the PostScript syntax. */
+
+/* check if native records */
+static int nv_native(void)
+{
+	return svg || epsf > 1;
+}
+
+/* output a native record */
+static void nv_out(int nv, float *v, int n)
+{
+	char rec[2 + NV_MAXVAL * sizeof (float) + 1];
+	float f;
+	int i, l;
+
+	rec[0] = NV_MARK;
+	rec[1] = 'A' + nv;
+	l = 2;
+	for (i = 0; i < n; i++) {
+		f = rint(v[i] * 10.) / 10;	/* as "%.1f" */
+		memcpy(&rec[l], &f, sizeof f);
+		l += sizeof f;
+	}
+	rec[l++] = '\n';
+	a2b_txt(rec, l);
+}
+
+/* get the coordinates as putxy() */
+static void nv_xy(float *v, float x, float y)
+{
+	v[0] = x / cur_scale;
+	v[1] = scale_voice ?
+		y / cur_scale :			/* scaled voice */
+		y - cur_trans;			/* scaled staff */
+}
+
+/* output a ledger line */
+static void out_hl(float x, float y, char *op, int nv)
+{
+	float v[2];
+
+	if (nv_native()) {
+		nv_xy(v, x, y);
+		nv_out(nv, v, 2);
+		return;
+	}
+	putxy(x, y);
+	a2b("%s ", op);
+}
+
+/* output a stem */
+static void out_stem(float h, char type, char dir)
+{
+	int nv;
+
+	if (!nv_native()) {
+		a2b(" %.1f %c%c", h, type, dir);
+		return;
+	}
+	if (type == 's')
+		nv = dir == 'u' ? NV_su : NV_sd;
+	else
+		nv = dir == 'u' ? NV_gu : NV_gd;
+	nv_out(nv, &h, 1);
+}
+
 /* output debug annotations */
 static void anno_out(struct SYMBOL *s, char type)
 {
@@ -573,7 +647,7 @@ static void draw_beam(float x1,
 		      int n)			/* beam number (1..n) */
 {
 	struct SYMBOL *s;
-	float y1, dy2;
+	float y1, dy2, v[5];
 
 	s = bm->s1;
 	if ((s->sflags & S_TREM2) && n > s->nflags - s->aux
@@ -591,6 +665,14 @@ static void draw_beam(float x1,
 	x2 -= x1;
 	dy2 = bm->a * x2;
 
+	if (nv_native()) {
+		v[0] = h;
+		v[1] = x2 / cur_scale;
+		v[2] = dy2;
+		nv_xy(&v[3], x1, y1);
+		nv_out(NV_bm, v, 5);
+		return;
+	}
 	putf(h);
 	putx(x2);
 	putf(dy2);
@@ -795,7 +877,7 @@ static void draw_sysbra(float x, int staff, int flag)
 static void draw_lstaff(float x)
 {
 	int i, j, l, nst;
-	float yb;
+	float yb, v[3];
 
 	if (cfmt.alignbars)
 		return;
@@ -822,11 +904,15 @@ static void draw_lstaff(float x)
 	set_sscale(-1);
 	yb = staff_tb[j].y + staff_tb[j].botbar
 				* staff_tb[j].staffscale;
-	a2b("%.1f %.1f %.1f bar\n",
-	     staff_tb[i].y
+	v[0] = staff_tb[i].y
 		+ staff_tb[i].topbar * staff_tb[i].staffscale
-		- yb,
-	     x, yb);
+		- yb;
+	v[1] = x;
+	v[2] = yb;
+	if (nv_native())
+		nv_out(NV_bar, v, 3);
+	else
+		a2b("%.1f %.1f %.1f bar\n", v[0], v[1], v[2]);
 	for (i = 0; i <= nst; i++) {
 		if (cursys->staff[i].flags & OPEN_BRACE)
 			draw_sysbra(x, i, CLOSE_BRACE);
@@ -966,7 +1052,14 @@ static void draw_acc(int acc, int microscale)
 static void draw_hl(float x, int staffb, int up,
 		int y, int stafflines, char *hltype)
 {
-	int i;
+	int i, nv;
+
+	switch (hltype[0] == 'g' ? 'g' : hltype[2]) {
+	case 'g': nv = NV_ghl; break;
+	case '1': nv = NV_hl1; break;
+	case '2': nv = NV_hl2; break;
+	default: nv = NV_hl; break;
+	}
 
 	if (!up) {
 		switch (stafflines) {		// lower ledger lines
@@ -976,10 +1069,8 @@ static void draw_hl(float x, int staffb, int up,
 		case 3: i = 0; break;
 		default: i = -6; break;
 		}
-		for ( ; i >= y; i -= 6) {
-			putxy(x, staffb + i);
-			a2b("%s ", hltype);
-		}
+		for ( ; i >= y; i -= 6)
+			out_hl(x, staffb + i, hltype, nv);
 		return;
 	}
 
@@ -990,10 +1081,8 @@ static void draw_hl(float x, int staffb, int up,
 	case 3: i = 24; break;
 	default: i = stafflines * 6; break;
 	}
-	for ( ; i <= y; i += 6) {
-		putxy(x, staffb + i);
-		a2b("%s ", hltype);
-	}
+	for ( ; i <= y; i += 6)
+		out_hl(x, staffb + i, hltype, nv);
 }
 
 /* -- draw a key signature -- */
@@ -1352,28 +1441,20 @@ static void draw_rest(struct SYMBOL *s)
 		}
 		switch (i) {
 		case 6:					/* minim */
-			if (y <= yb || y >= yt) {
-				putxy(x, y + staffb);
-				a2b("hl ");
-			}
+			if (y <= yb || y >= yt)
+				out_hl(x, y + staffb, "hl", NV_hl);
 			break;
 		case 7:					/* semibreve */
-			if (y < yb || y >= yt - 6) {
-				putxy(x, y + 6 + staffb);
-				a2b("hl ");
-			}
+			if (y < yb || y >= yt - 6)
+				out_hl(x, y + 6 + staffb, "hl", NV_hl);
 			break;
 		default:
-			if (y < yb || y >= yt - 6) {
-				putxy(x,y + 6 + staffb);
-				a2b("hl ");
-			}
+			if (y < yb || y >= yt - 6)
+				out_hl(x, y + 6 + staffb, "hl", NV_hl);
 			if (i == 9)			/* longa */
 				y -= 6;
-			if (y <= yb || y >= yt) {
-				putxy(x, y + staffb);
-				a2b("hl ");
-			}
+			if (y <= yb || y >= yt)
+				out_hl(x, y + staffb, "hl", NV_hl);
 			break;
 		}
 	}
@@ -1587,7 +1668,7 @@ static void draw_basic_note(float x,
 			    signed char *y_tb)
 {
 	struct note *note = &s->u.note.notes[m];
-	int y, head, dots, nflags, acc;
+	int y, head, dots, nflags, acc, nv, native;
 //	int no_head;
 	int old_color = -1;
 	float staffb, shhd;
@@ -1601,11 +1682,10 @@ static void draw_basic_note(float x,
 	if (s->flags & ABC_F_INVIS)
 		return;
 
-	putxy(x + shhd, y + staffb);		/* output x and y */
-
 	/* special case when no head */
 	if (s->nohdi1 >= 0
 	 && m >= s->nohdi1 && m < s->nohdi2) {
+		putxy(x + shhd, y + staffb);	/* output x and y */
 		a2b("xydef");			/* set x y */
 		return;
 	}
@@ -1613,38 +1693,16 @@ static void draw_basic_note(float x,
 	identify_note(s, note->len, &head, &dots, &nflags);
 	acc = note->acc;
 
-	/* output a ledger line if horizontal shift / chord
-	 * and note on a line */
-	if (y % 6 == 0
-	 && shhd != (s->stem > 0 ? s->u.note.notes[0].shhd :
-				s->u.note.notes[s->nhd].shhd)) {
-		int yy;
-
-		yy = 0;
-		if (y >= 30) {
-			yy = y;
-			if (yy % 6)
-				yy -= 3;
-		} else if (y <= -6) {
-			yy = y;
-			if (yy % 6)
-				yy += 3;
-		}
-		if (yy) {
-			putxy(x + shhd, yy + staffb);
-			a2b("hl ");
-		}
-	}
-
-	/* draw the head */
+	/* get the head */
+	nv = -1;				/* no native head */
 	if (note->invisible) {
 		p = "xydef";
 	} else if ((p = note->head) != NULL) {
 		snprintf(hd, sizeof hd, "%.*s", note->hlen, p);
 		p = hd;
-		a2b("2 copy xydef ");		/* set x y */
 	} else if (s->flags & ABC_F_GRACE) {
 		p = "ghd";
+		nv = NV_ghd;
 	} else if (s->type == CUSTOS) {
 		p = "custos";
 	} else if ((s->sflags & S_PERC) && acc != 0) {
@@ -1656,10 +1714,12 @@ static void draw_basic_note(float x,
 		case H_OVAL:
 			if (note->len < BREVE) {
 				p = "HD";
+				nv = NV_HD;
 				break;
 			}
 			if (s->head != H_SQUARE) {
 				p = "HDD";
+				nv = NV_HDD;
 				break;
 			}
 			/* fall thru */
@@ -1672,11 +1732,43 @@ static void draw_basic_note(float x,
 				dots = 0;
 			break;
 		case H_EMPTY:
-			p = "Hd"; break;
+			p = "Hd";
+			nv = NV_Hd;
+			break;
 		default:
-			p = "hd"; break;
+			p = "hd";
+			nv = NV_hd;
+			break;
+		}
+	}
+	native = nv >= 0 && nv_native();
+	if (!native)
+		putxy(x + shhd, y + staffb);	/* output x and y */
+
+	/* output a ledger line if horizontal shift / chord
+	 * and note on a line */
+	if (y % 6 == 0
+	 && shhd != (s->stem > 0 ? s->u.note.notes[0].shhd :
+				s->u.note.notes[s->nhd].shhd)) {
+		int yy;
+
+		yy = 0;
+		if (y >= 30) {
+			yy = y;
+			if (yy % 6)
+				yy -= 3;
+		} else if (y <= -6) {
+			yy = y;
+			if (yy % 6)
+				yy += 3;
 		}
+		if (yy)
+			out_hl(x + shhd, yy + staffb, "hl", NV_hl);
 	}
+
+	/* draw the head */
+	if (!note->invisible && note->head)
+		a2b("2 copy xydef ");		/* set x y */
 	if (note->color >= 0) {
 		int new_color = note->color;
 
@@ -1688,7 +1780,14 @@ static void draw_basic_note(float x,
 				(float) (new_color & 0xff) / 255);
 		}
 	}
-	a2b("%s", p);
+	if (native) {
+		float v[2];
+
+		nv_xy(v, x + shhd, y + staffb);
+		nv_out(nv, v, 2);
+	} else {
+		a2b("%s", p);
+	}
 
 	/* draw the dots */
 /*fixme: to see for grace notes*/
@@ -1701,7 +1800,15 @@ static void draw_basic_note(float x,
 		if (scale_voice)
 			doty /= cur_scale;
 		while (--dots >= 0) {
-			a2b(" %.1f %d dt", dotx, doty);
+			if (nv_native()) {
+				float v[2];
+
+				v[0] = dotx;
+				v[1] = doty;
+				nv_out(NV_dt, v, 2);
+			} else {
+				a2b(" %.1f %d dt", dotx, doty);
+			}
 			dotx += 3.5;
 		}
 	}
@@ -1791,7 +1898,7 @@ static void draw_note(float x,
 				else
 					slen += 1;
 			}
-			a2b(" %.1f %c%c", slen, c2, c);
+			out_stem(slen, c2, c);
 		} else {				/* stem and flags */
 			if (cfmt.straightflags)
 				c = 's';		/* straight flag */
@@ -1806,7 +1913,7 @@ static void draw_note(float x,
 		slen += staff_tb[s2->staff].y - staffb;
 /*fixme:KO when different scales*/
 		slen /= voice_tb[s->voice].scale;
-		a2b(" %.1f su", slen);
+		out_stem(slen, 's', 'u');
 	}
 
 	/* draw the tremolo bars */
@@ -2759,8 +2866,9 @@ static struct SYMBOL *draw_tuplet(struct SYMBOL *t,	/* tuplet in extra */
 			return next;
 	}
 
-	if ((t->aux & 0x0f00) != 0)		/* if 'what' != square */
-		fprintf(stderr, "'what' value of %%%%tuplets not yet coded\n");
+	if ((t->aux & 0x0f00) != 0		/* if 'what' != square */
+	 && !job_quiet())
+		fprintf(err_out(), "'what' value of %%%%tuplets not yet coded\n");
 
 /*fixme: two staves not treated*/
 /*fixme: to optimize*/
@@ -4901,6 +5009,26 @@ void set_sscale(int staff)
 	}
 }
 
+/* -- get the scale and color state (jobs.c) -- */
+void get_draw_state(float *st)
+{
+	st[0] = scale_voice;
+	st[1] = cur_scale;
+	st[2] = cur_trans;
+	st[3] = cur_staff;
+	st[4] = cur_color;
+}
+
+/* -- restore the scale and color state (jobs.c) -- */
+void set_draw_state(float *st)
+{
+	scale_voice = st[0];
+	cur_scale = st[1];
+	cur_trans = st[2];
+	cur_staff = st[3];
+	cur_color = st[4];
+}
+
 /* -- set the tie directions for one voice -- */
 static void set_tie_dir(struct SYMBOL *sym)
 {
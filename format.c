@@ -13,25 +13,29 @@
  */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <ctype.h>
 
 #include "abcm2ps.h"
 
-struct FORMAT cfmt;		/* current format for output */
+TLS struct FORMAT cfmt;		/* current format for output */
 
-char *fontnames[MAXFONTS];		/* list of font names */
-static char font_enc[MAXFONTS];		/* font encoding */
-static char def_font_enc[MAXFONTS];	/* default font encoding */
-static char used_font[MAXFONTS];	/* used fonts */
-static float swfac_font[MAXFONTS];	/* width scale */
-static int nfontnames;
-static float staffwidth;
+TLS char *fontnames[MAXFONTS];		/* list of font names */
+static TLS char font_enc[MAXFONTS];		/* font encoding */
+static TLS char def_font_enc[MAXFONTS];	/* default font encoding */
+static TLS char used_font[MAXFONTS];	/* used fonts */
+static TLS float swfac_font[MAXFONTS];	/* width scale */
+static TLS int nfontnames;
+static TLS float staffwidth;
 
 /* format table */
+#define FMT(f) offsetof(struct FORMAT, f)
+#define FMT_STAFFWIDTH -1
+
 static struct format {
 	char *name;
-	void *v;
+	short v;		/* offset in struct FORMAT */
 	char type;
 #define FORMAT_I 0	/* int */
 #define FORMAT_R 1	/* float */
@@ -40,117 +44,125 @@ static struct format {
 #define FORMAT_B 4	/* boolean */
 #define FORMAT_S 5	/* string */
 	char subtype;		/* special cases - see code */
-	short lock;
 } format_tb[] = {
-	{"abc2pscompat", &cfmt.abc2pscompat, FORMAT_B, 3},
-	{"alignbars", &cfmt.alignbars, FORMAT_I, 0},
-	{"aligncomposer", &cfmt.aligncomposer, FORMAT_I, 0},
-	{"annotationfont", &cfmt.font_tb[ANNOTATIONFONT], FORMAT_F, 0},
-	{"autoclef", &cfmt.autoclef, FORMAT_B, 0},
-	{"barsperstaff", &cfmt.barsperstaff, FORMAT_I, 0},
-	{"bgcolor", &cfmt.bgcolor, FORMAT_S, 0},
-	{"botmargin", &cfmt.botmargin, FORMAT_U, 1},
-	{"breaklimit", &cfmt.breaklimit, FORMAT_R, 3},
-	{"breakoneoln", &cfmt.breakoneoln, FORMAT_B, 0},
-	{"bstemdown", &cfmt.bstemdown, FORMAT_B, 0},
-	{"cancelkey", &cfmt.cancelkey, FORMAT_B, 0},
-	{"combinevoices", &cfmt.combinevoices, FORMAT_I, 0},
-	{"composerfont", &cfmt.font_tb[COMPOSERFONT], FORMAT_F, 0},
-	{"composerspace", &cfmt.composerspace, FORMAT_U, 0},
-	{"contbarnb", &cfmt.contbarnb, FORMAT_B, 0},
-	{"continueall", &cfmt.continueall, FORMAT_B, 0},
-	{"custos", &cfmt.custos, FORMAT_B, 0},
-	{"dateformat", &cfmt.dateformat, FORMAT_S, 0},
-	{"dblrepbar", &cfmt.dblrepbar, FORMAT_I, 2},
-	{"decoerr", &cfmt.decoerr, FORMAT_B, 0},
-	{"dynalign", &cfmt.dynalign, FORMAT_B, 0},
-	{"footer", &cfmt.footer, FORMAT_S, 0},
-	{"footerfont", &cfmt.font_tb[FOOTERFONT], FORMAT_F, 0},
-	{"flatbeams", &cfmt.flatbeams, FORMAT_B, 0},
-	{"gchordbox", &cfmt.gchordbox, FORMAT_B, 0},
-	{"gchordfont", &cfmt.font_tb[GCHORDFONT], FORMAT_F, 3},
-	{"graceslurs", &cfmt.graceslurs, FORMAT_B, 0},
-	{"graceword", &cfmt.graceword, FORMAT_B, 0},
-	{"gracespace", &cfmt.gracespace, FORMAT_I, 5},
-	{"header", &cfmt.header, FORMAT_S, 0},
-	{"headerfont", &cfmt.font_tb[HEADERFONT], FORMAT_F, 0},
-	{"historyfont", &cfmt.font_tb[HISTORYFONT], FORMAT_F, 0},
-	{"hyphencont", &cfmt.hyphencont, FORMAT_B, 0},
-	{"indent", &cfmt.indent, FORMAT_U, 0},
-	{"infofont", &cfmt.font_tb[INFOFONT], FORMAT_F, 0},
-	{"infoline", &cfmt.infoline, FORMAT_B, 0},
-	{"infospace", &cfmt.infospace, FORMAT_U, 0},
-	{"keywarn", &cfmt.keywarn, FORMAT_B, 0},
-	{"landscape", &cfmt.landscape, FORMAT_B, 0},
-	{"leftmargin", &cfmt.leftmargin, FORMAT_U, 1},
-	{"lineskipfac", &cfmt.lineskipfac, FORMAT_R, 0},
-	{"linewarn", &cfmt.linewarn, FORMAT_B, 0},
-	{"maxshrink", &cfmt.maxshrink, FORMAT_R, 2},
-	{"maxstaffsep", &cfmt.maxstaffsep, FORMAT_U, 0},
-	{"maxsysstaffsep", &cfmt.maxsysstaffsep, FORMAT_U, 0},
-	{"measurebox", &cfmt.measurebox, FORMAT_B, 0},
-	{"measurefirst", &cfmt.measurefirst, FORMAT_I, 0},
-	{"measurefont", &cfmt.font_tb[MEASUREFONT], FORMAT_F, 2},
-	{"measurenb", &cfmt.measurenb, FORMAT_I, 0},
-	{"micronewps", &cfmt.micronewps, FORMAT_B, 0},
-	{"musicspace", &cfmt.musicspace, FORMAT_U, 0},
-	{"notespacingfactor", &cfmt.notespacingfactor, FORMAT_R, 1},
-	{"oneperpage", &cfmt.oneperpage, FORMAT_B, 0},
-	{"pageheight", &cfmt.pageheight, FORMAT_U, 1},
-	{"pagewidth", &cfmt.pagewidth, FORMAT_U, 1},
-	{"pagescale", &cfmt.scale, FORMAT_R, 0},
+	{"abc2pscompat", FMT(abc2pscompat), FORMAT_B, 3},
+	{"alignbars", FMT(alignbars), FORMAT_I, 0},
+	{"aligncomposer", FMT(aligncomposer), FORMAT_I, 0},
+	{"annotationfont", FMT(font_tb[ANNOTATIONFONT]), FORMAT_F, 0},
+	{"autoclef", FMT(autoclef), FORMAT_B, 0},
+	{"barsperstaff", FMT(barsperstaff), FORMAT_I, 0},
+	{"bgcolor", FMT(bgcolor), FORMAT_S, 0},
+	{"botmargin", FMT(botmargin), FORMAT_U, 1},
+	{"breaklimit", FMT(breaklimit), FORMAT_R, 3},
+	{"breakoneoln", FMT(breakoneoln), FORMAT_B, 0},
+	{"bstemdown", FMT(bstemdown), FORMAT_B, 0},
+	{"cancelkey", FMT(cancelkey), FORMAT_B, 0},
+	{"combinevoices", FMT(combinevoices), FORMAT_I, 0},
+	{"composerfont", FMT(font_tb[COMPOSERFONT]), FORMAT_F, 0},
+	{"composerspace", FMT(composerspace), FORMAT_U, 0},
+	{"contbarnb", FMT(contbarnb), FORMAT_B, 0},
+	{"continueall", FMT(continueall), FORMAT_B, 0},
+	{"custos", FMT(custos), FORMAT_B, 0},
+	{"dateformat", FMT(dateformat), FORMAT_S, 0},
+	{"dblrepbar", FMT(dblrepbar), FORMAT_I, 2},
+	{"decoerr", FMT(decoerr), FORMAT_B, 0},
+	{"dynalign", FMT(dynalign), FORMAT_B, 0},
+	{"footer", FMT(footer), FORMAT_S, 0},
+	{"footerfont", FMT(font_tb[FOOTERFONT]), FORMAT_F, 0},
+	{"flatbeams", FMT(flatbeams), FORMAT_B, 0},
+	{"gchordbox", FMT(gchordbox), FORMAT_B, 0},
+	{"gchordfont", FMT(font_tb[GCHORDFONT]), FORMAT_F, 3},
+	{"graceslurs", FMT(graceslurs), FORMAT_B, 0},
+	{"graceword", FMT(graceword), FORMAT_B, 0},
+	{"gracespace", FMT(gracespace), FORMAT_I, 5},
+	{"header", FMT(header), FORMAT_S, 0},
+	{"headerfont", FMT(font_tb[HEADERFONT]), FORMAT_F, 0},
+	{"historyfont", FMT(font_tb[HISTORYFONT]), FORMAT_F, 0},
+	{"hyphencont", FMT(hyphencont), FORMAT_B, 0},
+	{"indent", FMT(indent), FORMAT_U, 0},
+	{"infofont", FMT(font_tb[INFOFONT]), FORMAT_F, 0},
+	{"infoline", FMT(infoline), FORMAT_B, 0},
+	{"infospace", FMT(infospace), FORMAT_U, 0},
+	{"keywarn", FMT(keywarn), FORMAT_B, 0},
+	{"landscape", FMT(landscape), FORMAT_B, 0},
+	{"leftmargin", FMT(leftmargin), FORMAT_U, 1},
+	{"lineskipfac", FMT(lineskipfac), FORMAT_R, 0},
+	{"linewarn", FMT(linewarn), FORMAT_B, 0},
+	{"maxshrink", FMT(maxshrink), FORMAT_R, 2},
+	{"maxstaffsep", FMT(maxstaffsep), FORMAT_U, 0},
+	{"maxsysstaffsep", FMT(maxsysstaffsep), FORMAT_U, 0},
+	{"measurebox", FMT(measurebox), FORMAT_B, 0},
+	{"measurefirst", FMT(measurefirst), FORMAT_I, 0},
+	{"measurefont", FMT(font_tb[MEASUREFONT]), FORMAT_F, 2},
+	{"measurenb", FMT(measurenb), FORMAT_I, 0},
+	{"micronewps", FMT(micronewps), FORMAT_B, 0},
+	{"musicspace", FMT(musicspace), FORMAT_U, 0},
+	{"notespacingfactor", FMT(notespacingfactor), FORMAT_R, 1},
+	{"oneperpage", FMT(oneperpage), FORMAT_B, 0},
+	{"pageheight", FMT(pageheight), FORMAT_U, 1},
+	{"pagewidth", FMT(pagewidth), FORMAT_U, 1},
+	{"pagescale", FMT(scale), FORMAT_R, 0},
 #ifdef HAVE_PANGO
-	{"pango", &cfmt.pango, FORMAT_B, 2},
+	{"pango", FMT(pango), FORMAT_B, 2},
 #endif
-	{"parskipfac", &cfmt.parskipfac, FORMAT_R, 0},
-	{"partsbox", &cfmt.partsbox, FORMAT_B, 0},
-	{"partsfont", &cfmt.font_tb[PARTSFONT], FORMAT_F, 1},
-	{"partsspace", &cfmt.partsspace, FORMAT_U, 0},
-	{"pdfmark", &cfmt.pdfmark, FORMAT_I, 0},
-	{"rbdbstop", &cfmt.rbdbstop, FORMAT_B, 0},
-	{"rbmax", &cfmt.rbmax, FORMAT_I, 0},
-	{"rbmin", &cfmt.rbmin, FORMAT_I, 0},
-	{"repeatfont", &cfmt.font_tb[REPEATFONT], FORMAT_F, 0},
-	{"rightmargin", &cfmt.rightmargin, FORMAT_U, 1},
-//	{"scale", &cfmt.scale, FORMAT_R, 0},
-	{"setdefl", &cfmt.setdefl, FORMAT_B, 0},
-//	{"shifthnote", &cfmt.shiftunison, FORMAT_B, 0},	/*to remove*/
-	{"shiftunison", &cfmt.shiftunison, FORMAT_I, 0},
-	{"slurheight", &cfmt.slurheight, FORMAT_R, 0},
-	{"splittune", &cfmt.splittune, FORMAT_I, 1},
-	{"squarebreve", &cfmt.squarebreve, FORMAT_B, 0},
-	{"staffnonote", &cfmt.staffnonote, FORMAT_I, 0},
-	{"staffsep", &cfmt.staffsep, FORMAT_U, 0},
-	{"staffwidth", &staffwidth, FORMAT_U, 2},
-	{"stemheight", &cfmt.stemheight, FORMAT_R, 0},
-	{"straightflags", &cfmt.straightflags, FORMAT_B, 0},
-	{"stretchlast", &cfmt.stretchlast, FORMAT_R, 2},
-	{"stretchstaff", &cfmt.stretchstaff, FORMAT_B, 0},
-	{"subtitlefont", &cfmt.font_tb[SUBTITLEFONT], FORMAT_F, 0},
-	{"subtitlespace", &cfmt.subtitlespace, FORMAT_U, 0},
-	{"sysstaffsep", &cfmt.sysstaffsep, FORMAT_U, 0},
-	{"tempofont", &cfmt.font_tb[TEMPOFONT], FORMAT_F, 0},
-	{"textfont", &cfmt.font_tb[TEXTFONT], FORMAT_F, 0},
-	{"textoption", &cfmt.textoption, FORMAT_I, 4},
-	{"textspace", &cfmt.textspace, FORMAT_U, 0},
-	{"titlecaps", &cfmt.titlecaps, FORMAT_B, 0},
-	{"titlefont", &cfmt.font_tb[TITLEFONT], FORMAT_F, 0},
-	{"titleformat", &cfmt.titleformat, FORMAT_S, 0},
-	{"titleleft", &cfmt.titleleft, FORMAT_B, 0},
-	{"titlespace", &cfmt.titlespace, FORMAT_U, 0},
-	{"titletrim", &cfmt.titletrim, FORMAT_B, 0},
-	{"timewarn", &cfmt.timewarn, FORMAT_B, 0},
-	{"topmargin", &cfmt.topmargin, FORMAT_U, 1},
-	{"topspace", &cfmt.topspace, FORMAT_U, 0},
-	{"tuplets", &cfmt.tuplets, FORMAT_I, 3},
-	{"vocalfont", &cfmt.font_tb[VOCALFONT], FORMAT_F, 0},
-	{"vocalspace", &cfmt.vocalspace, FORMAT_U, 0},
-	{"voicefont", &cfmt.font_tb[VOICEFONT], FORMAT_F, 0},
-	{"wordsfont", &cfmt.font_tb[WORDSFONT], FORMAT_F, 0},
-	{"wordsspace", &cfmt.wordsspace, FORMAT_U, 0},
-	{"writefields", &cfmt.fields, FORMAT_B, 1},
+	{"parskipfac", FMT(parskipfac), FORMAT_R, 0},
+	{"partsbox", FMT(partsbox), FORMAT_B, 0},
+	{"partsfont", FMT(font_tb[PARTSFONT]), FORMAT_F, 1},
+	{"partsspace", FMT(partsspace), FORMAT_U, 0},
+	{"pdfmark", FMT(pdfmark), FORMAT_I, 0},
+	{"rbdbstop", FMT(rbdbstop), FORMAT_B, 0},
+	{"rbmax", FMT(rbmax), FORMAT_I, 0},
+	{"rbmin", FMT(rbmin), FORMAT_I, 0},
+	{"repeatfont", FMT(font_tb[REPEATFONT]), FORMAT_F, 0},
+	{"rightmargin", FMT(rightmargin), FORMAT_U, 1},
+//	{"scale", FMT(scale), FORMAT_R, 0},
+	{"setdefl", FMT(setdefl), FORMAT_B, 0},
+//	{"shifthnote", FMT(shiftunison), FORMAT_B, 0},	/*to remove*/
+	{"shiftunison", FMT(shiftunison), FORMAT_I, 0},
+	{"slurheight", FMT(slurheight), FORMAT_R, 0},
+	{"splittune", FMT(splittune), FORMAT_I, 1},
+	{"squarebreve", FMT(squarebreve), FORMAT_B, 0},
+	{"staffnonote", FMT(staffnonote), FORMAT_I, 0},
+	{"staffsep", FMT(staffsep), FORMAT_U, 0},
+	{"staffwidth", FMT_STAFFWIDTH, FORMAT_U, 2},
+	{"stemheight", FMT(stemheight), FORMAT_R, 0},
+	{"straightflags", FMT(straightflags), FORMAT_B, 0},
+	{"stretchlast", FMT(stretchlast), FORMAT_R, 2},
+	{"stretchstaff", FMT(stretchstaff), FORMAT_B, 0},
+	{"subtitlefont", FMT(font_tb[SUBTITLEFONT]), FORMAT_F, 0},
+	{"subtitlespace", FMT(subtitlespace), FORMAT_U, 0},
+	{"sysstaffsep", FMT(sysstaffsep), FORMAT_U, 0},
+	{"tempofont", FMT(font_tb[TEMPOFONT]), FORMAT_F, 0},
+	{"textfont", FMT(font_tb[TEXTFONT]), FORMAT_F, 0},
+	{"textoption", FMT(textoption), FORMAT_I, 4},
+	{"textspace", FMT(textspace), FORMAT_U, 0},
+	{"titlecaps", FMT(titlecaps), FORMAT_B, 0},
+	{"titlefont", FMT(font_tb[TITLEFONT]), FORMAT_F, 0},
+	{"titleformat", FMT(titleformat), FORMAT_S, 0},
+	{"titleleft", FMT(titleleft), FORMAT_B, 0},
+	{"titlespace", FMT(titlespace), FORMAT_U, 0},
+	{"titletrim", FMT(titletrim), FORMAT_B, 0},
+	{"timewarn", FMT(timewarn), FORMAT_B, 0},
+	{"topmargin", FMT(topmargin), FORMAT_U, 1},
+	{"topspace", FMT(topspace), FORMAT_U, 0},
+	{"tuplets", FMT(tuplets), FORMAT_I, 3},
+	{"vocalfont", FMT(font_tb[VOCALFONT]), FORMAT_F, 0},
+	{"vocalspace", FMT(vocalspace), FORMAT_U, 0},
+	{"voicefont", FMT(font_tb[VOICEFONT]), FORMAT_F, 0},
+	{"wordsfont", FMT(font_tb[WORDSFONT]), FORMAT_F, 0},
+	{"wordsspace", FMT(wordsspace), FORMAT_U, 0},
+	{"writefields", FMT(fields), FORMAT_B, 1},
 	{0, 0, 0, 0}		/* end of table */
 };
+static TLS char format_lock[sizeof format_tb / sizeof format_tb[0]];
+
+/* -- get the address of a format value -- */
+static void *fmt_v(struct format *fd)
+{
+	if (fd->v == FMT_STAFFWIDTH)
+		return &staffwidth;
+	return (char *) &cfmt + fd->v;
+}
 
 static const char helvetica[] = "Helvetica";
 static const char times[] = "Times-Roman";
@@ -481,7 +493,7 @@ static char *yn[2] = {"no","yes"};
 #endif
 			default:
 			case 0:
-				printf("%s\n", yn[*((int *) fd->v)]);
+				printf("%s\n", yn[*((int *) fmt_v(fd))]);
 				break;
 			case 1: {			/* writefields */
 				int i;
@@ -500,7 +512,7 @@ static char *yn[2] = {"no","yes"};
 		case FORMAT_I:
 			switch (fd->subtype) {
 			default:
-				printf("%d\n", *((int *) fd->v));
+				printf("%d\n", *((int *) fmt_v(fd)));
 				break;
 			case 2: {		/* dblrepbar */
 				int v;
@@ -549,12 +561,12 @@ static char *yn[2] = {"no","yes"};
 			}
 			break;
 		case FORMAT_R:
-			printf("%.2f\n", *((float *) fd->v));
+			printf("%.2f\n", *((float *) fmt_v(fd)));
 			break;
 		case FORMAT_F: {
 			struct FONTSPEC *s;
 
-			s = (struct FONTSPEC *) fd->v;
+			s = (struct FONTSPEC *) fmt_v(fd);
 			printf("%s", fontnames[s->fnum]);
 			printf(" %s", font_enc[s->fnum] ? "native" : "utf-8");
 			printf(" %.1f", s->size);
@@ -567,9 +579,9 @@ static char *yn[2] = {"no","yes"};
 		}
 		case FORMAT_U:
 			if (fd->subtype == 0)
-				printf("%.2f\n", *((float *) fd->v));
+				printf("%.2f\n", *((float *) fmt_v(fd)));
 			else if (fd->subtype == 1)
-				printf("%.2fcm\n", *((float *) fd->v) / (1 CM));
+				printf("%.2fcm\n", *((float *) fmt_v(fd)) / (1 CM));
 			else //if (fd->subtype == 2)
 				printf("%.2fcm\n",
 					(cfmt.pagewidth
@@ -579,7 +591,7 @@ static char *yn[2] = {"no","yes"};
 			break;
 		case FORMAT_S:
 			printf("\"%s\"\n",
-				*((char **) fd->v) != 0 ? *((char **) fd->v) : "");
+				*((char **) fmt_v(fd)) != 0 ? *((char **) fmt_v(fd)) : "");
 			break;
 		}
 	}
@@ -744,7 +756,8 @@ static void g_fspc(char *p,
 		 fsize);
 	if (file_initialized <= 0)
 		used_font[f->fnum] = 1;
-	if (f - cfmt.font_tb == outft)
+	if (f - cfmt.font_tb == outft
+	 || OUTFT_UNSURE(f - cfmt.font_tb) == outft)
 		outft = -1;
 #ifdef HAVE_PANGO
 	pg_reset_font();
@@ -1114,9 +1127,9 @@ void interpret_fmt_line(char *w,		/* keyword */
 			for (fd = format_tb; fd->name; fd++)
 				if (strcmp("pagescale", fd->name) == 0)
 					break;
-			if (fd->lock)
+			if (format_lock[fd - format_tb])
 				return;
-			fd->lock = lock;
+			format_lock[fd - format_tb] = lock;
 			f = strtod(p, &q);
 			if (*q != '\0' && *q != ' ')
 				goto bad;
@@ -1162,8 +1175,8 @@ void interpret_fmt_line(char *w,		/* keyword */
 	}
 
 	if (lock)
-		fd->lock = 1;
-	else if (fd->lock)
+		format_lock[fd - format_tb] = 1;
+	else if (format_lock[fd - format_tb])
 		return;
 
 	switch (fd->type) {
@@ -1180,7 +1193,7 @@ void interpret_fmt_line(char *w,		/* keyword */
 		default:
 		case 0:
 		case 3:				/* %%abc2pscompat */
-			*((int *) fd->v) = get_bool(p);
+			*((int *) fmt_v(fd)) = get_bool(p);
 			if (fd->subtype == 3) {
 				if (cfmt.abc2pscompat)
 					deco['M'] = "tenuto";
@@ -1252,9 +1265,9 @@ void interpret_fmt_line(char *w,		/* keyword */
 		else if (fd->subtype == 4 && !isdigit(*p)) /* textoption */
 			cfmt.textoption = get_textopt(p);
 		else if (isdigit(*p) || *p == '-' || *p == '+')
-			sscanf(p, "%d", (int *) fd->v);
+			sscanf(p, "%d", (int *) fmt_v(fd));
 		else
-			*((int *) fd->v) = get_bool(p);
+			*((int *) fmt_v(fd)) = get_bool(p);
 		if (fd->subtype == 4) {			/* textoption */
 			if (cfmt.textoption < 0) {
 				cfmt.textoption = 0;
@@ -1299,12 +1312,12 @@ void interpret_fmt_line(char *w,		/* keyword */
 				goto bad;
 			break;
 		}
-		*((float *) fd->v) = f;
+		*((float *) fmt_v(fd)) = f;
 		break;
 	case FORMAT_F: {
 		int b;
 
-		g_fspc(p, (struct FONTSPEC *) fd->v);
+		g_fspc(p, (struct FONTSPEC *) fmt_v(fd));
 		b = strstr(p, "box") != NULL;
 		switch (fd->subtype) {
 		case 1:
@@ -1320,7 +1333,7 @@ void interpret_fmt_line(char *w,		/* keyword */
 		break;
 	    }
 	case FORMAT_U:
-		*((float *) fd->v) = scan_u(p, fd->subtype);
+		*((float *) fmt_v(fd)) = scan_u(p, fd->subtype);
 		switch (fd->subtype) {
 		case 2:					/* staffwidth */
 			f = (cfmt.landscape ? cfmt.pageheight : cfmt.pagewidth)
@@ -1334,11 +1347,11 @@ void interpret_fmt_line(char *w,		/* keyword */
 		break;
 	case FORMAT_S:
 		i = strlen(p) + 1;
-		*((char **) fd->v) = getarena(i);
+		*((char **) fmt_v(fd)) = getarena(i);
 		if (*p == '"')
-			get_str(*((char **) fd->v), p, i);
+			get_str(*((char **) fmt_v(fd)), p, i);
 		else
-			strcpy(*((char **) fd->v), p);
+			strcpy(*((char **) fmt_v(fd)), p);
 		break;
 	}
 	return;
@@ -1352,11 +1365,22 @@ void lock_fmt(void *fmt)
 	struct format *fd;
 
 	for (fd = format_tb; fd->name; fd++)
-		if (fd->v == fmt)
+		if (fmt_v(fd) == fmt)
 			break;
 	if (fd->name == 0)
 		return;
-	fd->lock = 1;
+	format_lock[fd - format_tb] = 1;
+}
+
+/* -- check if a name is the one of a format parameter -- */
+int is_fmt_param(char *w)
+{
+	struct format *fd;
+
+	for (fd = format_tb; fd->name; fd++)
+		if (strcmp(w, fd->name) == 0)
+			return 1;
+	return 0;
 }
 
 /* -- start a new font -- */
@@ -1367,6 +1391,10 @@ void set_font(int ft)
 
 	if (ft == outft)
 		return;
+	if (job_capt()) {		/* output font known at replay time */
+		job_font(ft, EV_FONT);
+		return;
+	}
 	f = &cfmt.font_tb[ft];
 	if (outft >= 0) {
 		f2 = &cfmt.font_tb[outft];
@@ -1397,6 +1425,14 @@ void set_font(int ft)
 	a2b("%.1f F%d ", f->size, fnum);
 }
 
+/* -- get the number of fonts and the format locks (jobs.c) -- */
+int font_state(char **lock, int *nlock)
+{
+	*lock = format_lock;
+	*nlock = sizeof format_lock;
+	return nfontnames;
+}
+
 /* -- get the encoding of a font -- */
 int get_font_encoding(int ft)
 {
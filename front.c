@@ -22,14 +22,27 @@
 #define strdup _strdup
 #endif
 
+/* scan the text by 16 bytes when possible */
+#if defined(__SSE2__) && defined(__GNUC__) && !defined(__SANITIZE_ADDRESS__)
+#define SCAN_SSE2 1
+#include <stdint.h>
+#include <emmintrin.h>
+#endif
+
 #include "abcm2ps.h"
 
-static unsigned char *dst;
-static int offset, size;
-static unsigned char *selection;
-static int latin, skip;
-static char prefix[4] = {'%'};
-static int state;
+static TLS unsigned char *dst;
+static TLS int offset, size;
+static TLS unsigned char *selection;
+static TLS regex_t sel_re;		/* compiled regular expression */
+static TLS int sel_re_ok;		/*  of the selection */
+static TLS int latin, skip;
+static TLS int enc_known;		/* encoding known (by guess or %%encoding) */
+static TLS int fe_part;			/* part of a stream (see frontend_stream) */
+#define FE_CONT 1			/*  not the first part */
+#define FE_MORE 2			/*  not the last part */
+static TLS char prefix[4] = {'%'};
+static TLS int state;
 
 /*
  * translation table from the ABC draft version 2
@@ -110,8 +123,8 @@ static void txt_add(unsigned char *s, int sz)
 		else
 			dst = realloc(dst, size);
 		if (!dst) {
-			fprintf(stderr, "Out of memory - abort\n");
-			exit(EXIT_FAILURE);
+			fprintf(err_out(), "Out of memory - abort\n");
+			fatal_exit(EXIT_FAILURE);
 		}
 	}
 	memcpy(dst + offset, s, sz);
@@ -376,10 +389,92 @@ static void txt_add_eos(char *fname, int linenum)
 		return;
 	}
 	txt_add(&eos, 1);
+	stats_mem(MEM_TEXT, offset, size);
+	stats_begin(ST_ABC_PARSE);
 	abc_parse((char *) dst, fname, linenum);
+	stats_end(ST_ABC_PARSE);
 	offset = 0;
 }
 
+#ifdef SCAN_SSE2
+/* the aligned loads do not cross a page boundary, so that reading
+ * after the null byte at end of text is safe */
+#define SCAN_START(p, a, m) \
+	a = (unsigned char *) ((uintptr_t) (p) & ~(uintptr_t) 15); \
+	m = 0xffff << ((p) - a)
+#define EQ(v, c) _mm_cmpeq_epi8(v, _mm_set1_epi8(c))
+#endif
+
+/* -- get the end of a line -- */
+/* '*cnv' is set when the line contains characters to be converted */
+static unsigned char *line_end(unsigned char *p, int *cnv)
+{
+#ifdef SCAN_SSE2
+	__m128i v;
+	unsigned char *a;
+	unsigned m, eol, esc;
+
+	SCAN_START(p, a, m);
+	for (;;) {
+		v = _mm_load_si128((__m128i *) a);
+		eol = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(EQ(v, '\0'),
+								EQ(v, '\n')),
+						EQ(v, '\r'))) & m;
+		esc = _mm_movemask_epi8(_mm_or_si128(EQ(v, '\\'), EQ(v, '%')));
+		if (latin > 0)
+			esc |= _mm_movemask_epi8(v);	/* non ASCII */
+		esc &= m;
+		if (eol) {
+			eol &= -eol;			/* first end of line */
+			if (esc & (eol - 1))
+				*cnv = 1;
+			return a + __builtin_ctz(eol);
+		}
+		if (esc)
+			*cnv = 1;
+		a += 16;
+		m = 0xffff;
+	}
+#else
+	while (*p != '\0'
+	    && *p != '\r'
+	    && *p != '\n') {
+		if (*p == '\\'
+		 || *p == '%'
+		 || (latin > 0 && *p >= 0x80))
+			*cnv = 1;
+		p++;
+	}
+	return p;
+#endif
+}
+
+/* -- get the next '\', non ASCII or null character -- */
+static unsigned char *enc_next(unsigned char *p)
+{
+#ifdef SCAN_SSE2
+	__m128i v;
+	unsigned char *a;
+	unsigned m;
+
+	SCAN_START(p, a, m);
+	for (;;) {
+		v = _mm_load_si128((__m128i *) a);
+		m &= _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(EQ(v, '\0'),
+								EQ(v, '\\')),
+						v));
+		if (m)
+			return a + __builtin_ctz(m);
+		a += 16;
+		m = 0xffff;
+	}
+#else
+	while (*p != '\0' && *p != '\\' && *p < 0x80)
+		p++;
+	return p;
+#endif
+}
+
 /* get the ABC version */
 static void get_vers(char *p)
 {
@@ -392,45 +487,106 @@ static void get_vers(char *p)
 	parse.abc_vers = (i << 16) + (j << 8) + k;
 }
 
+/* check if a tune number is in the list of the selection */
+/* return the end of the list */
+static unsigned char *sel_list(unsigned char *sel,
+				int tune_number,
+				int *found)
+{
+	int cur_sel, end_sel, n;
+
+	*found = 0;
+	for (;;) {
+		if (sscanf((char *) sel, "%d%n", &cur_sel, &n) != 1)
+			break;
+		sel += n;
+		if (*sel == '-') {
+			sel++;
+			if (sscanf((char *) sel, "%d%n", &end_sel, &n) != 1)
+				end_sel = ~0u >> 1;
+			else
+				sel += n;
+		} else {
+			end_sel = cur_sel;
+		}
+		if (tune_number >= cur_sel && tune_number <= end_sel) {
+			*found = 1;
+			break;
+		}
+		if (*sel != ',')
+			break;
+		sel++;
+	}
+	return sel;
+}
+
+/* compile the regular expression of the selection */
+static void sel_compile(void)
+{
+	unsigned char *sel;
+	int found;
+
+	if (sel_re_ok) {
+		regfree(&sel_re);
+		sel_re_ok = 0;
+	}
+	sel = selection;
+	if (!sel)
+		return;
+	if (isdigit(*sel)) {
+		sel = sel_list(sel, -1, &found);
+		if (*sel == '\0')
+			return;
+	}
+	sel_re_ok = regcomp(&sel_re, (char *) sel,
+			REG_EXTENDED | REG_NEWLINE | REG_NOSUB) == 0;
+}
+
+/* check if a tune is selected by its X: number only */
+/* return 1 if selected, 0 if not selected
+ * and -1 if the tune header must be checked */
+int sel_xnum(int xnum)
+{
+	unsigned char *sel;
+	int found;
+
+	sel = selection;
+	if (!sel)
+		return 1;
+	if (!isdigit(*sel))
+		return -1;
+	sel = sel_list(sel, xnum, &found);
+	if (found)
+		return 1;
+	return *sel == '\0' ? 0 : -1;
+}
+
 /* check if the current tune is to be selected */
 static int tune_select(unsigned char *s)
 {
-	regex_t r;
 	unsigned char *p, *sel;
-	int ret;
+	int found;
+#ifdef REG_STARTEND
+	regmatch_t pm;
+#else
+	static TLS char *hdr;
+	static TLS int hdr_sz;
+#endif
 
 	/* if there is a list of tune indexes,
 	 * check the tune index */
 	sel = selection;
 	if (isdigit(*sel)) {
-		int tune_number, cur_sel, end_sel, n;
 
 		/* get the tune number ('s' points to X:) */
-		tune_number = strtod((char *) s + 2, 0);
-
-		/* search it in the number list */
-		for (;;) {
-			if (sscanf((char *) sel, "%d%n", &cur_sel, &n) != 1)
-				break;
-			sel += n;
-			if (*sel == '-') {
-				sel++;
-				if (sscanf((char *) sel, "%d%n", &end_sel, &n) != 1)
-					end_sel = ~0u >> 1;
-				else
-					sel += n;
-			} else {
-				end_sel = cur_sel;
-			}
-			if (tune_number >= cur_sel && tune_number <= end_sel)
-				return 1;
-			if (*sel != ',')
-				break;
-			sel++;
-		}
+		sel = sel_list(sel, strtod((char *) s + 2, 0), &found);
+		if (found)
+			return 1;
 		if (*sel == '\0')
 			return 0;
 	}
+	if (!sel_re_ok)
+		return 0;
 
 	for (p = s + 2; ; p++) {
 		switch (*p) {
@@ -452,21 +608,24 @@ static int tune_select(unsigned char *s)
 		break;
 	}
 
-	ret = p - s;
-	if (ret >= TEX_BUF_SZ - 1) {
-		fprintf(stderr, "Tune header too big for %%%%select\n");
-		return 0;
+	/* match the tune header in place */
+#ifdef REG_STARTEND
+	pm.rm_so = 0;
+	pm.rm_eo = p - s;
+	return regexec(&sel_re, (char *) s, 1, &pm, REG_STARTEND) == 0;
+#else
+	if (p - s >= hdr_sz) {
+		hdr_sz = (p - s + 1024) & ~1023;
+		hdr = realloc(hdr, hdr_sz);
+		if (!hdr) {
+			hdr_sz = 0;
+			return 0;
+		}
 	}
-	memcpy(tex_buf, s, ret);
-	tex_buf[ret] = '\0';
-
-	ret = regcomp(&r, (char *) sel,
-				REG_EXTENDED | REG_NEWLINE | REG_NOSUB);
-	if (ret)
-		return 0;
-	ret = regexec(&r, tex_buf, 0, NULL, 0);
-	regfree(&r);
-	return !ret;
+	memcpy(hdr, s, p - s);
+	hdr[p - s] = '\0';
+	return regexec(&sel_re, hdr, 0, NULL, 0) == 0;
+#endif
 }
 
 /* -- front end parser -- */
@@ -475,17 +634,26 @@ void frontend(unsigned char *s,
 		char *fname,
 		int linenum)
 {
-	unsigned char *p, *q, c, *begin_end, sep;
-	int i, l, str_cnv_p, histo, end_len;
+	unsigned char *p, *q, c, *begin_end, *fn;
+	unsigned char *tune_s, *tune_e;	/* skipped tune (jobs.c) */
+	int i, l, str_cnv_p, histo, end_len, part;
+	int tune_ln, tune_eln, job_again;
 	char prefix_sav[4];
 	int latin_sav = 0;		/* have C compiler happy */
 
+	stats_begin(ST_FRONTEND);
 	begin_end = NULL;
 	end_len = 0;
 	histo = 0;
+	tune_s = tune_e = NULL;
+	tune_ln = tune_eln = 0;
+	job_again = 0;
 //	state = 0;
+	part = fe_part;			/* (not for the included files) */
+	fe_part = 0;
 
 	if (ftype == FE_ABC
+	 && !(part & FE_CONT)
 	 && strncmp((char *) s, "%abc-", 5) == 0) {
 		get_vers((char *) s + 5);
 		while (*s != '\0'
@@ -501,11 +669,15 @@ void frontend(unsigned char *s,
 	}
 
 	/* if unknown encoding, check if latin1 or utf-8 */
-	if (ftype == FE_ABC
+	if ((part & FE_CONT) && enc_known) {
+		;				/* same as the previous parts */
+	} else if (ftype == FE_ABC
 	 && parse.abc_vers >= ((2 << 16) | (1 << 8))) {	// if ABC version >= 2.1
 		latin = 0;				// always UTF-8
+		enc_known = 1;
 	} else {
-		for (p = s; *p != '\0'; p++) {
+		enc_known = 0;
+		for (p = s; *(p = enc_next(p)) != '\0'; p++) {
 			c = *p;
 			if (c == '\\') {
 				if (!isdigit(p[1]))
@@ -514,10 +686,12 @@ void frontend(unsigned char *s,
 				 && p[2] == '0')	/* accidental */
 					continue;
 				latin = 1;
+				enc_known = 1;
 				break;
 			}
 			if (c < 0x80)
 				continue;
+			enc_known = 1;
 			if (c >= 0xc2) {
 				if ((p[1] & 0xc0) == 0x80) {
 					latin = 0;
@@ -532,20 +706,12 @@ void frontend(unsigned char *s,
 
 	/* scan the file */
 	skip = 0;
+again:
 	while (*s != '\0') {
 
 		/* get a line */
 		str_cnv_p = 0;
-		p = s;
-		while (*p != '\0'
-		    && *p != '\r'
-		    && *p != '\n') {
-			if (*p == '\\'
-			 || *p == '%'
-			 || (latin > 0 && *p >= 0x80))
-				str_cnv_p = 1;
-			p++;
-		}
+		p = line_end(s, &str_cnv_p);
 		l = p - s;
 		if (*p != '\0') {
 			p++;
@@ -554,6 +720,25 @@ void frontend(unsigned char *s,
 		}
 		linenum++;
 
+		if (skip == 2) {			/* tune of an other thread */
+			switch (job_skip(s, l, (char *) prefix)) {
+			case 0:				/* end of tune */
+				skip = 0;
+				if (job_mode)
+					break;
+
+				/* main thread: treat the X: line only */
+				tune_e = s;
+				tune_eln = linenum - 1;
+				job_again = 2;
+				p = tune_s;
+				linenum = tune_ln;
+				goto ignore;
+			case 2:				/* global change */
+				skip = 0;
+				goto redo;
+			}
+		}
 		if (skip) {
 			if (l != 0)
 				goto ignore;
@@ -604,9 +789,10 @@ void frontend(unsigned char *s,
 			default:
 				goto ignore;
 			case 1:
-				fprintf(stderr,
-					"Line %d: Empty line in tune header - K:C added\n",
-					linenum);
+				if (!job_quiet())
+					fprintf(err_out(),
+						"Line %d: Empty line in tune header - K:C added\n",
+						linenum);
 				txt_add((unsigned char *) "K:C", 3);
 				txt_add_eos(fname, linenum);
 				/* fall thru */
@@ -715,6 +901,7 @@ pcinfo:
 					q = s + 12;
 				while (*q == ' ' || *q == '\t')
 					q++;
+				enc_known = 1;
 				if (strncasecmp((char *) q, "latin", 5) == 0) {
 					q += 5;
 				} else if (strncasecmp((char *) q, "iso-8859-", 9) == 0) {
@@ -767,16 +954,21 @@ pcinfo:
 					q++;
 				while (q[-1] == ' ')
 					q--;
-				sep = *q;
-				*q = '\0';
+				fn = malloc(q - s + 1);	/* (the input may be read-only) */
+				if (!fn) {
+					fprintf(err_out(), "Out of memory - abort\n");
+					fatal_exit(EXIT_FAILURE);
+				}
+				memcpy(fn, s, q - s);
+				fn[q - s] = '\0';
 				skip_sav = skip;
 //fixme: pb when different encoding in included file: != behaviour .fmt or .abc...
 //				latin_sav = latin;
 				offset = 0;
-				include_file(s);
+				include_file(fn);
 //				latin = latin_sav;
 				skip = skip_sav;
-				*q = sep;
+				free(fn);
 				goto ignore;
 			}
 			if (strncmp((char *) s, "select", 6) == 0) {
@@ -804,11 +996,11 @@ pcinfo:
 					selection = NULL;
 				}
 				if (q != s) {
-					sep = *q;
-					*q = '\0';
-					selection = (unsigned char *) strdup((char *) s);
-					*q = sep;
+					selection = malloc(q - s + 1);
+					memcpy(selection, s, q - s);
+					selection[q - s] = '\0';
 				}
+				sel_compile();
 				offset = 0;
 				goto ignore;
 			}
@@ -827,25 +1019,48 @@ info:
 			case 'X':
 				switch (state) {
 				case 1:
-					fprintf(stderr,
-						"Line %d: X: found in tune header - K:C added\n",
-						linenum);
+					if (!job_quiet())
+						fprintf(err_out(),
+							"Line %d: X: found in tune header - K:C added\n",
+							linenum);
 					txt_add((unsigned char *) "K:C", 3);
 					txt_add_eos(fname, linenum);
 					txt_add_eos(fname, linenum);	/* empty line */
 					break;
 				case 2:
 					txt_add_eos(fname, linenum);	/* no empty line - minor error */
+					if (jobs > 1 && job_redo())
+						goto redo;
 					break;
 				}
-				if (selection) {
+				if (job_again) {		/* tune seen again */
+					;
+				} else if (selection) {
 					skip = !tune_select(s);
-					if (skip)
+					if (skip) {
+						q = idx_tune_end(s, &linenum);
+						if (q)
+							p = q;	/* skip the tune */
 						goto ignore;
+					}
+				}
+				if (jobs > 1 && !job_again && job_tune()) {
+					skip = 2;
+					state = 0;
+					tune_s = s;
+					tune_ln = linenum - 1;
+					goto ignore;
 				}
 				state = 1;
 				strcpy(prefix_sav, prefix);
 				latin_sav = latin;
+				if (job_again == 2) {	/* rendered by a worker */
+					job_skeleton();
+					state = 2;
+					job_again = 3;
+				} else {
+					job_again = 0;
+				}
 				break;
 			case 'U':
 				break;
@@ -884,18 +1099,172 @@ next:
 		else
 next_eol:
 			txt_add_eos(fname, linenum);
+		if (job_again == 3) {		/* go to the end of the tune */
+			txt_add((unsigned char *) "K:C", 3);
+			txt_add_eos(fname, linenum);
+			job_again = 0;
+			p = tune_e;
+			linenum = tune_eln;
+		} else if (jobs > 1 && job_redo()) {
+redo:						/* parse the skipped tune */
+			state = 0;
+			job_again = 1;
+			p = tune_s;
+			linenum = tune_ln;
+		}
 ignore:
 		s = p;
 	}
-	if (begin_end)
-		fprintf(stderr,
+	if (skip == 2) {		/* end of file in a skipped tune */
+		skip = 0;
+		job_skip(NULL, 0, NULL);
+		if (!job_mode) {
+			tune_e = s;
+			tune_eln = linenum;
+			job_again = 2;
+			s = tune_s;
+			linenum = tune_ln;
+			goto again;
+		}
+	}
+	if (part & FE_MORE) {
+		stats_end(ST_FRONTEND);
+		return;				/* the stream goes on */
+	}
+	if (begin_end && !job_quiet())
+		fprintf(err_out(),
 			"Line %d: No %%%%end after %%%%begin\n",
 			linenum);
-	if (ftype == FE_FMT)
+	if (ftype == FE_FMT) {
+		stats_end(ST_FRONTEND);
 		return;
-	if (state == 1)
-		fprintf(stderr,
+	}
+	if (state == 1 && !job_quiet())
+		fprintf(err_out(),
 			"Line %d: Unexpected EOF in header definition\n",
 			linenum);
+	if (state != 0) {		/* the tune ends with the file */
+		state = 0;
+		strcpy(prefix, prefix_sav);
+		latin = latin_sav;
+	}
 	abc_eof();
+	if (jobs > 1 && job_redo()) {
+		job_again = 1;
+		s = tune_s;
+		linenum = tune_ln;
+		goto again;
+	}
+	stats_end(ST_FRONTEND);
+}
+
+/* -- treat an ABC stream tune by tune -- */
+/* the text is cut before the X: lines which follow an empty line
+ * out of %%begin/%%end sequences, and each part is treated
+ * as soon as it is read */
+void frontend_stream(FILE *f, char *fname)
+{
+	unsigned char *buf, *p, *e, *line, c;
+	int size, len, linenum, nl, off, part, empty, in_block, eof;
+
+	size = 65536;
+	buf = malloc(size + 1);
+	if (!buf) {
+		fprintf(err_out(), "Out of memory - abort\n");
+		fatal_exit(EXIT_FAILURE);
+	}
+	len = 0;
+	linenum = 0;
+	nl = 0;				/* number of lines of the current part */
+	part = 0;
+	empty = 0;			/* previous line empty */
+	in_block = 0;
+	eof = 0;
+	p = buf;			/* start of the next line to check */
+	while (!eof) {
+		if (size - len < 256) {
+			off = p - buf;
+			size *= 2;
+			buf = realloc(buf, size + 1);
+			if (!buf) {
+				fprintf(err_out(), "Out of memory - abort\n");
+				fatal_exit(EXIT_FAILURE);
+			}
+			p = buf + off;
+		}
+
+		/* read by lines for a pipe to be treated without delay */
+		if (fgets((char *) buf + len, size - len + 1, f)) {
+			len += strlen((char *) buf + len);
+		} else {
+			eof = 1;
+			if (ferror(f))
+				error(1, NULL, "Read error on %s", fname);
+		}
+		e = buf + len;
+
+		/* check the complete lines */
+		for (;;) {
+			line = p;
+			while (p < e && *p != '\n' && *p != '\r')
+				p++;
+			if (p == e
+			 || (*p == '\r' && p + 1 == e && !eof)) {
+				p = line;	/* (incomplete line) */
+				break;
+			}
+			if (line[0] == 'X' && line[1] == ':'
+			 && empty && !in_block && line != buf) {
+
+				/* treat the previous tunes */
+				c = *line;
+				*line = '\0';
+				fe_part = part | FE_MORE;
+				frontend(buf, FE_ABC, fname, linenum);
+				*line = c;
+				part = FE_CONT;
+				linenum += nl;
+				nl = 0;
+				if (fout)
+					fflush(fout);
+				len -= line - buf;
+				memmove(buf, line, len);
+				p -= line - buf;
+				line = buf;
+				e = buf + len;
+			}
+			nl++;
+			if (strncmp((char *) line, "%%begin", 7) == 0)
+				in_block = 1;
+			else if (strncmp((char *) line, "%%end", 5) == 0)
+				in_block = 0;
+			empty = 1;
+			while (line < p) {
+				if (!isspace(*line++)) {
+					empty = 0;
+					break;
+				}
+			}
+			p++;
+			if (p[-1] == '\r' && p < e && *p == '\n')
+				p++;
+		}
+	}
+
+	/* treat the last tunes */
+	buf[len] = '\0';
+	fe_part = part;
+	frontend(buf, FE_ABC, fname, linenum);
+	free(buf);
+}
+
+/* -- free the memory of the front end -- */
+void frontend_free(void)
+{
+	free(dst);
+	dst = NULL;
+	offset = size = 0;
+	free(selection);
+	selection = NULL;
+	sel_compile();
 }
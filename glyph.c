@@ -154,7 +154,7 @@ static char ***f0[64] = {
 };
 
 /* 1st character - c2..ff */
-static char **utf_1[62] = {
+static TLS char **utf_1[62] = {
 			c2,	c3,	c4,	c5,	NULL,	NULL,
 	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	ce,	NULL,
 	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,
@@ -206,6 +206,29 @@ char *glyph_out(char *p)
 	return p;
 }
 
+/* -- get a glyph table which may be changed -- */
+/* the static tables are shared by all the threads, so, copy them */
+static char **glyph_tb(char **g)
+{
+	static char **shared_tb[] = {
+		c2, c3, c4, c5, ce, e299, (char **) e2,
+		f09d84, (char **) f09d, (char **) f0
+	};
+	char **new_g;
+	unsigned i;
+
+	if (!g)
+		return calloc(64, sizeof(char **));
+	for (i = 0; i < sizeof shared_tb / sizeof shared_tb[0]; i++) {
+		if (g == shared_tb[i]) {
+			new_g = malloc(64 * sizeof(char **));
+			memcpy(new_g, g, 64 * sizeof(char **));
+			return new_g;
+		}
+	}
+	return g;
+}
+
 /* -- add a glyph -- */
 /* %%glyph hex_value glyph_name */
 void glyph_add(char *p)
@@ -236,28 +259,19 @@ void glyph_add(char *p)
 		i3 = (val >> 6) & 0x3f;
 		i4 = val & 0x3f;
 	}
-	g1 = utf_1[i1];
-	if (!g1) {
-		g1 = calloc(64, sizeof(char **));
-		utf_1[i1] = g1;
-	}
+	g1 = glyph_tb(utf_1[i1]);
+	utf_1[i1] = g1;
 	if (i3 < 0) {
 		g1[i2] = strdup(p);
 		return;
 	}
-	g = (char **) g1[i2];
-	if (!g) {
-		g = calloc(64, sizeof(char **));
-		g1[i2] = (char *) g;
-	}
+	g = glyph_tb((char **) g1[i2]);
+	g1[i2] = (char *) g;
 	if (i4 < 0) {
 		g[i3] = strdup(p);
 		return;
 	}
-	g1 = (char **) g[i3];
-	if (!g1) {
-		g1 = calloc(64, sizeof(char **));
-		g[i3] = (char *) g1;
-	}
+	g1 = glyph_tb((char **) g[i3]);
+	g[i3] = (char *) g1;
 	g1[i4] = strdup(p);
 }
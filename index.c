@@ -0,0 +1,331 @@
+/*
+ * Index of the tunes of the ABC files for the tune selection.
+ *
+ * This file is part of abcm2ps.
+ *
+ * Copyright (C) 2016 Jean-François Moine
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * When a tune is not selected, the front end ignores all the lines
+ * up to the next empty line. The index gives, for each X: line of the
+ * file, the offset of this empty line and the X: number, so that the
+ * tune is skipped without scanning it. When the next tunes
+ * are not selected either by their X: number and when there is nothing
+ * but empty lines between them, they are skipped at the same time:
+ * the front end goes straight to the next selected tune.
+ * The index is built on the first skipped tune. It may be kept in
+ * a file '<ABC file>.idx' (option '-y') which is used by the next runs
+ * when the size, the date (with nanoseconds) and the hash of the whole
+ * ABC file did not change, and when the X: lines are at the offsets
+ * of the index.
+ * The tunes selected by a regular expression are checked by the front
+ * end on their header, so the index does not keep the titles.
+ *
+ * index file (binary, native byte order and sizes):
+ *	struct idx_hdr
+ *	struct tune[ntunes]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "abcm2ps.h"
+
+#define IDX_MAGIC "a2psidx\003"		/* (8 bytes) */
+
+TLS int idx_write;			/* write the index files (-y) */
+
+struct idx_hdr {			/* header of the index file */
+	char magic[8];
+	int hdr_sz;			/* size of the header */
+	int tune_sz;			/* size of a tune */
+	long size;			/* size of the ABC file */
+	long mtime;			/* date of the ABC file */
+	long mtime_ns;			/* (nanoseconds) */
+	uint64_t hash;			/* hash of the file */
+	int ntunes;			/* number of tunes */
+};
+
+struct tune {				/* tune in the index */
+	long start;			/* offset of the X: line */
+	long end;			/* offset of the empty line or of EOF */
+	int line;			/* line number of the X: line (from 0) */
+	int nlines;			/* number of lines from start to end */
+	int xnum;			/* X: value */
+	int glob;			/* not empty lines before the tune */
+};
+
+static TLS char *idx_fn;		/* ABC file */
+static TLS unsigned char *idx_base;	/* file contents */
+static TLS long idx_size;
+static TLS time_t idx_mtime;
+static TLS long idx_mtime_ns;
+static TLS struct tune *idx_tb;		/* index - NULL if not yet built */
+static TLS int ntunes;
+
+/* -- free the index -- */
+static void idx_free(void)
+{
+	free(idx_tb);
+	idx_tb = NULL;
+	ntunes = 0;
+}
+
+/* -- hash the ABC file -- */
+/* (FNV-1a on 64 bits words) */
+static uint64_t idx_hash(void)
+{
+	unsigned char *p, *e;
+	uint64_t h, w;
+
+	h = 14695981039346656037ULL;
+	p = idx_base;
+	e = p + (idx_size & ~7L);
+	while (p < e) {
+		memcpy(&w, p, sizeof w);
+		h = (h ^ w) * 1099511628211ULL;
+		p += sizeof w;
+	}
+	e = idx_base + idx_size;
+	while (p < e)
+		h = (h ^ *p++) * 1099511628211ULL;
+	return h;
+}
+
+/* -- build the index scanning the file -- */
+static int idx_build(void)
+{
+	unsigned char *p, *e, *line;
+	int max, nl, open, glob;
+	struct tune *t;
+
+	max = 64;
+	idx_tb = malloc(max * sizeof *idx_tb);
+	if (!idx_tb)
+		return 0;
+	ntunes = 0;
+	open = 0;			/* first tune without end */
+	glob = 0;			/* not empty line out of the tunes */
+	nl = 0;				/* line number */
+	p = idx_base;
+	e = p + idx_size;
+	while (p < e) {
+		line = p;
+		while (p < e && *p != '\n' && *p != '\r')
+			p++;
+		if (p == line) {		/* empty line */
+			for ( ; open < ntunes; open++) {
+				t = &idx_tb[open];
+				t->end = line - idx_base;
+				t->nlines = nl - t->line;
+			}
+		} else if (line[0] == 'X' && p - line >= 2 && line[1] == ':') {
+			if (ntunes >= max) {
+				max *= 2;
+				t = realloc(idx_tb, max * sizeof *idx_tb);
+				if (!t)
+					return 0;
+				idx_tb = t;
+			}
+			t = &idx_tb[ntunes++];
+			t->start = line - idx_base;
+			t->line = nl;
+			t->xnum = strtol((char *) line + 2, NULL, 10);
+			t->glob = glob;
+			glob = 0;
+		} else if (open >= ntunes) {
+			glob = 1;
+		}
+		if (p < e) {
+			p++;
+			if (p[-1] == '\r' && p < e && *p == '\n')
+				p++;
+		}
+		nl++;
+	}
+	for ( ; open < ntunes; open++) {	/* last tune up to EOF */
+		t = &idx_tb[open];
+		t->end = idx_size;
+		t->nlines = nl - t->line;
+	}
+	return 1;
+}
+
+/* -- read the index file -- */
+static int idx_read(char *fn)
+{
+	FILE *f;
+	struct idx_hdr hdr;
+	struct tune *t;
+	int i;
+
+	f = fopen(fn, "rb");
+	if (!f)
+		return 0;
+	if (fread(&hdr, sizeof hdr, 1, f) != 1
+	 || memcmp(hdr.magic, IDX_MAGIC, sizeof hdr.magic) != 0
+	 || hdr.hdr_sz != sizeof hdr
+	 || hdr.tune_sz != sizeof *t
+	 || hdr.size != idx_size
+	 || hdr.mtime != (long) idx_mtime
+	 || hdr.mtime_ns != idx_mtime_ns
+	 || hdr.ntunes < 0 || hdr.ntunes > idx_size / 3
+	 || hdr.hash != idx_hash())
+		goto err;
+	ntunes = hdr.ntunes;
+	idx_tb = malloc((ntunes + 1) * sizeof *idx_tb);
+	if (!idx_tb
+	 || fread(idx_tb, sizeof *idx_tb, ntunes, f) != (size_t) ntunes)
+		goto err;
+
+	/* check that the tunes are where the index says */
+	for (i = 0, t = idx_tb; i < ntunes; i++, t++) {
+		if (t->start < 0 || t->end > idx_size || t->start >= t->end
+		 || (i > 0 && t->start <= t[-1].start)
+		 || idx_base[t->start] != 'X'
+		 || idx_base[t->start + 1] != ':'
+		 || (t->start > 0
+		  && idx_base[t->start - 1] != '\n'
+		  && idx_base[t->start - 1] != '\r')
+		 || (t->end < idx_size
+		  && idx_base[t->end] != '\n' && idx_base[t->end] != '\r'))
+			goto err;
+	}
+	fclose(f);
+	return 1;
+err:
+	idx_free();
+	fclose(f);
+	return 0;
+}
+
+/* -- write the index file -- */
+static void idx_save(char *fn)
+{
+	FILE *f;
+	struct idx_hdr hdr;
+	char tmp_fn[FILENAME_MAX];
+	int err;
+
+	if (strlen(fn) + 5 >= sizeof tmp_fn)
+		return;
+	sprintf(tmp_fn, "%s.tmp", fn);		/* (atomic update) */
+	f = fopen(tmp_fn, "wb");
+	if (!f) {
+		error(0, NULL, "Cannot create the index file %s", fn);
+		return;
+	}
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, IDX_MAGIC, sizeof hdr.magic);
+	hdr.hdr_sz = sizeof hdr;
+	hdr.tune_sz = sizeof *idx_tb;
+	hdr.size = idx_size;
+	hdr.mtime = idx_mtime;
+	hdr.mtime_ns = idx_mtime_ns;
+	hdr.hash = idx_hash();
+	hdr.ntunes = ntunes;
+	fwrite(&hdr, sizeof hdr, 1, f);
+	fwrite(idx_tb, sizeof *idx_tb, ntunes, f);
+	err = ferror(f);
+	if (fclose(f) != 0 || err || rename(tmp_fn, fn) != 0) {
+		remove(tmp_fn);
+		error(0, NULL, "Cannot write the index file %s", fn);
+	}
+}
+
+/* -- load or build the index -- */
+static int idx_load(void)
+{
+	char fn[FILENAME_MAX];
+	int stdin_f;
+
+	stdin_f = strcmp(idx_fn, "stdin") == 0;
+	if (!stdin_f && strlen(idx_fn) + 4 < sizeof fn)
+		sprintf(fn, "%s.idx", idx_fn);
+	else
+		fn[0] = '\0';
+	if (fn[0] != '\0' && idx_read(fn))
+		return 1;
+	if (!idx_build())
+		return 0;
+	if (idx_write && fn[0] != '\0' && !job_mode)
+		idx_save(fn);
+	return 1;
+}
+
+/* -- start treating an ABC file -- */
+void idx_open(char *fn, char *file, long size,
+		time_t mtime, long mtime_ns)
+{
+	idx_fn = fn;
+	idx_base = (unsigned char *) file;
+	idx_size = size;
+	idx_mtime = mtime;
+	idx_mtime_ns = mtime_ns;
+	idx_free();			/* (ABC file included by an other one) */
+}
+
+/* -- end of the ABC file -- */
+void idx_close(void)
+{
+	idx_free();
+	idx_base = NULL;
+}
+
+/* -- get the end of a skipped tune -- */
+/* 's' is the start of the X: line,
+ * '*linenum' is the line number of X: and is updated for the line
+ * before the returned end of tune.
+ * The following tunes which are not selected by their X: number
+ * ('sel_xnum()' returns 0) are skipped at the same time. */
+unsigned char *idx_tune_end(unsigned char *s, int *linenum)
+{
+	struct tune *t, *t2;
+	long off;
+	int lo, hi, i;
+
+	if (!idx_base
+	 || s < idx_base || s >= idx_base + idx_size)
+		return NULL;			/* not in the ABC file */
+	if (!idx_tb) {
+		if (!idx_load()) {
+			idx_base = NULL;
+			return NULL;
+		}
+	}
+	off = s - idx_base;
+	lo = 0;
+	hi = ntunes;
+	for (;;) {
+		if (lo >= hi)
+			return NULL;
+		i = (lo + hi) / 2;
+		t = &idx_tb[i];
+		if (t->start == off)
+			break;
+		if (t->start < off)
+			lo = i + 1;
+		else
+			hi = i;
+	}
+
+	/* skip the next unselected tunes */
+	t2 = t;
+	while (++i < ntunes) {
+		if (idx_tb[i].start < t2->end)
+			continue;		/* (no empty line before X:) */
+		if (idx_tb[i].glob
+		 || sel_xnum(idx_tb[i].xnum) != 0)
+			break;
+		t2 = &idx_tb[i];
+	}
+	*linenum += t2->line - t->line + t2->nlines - 1;
+	return idx_base + t2->end;
+}
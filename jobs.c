@@ -0,0 +1,862 @@
+/*
+ * Rendering of the tunes by many threads (option '-J').
+ *
+ * This file is part of abcm2ps.
+ *
+ * Copyright (C) 2016 Jean-François Moine
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * The worker threads run the program with the same arguments as the
+ * main thread, but they skip the tunes which are not theirs.
+ * When a worker renders a tune, the output is captured: the generated
+ * text is kept in the output buffer and the calls to the page
+ * functions of buffer.c are recorded as events with the current format.
+ * The main thread parses only the X: line of the tunes claimed by
+ * a worker. At the start of such a tune, it checks that the worker had
+ * the same state and replays the events, so that the page breaks, the
+ * page numbers and the fonts are the same as in a serial run.
+ * When something cannot be replayed, the main thread parses and renders
+ * the tune.
+ * When a thread skips a tune which contains a directive changing the
+ * global state, it parses and renders this tune, the output being
+ * dropped in the worker threads.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "abcm2ps.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+TLS int jobs = 1;			/* number of rendering threads */
+TLS int job_mode;			/* 0 (main thread), JOB_WORKER or JOB_CAPT */
+
+#define NDRAW 5				/* size of the drawing state */
+
+struct event {
+	char type;			/* EV_xxx */
+	signed char outft;		/* font in the output file */
+	int fmt;			/* index of the format */
+	int info;			/* index of the information fields */
+	int txt;			/* offset in the output text */
+	int arg;
+	float v;
+};
+
+struct capt {				/* captured tune */
+	int tune;			/* tune number */
+	int fno, linenum;		/* file number and line of X: */
+	int ok;				/* 0 if the tune cannot be replayed */
+	int worker;
+
+	/* state at start of tune */
+	int nfonts;
+	float draw[NDRAW];
+	float space[NFLAGS_SZ];
+	char *lock;
+
+	/* state at end of tune */
+	int outft, defl, ntunes;
+	float e_draw[NDRAW];
+	float e_space[NFLAGS_SZ];
+
+	/* captured data */
+	struct event *ev;
+	int nev, maxev;
+	struct event *sev;		/* events in the side buffer */
+	int nsev, maxsev;
+	struct FORMAT *fmt;
+	int nfmt, maxfmt;
+	INFO *info;
+	int ninfo, maxinfo;
+	char *msg;
+	int lmsg, maxmsg;
+	char *txt;
+	int ltxt;
+	struct tstats *stt;		/* statistics (--stats) */
+};
+
+static TLS int nfile;			/* number of treated ABC files */
+static TLS struct capt *capt;		/* tune being captured */
+static TLS FILE *null_f;		/* messages of the worker threads */
+
+#ifdef HAVE_PTHREAD
+static TLS int ntune;			/* tune number */
+static TLS int capt_tunenum;
+static TLS int m_argc;			/* program arguments (main thread) */
+static TLS char **m_argv;
+static TLS int skel_tune;		/* tune reduced to its X: line */
+static TLS int redo;			/* the tune must be parsed again */
+
+/* shared data */
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t *job_th;		/* worker threads */
+static char *job_retired;		/* worker state (1: stopped) */
+static int nworkers;			/* (changed by the main thread only) */
+static int j_argc;			/* program arguments */
+static char **j_argv;
+static int next_claim;			/* next tune which may be rendered */
+static int main_pos;			/* tune treated by the main thread */
+static int done_files;			/* number of files treated by main */
+static int stop;
+static int nslots;			/* max number of tunes in advance */
+static struct slot {
+	int tune;
+	int state;
+#define SL_FREE 0
+#define SL_CLAIMED 1			/* being rendered by a worker */
+#define SL_DONE 2			/* rendered */
+#define SL_LOST 3			/* not wanted anymore */
+	struct capt *c;
+} *slots;
+
+static TLS int job_id;			/* worker number */
+static TLS int my_tune = -1;		/* tune claimed by the worker */
+
+/* -- free a captured tune -- */
+static void capt_free(struct capt *c)
+{
+	if (!c)
+		return;
+	free(c->lock);
+	free(c->ev);
+	free(c->sev);
+	free(c->fmt);
+	free(c->info);
+	free(c->msg);
+	free(c->txt);
+	free(c->stt);
+	free(c);
+}
+
+/* -- get the state that must be the same in the main and worker threads -- */
+static void state_get(int *nfonts, float *draw, float *space)
+{
+	char *lock;
+	int nlock;
+
+	*nfonts = font_state(&lock, &nlock);
+	get_draw_state(draw);
+	memcpy(space, space_tb, sizeof space_tb);
+}
+
+/* -- deliver the result of a claimed tune (mutex locked) -- */
+static void deliver(struct capt *c)
+{
+	struct slot *sl;
+
+	sl = &slots[my_tune % nslots];
+	if (sl->tune == my_tune && sl->state == SL_CLAIMED) {
+		sl->c = c;
+		sl->state = SL_DONE;
+		pthread_cond_broadcast(&job_cond);
+	} else {
+		if (sl->tune == my_tune && sl->state == SL_LOST)
+			sl->state = SL_FREE;
+		capt_free(c);
+	}
+	my_tune = -1;
+}
+
+/* -- stop the current worker -- */
+static void worker_exit(void)
+{
+	pthread_mutex_lock(&job_mutex);
+	if (my_tune >= 0)
+		deliver(NULL);
+	job_retired[job_id] = 1;
+	pthread_cond_broadcast(&job_cond);
+	pthread_mutex_unlock(&job_mutex);
+	stats_merge();
+
+	/* free the memory areas of the thread */
+	capt_free(capt);
+	capt = NULL;
+	if (null_f) {
+		fclose(null_f);
+		null_f = NULL;
+	}
+	freearena();
+	frontend_free();
+	free_outbuf();
+	free_symbols();
+	free_tex_cache();
+	pthread_exit(NULL);
+}
+
+/* -- worker thread -- */
+static void *worker(void *arg)
+{
+	job_id = (int) (long) arg;
+	job_mode = JOB_WORKER;
+	abcm2ps_main(j_argc, j_argv);
+	worker_exit();
+	return NULL;
+}
+
+/* -- start the worker threads -- */
+static void workers_start(void)
+{
+	int i;
+
+	for (i = 1; i < m_argc; i++) {
+		if (strcmp(m_argv[i], "-") == 0)
+			break;			/* cannot read stdin twice */
+	}
+	if (!m_argv || i < m_argc || epsf == 3 || serve_req) {
+		jobs = 1;
+		return;
+	}
+	nslots = jobs * 4;
+	slots = calloc(nslots, sizeof *slots);
+	job_th = calloc(jobs, sizeof *job_th);
+	job_retired = calloc(jobs, 1);
+	if (!slots || !job_th || !job_retired) {
+		jobs = 1;
+		return;
+	}
+	for (i = 0; i < nslots; i++)
+		slots[i].tune = -1;
+	done_files = nfile;
+	main_pos = ntune;
+	next_claim = ntune + 1;
+	j_argc = m_argc;
+	j_argv = m_argv;
+	for (i = 1; i < jobs; i++) {
+		if (pthread_create(&job_th[i], NULL, worker,
+				(void *) (long) i) != 0) {
+			error(0, NULL, "Cannot create thread %d", i);
+			break;
+		}
+		pthread_mutex_lock(&job_mutex);
+		nworkers++;
+		pthread_mutex_unlock(&job_mutex);
+	}
+	if (nworkers == 0)
+		jobs = 1;
+}
+#endif
+
+/* -- keep the program arguments for the worker threads -- */
+void job_args(int argc, char **argv)
+{
+#ifdef HAVE_PTHREAD
+	m_argc = argc;
+	m_argv = argv;
+#endif
+}
+
+/* -- stop the worker threads at end of program -- */
+void job_stop(void)
+{
+#ifdef HAVE_PTHREAD
+	int i;
+
+	if (job_mode)
+		worker_exit();			/* no return */
+	if (nworkers == 0)
+		return;
+	pthread_mutex_lock(&job_mutex);
+	stop = 1;
+	pthread_cond_broadcast(&job_cond);
+	pthread_mutex_unlock(&job_mutex);
+	for (i = 1; i <= nworkers; i++)
+		pthread_join(job_th[i], NULL);
+	nworkers = 0;
+
+	/* free the tunes which were not used */
+	for (i = 0; i < nslots; i++)
+		capt_free(slots[i].c);
+	free(slots);
+	slots = NULL;
+	free(job_th);
+	job_th = NULL;
+	free(job_retired);
+	job_retired = NULL;
+#endif
+}
+
+/* -- a new tune starts (X:) -- */
+/* return 1 if the tune is to be skipped
+ * (in the main thread, if it is rendered by a worker) */
+int job_tune(void)
+{
+#ifdef HAVE_PTHREAD
+	struct slot *sl;
+	int i, skip;
+
+	ntune++;
+	if (!job_mode) {			/* main thread */
+		if (nworkers == 0) {
+			if (!slots)
+				workers_start();
+			if (nworkers == 0)
+				return 0;
+		}
+		pthread_mutex_lock(&job_mutex);
+		main_pos = ntune;
+		if (next_claim <= ntune)
+			next_claim = ntune + 1;
+
+		/* forget the tunes which were not used */
+		for (i = 0, sl = slots; i < nslots; i++, sl++) {
+			if (sl->tune < 0 || sl->tune >= ntune)
+				continue;
+			if (sl->state == SL_DONE) {
+				capt_free(sl->c);
+				sl->c = NULL;
+				sl->state = SL_FREE;
+			} else if (sl->state == SL_CLAIMED) {
+				sl->state = SL_LOST;
+			}
+		}
+		sl = &slots[ntune % nslots];
+		skip = sl->tune == ntune
+			&& (sl->state == SL_CLAIMED || sl->state == SL_DONE);
+		pthread_cond_broadcast(&job_cond);
+		pthread_mutex_unlock(&job_mutex);
+		return skip;
+	}
+
+	/* worker thread */
+	if (!svg && !epsf)
+		file_initialized = 1;		/* as in the main thread */
+	pthread_mutex_lock(&job_mutex);
+	if (my_tune >= 0)
+		deliver(NULL);
+	while (!stop
+	    && next_claim == ntune
+	    && ntune >= main_pos + nslots)
+		pthread_cond_wait(&job_cond, &job_mutex);
+	if (stop || job_retired[job_id]) {
+		pthread_mutex_unlock(&job_mutex);
+		worker_exit();
+	}
+	skip = 1;
+	if (next_claim <= ntune) {
+		next_claim = ntune + 1;
+		sl = &slots[ntune % nslots];
+		if (sl->state == SL_FREE) {
+			sl->tune = ntune;
+			sl->state = SL_CLAIMED;
+			sl->c = NULL;
+			my_tune = ntune;
+			skip = 0;
+		}
+	}
+	pthread_mutex_unlock(&job_mutex);
+	return skip;
+#else
+	return 0;
+#endif
+}
+
+/* -- check a line of a tune rendered by an other thread -- */
+/* return 0 at end of tune, 1 if the line is skipped or 2 if the tune
+ * must be parsed (directive which changes the global state)
+ * - s is NULL at end of file */
+int job_skip(unsigned char *s, int l, char *prefix)
+{
+	static TLS int in_begin;		/* in %%begin../%%end.. */
+	static const char *stop_tb[] = {
+		"abcm2ps", "abc-version", "beginps", "beginsvg", "select",
+		"format", "abc-include", "encoding", "abc-charset",
+		"deco", "font", "glyph",
+		"tablature", "tune", "voice", "ps", "postscript",
+		NULL
+	};
+	const char **p;
+	int n;
+
+	if (!s) {
+		in_begin = 0;
+		return 0;
+	}
+	if (in_begin) {
+		if (s[0] == '%' && strchr(prefix, s[1])) {
+			s += 2;
+			while (*s == ' ' || *s == '\t')
+				s++;
+			if (strncmp((char *) s, "end", 3) == 0)
+				in_begin = 0;
+		}
+		return 1;
+	}
+	while (l > 0 && isspace(s[l - 1]))
+		l--;
+	if (l == 0
+	 || (s[0] == 'X' && s[1] == ':'))
+		return 0;
+
+	/* the directives which change the global state
+	 * cannot be skipped */
+	if (s[0] == 'I' && s[1] == ':') {
+		s += 2;
+	} else if (s[0] == '%' && strchr(prefix, s[1])) {
+		s += 2;
+	} else {
+		return 1;
+	}
+	while (*s == ' ' || *s == '\t')
+		s++;
+	for (p = stop_tb; *p; p++) {
+		n = strlen(*p);
+		if (strncmp((char *) s, *p, n) == 0
+		 && (s[n] == '\0' || isspace(s[n])))
+			return 2;
+	}
+	if (strncmp((char *) s, "begin", 5) == 0)
+		in_begin = 1;			/* (may contain empty lines) */
+	return 1;
+}
+
+/* -- the tune is reduced to its X: line (main thread) -- */
+void job_skeleton(void)
+{
+#ifdef HAVE_PTHREAD
+	skel_tune = ntune;
+#endif
+}
+
+/* -- check if the tune reduced to its X: line must be parsed -- */
+int job_redo(void)
+{
+#ifdef HAVE_PTHREAD
+	if (redo) {
+		redo = 0;
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+/* -- end of an ABC file -- */
+void job_file_end(void)
+{
+	nfile++;
+#ifdef HAVE_PTHREAD
+	if (!job_mode && nworkers == 0)
+		return;
+	pthread_mutex_lock(&job_mutex);
+	if (!job_mode) {
+		done_files = nfile;
+		pthread_cond_broadcast(&job_cond);
+	} else {
+
+		/* wait for the main thread before freeing the tunes */
+		if (my_tune >= 0)
+			deliver(NULL);
+		while (!stop && done_files < nfile)
+			pthread_cond_wait(&job_cond, &job_mutex);
+		if (stop) {
+			pthread_mutex_unlock(&job_mutex);
+			worker_exit();
+		}
+	}
+	pthread_mutex_unlock(&job_mutex);
+#endif
+}
+
+/* -- the captured tune cannot be replayed -- */
+void job_invalid(void)
+{
+	if (job_mode == JOB_CAPT)
+		capt->ok = 0;
+}
+
+/* -- check if a message must not be output -- */
+int job_quiet(void)
+{
+	job_invalid();
+	return job_mode;
+}
+
+/* -- get the stream of the messages -- */
+/* the messages of the worker threads are lost:
+ * the tune will be rendered again by the main thread */
+FILE *job_err(void)
+{
+	if (!job_mode)
+		return err_out();
+	job_invalid();
+	if (!null_f)
+		null_f = fopen("/dev/null", "w");
+	return null_f ? null_f : err_out();
+}
+
+/* -- check if the output is being captured -- */
+int job_capt(void)
+{
+	return job_mode == JOB_CAPT;
+}
+
+/* -- get a new event -- */
+static struct event *ev_new(struct event **tb, int *n, int *max)
+{
+	if (*n >= *max) {
+		*max = *max ? *max * 2 : 64;
+		*tb = realloc(*tb, *max * sizeof **tb);
+		if (!*tb) {
+			error(1, NULL, "Out of memory - abort");
+			fatal_exit(EXIT_FAILURE);
+		}
+	}
+	return &(*tb)[(*n)++];
+}
+
+/* -- record an event of the captured tune -- */
+/* the events of the side buffer are moved by job_side() */
+void job_event(int type, int arg, float v)
+{
+	struct capt *c = capt;
+	struct event *ev;
+
+	if (!c->ok)
+		return;
+	if (out_side) {				/* (music.c delayed_output) */
+		if (c->nsev > 0 && mbf - outbuf < c->sev[c->nsev - 1].txt) {
+			c->ok = 0;
+			return;
+		}
+	} else if (c->nev > 0 && mbf - outbuf < c->ev[c->nev - 1].txt) {
+		c->ok = 0;
+		return;
+	}
+	if (c->nfmt == 0
+	 || memcmp(&c->fmt[c->nfmt - 1], &cfmt, sizeof cfmt) != 0) {
+		if (c->nfmt >= c->maxfmt) {
+			c->maxfmt = c->maxfmt ? c->maxfmt * 2 : 4;
+			c->fmt = realloc(c->fmt, c->maxfmt * sizeof *c->fmt);
+		}
+		memcpy(&c->fmt[c->nfmt++], &cfmt, sizeof cfmt);
+	}
+	if (c->ninfo == 0
+	 || memcmp(&c->info[c->ninfo - 1], &info, sizeof info) != 0) {
+		if (c->ninfo >= c->maxinfo) {
+			c->maxinfo = c->maxinfo ? c->maxinfo * 2 : 4;
+			c->info = realloc(c->info, c->maxinfo * sizeof *c->info);
+		}
+		memcpy(&c->info[c->ninfo++], &info, sizeof info);
+	}
+	if (!c->fmt || !c->info) {
+		error(1, NULL, "Out of memory - abort");
+		fatal_exit(EXIT_FAILURE);
+	}
+	if (out_side)
+		ev = ev_new(&c->sev, &c->nsev, &c->maxsev);
+	else
+		ev = ev_new(&c->ev, &c->nev, &c->maxev);
+	ev->type = type;
+	ev->outft = outft;
+	ev->fmt = c->nfmt - 1;
+	ev->info = c->ninfo - 1;
+	ev->txt = mbf - outbuf;
+	ev->arg = arg;
+	ev->v = v;
+
+	/* the page functions may reset the output font */
+	if (type >= EV_BLOCK && type <= EV_EPS
+	 && outft >= 0)
+		outft = OUTFT_UNSURE(outft);
+}
+
+/* -- the side buffer is put at offset 'base' of the output buffer -- */
+void job_side(int base)
+{
+	struct capt *c = capt;
+	struct event *ev;
+	int i;
+
+	if (c->ok && c->nsev > 0) {
+		if (c->nev > 0 && base < c->ev[c->nev - 1].txt) {
+			c->ok = 0;
+		} else {
+			for (i = 0; i < c->nsev; i++) {
+				ev = ev_new(&c->ev, &c->nev, &c->maxev);
+				*ev = c->sev[i];
+				ev->txt += base;
+			}
+		}
+	}
+	c->nsev = 0;
+}
+
+/* -- record a font change of the captured tune -- */
+/* type is EV_FONT or EV_STRFT */
+void job_font(int ft, int type)
+{
+	struct FONTSPEC *f;
+
+	f = &cfmt.font_tb[ft];
+	if (f->size == 0)
+		f->size = 8;			/* (warning at replay time) */
+	job_event(type, ft, 0);
+	outft = ft;
+}
+
+/* -- keep the statistics of the captured tune -- */
+void job_stats(struct tstats *t)
+{
+	if (job_mode != JOB_CAPT) {
+		free(t);
+		return;
+	}
+	free(capt->stt);
+	capt->stt = t;
+}
+
+/* -- record a message of the captured tune -- */
+void job_msg(int sev, char *msg)
+{
+	struct capt *c = capt;
+	int l;
+
+	if (!c->ok)
+		return;
+	l = strlen(msg) + 1;
+	if (c->lmsg + l > c->maxmsg) {
+		c->maxmsg = (c->lmsg + l) * 2;
+		c->msg = realloc(c->msg, c->maxmsg);
+		if (!c->msg) {
+			error(1, NULL, "Out of memory - abort");
+			fatal_exit(EXIT_FAILURE);
+		}
+	}
+	memcpy(c->msg + c->lmsg, msg, l);
+	job_event(EV_MSG, c->lmsg, sev);
+	c->lmsg += l;
+}
+
+#ifdef HAVE_PTHREAD
+/* -- replay a captured tune -- */
+static void replay(struct capt *c)
+{
+	struct event *ev;
+	int i, txt, fmt, inf;
+
+	tunenum += c->ntunes;
+	if (c->stt) {
+		stats_tune_add(c->stt);
+		c->stt = NULL;
+	}
+	txt = 0;
+	fmt = inf = -1;
+	for (i = 0, ev = c->ev; i < c->nev; i++, ev++) {
+		if (ev->txt > txt) {
+			a2b_txt(c->txt + txt, ev->txt - txt);
+			txt = ev->txt;
+		}
+		if (ev->fmt != fmt) {
+			fmt = ev->fmt;
+			memcpy(&cfmt, &c->fmt[fmt], sizeof cfmt);
+		}
+		if (ev->info != inf) {
+			inf = ev->info;
+			memcpy(&info, &c->info[inf], sizeof info);
+		}
+		if (ev->outft >= -1)		/* if known */
+			outft = ev->outft;
+		switch (ev->type) {
+		case EV_BSKIP:
+			bskip(ev->v);
+			break;
+		case EV_FONT:
+			set_font(ev->arg);
+			break;
+		case EV_STRFT:
+			if (outft != ev->arg) {
+				a2b(" ");
+				set_font(ev->arg);
+			}
+			break;
+		case EV_DEFL:
+			set_defl(ev->arg);
+			break;
+		case EV_BLOCK:
+			block_put();
+			break;
+		case EV_EOB:
+			buffer_eob(ev->arg);
+			break;
+		case EV_WRITE:
+			write_buffer();
+			break;
+		case EV_CLOSE:
+			close_page();
+			break;
+		case EV_EPS:
+			write_eps();
+			break;
+		case EV_MSG:
+			fputs(c->msg + ev->arg, err_out());
+			if (ev->v > severity)
+				severity = ev->v;
+			break;
+		}
+	}
+	if (c->ltxt > txt)
+		a2b_txt(c->txt + txt, c->ltxt - txt);
+	if (c->outft >= -1)
+		outft = c->outft;
+	if (c->defl >= 0)
+		defl = c->defl;
+	set_draw_state(c->e_draw);
+	memcpy(space_tb, c->e_space, sizeof space_tb);
+}
+#endif
+
+/* -- start of a tune (X: in the tune) -- */
+/* return 1 if the tune has been rendered by a worker thread */
+int job_tune_start(struct SYMBOL *s)
+{
+#ifdef HAVE_PTHREAD
+	struct capt *c;
+	struct slot *sl;
+	char *lock;
+	int nlock, nfonts, skel;
+	float draw[NDRAW], space[NFLAGS_SZ];
+
+	if (job_mode) {				/* worker thread */
+		if (my_tune != ntune)
+			return 0;
+		c = calloc(1, sizeof *c);
+		if (!c)
+			return 0;
+		c->tune = ntune;
+		c->fno = nfile;
+		c->linenum = s->linenum;
+		c->worker = job_id;
+		c->ok = 1;
+		c->nfonts = font_state(&lock, &nlock);
+		c->lock = malloc(nlock);
+		if (!c->lock) {
+			free(c);
+			return 0;
+		}
+		memcpy(c->lock, lock, nlock);
+		get_draw_state(c->draw);
+		memcpy(c->space, space_tb, sizeof c->space);
+		capt = c;
+		capt_tunenum = tunenum;
+		outbuf_reset();
+		outft = OUTFT_UNKNOWN;
+		defl = -1;
+		job_mode = JOB_CAPT;
+		return 0;
+	}
+
+	/* main thread */
+	skel = skel_tune == ntune;
+	skel_tune = 0;
+	if (nworkers == 0)
+		goto decline;
+	sl = &slots[ntune % nslots];
+	pthread_mutex_lock(&job_mutex);
+	if (sl->tune != ntune
+	 || sl->state == SL_FREE || sl->state == SL_LOST) {
+		pthread_mutex_unlock(&job_mutex);
+		goto decline;
+	}
+	while (sl->state == SL_CLAIMED)
+		pthread_cond_wait(&job_cond, &job_mutex);
+	c = sl->c;
+	sl->c = NULL;
+	sl->state = SL_FREE;
+	pthread_mutex_unlock(&job_mutex);
+
+	if (!c)
+		goto decline;
+	if (!c->ok
+	 || c->fno != nfile
+	 || c->linenum != s->linenum
+	 || mbf != outbuf
+	 || multicol_start != 0
+	 || (!svg && !epsf && file_initialized <= 0)) {
+		capt_free(c);
+		goto decline;
+	}
+	state_get(&nfonts, draw, space);
+	font_state(&lock, &nlock);
+	if (c->nfonts != nfonts
+	 || memcmp(c->lock, lock, nlock) != 0
+	 || memcmp(c->draw, draw, sizeof draw) != 0
+	 || memcmp(c->space, space, sizeof space) != 0) {
+		pthread_mutex_lock(&job_mutex);	/* the worker went wrong */
+		job_retired[c->worker] = 1;
+		pthread_mutex_unlock(&job_mutex);
+		capt_free(c);
+		goto decline;
+	}
+	replay(c);
+	capt_free(c);
+	return 1;
+
+	/* the main thread renders the tune
+	 * if it has only its X: line, the front end parses it again */
+decline:
+	if (!skel)
+		return 0;
+	redo = 1;
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/* -- end of a tune -- */
+void job_tune_end(void)
+{
+#ifdef HAVE_PTHREAD
+	struct capt *c;
+	char *lock;
+	int nlock;
+
+	if (job_mode != JOB_CAPT)
+		return;
+	c = capt;
+	capt = NULL;
+	job_mode = JOB_WORKER;
+	if (c->ok) {
+		if (font_state(&lock, &nlock) != c->nfonts
+		 || memcmp(c->lock, lock, nlock) != 0
+		 || multicol_start != 0
+		 || c->nsev != 0)
+			c->ok = 0;
+	}
+	if (c->ok) {
+		c->ltxt = mbf - outbuf;
+		c->txt = malloc(c->ltxt + 1);
+		if (!c->txt) {
+			c->ok = 0;
+		} else {
+			memcpy(c->txt, outbuf, c->ltxt);
+			c->txt[c->ltxt] = '\0';
+		}
+		c->outft = outft;
+		c->defl = defl;
+		c->ntunes = tunenum - capt_tunenum;
+		get_draw_state(c->e_draw);
+		memcpy(c->e_space, space_tb, sizeof c->e_space);
+	}
+	outbuf_reset();
+	pthread_mutex_lock(&job_mutex);
+	if (c->ok) {
+		deliver(c);
+	} else {
+		capt_free(c);
+		deliver(NULL);
+	}
+	pthread_mutex_unlock(&job_mutex);
+#endif
+}
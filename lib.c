@@ -0,0 +1,250 @@
+/*
+ * Library interface (libabcm2ps).
+ *
+ * This file is part of abcm2ps.
+ *
+ * Copyright (C) 2016 Jean-François Moine
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Each rendering is done by a new thread, so that it starts with
+ * a fresh rendering state.
+ * The ABC text is read from memory as if it were stdin, and the
+ * output file is a stream which calls the sink function of the caller.
+ * The messages go to an other stream which calls the message function
+ * of the caller.
+ * On fatal errors, fatal_exit() jumps back to the rendering thread
+ * instead of stopping the process.
+ */
+
+#define _GNU_SOURCE			/* fopencookie() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <setjmp.h>
+
+#include "abcm2ps.h"
+#include "libabcm2ps.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+TLS FILE *lib_out;			/* output of the library */
+TLS FILE *lib_err;			/* messages of the library */
+TLS const char *lib_abc;		/* ABC text */
+TLS int lib_abclen;
+static TLS jmp_buf *lib_jmp;		/* return on fatal error */
+
+/* -- get the stream of the messages -- */
+FILE *err_out(void)
+{
+	return lib_err ? lib_err : stderr;
+}
+
+/* -- stop on a fatal error -- */
+/* in the library, go back to the rendering thread */
+void fatal_exit(int status)
+{
+	if (lib_jmp) {
+		fflush(lib_err);
+		longjmp(*lib_jmp, 1);
+	}
+	exit(status);
+}
+
+#ifdef HAVE_PTHREAD
+struct render {
+	const char *abc;
+	int len;
+	int argc;
+	char **argv;
+	abcm2ps_sink *sink;
+	abcm2ps_sink *msg;
+	void *ctx;
+	int status;
+};
+struct stream {				/* output or messages */
+	abcm2ps_sink *f;
+	void *ctx;
+};
+
+/* -- write to a function of the caller -- */
+#if defined(__GLIBC__)
+static ssize_t sink_write(void *cookie, const char *buf, size_t len)
+{
+	struct stream *st = cookie;
+
+	if (st->f && st->f(st->ctx, buf, len) != 0)
+		return 0;
+	return len;
+}
+#elif defined(__APPLE__) || defined(__FreeBSD__) \
+   || defined(__NetBSD__) || defined(__OpenBSD__)
+static int sink_write(void *cookie, const char *buf, int len)
+{
+	struct stream *st = cookie;
+
+	if (st->f && st->f(st->ctx, buf, len) != 0)
+		return -1;
+	return len;
+}
+#endif
+
+/* -- open a stream to a function of the caller -- */
+static FILE *sink_open(struct stream *st)
+{
+#if defined(__GLIBC__)
+	cookie_io_functions_t fn;
+
+	memset(&fn, 0, sizeof fn);
+	fn.write = sink_write;
+	return fopencookie(st, "w", fn);
+#elif defined(__APPLE__) || defined(__FreeBSD__) \
+   || defined(__NetBSD__) || defined(__OpenBSD__)
+	return funopen(st, NULL, sink_write, NULL, NULL);
+#else
+	return NULL;
+#endif
+}
+
+/* -- rendering thread -- */
+static void *render(void *arg)
+{
+	struct render *r = arg;
+	struct stream out, msg;
+	jmp_buf jb;
+
+	out.f = r->sink;
+	msg.f = r->msg;
+	out.ctx = msg.ctx = r->ctx;
+	lib_out = sink_open(&out);
+	lib_err = sink_open(&msg);
+	if (!lib_out || !lib_err) {
+		if (lib_out)
+			fclose(lib_out);
+		if (lib_err)
+			fclose(lib_err);
+		r->status = -1;
+		return NULL;
+	}
+	setvbuf(lib_err, NULL, _IOLBF, BUFSIZ);
+	lib_abc = r->abc;
+	lib_abclen = r->len;
+	if (setjmp(jb) == 0) {
+		lib_jmp = &jb;
+		r->status = abcm2ps_main(r->argc, r->argv);
+	} else {
+		r->status = 2;			/* fatal error */
+		if (fout && fout != lib_out)
+			fclose(fout);
+	}
+	lib_jmp = NULL;
+	fclose(lib_out);
+	fclose(lib_err);
+
+	/* free the main memory areas of the thread */
+	freearena();
+	frontend_free();
+	free_outbuf();
+	free_symbols();
+	free_tex_cache();
+	return NULL;
+}
+#endif
+
+/* -- check the arguments of the library and of the daemon requests -- */
+/* the output is always '-O -' and the input is the ABC text
+ * the long options are the format parameters only
+ * return the number of arguments or -1 if error */
+int args_check(char **args)
+{
+	char *p;
+	int n;
+
+	for (n = 0; args && args[n]; n++) {
+		p = args[n];
+		if (p[0] == '-' && p[1] == '-') {	/* --xxx value */
+			if (!is_fmt_param(p + 2)
+			 || !args[n + 1])
+				return -1;
+			n++;
+			continue;
+		}
+		if (*p != '-' && *p != '+')
+			return -1;		/* no file name */
+		if (p[1] == '\0')
+			return -1;		/* no stdin */
+		while (*++p != '\0') {
+			if (strchr("DFhHOyz", *p))
+				return -1;	/* no file or stdout output,
+						 * no file read */
+			if (*args[n] == '+')
+				continue;
+			if (*p == 'N') {		/* optional arg */
+				if (p[1] == '\0' && args[n + 1]
+				 && isdigit((unsigned char) args[n + 1][0]))
+					n++;
+				break;
+			}
+			if (strchr("aBbDdeFfIJjkmsTw", *p)) {	/* if with arg */
+				if (p[1] == '\0') {
+					if (!args[n + 1])
+						return -1;
+					n++;
+				}
+				break;
+			}
+		}
+	}
+	return n;
+}
+
+/* -- render an ABC text -- */
+int abcm2ps_render(const char *abc, int len,
+		char **args,
+		abcm2ps_sink *sink, abcm2ps_sink *msg, void *ctx)
+{
+#ifdef HAVE_PTHREAD
+	struct render r;
+	pthread_t th;
+	int n;
+
+	n = args_check(args);
+	if (n < 0)
+		return -1;
+	r.argv = malloc((n + 6) * sizeof *r.argv);
+	if (!r.argv)
+		return -1;
+	r.argc = 0;
+	r.argv[r.argc++] = "abcm2ps";
+	r.argv[r.argc++] = "-q";
+	if (n > 0)
+		memcpy(&r.argv[r.argc], args, n * sizeof *r.argv);
+	r.argc += n;
+	r.argv[r.argc++] = "-O";
+	r.argv[r.argc++] = "-";
+	r.argv[r.argc++] = "-";		/* ABC text (as stdin) */
+	r.argv[r.argc] = NULL;
+	r.abc = abc;
+	r.len = len;
+	r.sink = sink;
+	r.msg = msg;
+	r.ctx = ctx;
+	r.status = -1;
+
+	if (pthread_create(&th, NULL, render, &r) == 0)
+		pthread_join(th, NULL);
+	free(r.argv);
+	return r.status;
+#else
+	error(1, NULL, "No thread support - no library rendering");
+	return -1;
+#endif
+}
@@ -0,0 +1,45 @@
+/*
+ * libabcm2ps: interface of the abcm2ps library
+ *
+ * This file is part of abcm2ps.
+ *
+ * Copyright (C) 2016 Jean-François Moine
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef LIBABCM2PS_H
+#define LIBABCM2PS_H
+
+/* output function: called with each part of the generated output
+ * or of the messages
+ * it returns 0 on success, non zero to stop the output */
+typedef int abcm2ps_sink(void *ctx, const char *buf, int len);
+
+/* render an ABC text
+ *	abc, len: ABC text
+ *	args: command line options, NULL terminated - may be NULL
+ *		The file names, '-' (stdin), the options which output
+ *		to files or to stdout ('-h', '-H', '-O', '-y', '-z')
+ *		and the options which read files ('-D', '-F') are refused.
+ *		The long options are the format parameters only
+ *		('--stats', '--trace', '--sprite', '--serve'.. are refused).
+ *		With '-E', the EPS images follow each other in the output.
+ *		%%format and %%abc-include read only the files
+ *		of the format directory.
+ *	sink: output function
+ *	msg: message function (errors and warnings) - may be NULL
+ *	ctx: first argument of the output and message functions
+ * The output is the same as with the command line and '-O -'.
+ * The function may be called from many threads at the same time.
+ * It returns 0 on success, 1 on rendering error, 2 when the rendering
+ * was stopped by a fatal error (the output is truncated)
+ * and -1 when the rendering could not be started. */
+int abcm2ps_render(const char *abc, int len,
+		char **args,
+		abcm2ps_sink *sink, abcm2ps_sink *msg, void *ctx);
+
+#endif
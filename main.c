@@ -0,0 +1,21 @@
+/*
+ * abcm2ps: program entry
+ *
+ * The program is built from the library and this main function.
+ *
+ * This file is part of abcm2ps.
+ *
+ * Copyright (C) 2016 Jean-François Moine
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "abcm2ps.h"
+
+int main(int argc, char **argv)
+{
+	return abcm2ps_main(argc, argv);
+}
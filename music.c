@@ -17,24 +17,24 @@
 
 #include "abcm2ps.h"
 
-struct STAFF_S staff_tb[MAXSTAFF];	/* staff table */
-struct SYMBOL *tsnext;		/* next line when cut */
-float realwidth;		/* real staff width while generating */
+TLS struct STAFF_S staff_tb[MAXSTAFF];	/* staff table */
+TLS struct SYMBOL *tsnext;		/* next line when cut */
+TLS float realwidth;		/* real staff width while generating */
 
-static int insert_meter;	/* insert time signature (1) and indent 1st line (2) */
-static float beta_last;		/* for last short short line.. */
+static TLS int insert_meter;	/* insert time signature (1) and indent 1st line (2) */
+static TLS float beta_last;		/* for last short short line.. */
 
 #define AT_LEAST(a,b)  do { float tmp = b; if(a<tmp) a=tmp; } while (0)
 
 /* width of notes indexed by log2(note_length) */
-float space_tb[NFLAGS_SZ] = {
+TLS float space_tb[NFLAGS_SZ] = {
 	7, 10, 14.15, 20, 28.3,
 	40,				/* crotchet */
 	56.6, 80, 113, 150
 };
 // width of note heads indexed by s->head
 float hw_tb[] = {4.5, 5, 6, 8};
-static int smallest_duration;
+static TLS int smallest_duration;
 
 /* upper and lower space needed by rests */
 static char rest_sp[NFLAGS_SZ][2] = {
@@ -2098,6 +2098,7 @@ cut_here:
 		if (s->sflags & S_NL) {		/* already set here - advance */
 			error(0, s, "Line split problem - "
 					"adjust maxshrink and/or breaklimit");
+			trace_mark("line split problem", s->linenum);
 			nlines = 2;
 			for (s = s->ts_next; s != last; s = s->ts_next) {
 				if (s->x == 0)
@@ -4952,19 +4953,18 @@ static void error_show(void)
 static float delayed_output(float indent)
 {
 	float line_height;
-	char *outbuf_sav, *mbf_sav, tmpbuf[20 * 1024];
 
-	outbuf_sav = outbuf;
-	mbf_sav = mbf;
-	mbf = outbuf = tmpbuf;
-	*outbuf = '\0';
+	outbuf_side(1);
 	outft = -1;
+	stats_begin(ST_DRAW_SYM_NEAR);
 	draw_sym_near();
-	outbuf = outbuf_sav;
-	mbf = mbf_sav;
+	stats_end(ST_DRAW_SYM_NEAR);
+	outbuf_side(0);
 	outft = -1;
+	stats_begin(ST_DRAW_SYSTEMS);
 	line_height = draw_systems(indent);
-	a2b("%s", tmpbuf);
+	stats_end(ST_DRAW_SYSTEMS);
+	outbuf_side_put();
 	return line_height;
 }
 
@@ -4978,22 +4978,31 @@ void output_music(void)
 	gen_init();
 	if (!tsfirst)
 		return;
-	check_buffer();
 	set_global();			/* initialize the generator */
 	if (first_voice->next) {	/* if many voices */
 //		if (cfmt.combinevoices >= 0)
-			combine_voices();
+		stats_begin(ST_COMBINE_VOICES);
+		combine_voices();
+		stats_end(ST_COMBINE_VOICES);
 		set_stem_dir();		/* set the stems direction in 'multi' */
 	}
+	stats_begin(ST_SET_BEAMS);
 	for (p_voice = first_voice; p_voice; p_voice = p_voice->next)
 		set_beams(p_voice->sym);	/* decide on beams */
+	stats_end(ST_SET_BEAMS);
+	stats_begin(ST_SET_STEMS);
 	set_stems();			/* set the stem lengths */
+	stats_end(ST_SET_STEMS);
 	if (first_voice->next) {	/* when multi-voices */
 		set_rest_offset();	/* set the vertical offset of rests */
+		stats_begin(ST_SET_OVERLAP);
 		set_overlap();		/* shift the notes on voice overlap */
+		stats_end(ST_SET_OVERLAP);
 	}
 	set_acc_shft();			// set the horizontal offset of accidentals
+	stats_begin(ST_SET_ALLSYMWIDTH);
 	set_allsymwidth(NULL);		/* set the width of all symbols */
+	stats_end(ST_SET_ALLSYMWIDTH);
 
 	lwidth = ((cfmt.landscape ? cfmt.pageheight : cfmt.pagewidth)
 		- cfmt.leftmargin - cfmt.rightmargin)
@@ -5003,19 +5012,29 @@ void output_music(void)
 		lwidth = 10 CM;
 	}
 	indent = set_indent();
+	stats_begin(ST_CUT_TUNE);
 	cut_tune(lwidth, indent);
+	stats_end(ST_CUT_TUNE);
 	beta_last = 0;
 	for (;;) {			/* loop per music line */
 		float line_height;
 
+		trace_begin(SP_LINE, tsfirst->linenum);
+		PROBE1(line__start, tsfirst->linenum);
 		set_piece();
 		indent = set_indent();
+		stats_begin(ST_SET_SYM_GLUE);
 		set_sym_glue(lwidth - indent);
+		stats_end(ST_SET_SYM_GLUE);
 		if (indent != 0)
 			a2b("%.2f 0 T\n", indent); /* do indentation */
 		line_height = delayed_output(indent);
+		stats_begin(ST_DRAW_ALL_SYMB);
 		draw_all_symb();
+		stats_end(ST_DRAW_ALL_SYMB);
+		stats_begin(ST_DRAW_ALL_DECO);
 		draw_all_deco();
+		stats_end(ST_DRAW_ALL_DECO);
 		if (showerror)
 			error_show();
 		bskip(line_height);
@@ -5023,6 +5042,8 @@ void output_music(void)
 			a2b("%.2f 0 T\n", -indent);
 			insert_meter &= ~2;	// no more indentation
 		}
+		trace_end(SP_LINE);
+		PROBE1(line__end, tsfirst->linenum);
 		tsfirst = tsnext;
 		gen_init();
 		if (!tsfirst)
@@ -41,39 +41,39 @@ struct tune_opt_s {			/* tune options */
 	struct SYMBOL *s;		/* list of options (%%xxx) */
 };
 
-int nstaff;				/* (0..MAXSTAFF-1) */
-struct SYMBOL *tsfirst;			/* first symbol in the time sorted list */
+TLS int nstaff;				/* (0..MAXSTAFF-1) */
+TLS struct SYMBOL *tsfirst;			/* first symbol in the time sorted list */
 
-struct VOICE_S voice_tb[MAXVOICE];	/* voice table */
-static struct VOICE_S *curvoice;	/* current voice while parsing */
-struct VOICE_S *first_voice;		/* first voice */
-struct SYSTEM *cursys;			/* current system */
-static struct SYSTEM *parsys;		/* current system while parsing */
+TLS struct VOICE_S voice_tb[MAXVOICE];	/* voice table */
+static TLS struct VOICE_S *curvoice;	/* current voice while parsing */
+TLS struct VOICE_S *first_voice;		/* first voice */
+TLS struct SYSTEM *cursys;			/* current system */
+static TLS struct SYSTEM *parsys;		/* current system while parsing */
 
-struct FORMAT dfmt;			/* current global format */
-int nbar;				/* current measure number */
+TLS struct FORMAT dfmt;			/* current global format */
+TLS int nbar;				/* current measure number */
 
-struct map *maps;			/* note mappings */
+TLS struct map *maps;			/* note mappings */
 
-static struct voice_opt_s *voice_opts, *tune_voice_opts;
-static struct tune_opt_s *tune_opts, *cur_tune_opts;
-static struct brk_s *brks;
-static struct symsel_s clip_start, clip_end;
+static TLS struct voice_opt_s *voice_opts, *tune_voice_opts;
+static TLS struct tune_opt_s *tune_opts, *cur_tune_opts;
+static TLS struct brk_s *brks;
+static TLS struct symsel_s clip_start, clip_end;
 
-static INFO info_glob;			/* global info definitions */
-static char *deco_glob[256];		/* global decoration table */
-static struct map *maps_glob;		/* save note maps */
+static TLS INFO info_glob;			/* global info definitions */
+static TLS char *deco_glob[256];		/* global decoration table */
+static TLS struct map *maps_glob;		/* save note maps */
 
-static int over_time;			/* voice overlay start time */
-static int over_mxtime;			/* voice overlay max time */
-static short over_bar;			/* voice overlay in a measure */
-static short over_voice;		/* main voice in voice overlay */
-static int staves_found;		/* time of the last %%staves */
-static int abc2win;
+static TLS int over_time;			/* voice overlay start time */
+static TLS int over_mxtime;			/* voice overlay max time */
+static TLS short over_bar;			/* voice overlay in a measure */
+static TLS short over_voice;		/* main voice in voice overlay */
+static TLS int staves_found;		/* time of the last %%staves */
+static TLS int abc2win;
 
-float multicol_start;			/* (for multicol) */
-static float multicol_max;
-static float lmarg, rmarg;
+TLS float multicol_start;			/* (for multicol) */
+static TLS float multicol_max;
+static TLS float lmarg, rmarg;
 
 static void get_clef(struct SYMBOL *s);
 static struct SYMBOL *get_info(struct SYMBOL *s);
@@ -634,9 +634,13 @@ static void system_new(void)
 /* this routine is called when starting the generation */
 static void system_init(void)
 {
+	stats_begin(ST_VOICE_COMPRESS);
 	voice_compress();
+	stats_end(ST_VOICE_COMPRESS);
 	voice_dup();
+	stats_begin(ST_SORT_ALL);
 	sort_all();			/* define the time / vertical sequences */
+	stats_end(ST_SORT_ALL);
 //	if (!tsfirst)
 //		return;
 //	parsys->nstaff = nstaff;	/* save the number of staves */
@@ -974,11 +978,16 @@ static void generate(void)
 	system_init();
 	if (!tsfirst)
 		return;				/* no symbol */
+	stats_begin(ST_SET_BAR_NUM);
 	set_bar_num();
+	stats_end(ST_SET_BAR_NUM);
 	if (!tsfirst)
 		return;				/* no more symbol */
+	stats_symbols();
 	old_lvl = lvlarena(2);
+	stats_begin(ST_OUTPUT_MUSIC);
 	output_music();
+	stats_end(ST_OUTPUT_MUSIC);
 	clrarena(2);				/* clear generation */
 	lvlarena(old_lvl);
 
@@ -2188,7 +2197,9 @@ static void get_staves(struct SYMBOL *s)
 	struct staff_s *p_staff, staves[MAXVOICE];
 	int i, flags, voice, staff, range, dup_voice, maxtime;
 
+	stats_begin(ST_VOICE_COMPRESS);
 	voice_compress();
+	stats_end(ST_VOICE_COMPRESS);
 	voice_dup();
 
 	/* create a new staff system */
@@ -2967,6 +2978,10 @@ static struct SYMBOL *get_info(struct SYMBOL *s)
 		info['X' - 'A'] = s;
 		if (tune_opts)
 			tune_filter(s);
+		if (jobs > 1 && job_tune_start(s)) {	/* tune rendered by a thread */
+			lvlarena(old_lvl);
+			return NULL;
+		}
 		break;
 	default:
 		if (info_type >= 'A' && info_type <= 'Z') {
@@ -3253,6 +3268,9 @@ void do_tune(void)
 	struct SYMBOL *s, *s1, *s2;
 	int i;
 
+	s = parse.first_sym;
+	PROBE2(tune__start, s ? s->fn : NULL, s ? s->linenum : 0);
+
 	/* initialize */
 	lvlarena(0);
 	nstaff = 0;
@@ -3338,6 +3356,8 @@ void do_tune(void)
 		switch (s->abc_type) {
 		case ABC_T_INFO:
 			s = get_info(s);
+			if (!s)
+				goto tune_end;
 			break;
 		case ABC_T_PSCOM:
 			s = process_pscomment(s);
@@ -3482,7 +3502,12 @@ void do_tune(void)
 //		if (!cfmt.oneperpage && in_page)
 //			use_buffer = cfmt.splittune != 1;
 	}
+	stats_tune_end();
+	job_tune_end();
 
+tune_end:
+	s = parse.first_sym;
+	PROBE2(tune__end, s ? s->fn : NULL, s ? s->linenum : 0);
 	if (info['X' - 'A']) {
 		memcpy(&cfmt, &dfmt, sizeof cfmt); /* restore global values */
 		memcpy(&info, &info_glob, sizeof info);
@@ -4853,6 +4878,21 @@ static struct SYMBOL *process_pscomment(struct SYMBOL *s)
 		error(1, s, "Cannot have %%%%%s in tune header", w);
 		return s;
 	}
+	if (job_mode == JOB_CAPT) {	/* side effects outside of the tune */
+		static const char *nojob[] = {
+			"beginps", "beginsvg", "deco", "EPS", "font", "glyph",
+			"multicol", "newpage", "ps", "postscript",
+			"tablature", "tune", "voice", NULL
+		};
+		const char **pw;
+
+		for (pw = nojob; *pw; pw++) {
+			if (strcmp(w, *pw) == 0) {
+				job_invalid();
+				break;
+			}
+		}
+	}
 	switch (w[0]) {
 	case 'b':
 		if (strcmp(w, "beginps") == 0
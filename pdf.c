@@ -0,0 +1,2106 @@
+/*
+ * PDF output (option '-P').
+ *
+ * This file is part of abcm2ps.
+ *
+ * Copyright (C) 2016 Jean-François Moine
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * The pages are generated by the PostScript interpreter of svg.c as
+ * with '-v'. The most frequent drawing operations (containers, symbols,
+ * stems, bars, beams, staves, flags and the PostScript paths) are
+ * sent directly to this file (pdf_xxx functions) which appends them
+ * to the content stream of the PDF page.
+ * The other operations are still written as SVG code into a memory
+ * stream. This code is translated each time a direct operation is
+ * done and at end of page:
+ * - the paths and shapes become PDF path operators,
+ * - the symbol definitions (<defs>) become form XObjects which are
+ *   written once and shared by all the pages,
+ * - the texts use the standard PDF fonts (Times, Helvetica, Courier)
+ *   with the WinAnsi encoding.
+ * Only the SVG subset generated by abcm2ps is treated.
+ * With zlib (HAVE_ZLIB), the streams are compressed (FlateDecode).
+ * With cairo (option '--cairo'), the content streams are lists of
+ * binary drawing operations (CR_xxx) which are played by cairo.c:
+ *	operation (1 byte), number of values (1 byte), values (floats)
+ * the UTF-8 bytes of a CR_TEXT following its values.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#include "abcm2ps.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define PX_PT 0.75			/* SVG pixels to PDF points */
+
+/* special color values */
+#define C_NONE -1			/* no painting */
+#define C_INH -2			/* inherited (in a form XObject) */
+#define C_CUR -3			/* currentColor */
+
+#define P_FILL 1			/* painting */
+#define P_STROKE 2
+
+#define O_CATALOG 1			/* fixed objects */
+#define O_PAGES 2
+#define O_RES 3
+
+/* growable buffer */
+struct pbuf {
+	char *s;
+	int len, max;
+};
+
+/* SVG style of an element */
+struct style {
+	int color;			/* currentColor */
+	int fill, stroke;		/* rgb, C_NONE or C_CUR */
+	float lw;			/* stroke width - < 0 if inherited */
+	char dash[32];			/* "" if solid, "-" if inherited */
+	int cap;			/* line cap - < 0 if inherited */
+	char evenodd;
+	char font;			/* 0: Times, 1: Helvetica, 2: Courier */
+	char bold, italic;
+	char anchor;			/* 0: start, 1: middle, 2: end */
+	float fsize;
+};
+
+/* PDF graphic state */
+struct gstate {
+	int fill, stroke;		/* rgb or C_INH */
+	float lw;
+	char dash[32];
+	int cap;
+};
+
+/* start tag of a XML element */
+#define MAXATTR 32
+struct xelt {
+	char *name;
+	int nl;
+	int na;
+	struct {
+		char *n, *v;
+		int nl, vl;
+	} a[MAXATTR];
+	char empty;			/* '<.../>' */
+};
+
+/* SVG to PDF translation */
+struct render {
+	struct pbuf *b;			/* content stream */
+	struct gstate gs;
+	char *e;			/* end of the SVG code */
+	int depth;
+};
+
+/* form XObject */
+struct xobj {
+	char *key;			/* id + '\0' + SVG code */
+	int klen;
+	int obj;			/* PDF object */
+	struct pbuf data;		/* content (cairo only) */
+};
+
+static char *font_names[12] = {
+	"Times-Roman", "Times-Bold", "Times-Italic", "Times-BoldItalic",
+	"Helvetica", "Helvetica-Bold", "Helvetica-Oblique",
+		"Helvetica-BoldOblique",
+	"Courier", "Courier-Bold", "Courier-Oblique", "Courier-BoldOblique",
+};
+
+TLS int cairo_out;			/* cairo output 1: PNG, 2: PDF */
+
+static TLS FILE *pdf_out;		/* PDF file - NULL if not started */
+static TLS FILE *pdf_svg;		/* SVG code which is not drawn directly */
+static TLS char *svg_s;			/* (memory stream) */
+static TLS size_t svg_l;
+static TLS long pdf_pos;		/* current offset in the PDF file */
+static TLS long *obj_off;		/* offsets of the objects */
+static TLS int nobj, maxobj;
+static TLS int *page_obj;		/* page objects */
+static TLS int npages, maxpages;
+static TLS struct xobj *xobj_tb;	/* form XObjects */
+static TLS int nxobj, maxxobj;
+static TLS int *id_xobj;		/* XObjects of the ids of the page */
+static TLS char **id_name;
+static TLS int nid, maxid;
+static TLS int font_obj[12];		/* font objects - 0 if not used */
+static TLS float page_w, page_h;	/* page size in points */
+static TLS struct pbuf page_buf, form_buf, text_buf;
+static TLS struct pbuf path_buf;	/* current path (svg.c) */
+static TLS struct render page_r;	/* drawing state of the page */
+static TLS struct style page_st;	/* style of the page */
+static TLS struct style g_st;		/* style of the container (svg.c) */
+static TLS struct gstate g_gs;		/* graphic state out of the container */
+static TLS int in_g;			/* in a container */
+#ifdef HAVE_ZLIB
+static TLS struct pbuf zbuf;		/* compressed stream */
+#endif
+
+static char *render_elt(struct render *r, char *p, struct xelt *x,
+			struct style *st);
+
+/* -- buffer functions -- */
+static void pb_room(struct pbuf *b, int len)
+{
+	if (b->len + len < b->max)
+		return;
+	b->max = (b->len + len) * 2 + 4096;
+	b->s = realloc(b->s, b->max);
+	if (!b->s) {
+		error(1, NULL, "Out of memory");
+		fatal_exit(EXIT_FAILURE);
+	}
+}
+
+static void pb_put(struct pbuf *b, const char *s, int len)
+{
+	pb_room(b, len + 1);
+	memcpy(b->s + b->len, s, len);
+	b->len += len;
+}
+
+static void pb_printf(struct pbuf *b, const char *fmt, ...)
+#ifdef __GNUC__
+	__attribute__ ((format (printf, 2, 3)))
+#endif
+	;
+static void pb_printf(struct pbuf *b, const char *fmt, ...)
+{
+	va_list args;
+	int l;
+
+	pb_room(b, 256);
+	va_start(args, fmt);
+	l = vfmt(b->s + b->len, b->max - b->len, fmt, args);
+	va_end(args);
+	if (l >= b->max - b->len) {
+		pb_room(b, l + 1);
+		va_start(args, fmt);
+		vfmt(b->s + b->len, b->max - b->len, fmt, args);
+		va_end(args);
+	}
+	b->len += l;
+}
+
+/* -- drawing operations -- */
+
+/* PDF operators (the values are the first arguments) */
+static const char *pdf_op[CR_N] = {
+	"q\n", "Q\n",
+	"%.4f %.4f %.4f %.4f %.2f %.2f cm\n",
+	"%.2f %.2f m\n", "%.2f %.2f l\n",
+	"%.2f %.2f %.2f %.2f %.2f %.2f c\n",
+	"%.2f %.2f %.2f %.2f re\n", "h\n",
+	"f\n", "f*\n", "S\n", "B\n", "B*\n",
+	"%.3f %.3f %.3f rg\n", "%.3f %.3f %.3f RG\n", "%.2f w\n",
+	/* (the other operations are not treated by op_out) */
+};
+
+/* add a binary operation (cairo) */
+static void cr_op(struct pbuf *b, int op, int n, double *v)
+{
+	float f;
+	int i;
+
+	pb_room(b, 2 + n * sizeof f);
+	b->s[b->len++] = op;
+	b->s[b->len++] = n;
+	for (i = 0; i < n; i++) {
+		f = v[i];
+		memcpy(b->s + b->len, &f, sizeof f);
+		b->len += sizeof f;
+	}
+}
+
+/* output a drawing operation with at most 6 values */
+static void op_out(struct pbuf *b, int op, int n, double *v)
+{
+	double z[6];
+
+	if (cairo_out) {
+		cr_op(b, op, n, v);
+		return;
+	}
+	if (n == 0) {
+		pb_put(b, pdf_op[op], strlen(pdf_op[op]));
+		return;
+	}
+	memset(z, 0, sizeof z);
+	memcpy(z, v, n * sizeof *v);
+	pb_printf(b, pdf_op[op], z[0], z[1], z[2], z[3], z[4], z[5]);
+}
+
+/* output a transformation matrix */
+static void cm_out(struct pbuf *b, double a, double b_, double c, double d,
+			double e, double f)
+{
+	double m[6];
+
+	if (cairo_out) {
+		m[0] = a; m[1] = b_; m[2] = c;
+		m[3] = d; m[4] = e; m[5] = f;
+		cr_op(b, CR_MATRIX, 6, m);
+	} else if (a == 1 && b_ == 0 && c == 0 && d == 1) {
+		pb_printf(b, "1 0 0 1 %.2f %.2f cm\n", e, f);
+	} else if (e != 0 || f != 0) {
+		pb_printf(b, "%.4f %.4f %.4f %.4f %.2f %.2f cm\n",
+			a, b_, c, d, e, f);
+	} else if (b_ == 0 && c == 0) {
+		pb_printf(b, "%.4f 0 0 %.4f 0 0 cm\n", a, d);
+	} else if (a == 1 && d == 1 && b_ == 0) {
+		pb_printf(b, "1 0 %.4f 1 0 0 cm\n", c);
+	} else if (a == 1 && d == 1 && c == 0) {
+		pb_printf(b, "1 %.4f 0 1 0 0 cm\n", b_);
+	} else {
+		pb_printf(b, "%.4f %.4f %.4f %.4f 0 0 cm\n", a, b_, c, d);
+	}
+}
+
+/* -- PDF file functions -- */
+static void pdf_write(const char *s, int len)
+{
+	fwrite(s, 1, len, pdf_out);
+	pdf_pos += len;
+}
+
+static void pdf_printf(const char *fmt, ...)
+#ifdef __GNUC__
+	__attribute__ ((format (printf, 1, 2)))
+#endif
+	;
+static void pdf_printf(const char *fmt, ...)
+{
+	va_list args;
+	char tmp[512];
+	int l;
+
+	va_start(args, fmt);
+	l = vfmt(tmp, sizeof tmp, fmt, args);
+	va_end(args);
+	if (l >= sizeof tmp)
+		l = sizeof tmp - 1;
+	pdf_write(tmp, l);
+}
+
+/* reserve an object number */
+static int obj_new(void)
+{
+	if (nobj + 1 >= maxobj) {
+		maxobj = maxobj * 2 + 64;
+		obj_off = realloc(obj_off, maxobj * sizeof *obj_off);
+	}
+	nobj++;
+	obj_off[nobj] = 0;
+	return nobj;
+}
+
+/* start writing an object */
+static void obj_start(int obj)
+{
+	obj_off[obj] = pdf_pos;
+	pdf_printf("%d 0 obj\n", obj);
+}
+
+/* write a stream object */
+static void obj_stream(int obj, const char *dict, struct pbuf *b)
+{
+#ifdef HAVE_ZLIB
+	uLongf zlen;
+
+	zlen = compressBound(b->len);
+	zbuf.len = 0;
+	pb_room(&zbuf, zlen);
+	if (compress2((Bytef *) zbuf.s, &zlen,
+			(Bytef *) b->s, b->len, Z_DEFAULT_COMPRESSION) == Z_OK) {
+		obj_start(obj);
+		pdf_printf("<<%s/Filter/FlateDecode/Length %lu>>\nstream\n",
+			dict, (unsigned long) zlen);
+		pdf_write(zbuf.s, zlen);
+		pdf_printf("\nendstream\nendobj\n");
+		return;
+	}
+#endif
+	obj_start(obj);
+	pdf_printf("<<%s/Length %d>>\nstream\n", dict, b->len);
+	pdf_write(b->s, b->len);
+	pdf_printf("\nendstream\nendobj\n");
+}
+
+/* -- XML parsing -- */
+
+/* parse a start tag ('p' points to the name after '<')
+ * return the pointer after the tag */
+static char *xml_tag(char *p, char *e, struct xelt *x)
+{
+	char c;
+
+	x->name = p;
+	while (p < e && !isspace((unsigned char) *p)
+	    && *p != '>' && *p != '/')
+		p++;
+	x->nl = p - x->name;
+	x->na = 0;
+	x->empty = 0;
+	for (;;) {
+		while (p < e && isspace((unsigned char) *p))
+			p++;
+		if (p >= e)
+			return e;
+		if (*p == '>')
+			return p + 1;
+		if (*p == '/') {
+			x->empty = 1;
+			while (p < e && *p != '>')
+				p++;
+			return p < e ? p + 1 : e;
+		}
+		if (x->na >= MAXATTR) {
+			p++;
+			continue;
+		}
+		x->a[x->na].n = p;
+		while (p < e && *p != '=' && *p != '>' && *p != '/'
+		    && !isspace((unsigned char) *p))
+			p++;
+		x->a[x->na].nl = p - x->a[x->na].n;
+		while (p < e && isspace((unsigned char) *p))
+			p++;
+		if (p >= e || *p != '=')
+			continue;		/* (no value) */
+		p++;
+		while (p < e && isspace((unsigned char) *p))
+			p++;
+		if (p >= e)
+			return e;
+		c = *p;
+		if (c != '"' && c != '\'')
+			continue;
+		x->a[x->na].v = ++p;
+		while (p < e && *p != c)
+			p++;
+		x->a[x->na].vl = p - x->a[x->na].v;
+		x->na++;
+		if (p < e)
+			p++;
+	}
+}
+
+/* get the value of an attribute */
+static char *xml_attr(struct xelt *x, char *name, int *len)
+{
+	int i, l;
+
+	l = strlen(name);
+	for (i = 0; i < x->na; i++) {
+		if (x->a[i].nl == l && memcmp(x->a[i].n, name, l) == 0) {
+			if (len)
+				*len = x->a[i].vl;
+			return x->a[i].v;
+		}
+	}
+	return NULL;
+}
+
+static float xml_num(struct xelt *x, char *name)
+{
+	char *v;
+
+	v = xml_attr(x, name, NULL);
+	return v ? strtod(v, NULL) : 0;
+}
+
+static int xml_is(struct xelt *x, char *name)
+{
+	return x->nl == strlen(name) && memcmp(x->name, name, x->nl) == 0;
+}
+
+/* skip a comment, a processing instruction or a declaration */
+static char *xml_skip_special(char *p, char *e)
+{
+	char *q;
+
+	if (p + 4 <= e && strncmp(p, "<!--", 4) == 0) {
+		for (q = p + 4; q + 3 <= e; q++) {
+			if (strncmp(q, "-->", 3) == 0)
+				return q + 3;
+		}
+		return e;
+	}
+	q = memchr(p, '>', e - p);
+	return q ? q + 1 : e;
+}
+
+/* skip the content of an element up to its end tag */
+static char *xml_skip(char *p, char *e)
+{
+	struct xelt x;
+	int depth;
+
+	depth = 1;
+	while (p < e) {
+		p = memchr(p, '<', e - p);
+		if (!p)
+			return e;
+		if (p[1] == '!' || p[1] == '?') {
+			p = xml_skip_special(p, e);
+			continue;
+		}
+		if (p[1] == '/') {
+			p = memchr(p, '>', e - p);
+			if (!p)
+				return e;
+			p++;
+			if (--depth == 0)
+				return p;
+			continue;
+		}
+		p = xml_tag(p + 1, e, &x);
+		if (!x.empty)
+			depth++;
+	}
+	return e;
+}
+
+/* -- style -- */
+
+static int hexval(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c = tolower(c);
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return 0;
+}
+
+/* parse a color or a paint */
+static int parse_color(char *v, int l)
+{
+	static struct {
+		char *name;
+		int rgb;
+	} names[] = {
+		{"black", 0x000000}, {"white", 0xffffff},
+		{"red", 0xff0000}, {"green", 0x008000},
+		{"blue", 0x0000ff}, {"yellow", 0xffff00},
+		{"gray", 0x808080}, {"grey", 0x808080},
+		{"orange", 0xffa500}, {"purple", 0x800080},
+	};
+	int i, r, g, b;
+
+	while (l > 0 && isspace((unsigned char) *v)) {
+		v++;
+		l--;
+	}
+	while (l > 0 && isspace((unsigned char) v[l - 1]))
+		l--;
+	if (l == 4 && strncmp(v, "none", 4) == 0)
+		return C_NONE;
+	if (l == 12 && strncasecmp(v, "currentColor", 12) == 0)
+		return C_CUR;
+	if (*v == '#') {
+		if (l == 4)
+			return hexval(v[1]) * 0x110000
+				+ hexval(v[2]) * 0x1100
+				+ hexval(v[3]) * 0x11;
+		if (l == 7)
+			return (hexval(v[1]) << 20) + (hexval(v[2]) << 16)
+				+ (hexval(v[3]) << 12) + (hexval(v[4]) << 8)
+				+ (hexval(v[5]) << 4) + hexval(v[6]);
+		return 0;
+	}
+	if (l > 4 && strncmp(v, "rgb(", 4) == 0) {
+		if (sscanf(v + 4, "%d , %d , %d", &r, &g, &b) == 3)
+			return ((r & 0xff) << 16) + ((g & 0xff) << 8) + (b & 0xff);
+		return 0;
+	}
+	for (i = 0; i < sizeof names / sizeof names[0]; i++) {
+		if (strlen(names[i].name) == l
+		 && strncasecmp(v, names[i].name, l) == 0)
+			return names[i].rgb;
+	}
+	return 0;
+}
+
+/* set a style property */
+static void style_prop(struct style *st, char *n, int nl, char *v, int vl)
+{
+	char tmp[64];
+
+	if (vl >= sizeof tmp)
+		vl = sizeof tmp - 1;
+	memcpy(tmp, v, vl);
+	tmp[vl] = '\0';
+	switch (nl) {
+	case 4:
+		if (strncmp(n, "fill", 4) == 0)
+			st->fill = parse_color(v, vl);
+		break;
+	case 5:
+		if (strncmp(n, "color", 5) == 0) {
+			st->color = parse_color(v, vl);
+			if (st->color < 0)
+				st->color = 0;
+		}
+		break;
+	case 6:
+		if (strncmp(n, "stroke", 6) == 0)
+			st->stroke = parse_color(v, vl);
+		break;
+	case 9:
+		if (strncmp(n, "fill-rule", 9) == 0)
+			st->evenodd = strcmp(tmp, "evenodd") == 0;
+		else if (strncmp(n, "font-size", 9) == 0)
+			st->fsize = strtod(tmp, NULL);
+		break;
+	case 10:
+		if (strncmp(n, "font-style", 10) == 0)
+			st->italic = strcmp(tmp, "normal") != 0;
+		break;
+	case 11:
+		if (strncmp(n, "font-family", 11) == 0) {
+			if (strstr(tmp, "ans") || strstr(tmp, "Helvetica")
+			 || strstr(tmp, "Arial") || strstr(tmp, "Verdana"))
+				st->font = 1;
+			else if (strstr(tmp, "ono") || strstr(tmp, "Courier"))
+				st->font = 2;
+			else
+				st->font = 0;
+			if (strstr(tmp, "Bold"))
+				st->bold = 1;
+			if (strstr(tmp, "Italic") || strstr(tmp, "Oblique"))
+				st->italic = 1;
+		} else if (strncmp(n, "font-weight", 11) == 0) {
+			st->bold = strcmp(tmp, "bold") == 0
+				|| strcmp(tmp, "bolder") == 0
+				|| atoi(tmp) >= 600;
+		} else if (strncmp(n, "text-anchor", 11) == 0) {
+			st->anchor = strcmp(tmp, "middle") == 0 ? 1
+				: strcmp(tmp, "end") == 0 ? 2 : 0;
+		}
+		break;
+	case 12:
+		if (strncmp(n, "stroke-width", 12) == 0)
+			st->lw = strtod(tmp, NULL);
+		break;
+	case 14:
+		if (strncmp(n, "stroke-linecap", 14) == 0)
+			st->cap = strcmp(tmp, "round") == 0 ? 1
+				: strcmp(tmp, "square") == 0 ? 2 : 0;
+		break;
+	case 16:
+		if (strncmp(n, "stroke-dasharray", 16) == 0) {
+			char *p;
+
+			if (strcmp(tmp, "none") == 0) {
+				st->dash[0] = '\0';
+				break;
+			}
+			for (p = tmp; *p != '\0'; p++) {
+				if (*p == ',')
+					*p = ' ';
+			}
+			tmp[sizeof st->dash - 1] = '\0';
+			strcpy(st->dash, tmp);
+		}
+		break;
+	}
+}
+
+/* set the style of an element from its attributes */
+static void style_set(struct style *st, struct xelt *x)
+{
+	char *v, *p, *q, *e;
+	int i, l;
+
+	for (i = 0; i < x->na; i++)
+		style_prop(st, x->a[i].n, x->a[i].nl, x->a[i].v, x->a[i].vl);
+	v = xml_attr(x, "style", &l);
+	if (v) {				/* "prop:value;.." */
+		e = v + l;
+		while (v < e) {
+			while (v < e && isspace((unsigned char) *v))
+				v++;
+			p = memchr(v, ':', e - v);
+			if (!p)
+				break;
+			q = memchr(p, ';', e - p);
+			if (!q)
+				q = e;
+			style_prop(st, v, p - v, p + 1, q - p - 1);
+			v = q + 1;
+		}
+	}
+	v = xml_attr(x, "class", &l);		/* (see the SVG header) */
+	if (v) {
+		if (l == 4 && strncmp(v, "fill", 4) == 0) {
+			st->fill = C_CUR;
+			st->stroke = C_NONE;
+		} else if (l == 6 && strncmp(v, "stroke", 6) == 0) {
+			st->stroke = C_CUR;
+			st->fill = C_NONE;
+		}
+	}
+}
+
+/* -- graphic state -- */
+
+static void color_out(struct pbuf *b, int rgb, int op)
+{
+	double v[3];
+
+	if (rgb == 0 && !cairo_out) {
+		pb_put(b, op == CR_FILLRGB ? "0 g\n" : "0 G\n", 4);
+		return;
+	}
+	v[0] = (rgb >> 16) / 255.;
+	v[1] = ((rgb >> 8) & 0xff) / 255.;
+	v[2] = (rgb & 0xff) / 255.;
+	op_out(b, op, 3, v);
+}
+
+/* set the graphic state for painting
+ * return 1 when the state is changed inside 'q' .. 'Q' */
+static int gs_set(struct render *r, struct style *st, int paint)
+{
+	struct gstate n, *gs;
+	double v[16];
+	char *p, *e;
+	int q, i;
+
+	gs = &r->gs;
+	n = *gs;
+	if (paint & P_FILL) {
+		n.fill = st->fill == C_CUR ? st->color : st->fill;
+		if (n.fill == C_INH)
+			n.fill = gs->fill;
+	}
+	if (paint & P_STROKE) {
+		n.stroke = st->stroke == C_CUR ? st->color : st->stroke;
+		if (n.stroke == C_INH)
+			n.stroke = gs->stroke;
+		if (st->lw >= 0)
+			n.lw = st->lw;
+		if (st->dash[0] != '-')
+			strcpy(n.dash, st->dash);
+		if (st->cap >= 0)
+			n.cap = st->cap;
+	}
+
+	/* in a form, the inherited state must be restored */
+	q = (n.fill != gs->fill && gs->fill == C_INH)
+	 || (n.stroke != gs->stroke && gs->stroke == C_INH)
+	 || (n.lw != gs->lw && gs->lw < 0)
+	 || (strcmp(n.dash, gs->dash) != 0 && gs->dash[0] == '-')
+	 || (n.cap != gs->cap && gs->cap < 0);
+	if (q)
+		op_out(r->b, CR_SAVE, 0, NULL);
+	if (n.fill != gs->fill && n.fill >= 0)
+		color_out(r->b, n.fill, CR_FILLRGB);
+	if (n.stroke != gs->stroke && n.stroke >= 0)
+		color_out(r->b, n.stroke, CR_STROKERGB);
+	if (n.lw != gs->lw) {
+		v[0] = n.lw;
+		op_out(r->b, CR_LW, 1, v);
+	}
+	if (strcmp(n.dash, gs->dash) != 0) {
+		if (cairo_out) {
+			p = n.dash;
+			for (i = 0; i < 16; i++) {
+				v[i] = strtod(p, &e);
+				if (e == p)
+					break;
+				p = e;
+			}
+			cr_op(r->b, CR_DASH, i, v);
+		} else {
+			pb_printf(r->b, "[%s] 0 d\n", n.dash);
+		}
+	}
+	if (n.cap != gs->cap) {
+		if (cairo_out) {
+			v[0] = n.cap;
+			cr_op(r->b, CR_CAP, 1, v);
+		} else {
+			pb_printf(r->b, "%d J\n", n.cap);
+		}
+	}
+	if (!q)
+		*gs = n;
+	return q;
+}
+
+/* output a transform */
+static void transform_out(struct pbuf *b, char *v, int l)
+{
+	char *e, *p, *name;
+	float a[6], c, s;
+	int n, nl;
+
+	e = v + l;
+	while (v < e) {
+		while (v < e && (isspace((unsigned char) *v) || *v == ','))
+			v++;
+		name = v;
+		while (v < e && isalpha((unsigned char) *v))
+			v++;
+		nl = v - name;
+		if (nl == 0 || v >= e || *v != '(')
+			break;
+		v++;
+		n = 0;
+		for (;;) {
+			while (v < e && (isspace((unsigned char) *v) || *v == ','))
+				v++;
+			if (v >= e || *v == ')')
+				break;
+			a[n] = strtod(v, &p);
+			if (p == v)
+				break;
+			v = p;
+			if (++n >= 6)
+				break;
+		}
+		while (v < e && *v != ')')
+			v++;
+		v++;
+		if (nl == 9 && strncmp(name, "translate", 9) == 0) {
+			if (n == 1)
+				a[1] = 0;
+			cm_out(b, 1, 0, 0, 1, a[0], a[1]);
+		} else if (nl == 5 && strncmp(name, "scale", 5) == 0) {
+			if (n == 1)
+				a[1] = a[0];
+			cm_out(b, a[0], 0, 0, a[1], 0, 0);
+		} else if (nl == 6 && strncmp(name, "rotate", 6) == 0) {
+			if (n == 3)
+				cm_out(b, 1, 0, 0, 1, a[1], a[2]);
+			c = cos(a[0] * M_PI / 180);
+			s = sin(a[0] * M_PI / 180);
+			cm_out(b, c, s, -s, c, 0, 0);
+			if (n == 3)
+				cm_out(b, 1, 0, 0, 1, -a[1], -a[2]);
+		} else if (nl == 6 && strncmp(name, "matrix", 6) == 0) {
+			if (n == 6)
+				cm_out(b, a[0], a[1], a[2], a[3], a[4], a[5]);
+		} else if (nl == 5 && strncmp(name, "skewX", 5) == 0) {
+			cm_out(b, 1, 0, tan(a[0] * M_PI / 180), 1, 0, 0);
+		} else if (nl == 5 && strncmp(name, "skewY", 5) == 0) {
+			cm_out(b, 1, tan(a[0] * M_PI / 180), 0, 1, 0, 0);
+		}
+	}
+}
+
+/* -- paths -- */
+
+/* output an elliptic arc as Bézier curves (SVG implementation notes) */
+static void arc_out(struct pbuf *b, float x1, float y1,
+		float rx, float ry, float phi, int large, int sweep,
+		float x2, float y2)
+{
+	double cp, sp, dx, dy, x1p, y1p, lambda, sq, num, den;
+	double cxp, cyp, cx, cy, t1, dt, t, a, ux, uy, vx, vy;
+	double v[6];
+	int n, i;
+
+	if (rx == 0 || ry == 0) {
+		v[0] = x2;
+		v[1] = y2;
+		op_out(b, CR_LINE, 2, v);
+		return;
+	}
+	rx = fabs(rx);
+	ry = fabs(ry);
+	cp = cos(phi * M_PI / 180);
+	sp = sin(phi * M_PI / 180);
+	dx = (x1 - x2) / 2;
+	dy = (y1 - y2) / 2;
+	x1p = cp * dx + sp * dy;
+	y1p = -sp * dx + cp * dy;
+	lambda = x1p * x1p / (rx * rx) + y1p * y1p / (ry * ry);
+	if (lambda > 1) {
+		rx *= sqrt(lambda);
+		ry *= sqrt(lambda);
+	}
+	num = rx * rx * ry * ry - rx * rx * y1p * y1p - ry * ry * x1p * x1p;
+	den = rx * rx * y1p * y1p + ry * ry * x1p * x1p;
+	sq = num <= 0 || den == 0 ? 0 : sqrt(num / den);
+	if (large == sweep)
+		sq = -sq;
+	cxp = sq * rx * y1p / ry;
+	cyp = -sq * ry * x1p / rx;
+	cx = cp * cxp - sp * cyp + (x1 + x2) / 2;
+	cy = sp * cxp + cp * cyp + (y1 + y2) / 2;
+	ux = (x1p - cxp) / rx;
+	uy = (y1p - cyp) / ry;
+	vx = (-x1p - cxp) / rx;
+	vy = (-y1p - cyp) / ry;
+	t1 = atan2(uy, ux);
+	dt = atan2(vy, vx) - t1;
+	if (sweep && dt < 0)
+		dt += 2 * M_PI;
+	else if (!sweep && dt > 0)
+		dt -= 2 * M_PI;
+	n = ceil(fabs(dt) / (M_PI / 2) - 0.001);
+	if (n < 1)
+		n = 1;
+	dt /= n;
+	a = 4. / 3 * tan(dt / 4);
+	for (i = 0, t = t1; i < n; i++, t += dt) {
+		double c1 = cos(t), s1 = sin(t),
+			c2 = cos(t + dt), s2 = sin(t + dt);
+		double ex1 = c1 - a * s1, ey1 = s1 + a * c1,
+			ex2 = c2 + a * s2, ey2 = s2 - a * c2;
+
+#define AX(x, y) (cx + rx * (x) * cp - ry * (y) * sp)
+#define AY(x, y) (cy + rx * (x) * sp + ry * (y) * cp)
+		v[0] = AX(ex1, ey1);
+		v[1] = AY(ex1, ey1);
+		v[2] = AX(ex2, ey2);
+		v[3] = AY(ex2, ey2);
+		v[4] = AX(c2, s2);
+		v[5] = AY(c2, s2);
+		op_out(b, CR_CURVE, 6, v);
+#undef AX
+#undef AY
+	}
+}
+
+/* get the numbers of a path command */
+static char *path_nums(char *p, char *e, float *v, int n)
+{
+	char *q;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		while (p < e && (isspace((unsigned char) *p) || *p == ','))
+			p++;
+		if (p >= e)
+			return NULL;
+		v[i] = strtod(p, &q);
+		if (q == p)
+			return NULL;
+		p = q;
+	}
+	return p;
+}
+
+/* check if there are more numbers after a command */
+static int path_more(char *p, char *e)
+{
+	while (p < e && (isspace((unsigned char) *p) || *p == ','))
+		p++;
+	return p < e && (isdigit((unsigned char) *p)
+			|| *p == '-' || *p == '+' || *p == '.');
+}
+
+/* output the path data 'd' */
+static void path_out(struct pbuf *b, char *p, char *e)
+{
+	float v[7], x, y, x0, y0, cx, cy, qx, qy;
+	double d[6];
+	char cmd, lcmd;
+	int rel, i;
+
+	x = y = x0 = y0 = cx = cy = qx = qy = 0;
+	lcmd = 0;
+	while (p < e) {
+		while (p < e && (isspace((unsigned char) *p) || *p == ','))
+			p++;
+		if (p >= e)
+			break;
+		if (isalpha((unsigned char) *p)) {
+			cmd = *p++;
+		} else if (lcmd != 0 && path_more(p, e)) {
+			cmd = lcmd;		/* repeated command */
+			if (cmd == 'M')
+				cmd = 'L';
+			else if (cmd == 'm')
+				cmd = 'l';
+		} else {
+			break;
+		}
+		rel = islower((unsigned char) cmd);
+		switch (toupper((unsigned char) cmd)) {
+		case 'M':
+			p = path_nums(p, e, v, 2);
+			if (!p)
+				return;
+			if (rel) {
+				v[0] += x;
+				v[1] += y;
+			}
+			d[0] = x = x0 = v[0];
+			d[1] = y = y0 = v[1];
+			op_out(b, CR_MOVE, 2, d);
+			cx = qx = x;
+			cy = qy = y;
+			break;
+		case 'L':
+		case 'H':
+		case 'V':
+			switch (toupper((unsigned char) cmd)) {
+			case 'L':
+				p = path_nums(p, e, v, 2);
+				if (!p)
+					return;
+				if (rel) {
+					v[0] += x;
+					v[1] += y;
+				}
+				break;
+			case 'H':
+				p = path_nums(p, e, v, 1);
+				if (!p)
+					return;
+				if (rel)
+					v[0] += x;
+				v[1] = y;
+				break;
+			default:
+				p = path_nums(p, e, v + 1, 1);
+				if (!p)
+					return;
+				if (rel)
+					v[1] += y;
+				v[0] = x;
+				break;
+			}
+			d[0] = x = v[0];
+			d[1] = y = v[1];
+			op_out(b, CR_LINE, 2, d);
+			cx = qx = x;
+			cy = qy = y;
+			break;
+		case 'C':
+		case 'S':
+			if (toupper((unsigned char) cmd) == 'C') {
+				p = path_nums(p, e, v, 6);
+				if (!p)
+					return;
+				if (rel) {
+					v[0] += x; v[1] += y;
+					v[2] += x; v[3] += y;
+					v[4] += x; v[5] += y;
+				}
+			} else {
+				p = path_nums(p, e, v + 2, 4);
+				if (!p)
+					return;
+				if (rel) {
+					v[2] += x; v[3] += y;
+					v[4] += x; v[5] += y;
+				}
+				v[0] = 2 * x - cx;	/* reflection */
+				v[1] = 2 * y - cy;
+			}
+			for (i = 0; i < 6; i++)
+				d[i] = v[i];
+			op_out(b, CR_CURVE, 6, d);
+			cx = v[2];
+			cy = v[3];
+			x = qx = v[4];
+			y = qy = v[5];
+			break;
+		case 'Q':
+		case 'T':
+			if (toupper((unsigned char) cmd) == 'Q') {
+				p = path_nums(p, e, v, 4);
+				if (!p)
+					return;
+				if (rel) {
+					v[0] += x; v[1] += y;
+					v[2] += x; v[3] += y;
+				}
+			} else {
+				p = path_nums(p, e, v + 2, 2);
+				if (!p)
+					return;
+				if (rel) {
+					v[2] += x; v[3] += y;
+				}
+				v[0] = 2 * x - qx;
+				v[1] = 2 * y - qy;
+			}
+			d[0] = x + 2. / 3 * (v[0] - x);
+			d[1] = y + 2. / 3 * (v[1] - y);
+			d[2] = v[2] + 2. / 3 * (v[0] - v[2]);
+			d[3] = v[3] + 2. / 3 * (v[1] - v[3]);
+			d[4] = v[2];
+			d[5] = v[3];
+			op_out(b, CR_CURVE, 6, d);
+			qx = v[0];
+			qy = v[1];
+			x = cx = v[2];
+			y = cy = v[3];
+			break;
+		case 'A':
+			p = path_nums(p, e, v, 7);
+			if (!p)
+				return;
+			if (rel) {
+				v[5] += x;
+				v[6] += y;
+			}
+			arc_out(b, x, y, v[0], v[1], v[2],
+				v[3] != 0, v[4] != 0, v[5], v[6]);
+			x = cx = qx = v[5];
+			y = cy = qy = v[6];
+			break;
+		case 'Z':
+			op_out(b, CR_CLOSE, 0, NULL);
+			x = cx = qx = x0;
+			y = cy = qy = y0;
+			break;
+		default:
+			return;
+		}
+		lcmd = cmd;
+	}
+}
+
+/* output an ellipse */
+static void ellipse_out(struct pbuf *b, float cx, float cy, float rx, float ry)
+{
+	float kx, ky;
+	double v[6];
+
+	kx = rx * 0.5523;
+	ky = ry * 0.5523;
+	v[0] = cx + rx;
+	v[1] = cy;
+	op_out(b, CR_MOVE, 2, v);
+	v[0] = cx + rx; v[1] = cy + ky;
+	v[2] = cx + kx; v[3] = cy + ry;
+	v[4] = cx;	v[5] = cy + ry;
+	op_out(b, CR_CURVE, 6, v);
+	v[0] = cx - kx; v[1] = cy + ry;
+	v[2] = cx - rx; v[3] = cy + ky;
+	v[4] = cx - rx; v[5] = cy;
+	op_out(b, CR_CURVE, 6, v);
+	v[0] = cx - rx; v[1] = cy - ky;
+	v[2] = cx - kx; v[3] = cy - ry;
+	v[4] = cx;	v[5] = cy - ry;
+	op_out(b, CR_CURVE, 6, v);
+	v[0] = cx + kx; v[1] = cy - ry;
+	v[2] = cx + rx; v[3] = cy - ky;
+	v[4] = cx + rx; v[5] = cy;
+	op_out(b, CR_CURVE, 6, v);
+	op_out(b, CR_CLOSE, 0, NULL);
+}
+
+/* output a shape (path, rect, circle, ellipse, line) */
+static void shape_out(struct render *r, struct xelt *x, struct style *st)
+{
+	struct pbuf *b;
+	char *v;
+	double d[4];
+	int paint, l, q;
+
+	paint = 0;
+	if (st->fill != C_NONE && !xml_is(x, "line"))
+		paint |= P_FILL;
+	if (st->stroke != C_NONE)
+		paint |= P_STROKE;
+	if (!paint)
+		return;
+	b = r->b;
+	q = gs_set(r, st, paint);
+	switch (x->name[0]) {
+	case 'p':				/* path */
+		v = xml_attr(x, "d", &l);
+		if (!v)
+			break;
+		path_out(b, v, v + l);
+		break;
+	case 'r':				/* rect */
+		d[0] = xml_num(x, "x");
+		d[1] = xml_num(x, "y");
+		d[2] = xml_num(x, "width");
+		d[3] = xml_num(x, "height");
+		op_out(b, CR_RECT, 4, d);
+		break;
+	case 'c':				/* circle */
+		ellipse_out(b, xml_num(x, "cx"), xml_num(x, "cy"),
+			xml_num(x, "r"), xml_num(x, "r"));
+		break;
+	case 'e':				/* ellipse */
+		ellipse_out(b, xml_num(x, "cx"), xml_num(x, "cy"),
+			xml_num(x, "rx"), xml_num(x, "ry"));
+		break;
+	case 'l':				/* line */
+		d[0] = xml_num(x, "x1");
+		d[1] = xml_num(x, "y1");
+		d[2] = xml_num(x, "x2");
+		d[3] = xml_num(x, "y2");
+		op_out(b, CR_MOVE, 2, d);
+		op_out(b, CR_LINE, 2, d + 2);
+		break;
+	}
+	switch (paint) {
+	case P_FILL:
+		op_out(b, st->evenodd ? CR_EOFILL : CR_FILL, 0, NULL);
+		break;
+	case P_STROKE:
+		op_out(b, CR_STROKE, 0, NULL);
+		break;
+	default:
+		op_out(b, st->evenodd ? CR_EOFILLSTROKE : CR_FILLSTROKE,
+			0, NULL);
+		break;
+	}
+	if (q)
+		op_out(b, CR_RESTORE, 0, NULL);
+}
+
+/* -- texts -- */
+
+/* convert a unicode character to WinAnsi */
+static int winansi(int c)
+{
+	static const short cp1252[32] = {
+		0x20ac, 0, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,
+		0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0, 0x017d, 0,
+		0, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+		0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0, 0x017e, 0x0178,
+	};
+	int i;
+
+	if (c < 0x80 || (c >= 0xa0 && c <= 0xff))
+		return c;
+	for (i = 0; i < 32; i++) {
+		if (cp1252[i] == c)
+			return 0x80 + i;
+	}
+	switch (c) {
+	case 0x266d: return 'b';	/* flat */
+	case 0x266e: return '=';	/* natural */
+	case 0x266f: return '#';	/* sharp */
+	}
+	return '?';
+}
+
+/* get the text of a text element up to '<'
+ * append the WinAnsi characters to 'b' and return the text width
+ * (with cairo, the text is kept in UTF-8 and measured by pango) */
+static char *text_get(char *p, char *e, struct pbuf *b,
+			struct style *st, float *w)
+{
+	unsigned char *q;
+	int c, n;
+	float cw;
+
+	cw = 0;
+	while (p < e && *p != '<') {
+		q = (unsigned char *) p;
+		c = *q;
+		if (c == '&') {			/* entity */
+			p++;
+			if (*p == '#') {
+				if (p[1] == 'x')
+					c = strtol(p + 2, &p, 16);
+				else
+					c = strtol(p + 1, &p, 10);
+			} else if (strncmp(p, "amp", 3) == 0) {
+				c = '&';
+			} else if (strncmp(p, "lt", 2) == 0) {
+				c = '<';
+			} else if (strncmp(p, "gt", 2) == 0) {
+				c = '>';
+			} else if (strncmp(p, "quot", 4) == 0) {
+				c = '"';
+			} else if (strncmp(p, "apos", 4) == 0) {
+				c = '\'';
+			} else {
+				c = '&';
+				p--;
+			}
+			while (p < e && *p != ';' && *p != '<')
+				p++;
+			if (p < e && *p == ';')
+				p++;
+		} else if (c >= 0xc0) {		/* UTF-8 */
+			n = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : 1;
+			c &= 0x3f >> n;
+			p++;
+			while (--n >= 0 && p < e
+			    && (*p & 0xc0) == 0x80)
+				c = (c << 6) | (*p++ & 0x3f);
+		} else {
+			p++;
+			if (c == '\n' || c == '\t')
+				c = ' ';
+		}
+		if (cairo_out) {		/* (cairo: keep UTF-8) */
+			pb_room(b, 4);
+			if (c < 0x80) {
+				b->s[b->len++] = c;
+			} else if (c < 0x800) {
+				b->s[b->len++] = 0xc0 | (c >> 6);
+				b->s[b->len++] = 0x80 | (c & 0x3f);
+			} else if (c < 0x10000) {
+				b->s[b->len++] = 0xe0 | (c >> 12);
+				b->s[b->len++] = 0x80 | ((c >> 6) & 0x3f);
+				b->s[b->len++] = 0x80 | (c & 0x3f);
+			} else {
+				b->s[b->len++] = 0xf0 | (c >> 18);
+				b->s[b->len++] = 0x80 | ((c >> 12) & 0x3f);
+				b->s[b->len++] = 0x80 | ((c >> 6) & 0x3f);
+				b->s[b->len++] = 0x80 | (c & 0x3f);
+			}
+			continue;
+		}
+		c = winansi(c);
+		pb_room(b, 1);
+		b->s[b->len++] = c;
+		if (st->font == 2)
+			cw += .6;
+		else
+			cw += c < 0x80 ? cwid(c) : .5;
+	}
+	*w = cw * st->fsize;
+	return p;
+}
+
+/* output a PDF string */
+static void pdf_str(struct pbuf *b, char *s, int len)
+{
+	int c;
+
+	pb_room(b, len * 2 + 3);
+	b->s[b->len++] = '(';
+	while (--len >= 0) {
+		c = (unsigned char) *s++;
+		if (c == '(' || c == ')' || c == '\\')
+			b->s[b->len++] = '\\';
+		b->s[b->len++] = c;
+	}
+	b->s[b->len++] = ')';
+}
+
+static int font_num(struct style *st)
+{
+	int f;
+
+	f = st->font * 4 + st->bold + st->italic * 2;
+	if (font_obj[f] == 0)
+		font_obj[f] = -1;		/* used */
+	return f + 1;
+}
+
+/* treat a text element (tspan's are treated inline) */
+#define MAXSEG 64
+static char *text_out(struct render *r, char *p, struct xelt *x,
+			struct style *st)
+{
+	struct {
+		int off, len;
+		float dx;
+		float w;
+		struct style st;
+	} seg[MAXSEG];
+	struct xelt xs;
+	struct style sst;
+	struct gstate gs;
+	char *v, *e;
+	float tx, ty, w, tl, dx;
+	double d[4];
+	int i, nseg, q, f, l;
+
+	e = r->e;
+	text_buf.len = 0;
+	nseg = 0;
+	w = 0;
+	sst = *st;
+	dx = 0;
+	while (p < e) {
+		if (*p != '<') {
+			if (nseg >= MAXSEG) {
+				p = memchr(p, '<', e - p);
+				if (!p)
+					p = e;
+				continue;
+			}
+			seg[nseg].off = text_buf.len;
+			p = text_get(p, e, &text_buf, &sst, &seg[nseg].w);
+			seg[nseg].len = text_buf.len - seg[nseg].off;
+			seg[nseg].dx = dx;
+			seg[nseg].st = sst;
+			w += seg[nseg].w + dx;
+			dx = 0;
+			nseg++;
+			continue;
+		}
+		if (p[1] == '!') {
+			p = xml_skip_special(p, e);
+			continue;
+		}
+		if (p[1] == '/') {
+			l = 0;
+			while (p + l < e && p[l] != '>')
+				l++;
+			if (l >= 6 && strncmp(p + 2, "tspan", 5) == 0) {
+				p += l + 1;
+				sst = *st;
+				continue;
+			}
+			p += l + 1;		/* end of text */
+			break;
+		}
+		p = xml_tag(p + 1, e, &xs);
+		if (xml_is(&xs, "tspan")) {
+			sst = *st;
+			style_set(&sst, &xs);
+			dx = xml_num(&xs, "dx");
+			if (xs.empty)
+				sst = *st;
+		} else if (!xs.empty) {
+			p = xml_skip(p, e);
+		}
+	}
+	if (nseg == 0)
+		return p;
+
+	/* output */
+	v = xml_attr(x, "transform", &l);
+	if (v) {
+		gs = r->gs;
+		op_out(r->b, CR_SAVE, 0, NULL);
+		transform_out(r->b, v, l);
+	}
+	q = gs_set(r, st, P_FILL);
+	tx = xml_num(x, "x");
+	ty = xml_num(x, "y");
+	tl = xml_num(x, "textLength");
+	if (cairo_out) {		/* (the text is measured by cairo) */
+		d[0] = st->anchor;
+		d[1] = tl;
+		d[2] = tx;
+		d[3] = ty;
+		cr_op(r->b, CR_BT, 4, d);
+		for (i = 0; i < nseg; i++) {
+			d[0] = font_num(&seg[i].st) - 1;
+			d[1] = seg[i].st.fsize;
+			cr_op(r->b, CR_FONT, 2, d);
+			if (seg[i].dx > 0 && seg[i].st.fsize > 0) {
+				d[0] = seg[i].dx;
+				cr_op(r->b, CR_SPACE, 1, d);
+			}
+			d[0] = seg[i].len;
+			cr_op(r->b, CR_TEXT, 1, d);
+			pb_put(r->b, text_buf.s + seg[i].off, seg[i].len);
+		}
+		cr_op(r->b, CR_ET, 0, NULL);
+	} else {
+		if (tl > 0 && w > 0) {
+			pb_printf(r->b, "BT %.2f Tz\n", tl / w * 100);
+		} else {
+			pb_put(r->b, "BT\n", 3);
+			if (st->anchor == 1)
+				tx -= w / 2;
+			else if (st->anchor == 2)
+				tx -= w;
+		}
+		pb_printf(r->b, "1 0 0 -1 %.2f %.2f Tm\n", tx, ty);
+		f = -1;
+		for (i = 0; i < nseg; i++) {
+			l = font_num(&seg[i].st);
+			if (l != f
+			 || (i > 0 && seg[i].st.fsize != seg[i - 1].st.fsize)) {
+				f = l;
+				pb_printf(r->b, "/F%d %.2f Tf\n",
+					f, seg[i].st.fsize);
+			}
+			if (seg[i].dx != 0 && seg[i].st.fsize > 0)
+				pb_printf(r->b, "[%.1f] TJ\n",
+					-seg[i].dx * 1000 / seg[i].st.fsize);
+			pdf_str(r->b, text_buf.s + seg[i].off, seg[i].len);
+			pb_put(r->b, " Tj\n", 4);
+		}
+		pb_put(r->b, "ET\n", 3);
+		if (tl > 0 && w > 0)
+			pb_put(r->b, "100 Tz\n", 7);
+	}
+	if (q)
+		op_out(r->b, CR_RESTORE, 0, NULL);
+	if (v) {
+		op_out(r->b, CR_RESTORE, 0, NULL);
+		r->gs = gs;
+	}
+	return p;
+}
+
+/* -- symbols -- */
+
+/* find the XObject of an id */
+static int id_find(char *id, int len)
+{
+	int i;
+
+	for (i = nid; --i >= 0; ) {
+		if (strlen(id_name[i]) == len
+		 && strncmp(id_name[i], id, len) == 0)
+			return id_xobj[i];
+	}
+	return -1;
+}
+
+static void id_add(char *id, int len, int xo)
+{
+	if (nid >= maxid) {
+		maxid = maxid * 2 + 64;
+		id_name = realloc(id_name, maxid * sizeof *id_name);
+		id_xobj = realloc(id_xobj, maxid * sizeof *id_xobj);
+	}
+	id_name[nid] = malloc(len + 1);
+	memcpy(id_name[nid], id, len);
+	id_name[nid][len] = '\0';
+	id_xobj[nid++] = xo;
+}
+
+/* create the XObject of a definition */
+static void def_out(struct render *r, char *tag, char *end,
+			char *id, int idl)
+{
+	struct render fr;
+	struct style st;
+	struct xelt x;
+	struct pbuf sav;
+	char *key;
+	int i, klen;
+
+	klen = idl + 1 + (end - tag);
+	for (i = 0; i < nxobj; i++) {
+		if (xobj_tb[i].klen == klen
+		 && memcmp(xobj_tb[i].key, id, idl) == 0
+		 && memcmp(xobj_tb[i].key + idl + 1, tag, end - tag) == 0) {
+			id_add(id, idl, i);	/* already defined */
+			return;
+		}
+	}
+
+	/* render the definition with an inherited state */
+	memset(&st, 0, sizeof st);
+	st.color = C_INH;
+	st.fill = C_CUR;
+	st.stroke = C_NONE;
+	st.lw = -1;
+	st.dash[0] = '-';
+	st.cap = -1;
+	st.fsize = 16;
+	memset(&fr, 0, sizeof fr);
+	fr.gs.fill = fr.gs.stroke = C_INH;
+	fr.gs.lw = -1;
+	fr.gs.dash[0] = '-';
+	fr.gs.cap = -1;
+	fr.e = end;
+	fr.depth = r->depth;
+	sav = form_buf;			/* (definitions may be nested) */
+	memset(&form_buf, 0, sizeof form_buf);
+	fr.b = &form_buf;
+	render_elt(&fr, xml_tag(tag + 1, end, &x), &x, &st);
+
+	if (nxobj >= maxxobj) {
+		maxxobj = maxxobj * 2 + 32;
+		xobj_tb = realloc(xobj_tb, maxxobj * sizeof *xobj_tb);
+	}
+	key = malloc(klen);
+	memcpy(key, id, idl);
+	key[idl] = '\0';
+	memcpy(key + idl + 1, tag, end - tag);
+	xobj_tb[nxobj].key = key;
+	xobj_tb[nxobj].klen = klen;
+	if (cairo_out) {			/* (drawn by cairo) */
+		xobj_tb[nxobj].obj = 0;
+		xobj_tb[nxobj].data = form_buf;
+	} else {
+		xobj_tb[nxobj].obj = obj_new();
+		obj_stream(xobj_tb[nxobj].obj,
+			"/Type/XObject/Subtype/Form"
+			"/BBox[-10000 -10000 10000 10000]"
+			"/Resources 3 0 R", &form_buf);
+		free(form_buf.s);
+		memset(&xobj_tb[nxobj].data, 0,
+			sizeof xobj_tb[nxobj].data);
+	}
+	form_buf = sav;
+	id_add(id, idl, nxobj++);
+}
+
+/* treat the definitions */
+static char *defs_out(struct render *r, char *p)
+{
+	struct xelt x;
+	char *tag, *id, *e;
+	int l;
+
+	e = r->e;
+	while (p < e) {
+		p = memchr(p, '<', e - p);
+		if (!p)
+			return e;
+		if (p[1] == '!' || p[1] == '?') {
+			p = xml_skip_special(p, e);
+			continue;
+		}
+		if (p[1] == '/') {		/* </defs> */
+			p = memchr(p, '>', e - p);
+			return p ? p + 1 : e;
+		}
+		tag = p;
+		p = xml_tag(p + 1, e, &x);
+		if (!x.empty)
+			p = xml_skip(p, e);
+		id = xml_attr(&x, "id", &l);
+		if (id)
+			def_out(r, tag, p, id, l);
+	}
+	return e;
+}
+
+/* draw a form XObject with the current color */
+static void form_out(struct render *r, struct style *st, int i,
+			char *tr, int trl, float x, float y)
+{
+	struct style ust;
+	double d;
+	int q;
+
+	ust = *st;
+	ust.fill = ust.stroke = C_CUR;
+	q = gs_set(r, &ust, P_FILL | P_STROKE);
+	op_out(r->b, CR_SAVE, 0, NULL);
+	if (tr)
+		transform_out(r->b, tr, trl);
+	if (x != 0 || y != 0)
+		cm_out(r->b, 1, 0, 0, 1, x, y);
+	if (cairo_out) {
+		d = i;
+		cr_op(r->b, CR_FORM, 1, &d);
+	} else {
+		pb_printf(r->b, "/X%d Do\n", i);
+	}
+	op_out(r->b, CR_RESTORE, 0, NULL);
+	if (q)
+		op_out(r->b, CR_RESTORE, 0, NULL);
+}
+
+/* output a 'use' */
+static void use_out(struct render *r, struct xelt *x, struct style *st)
+{
+	char *v, *tr;
+	int l, i;
+
+	v = xml_attr(x, "xlink:href", &l);
+	if (!v)
+		v = xml_attr(x, "href", &l);
+	if (!v || *v != '#')
+		return;
+	i = id_find(v + 1, l - 1);
+	if (i < 0)
+		return;
+	tr = xml_attr(x, "transform", &l);
+	form_out(r, st, i, tr, l, xml_num(x, "x"), xml_num(x, "y"));
+}
+
+/* -- render the children of an element -- */
+static char *render_children(struct render *r, char *p, struct style *st)
+{
+	struct xelt x;
+	char *e;
+
+	e = r->e;
+	while (p < e) {
+		p = memchr(p, '<', e - p);
+		if (!p)
+			return e;
+		if (p[1] == '!' || p[1] == '?') {
+			p = xml_skip_special(p, e);
+			continue;
+		}
+		if (p[1] == '/') {
+			p = memchr(p, '>', e - p);
+			return p ? p + 1 : e;
+		}
+		p = xml_tag(p + 1, e, &x);
+		p = render_elt(r, p, &x, st);
+	}
+	return e;
+}
+
+/* -- render an element -- */
+/* 'p' points after the start tag */
+static char *render_elt(struct render *r, char *p, struct xelt *x,
+			struct style *st)
+{
+	struct style cst;
+	struct gstate gs;
+	char *v;
+	int l;
+
+	if (++r->depth > 64) {			/* (too deep) */
+		r->depth--;
+		return x->empty ? p : xml_skip(p, r->e);
+	}
+	cst = *st;
+	style_set(&cst, x);
+	switch (x->name[0]) {
+	case 'c':
+		if (xml_is(x, "circle"))
+			goto shape;
+		break;
+	case 'd':
+		if (xml_is(x, "defs")) {
+			if (!x->empty)
+				p = defs_out(r, p);
+			r->depth--;
+			return p;
+		}
+		break;
+	case 'e':
+		if (xml_is(x, "ellipse"))
+			goto shape;
+		break;
+	case 'g':
+	case 'a':
+	case 's':
+		if (!xml_is(x, "g") && !xml_is(x, "a") && !xml_is(x, "svg"))
+			break;
+		if (x->empty)
+			break;
+		v = xml_attr(x, "transform", &l);
+		gs = r->gs;
+		op_out(r->b, CR_SAVE, 0, NULL);
+		if (v)
+			transform_out(r->b, v, l);
+		p = render_children(r, p, &cst);
+		op_out(r->b, CR_RESTORE, 0, NULL);
+		r->gs = gs;
+		r->depth--;
+		return p;
+	case 'l':
+		if (xml_is(x, "line"))
+			goto shape;
+		break;
+	case 'p':
+		if (xml_is(x, "path"))
+			goto shape;
+		break;
+	case 'r':
+		if (xml_is(x, "rect"))
+			goto shape;
+		break;
+	case 't':
+		if (xml_is(x, "text")) {
+			if (!x->empty)
+				p = text_out(r, p, x, &cst);
+			r->depth--;
+			return p;
+		}
+		break;
+	case 'u':
+		if (xml_is(x, "use"))
+			use_out(r, x, &cst);
+		break;
+	}
+	if (!x->empty)
+		p = xml_skip(p, r->e);
+	r->depth--;
+	return p;
+
+shape:
+	v = xml_attr(x, "transform", &l);
+	if (v) {
+		gs = r->gs;
+		op_out(r->b, CR_SAVE, 0, NULL);
+		transform_out(r->b, v, l);
+	}
+	shape_out(r, x, &cst);
+	if (v) {
+		op_out(r->b, CR_RESTORE, 0, NULL);
+		r->gs = gs;
+	}
+	if (!x->empty)
+		p = xml_skip(p, r->e);
+	r->depth--;
+	return p;
+}
+
+/* -- translate the SVG code which was not drawn directly -- */
+static void svg_flush(void)
+{
+	char *p, *e;
+
+	fflush(pdf_svg);
+	if (svg_l == 0)
+		return;
+	p = svg_s;
+	e = p + svg_l;
+	page_r.e = e;
+	while (p < e)			/* (skip the unexpected end tags) */
+		p = render_children(&page_r, p, in_g ? &g_st : &page_st);
+	rewind(pdf_svg);
+	svg_l = 0;
+}
+
+/* -- start a new page -- */
+/* the SVG code which is not drawn directly goes to a memory stream */
+void pdf_new_page(void)
+{
+	if (!pdf_out) {				/* start of the PDF file */
+		pdf_out = fout;
+		pdf_pos = 0;
+		nobj = 0;
+		npages = 0;
+		nxobj = 0;
+		memset(font_obj, 0, sizeof font_obj);
+		obj_new();			/* catalog */
+		obj_new();			/* page tree */
+		obj_new();			/* resources */
+		if (!cairo_out)
+			pdf_printf("%%PDF-1.4\n%%\xe2\xe3\xcf\xd3\n");
+	}
+	if (!pdf_svg) {
+		pdf_svg = open_memstream(&svg_s, &svg_l);
+		if (!pdf_svg) {
+			error(1, NULL, "Out of memory");
+			fatal_exit(EXIT_FAILURE);
+		}
+	}
+	rewind(pdf_svg);
+	svg_l = 0;
+	fout = pdf_svg;
+}
+
+/* -- direct drawing from svg.c -- */
+/* the coordinates are the ones of the SVG output */
+
+/* start the page (instead of the SVG header) */
+void pdf_page(float w, float h, char *bg)
+{
+	struct style st;
+	double v[4];
+	int q;
+
+	page_w = w * PX_PT;
+	page_h = h * PX_PT;
+	memset(&page_st, 0, sizeof page_st);
+	page_st.fill = C_CUR;
+	page_st.stroke = C_NONE;
+	page_st.lw = 1;
+	page_st.fsize = 16;
+	memset(&page_r, 0, sizeof page_r);
+	page_r.gs.lw = 1;
+	page_buf.len = 0;
+	page_r.b = &page_buf;
+	path_buf.len = 0;
+	in_g = 0;
+	if (cairo_out)
+		cm_out(page_r.b, PX_PT, 0, 0, -PX_PT, 0, page_h);
+	else
+		pb_printf(page_r.b, "%.2f 0 0 %.2f 0 %.2f cm\n",
+			PX_PT, -PX_PT, page_h);
+	if (!bg || *bg == '\0')
+		return;
+	st = page_st;
+	st.fill = parse_color(bg, strlen(bg));
+	q = gs_set(&page_r, &st, P_FILL);
+	v[0] = v[1] = 0;
+	v[2] = w;
+	v[3] = h;
+	op_out(page_r.b, CR_RECT, 4, v);
+	op_out(page_r.b, CR_FILL, 0, NULL);
+	if (q)
+		op_out(page_r.b, CR_RESTORE, 0, NULL);
+}
+
+/* start a graphical container */
+void pdf_g(float lw, float sx, float sy, float tx, float ty, float rot,
+	int rgb, char *font, float fsize)
+{
+	svg_flush();
+	sx = rint(sx * 1000) / 1000;		/* (rounded as in SVG) */
+	sy = rint(sy * 1000) / 1000;
+	tx = rint(tx * 100) / 100;
+	ty = rint(ty * 100) / 100;
+	rot = rint(rot * 100) / 100;
+	lw = rint(lw * 100) / 100;
+	g_gs = page_r.gs;
+	op_out(page_r.b, CR_SAVE, 0, NULL);
+	if (sx != 1 || sy != 1)
+		cm_out(page_r.b, sx, 0, 0, sy, 0, 0);
+	if (rot != 0) {
+		if (tx != 0 || ty != 0)
+			cm_out(page_r.b, 1, 0, 0, 1, tx, ty);
+		cm_out(page_r.b, cos(rot * M_PI / 180), sin(rot * M_PI / 180),
+			-sin(rot * M_PI / 180), cos(rot * M_PI / 180), 0, 0);
+	}
+	g_st = page_st;
+	g_st.lw = lw;
+	g_st.color = rgb;
+	if (*font != '\0') {
+		g_st.bold = g_st.italic = 0;
+		style_prop(&g_st, "font-family", 11, font, strlen(font));
+		g_st.fsize = fsize;
+	}
+	in_g = 1;
+}
+
+/* end of the graphical container */
+void pdf_g_end(void)
+{
+	svg_flush();
+	if (!in_g)
+		return;
+	op_out(page_r.b, CR_RESTORE, 0, NULL);
+	page_r.gs = g_gs;
+	in_g = 0;
+}
+
+/* symbol definitions */
+void pdf_defs(char *def)
+{
+	struct render r;
+
+	memset(&r, 0, sizeof r);
+	r.e = def + strlen(def);
+	defs_out(&r, def);
+}
+
+/* draw a symbol */
+void pdf_use(char *id, float x, float y)
+{
+	int i;
+
+	svg_flush();
+	i = id_find(id, strlen(id));
+	if (i >= 0)
+		form_out(&page_r, in_g ? &g_st : &page_st, i, NULL, 0, x, y);
+}
+
+/* add a segment to the current path (CR_MOVE, CR_LINE, CR_CURVE, CR_CLOSE) */
+void pdf_path(int op, int n, float *v)
+{
+	double d[6];
+	int i;
+
+	for (i = 0; i < n; i++)
+		d[i] = v[i];
+	op_out(&path_buf, op, n, d);
+}
+
+/* add a circle arc of radius 'r' to the current path */
+void pdf_arc(float x1, float y1, float r, int sweep, float x2, float y2)
+{
+	arc_out(&path_buf, x1, y1, r, r, 0, 0, sweep, x2, y2);
+}
+
+/* add a circle to the current path */
+void pdf_circle(float x, float y, float r)
+{
+	ellipse_out(&path_buf, x, y, r, r);
+}
+
+/* paint the current path (CR_FILL, CR_EOFILL or CR_STROKE)
+ * 'lw' is the line width (< 0 if inherited)
+ * 'dash' is the SVG dash attribute (may be NULL) */
+void pdf_paint(int op, float lw, char *dash)
+{
+	struct style st;
+	char *p;
+	int paint, q;
+
+	svg_flush();
+	st = in_g ? g_st : page_st;
+	if (op == CR_STROKE) {
+		st.fill = C_NONE;
+		st.stroke = C_CUR;
+		paint = P_STROKE;
+	} else {
+		st.fill = C_CUR;
+		st.stroke = C_NONE;
+		paint = P_FILL;
+	}
+	if (lw >= 0)
+		st.lw = lw;
+	if (dash && (p = strstr(dash, "dasharray=\"")) != NULL) {
+		p += 11;
+		style_prop(&st, "stroke-dasharray", 16, p, strcspn(p, "\""));
+	}
+	q = gs_set(&page_r, &st, paint);
+	pb_put(page_r.b, path_buf.s, path_buf.len);
+	path_buf.len = 0;
+	op_out(page_r.b, op, 0, NULL);
+	if (q)
+		op_out(page_r.b, CR_RESTORE, 0, NULL);
+}
+
+/* -- end of page: output the content stream -- */
+void pdf_close_page(void)
+{
+	int cobj, pobj;
+
+	if (!pdf_out || fout != pdf_svg)
+		return;
+	svg_flush();
+	if (in_g)
+		pdf_g_end();
+	fout = pdf_out;
+	while (nid > 0)
+		free(id_name[--nid]);
+	if (page_w <= 0 || page_h <= 0)
+		return;
+
+#ifdef HAVE_PANGO
+	if (cairo_out) {
+		pg_cairo_page(pdf_out, page_buf.s, page_buf.len,
+				page_w, page_h);
+		return;
+	}
+#endif
+	cobj = obj_new();
+	obj_stream(cobj, "", &page_buf);
+	pobj = obj_new();
+	obj_start(pobj);
+	pdf_printf("<</Type/Page/Parent 2 0 R"
+		"/MediaBox[0 0 %.2f %.2f]"
+		"/Resources 3 0 R/Contents %d 0 R>>\nendobj\n",
+		page_w, page_h, cobj);
+	if (npages >= maxpages) {
+		maxpages = maxpages * 2 + 64;
+		page_obj = realloc(page_obj, maxpages * sizeof *page_obj);
+	}
+	page_obj[npages++] = pobj;
+}
+
+/* -- get the content of a form (cairo) -- */
+char *pdf_form(int n, int *len)
+{
+	if (n < 0 || n >= nxobj)
+		return NULL;
+	*len = xobj_tb[n].data.len;
+	return xobj_tb[n].data.s;
+}
+
+/* -- end of the PDF file -- */
+static void pdf_free(void);
+void pdf_close(void)
+{
+	long xref;
+	int i;
+
+	if (!pdf_out)
+		return;
+	if (fout == pdf_svg)
+		pdf_close_page();
+	if (cairo_out) {
+#ifdef HAVE_PANGO
+		pg_cairo_close();
+#endif
+		pdf_free();
+		return;
+	}
+
+	/* fonts and resources */
+	for (i = 0; i < 12; i++) {
+		if (font_obj[i] == 0)
+			continue;
+		font_obj[i] = obj_new();
+		obj_start(font_obj[i]);
+		pdf_printf("<</Type/Font/Subtype/Type1/BaseFont/%s"
+			"/Encoding/WinAnsiEncoding>>\nendobj\n",
+			font_names[i]);
+	}
+	obj_start(O_RES);
+	pdf_printf("<</ProcSet[/PDF/Text]/Font<<");
+	for (i = 0; i < 12; i++) {
+		if (font_obj[i] > 0)
+			pdf_printf("/F%d %d 0 R", i + 1, font_obj[i]);
+	}
+	pdf_printf(">>/XObject<<");
+	for (i = 0; i < nxobj; i++)
+		pdf_printf("/X%d %d 0 R", i, xobj_tb[i].obj);
+	pdf_printf(">>>>\nendobj\n");
+
+	/* page tree and catalog */
+	obj_start(O_PAGES);
+	pdf_printf("<</Type/Pages/Count %d/Kids[", npages);
+	for (i = 0; i < npages; i++)
+		pdf_printf("%s%d 0 R", i == 0 ? "" : " ", page_obj[i]);
+	pdf_printf("]>>\nendobj\n");
+	obj_start(O_CATALOG);
+	pdf_printf("<</Type/Catalog/Pages 2 0 R>>\nendobj\n");
+	i = obj_new();				/* information */
+	obj_start(i);
+	pdf_printf("<</Creator(abcm2ps-" VERSION ")>>\nendobj\n");
+
+	xref = pdf_pos;
+	pdf_printf("xref\n0 %d\n0000000000 65535 f \n", nobj + 1);
+	for (i = 1; i <= nobj; i++)
+		pdf_printf("%010ld 00000 n \n", obj_off[i]);
+	pdf_printf("trailer\n<</Size %d/Root 1 0 R/Info %d 0 R>>\n"
+		"startxref\n%ld\n%%%%EOF\n",
+		nobj + 1, i - 1, xref);
+	pdf_free();
+}
+
+/* -- free the resources of the PDF file -- */
+static void pdf_free(void)
+{
+	int i;
+
+	for (i = 0; i < nxobj; i++) {
+		free(xobj_tb[i].key);
+		free(xobj_tb[i].data.s);
+	}
+	free(xobj_tb);
+	xobj_tb = NULL;
+	nxobj = maxxobj = 0;
+	free(obj_off);
+	obj_off = NULL;
+	maxobj = 0;
+	free(page_obj);
+	page_obj = NULL;
+	maxpages = 0;
+	free(id_name);
+	free(id_xobj);
+	id_name = NULL;
+	id_xobj = NULL;
+	maxid = 0;
+	free(page_buf.s);
+	free(text_buf.s);
+	free(path_buf.s);
+	memset(&page_buf, 0, sizeof page_buf);
+	memset(&text_buf, 0, sizeof text_buf);
+	memset(&path_buf, 0, sizeof path_buf);
+#ifdef HAVE_ZLIB
+	free(zbuf.s);
+	memset(&zbuf, 0, sizeof zbuf);
+#endif
+	pdf_out = NULL;
+	if (pdf_svg) {
+		fclose(pdf_svg);
+		pdf_svg = NULL;
+		free(svg_s);
+		svg_s = NULL;
+	}
+}
@@ -0,0 +1,508 @@
+/*
+ * Rendering daemon on a Unix socket (option '--serve').
+ *
+ * This file is part of abcm2ps.
+ *
+ * Copyright (C) 2016 Jean-François Moine
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * The daemon is initialized once: default format, format files and
+ * options of its command line. Then, for each connection, a child
+ * process is created. It starts with the initialized state of the
+ * daemon, so that nothing is kept from one request to the next one.
+ * As the default format depends on the kind of output (PostScript or
+ * SVG), an image of the daemon is created at startup and initialized
+ * for the other kind of output. When a request asks for this kind of
+ * output, it is passed to the image (arguments, ABC text and output
+ * files) which treats it in a child process.
+ *
+ * request:
+ *	"<number of arguments> <length of the ABC text>\n"
+ *	the arguments, each one terminated by a null character
+ *	the ABC text
+ * response:
+ *	"<exit status> <length of the output> <length of the messages>\n"
+ *	the output (as with '-O -')
+ *	the messages
+ * The arguments of the requests are options only. As the output goes to
+ * the response, the options which output to files ('-O', '-y', '-z')
+ * or to stdout ('-h', '-H') are refused (see args_check() in lib.c).
+ * With '-E', the EPS images follow each other in the output.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "abcm2ps.h"
+
+#if defined(unix) || defined(__unix__)
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#endif
+
+#define MAXARGS 256			/* max number of arguments by request */
+#define MAXARGSZ 1024			/* max size of an argument */
+#define NFDS 5				/* files passed to the image */
+
+int serve_req;				/* treating a request in a child */
+int serve_nargs;			/* number of arguments of the daemon */
+
+#if defined(unix) || defined(__unix__)
+static int conn;			/* connection of the request */
+static int req_status = EXIT_FAILURE;
+static int serve_kind;			/* kind of output of the daemon */
+static char **serve_argv;
+static char **req_argv;			/* arguments of the request */
+static int req_argc;
+static int img_fd = -1;			/* socket to the image */
+static int img_in = -1;			/* (in the image) socket from the daemon */
+static int img_st = -1;			/* (in a request of the image) exit status */
+
+/* -- kind of output: 1 for SVG, 0 for PostScript -- */
+static int out_kind(void)
+{
+	return svg || epsf > 2;
+}
+
+/* -- send a buffer -- */
+static void send_buf(char *p, size_t l)
+{
+	ssize_t n;
+
+	while (l > 0) {
+		n = write(conn, p, l);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		p += n;
+		l -= n;
+	}
+}
+
+/* -- send the content of a temporary file -- */
+static void send_file(int fd)
+{
+	char buf[8192];
+	ssize_t n;
+
+	lseek(fd, 0, SEEK_SET);
+	while ((n = read(fd, buf, sizeof buf)) > 0)
+		send_buf(buf, n);
+}
+
+/* -- send the response at end of the child -- */
+static void reply(void)
+{
+	struct stat out_st, err_st;
+	char hdr[64];
+
+	fflush(stdout);
+	fflush(stderr);
+	if (fstat(1, &out_st) < 0 || fstat(2, &err_st) < 0)
+		return;
+	sprintf(hdr, "%d %ld %ld\n",
+		req_status, (long) out_st.st_size, (long) err_st.st_size);
+	send_buf(hdr, strlen(hdr));
+	send_file(1);
+	send_file(2);
+	close(conn);
+}
+
+/* -- redirect a standard file to a temporary file -- */
+static void redirect(FILE *f, int fd)
+{
+	if (!f || dup2(fileno(f), fd) < 0) {
+		perror("Cannot create a temporary file");
+		exit(EXIT_FAILURE);
+	}
+	fclose(f);
+}
+
+/* -- treat a request in a child process -- */
+static void request(void)
+{
+	FILE *in, *abc;
+	char **av, buf[8192];
+	int nargs, ac, c, l;
+	long len;
+
+	signal(SIGCHLD, SIG_DFL);
+	redirect(tmpfile(), 1);
+	redirect(tmpfile(), 2);
+	atexit(reply);
+
+	in = fdopen(conn, "r");
+	if (!in
+	 || fscanf(in, "%d %ld", &nargs, &len) != 2
+	 || getc(in) != '\n'
+	 || nargs < 0 || nargs > MAXARGS
+	 || len < 0) {
+		error(1, NULL, "Bad request header");
+		exit(EXIT_FAILURE);
+	}
+
+	av = malloc((serve_nargs + nargs + 5) * sizeof *av);
+	for (ac = 0; ac <= serve_nargs; ac++)
+		av[ac] = serve_argv[ac];
+	while (--nargs >= 0) {
+		l = 0;
+		while ((c = getc(in)) != '\0') {
+			if (c == EOF || l >= MAXARGSZ - 1) {
+				error(1, NULL, "Bad request argument");
+				exit(EXIT_FAILURE);
+			}
+			buf[l++] = c;
+		}
+		buf[l] = '\0';
+		av[ac++] = strdup(buf);
+	}
+	av[ac] = NULL;
+	req_argv = av + serve_nargs + 1;
+	req_argc = args_check(req_argv);
+	if (req_argc < 0) {
+		error(1, NULL, "Bad request arguments (file name or forbidden option)");
+		exit(EXIT_FAILURE);
+	}
+	av[ac++] = "-O";
+	av[ac++] = "-";
+	av[ac++] = "-";			/* ABC text from stdin */
+	av[ac] = NULL;
+
+	abc = tmpfile();
+	while (len > 0) {
+		l = len > sizeof buf ? sizeof buf : len;
+		l = fread(buf, 1, l, in);
+		if (l <= 0) {
+			error(1, NULL, "Truncated ABC text");
+			exit(EXIT_FAILURE);
+		}
+		if (abc)
+			fwrite(buf, 1, l, abc);
+		len -= l;
+	}
+	if (abc)
+		rewind(abc);
+	redirect(abc, 0);
+	clearerr(stdin);
+
+	serve_req = 1;
+	req_status = abcm2ps_main(ac, av);
+	exit(req_status);
+}
+
+/* -- put the exit status of a request treated by the image -- */
+static void put_status(void)
+{
+	fflush(stdout);
+	fflush(stderr);
+	if (write(img_st, &req_status, sizeof req_status) < 0)
+		;
+}
+
+/* -- treat a request passed to the image in a child process -- */
+static void img_request(int *fds)
+{
+	FILE *f;
+	char **av, buf[MAXARGSZ];
+	int ac, c, l;
+
+	signal(SIGCHLD, SIG_DFL);
+	close(img_in);
+	if (dup2(fds[1], 0) < 0
+	 || dup2(fds[2], 1) < 0
+	 || dup2(fds[3], 2) < 0)
+		exit(EXIT_FAILURE);
+	img_st = fds[4];
+	atexit(put_status);
+	close(fds[1]);
+	close(fds[2]);
+	close(fds[3]);
+
+	/* get the arguments (already checked) */
+	av = malloc((serve_nargs + MAXARGS + 5) * sizeof *av);
+	f = fdopen(fds[0], "r");
+	if (!av || !f)
+		exit(EXIT_FAILURE);
+	for (ac = 0; ac <= serve_nargs; ac++)
+		av[ac] = serve_argv[ac];
+	l = 0;
+	while ((c = getc(f)) != EOF) {
+		if (c != '\0') {
+			if (l < MAXARGSZ - 1)
+				buf[l++] = c;
+			continue;
+		}
+		if (ac > serve_nargs + MAXARGS)
+			exit(EXIT_FAILURE);
+		buf[l] = '\0';
+		av[ac++] = strdup(buf);
+		l = 0;
+	}
+	fclose(f);
+	av[ac++] = "-O";
+	av[ac++] = "-";
+	av[ac++] = "-";			/* ABC text from stdin */
+	av[ac] = NULL;
+
+	serve_req = 1;
+	req_status = abcm2ps_main(ac, av);
+	exit(req_status);
+}
+
+/* -- treat the requests passed by the daemon -- */
+static int img_serve(void)
+{
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	struct iovec iov;
+	union {
+		struct cmsghdr h;
+		char buf[CMSG_SPACE(NFDS * sizeof (int))];
+	} u;
+	int fds[NFDS], i;
+	ssize_t n;
+	char c;
+
+	signal(SIGCHLD, SIG_IGN);	/* no zombie */
+	for (;;) {
+		memset(&msg, 0, sizeof msg);
+		iov.iov_base = &c;
+		iov.iov_len = 1;
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = u.buf;
+		msg.msg_controllen = sizeof u.buf;
+		n = recvmsg(img_in, &msg, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("recvmsg");
+			break;
+		}
+		if (n == 0)
+			break;			/* the daemon is stopped */
+		cm = CMSG_FIRSTHDR(&msg);
+		if (!cm
+		 || cm->cmsg_level != SOL_SOCKET
+		 || cm->cmsg_type != SCM_RIGHTS
+		 || cm->cmsg_len != CMSG_LEN(sizeof fds))
+			continue;
+		memcpy(fds, CMSG_DATA(cm), sizeof fds);
+		fflush(stdout);
+		fflush(stderr);
+		switch (fork()) {
+		case 0:
+			img_request(fds);	/* no return */
+		case -1:
+			perror("fork");
+			break;
+		}
+		for (i = 0; i < NFDS; i++)
+			close(fds[i]);
+	}
+	return EXIT_SUCCESS;
+}
+
+/* -- pass the current request to the image -- */
+static void img_pass(void)
+{
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	struct iovec iov;
+	union {
+		struct cmsghdr h;
+		char buf[CMSG_SPACE(NFDS * sizeof (int))];
+	} u;
+	FILE *args;
+	int fds[NFDS], st[2], status, i;
+	ssize_t n;
+	char c = 'r';
+
+	args = tmpfile();
+	if (!args || pipe(st) < 0) {
+		perror("Cannot pass the request");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < req_argc; i++)
+		fwrite(req_argv[i], 1, strlen(req_argv[i]) + 1, args);
+	rewind(args);
+	fflush(stdout);
+	fflush(stderr);
+	fds[0] = fileno(args);
+	fds[1] = 0;
+	fds[2] = 1;
+	fds[3] = 2;
+	fds[4] = st[1];
+
+	memset(&msg, 0, sizeof msg);
+	iov.iov_base = &c;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = u.buf;
+	msg.msg_controllen = sizeof u.buf;
+	cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof fds);
+	memcpy(CMSG_DATA(cm), fds, sizeof fds);
+	if (sendmsg(img_fd, &msg, 0) < 0) {
+		perror("Cannot pass the request");
+		exit(EXIT_FAILURE);
+	}
+	close(st[1]);
+	fclose(args);
+
+	/* wait for the end of the request */
+	while ((n = read(st[0], &status, sizeof status)) < 0
+	    && errno == EINTR)
+		;
+	if (n == sizeof status)
+		req_status = status;
+	exit(req_status);
+}
+
+/* -- create the image of the daemon for the other kind of output -- */
+/* called before the initialization of the daemon */
+void serve_init(void)
+{
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+		perror("Cannot create the image of the daemon");
+		return;
+	}
+	fflush(stdout);
+	fflush(stderr);
+	switch (fork()) {
+	case 0:				/* image */
+		close(sv[0]);
+		img_in = sv[1];
+		svg = !out_kind();
+		epsf = 0;
+		return;
+	case -1:
+		perror("Cannot create the image of the daemon");
+		close(sv[0]);
+		close(sv[1]);
+		return;
+	}
+	close(sv[1]);
+	img_fd = sv[0];
+}
+
+/* -- run the daemon -- */
+int serve(char *path, int argc, char **argv)
+{
+	struct sockaddr_un addr;
+	int sock;
+
+	/* keep the arguments of the daemon but '--serve' */
+	serve_argv = malloc(argc * sizeof *serve_argv);
+	serve_nargs = 0;
+	serve_argv[0] = argv[0];
+	while (--argc > 0) {
+		argv++;
+		if (strcmp(*argv, "--serve") == 0) {
+			argv++;
+			argc--;
+			continue;
+		}
+		serve_argv[++serve_nargs] = *argv;
+	}
+	serve_kind = out_kind();
+	if (epsf == 3) {
+		error(1, NULL, "Cannot use '-z' with '--serve'");
+		return EXIT_FAILURE;
+	}
+	if (img_in >= 0)
+		return img_serve();
+
+	if (strlen(path) >= sizeof addr.sun_path) {
+		error(1, NULL, "Socket name too long: %s", path);
+		return EXIT_FAILURE;
+	}
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		perror("Cannot create the socket");
+		return EXIT_FAILURE;
+	}
+	unlink(path);
+	if (bind(sock, (struct sockaddr *) &addr, sizeof addr) < 0
+	 || listen(sock, 16) < 0) {
+		perror(path);
+		close(sock);
+		return EXIT_FAILURE;
+	}
+	signal(SIGCHLD, SIG_IGN);	/* no zombie */
+	if (!quiet)
+		fprintf(stderr, "Serving on %s\n", path);
+	fflush(stdout);
+
+	for (;;) {
+		conn = accept(sock, NULL, NULL);
+		if (conn < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("accept");
+			break;
+		}
+		switch (fork()) {
+		case 0:
+			close(sock);
+			request();		/* no return */
+		case -1:
+			perror("fork");
+			break;
+		}
+		close(conn);
+	}
+	close(sock);
+	return EXIT_FAILURE;
+}
+
+/* -- check if the initialization of the daemon may be used -- */
+/* if not, pass the request to the image of the daemon */
+void serve_check(void)
+{
+	if (out_kind() == serve_kind)
+		return;			/* same default format */
+	if (img_fd < 0) {
+		error(1, NULL, "No daemon image for this kind of output");
+		exit(EXIT_FAILURE);
+	}
+	img_pass();			/* no return */
+}
+#else
+int serve(char *path, int argc, char **argv)
+{
+	error(1, NULL, "No Unix socket - '--serve' not treated");
+	return EXIT_FAILURE;
+}
+
+void serve_init(void)
+{
+}
+
+void serve_check(void)
+{
+}
+#endif
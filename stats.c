@@ -0,0 +1,812 @@
+/*
+ * Timing and counters of the generation phases (option '--stats')
+ * and timeline of the generation (option '--trace').
+ *
+ * This file is part of abcm2ps.
+ *
+ * Copyright (C) 2016 Jean-François Moine
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Each thread counts the calls of the phases and adds their wall and
+ * CPU times. The times are the ones of the outermost calls, so that
+ * the recursive calls are not counted twice.
+ * The statistics of a tune are the difference between its start (X:
+ * in abc_parse) and its end (end of do_tune). When a tune is rendered by a worker
+ * thread (-J), its statistics go to the main thread with the captured
+ * tune. At end of run, the totals of the main thread and the ones of
+ * the replayed tunes are the totals of the run. The remaining work of
+ * the workers (tunes skipped, lost or not replayable) is speculative:
+ * it goes to a section of its own in the JSON file.
+ * The trace is a list of spans (tunes, music lines, pages and output
+ * flushes) in the Chrome Trace Event format. Each thread has its own
+ * list. The lists of the workers are added to the main thread list
+ * at end of run, and the pages go to a track of their own, as they are
+ * not nested in the tunes.
+ * The memory pools (arena levels, output buffer..) keep their usage
+ * and their high-water marks in mem_tb. They are updated even without
+ * '--stats', as the arena routines are too hot for a test.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "abcm2ps.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+TLS char *stats_file;			/* JSON output file */
+TLS char *trace_file;			/* trace output file */
+
+struct phase {
+	unsigned long n;		/* number of calls */
+	double wall, cpu;		/* times in seconds */
+};
+
+struct tstats {				/* statistics of a tune */
+	struct tstats *next;
+	char file[128];
+	int linenum;
+	char x[16];			/* X: value */
+	char title[80];
+	int worker;			/* rendered by a worker thread */
+	double wall, cpu;
+	struct phase ph[ST_N];
+	struct mem_st mem[MEM_N];
+	unsigned long sym[NSYMTYPES];	/* number of symbols by type */
+};
+
+static const char *ph_name[ST_N] = {
+	"frontend", "abc_parse", "do_tune",
+	"sort_all", "voice_compress", "set_bar_num",
+	"output_music", "combine_voices", "set_beams", "set_stems",
+	"set_overlap", "set_allsymwidth", "cut_tune", "set_sym_glue",
+	"draw_sym_near", "draw_systems", "draw_all_symb", "draw_all_deco",
+	"svg_write", "write_buffer",
+};
+static const char *mem_name[MEM_N] = {
+	"arena_global", "arena_tune", "arena_generation",
+	"outbuf", "text", "svg",
+};
+static const char *sym_name[NSYMTYPES] = {
+	"none", "note", "space", "bar", "clef", "timesig", "keysig",
+	"tempo", "staves", "mrest", "part", "grace", "fmtchg", "tuplet",
+	"stbrk", "custos",
+};
+
+TLS struct mem_st mem_tb[MEM_N];	/* memory pools of the thread */
+static TLS unsigned long sym_tb[NSYMTYPES]; /* symbols of the thread */
+static TLS unsigned long tune_sym[NSYMTYPES];
+
+static TLS struct phase st_tb[ST_N];	/* totals of the thread */
+static TLS int st_depth[ST_N];		/* depth of the calls */
+static TLS double st_wall[ST_N], st_cpu[ST_N]; /* start of the outer calls */
+static TLS double run_wall, run_cpu;	/* start of the run (process CPU) */
+
+static TLS int in_tune;
+static TLS int wk_ntunes;		/* tunes rendered by the worker */
+static TLS double tune_wall, tune_cpu;	/* start of the tune */
+static TLS struct phase tune_tb[ST_N];
+static TLS struct tstats *tune_head, *tune_last; /* main thread */
+
+/* totals of the worker threads */
+static int wk_tunes;			/* number of rendered tunes */
+static int wk_nrep;			/* number of replayed tunes */
+static struct phase wk_tb[ST_N];
+static struct mem_st wk_mem[MEM_N];
+static unsigned long wk_sym[NSYMTYPES];
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t st_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+struct tevent {				/* trace event */
+	const char *name;
+	const char *aname;		/* name of the argument */
+	char ph;			/* 'X': span, 'i': instant */
+	int tid;
+	int arg;			/* source line, page or size */
+	double ts, dur;			/* times in seconds */
+	char x[16];			/* X: value of the tune */
+};
+static const char *sp_name[SP_N] = {
+	"tune", "music line", "page", "flush",
+};
+static const char *sp_arg[SP_N] = {
+	"line", "line", "page", "bytes",
+};
+#define TID_PAGES 1000			/* track of the pages */
+
+static TLS struct tevent *tr_ev;	/* events of the thread */
+static TLS int tr_n, tr_max;
+static TLS int tr_tid;			/* thread number */
+static TLS char tr_x[16];		/* X: value of the current tune */
+static TLS double tr_start[SP_N];	/* start of the spans */
+static TLS int tr_arg[SP_N];
+static TLS char tr_open[SP_N];
+
+static struct tevent *wk_ev;		/* events of the worker threads */
+static int wk_n, wk_max;
+static int tr_ntid;			/* number of worker threads */
+static double tr_t0;			/* start of the trace */
+
+/* -- get the wall time and the CPU time of the thread -- */
+static void get_times(double *wall, double *cpu)
+{
+#ifndef WIN32
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	*wall = ts.tv_sec + ts.tv_nsec * 1e-9;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	*cpu = ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+	*wall = *cpu = (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* -- get the CPU time of the process -- */
+static double proc_cpu(void)
+{
+#ifndef WIN32
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+	return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* -- start the statistics -- */
+void stats_init(void)
+{
+	double cpu;
+
+	if (!stats_file && !trace_file)
+		return;
+	get_times(&run_wall, &cpu);
+	run_cpu = proc_cpu();
+	if (!job_mode) {
+		tr_t0 = run_wall;
+		tr_ntid = 0;
+		tr_tid = 0;
+	} else {
+#ifdef HAVE_PTHREAD
+		pthread_mutex_lock(&st_mutex);
+#endif
+		tr_tid = ++tr_ntid;
+#ifdef HAVE_PTHREAD
+		pthread_mutex_unlock(&st_mutex);
+#endif
+	}
+}
+
+/* -- add a trace event -- */
+static void trace_add(const char *name, const char *aname,
+			int ph, int tid, int arg,
+			double ts, double dur)
+{
+	struct tevent *ev;
+
+	if (tr_n >= tr_max) {
+		tr_max = tr_max ? tr_max * 2 : 256;
+		ev = realloc(tr_ev, tr_max * sizeof *tr_ev);
+		if (!ev) {
+			error(1, NULL, "Out of memory for the trace");
+			trace_file = NULL;
+			return;
+		}
+		tr_ev = ev;
+	}
+	ev = &tr_ev[tr_n++];
+	ev->name = name;
+	ev->aname = aname;
+	ev->ph = ph;
+	ev->tid = tid;
+	ev->arg = arg;
+	ev->ts = ts - tr_t0;
+	ev->dur = dur;
+	strcpy(ev->x, tr_x);
+}
+
+/* -- start of a span -- */
+void trace_begin(int sp, int arg)
+{
+	double cpu;
+
+	if (!trace_file)
+		return;
+	get_times(&tr_start[sp], &cpu);
+	tr_arg[sp] = arg;
+	tr_open[sp] = 1;
+}
+
+/* -- end of a span -- */
+void trace_end(int sp)
+{
+	double wall, cpu;
+
+	if (!trace_file || !tr_open[sp])
+		return;
+	tr_open[sp] = 0;
+	get_times(&wall, &cpu);
+	trace_add(sp_name[sp], sp_arg[sp], 'X',
+		sp == SP_PAGE ? TID_PAGES + tr_tid : tr_tid,
+		tr_arg[sp], tr_start[sp], wall - tr_start[sp]);
+}
+
+/* -- instant event -- */
+void trace_mark(const char *name, int linenum)
+{
+	double wall, cpu;
+
+	if (!trace_file)
+		return;
+	get_times(&wall, &cpu);
+	trace_add(name, "line", 'i', tr_tid, linenum, wall, 0);
+}
+
+/* -- start of a phase -- */
+void stats_begin(int ph)
+{
+	if (!stats_file)
+		return;
+	st_tb[ph].n++;
+	if (st_depth[ph]++ == 0)
+		get_times(&st_wall[ph], &st_cpu[ph]);
+}
+
+/* -- end of a phase -- */
+void stats_end(int ph)
+{
+	double wall, cpu;
+
+	if (!stats_file || st_depth[ph] <= 0)
+		return;
+	if (--st_depth[ph] != 0)
+		return;
+	get_times(&wall, &cpu);
+	st_tb[ph].wall += wall - st_wall[ph];
+	st_tb[ph].cpu += cpu - st_cpu[ph];
+}
+
+/* -- count a call -- */
+void stats_count(int ph)
+{
+	if (stats_file)
+		st_tb[ph].n++;
+}
+
+/* -- account the usage of a memory pool -- */
+void stats_mem(int m, long used, long sys)
+{
+	struct mem_st *p;
+
+	if (!stats_file)
+		return;
+	p = &mem_tb[m];
+	p->used = used;
+	if (used > p->tmax)
+		p->tmax = used;
+	if (used > p->max)
+		p->max = used;
+	if (sys > p->sys)
+		p->sys = sys;
+}
+
+/* -- count the symbols of a piece of tune (before generation) -- */
+void stats_symbols(void)
+{
+	struct SYMBOL *s, *g;
+
+	if (!stats_file)
+		return;
+	for (s = tsfirst; s; s = s->ts_next) {
+		sym_tb[s->type]++;
+		for (g = s->extra; g; g = g->next)
+			sym_tb[g->type]++;
+	}
+}
+
+/* -- get the current totals, including the running phases -- */
+static void snapshot(struct phase *tb, double *wall, double *cpu)
+{
+	int ph;
+
+	get_times(wall, cpu);
+	memcpy(tb, st_tb, sizeof st_tb);
+	for (ph = 0; ph < ST_N; ph++) {
+		if (st_depth[ph] > 0) {
+			tb[ph].wall += *wall - st_wall[ph];
+			tb[ph].cpu += *cpu - st_cpu[ph];
+		}
+	}
+}
+
+/* -- start of a tune -- */
+/* p is the X: line */
+void stats_tune_start(char *p, int linenum)
+{
+	int i;
+
+	if (trace_file) {
+		p += 2;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		for (i = 0; i < (int) sizeof tr_x - 1; i++) {
+			if (p[i] == '\0' || p[i] == ' ' || p[i] == '\t'
+			 || p[i] == '%')
+				break;
+			tr_x[i] = p[i];
+		}
+		tr_x[i] = '\0';
+		trace_begin(SP_TUNE, linenum);
+	}
+	if (!stats_file)
+		return;
+	snapshot(tune_tb, &tune_wall, &tune_cpu);
+	memcpy(tune_sym, sym_tb, sizeof tune_sym);
+	for (i = 0; i < MEM_N; i++) {
+		mem_tb[i].tstart = mem_tb[i].tmax = mem_tb[i].used;
+		mem_tb[i].tbig = 0;
+	}
+	in_tune = 1;
+}
+
+/* -- end of a tune -- */
+void stats_tune_end(void)
+{
+	struct tstats *t;
+	struct SYMBOL *s;
+	struct phase tb[ST_N];
+	double wall, cpu;
+	int ph, i;
+
+	trace_end(SP_TUNE);
+	if (!stats_file || !in_tune)
+		return;
+	in_tune = 0;
+	s = info['X' - 'A'];
+	if (!s)
+		return;
+	t = calloc(1, sizeof *t);
+	if (!t)
+		return;
+	snapshot(tb, &wall, &cpu);
+	t->wall = wall - tune_wall;
+	t->cpu = cpu - tune_cpu;
+	for (ph = 0; ph < ST_N; ph++) {
+		t->ph[ph].n = tb[ph].n - tune_tb[ph].n;
+		t->ph[ph].wall = tb[ph].wall - tune_tb[ph].wall;
+		t->ph[ph].cpu = tb[ph].cpu - tune_tb[ph].cpu;
+	}
+	memcpy(t->mem, mem_tb, sizeof t->mem);
+	for (i = 0; i < NSYMTYPES; i++)
+		t->sym[i] = sym_tb[i] - tune_sym[i];
+	if (s->fn)
+		snprintf(t->file, sizeof t->file, "%s", s->fn);
+	t->linenum = s->linenum;
+	snprintf(t->x, sizeof t->x, "%s", &s->text[2]);
+	s = info['T' - 'A'];
+	if (s && s->text)
+		snprintf(t->title, sizeof t->title, "%s", &s->text[2]);
+	if (job_mode) {				/* worker thread */
+		t->worker = 1;
+		wk_ntunes++;
+		job_stats(t);
+	}
+	else
+		stats_tune_add(t);
+}
+
+/* -- move the work of a tune from the run to the speculative work -- */
+/* (the main thread parsed the tune that a worker rendered) */
+static void tune_dup(void)
+{
+	struct phase tb[ST_N];
+	double wall, cpu;
+	int ph, i;
+
+	snapshot(tb, &wall, &cpu);
+	for (ph = ST_FRONTEND + 1; ph < ST_N; ph++) {
+		if (ph == ST_SVG_WRITE || ph == ST_WRITE_BUFFER)
+			continue;		/* output of the previous tune */
+		tb[ph].n -= tune_tb[ph].n;
+		tb[ph].wall -= tune_tb[ph].wall;
+		tb[ph].cpu -= tune_tb[ph].cpu;
+		st_tb[ph].n -= tb[ph].n;
+		st_tb[ph].wall -= tb[ph].wall;	/* (the running phases */
+		st_tb[ph].cpu -= tb[ph].cpu;	/*  restart from now) */
+		wk_tb[ph].n += tb[ph].n;
+		wk_tb[ph].wall += tb[ph].wall;
+		wk_tb[ph].cpu += tb[ph].cpu;
+	}
+	for (i = 0; i < NSYMTYPES; i++) {
+		wk_sym[i] += sym_tb[i] - tune_sym[i];
+		sym_tb[i] = tune_sym[i];
+	}
+}
+
+/* -- add the statistics of a tune (main thread) -- */
+/* When the tune was rendered by a worker, its work goes from the
+ * speculative work to the run, and the parsing of the tune by the main
+ * thread goes from the run to the speculative work. */
+void stats_tune_add(struct tstats *t)
+{
+	int ph, i;
+
+	if (t->worker && in_tune) {
+		in_tune = 0;
+#ifdef HAVE_PTHREAD
+		pthread_mutex_lock(&st_mutex);
+#endif
+		tune_dup();
+		for (ph = ST_FRONTEND + 1; ph < ST_N; ph++) {
+			st_tb[ph].n += t->ph[ph].n;
+			st_tb[ph].wall += t->ph[ph].wall;
+			st_tb[ph].cpu += t->ph[ph].cpu;
+			wk_tb[ph].n -= t->ph[ph].n;
+			wk_tb[ph].wall -= t->ph[ph].wall;
+			wk_tb[ph].cpu -= t->ph[ph].cpu;
+		}
+		for (i = 0; i < NSYMTYPES; i++) {
+			sym_tb[i] += t->sym[i];
+			wk_sym[i] -= t->sym[i];
+		}
+		wk_nrep++;
+#ifdef HAVE_PTHREAD
+		pthread_mutex_unlock(&st_mutex);
+#endif
+	}
+	t->next = NULL;
+	if (!tune_head)
+		tune_head = t;
+	else
+		tune_last->next = t;
+	tune_last = t;
+}
+
+/* -- add the memory usage of a thread -- */
+/* the high-water marks are the ones of the busiest thread,
+ * the bytes got from the system are the sum of all the threads */
+static void mem_merge(struct mem_st *d, struct mem_st *s)
+{
+	int m;
+
+	for (m = 0; m < MEM_N; m++, d++, s++) {
+		if (s->max > d->max)
+			d->max = s->max;
+		d->sys += s->sys;
+		if (s->big > d->big)
+			d->big = s->big;
+		d->near += s->near;
+	}
+}
+
+/* -- add the totals and the events of a worker thread at end of run -- */
+void stats_merge(void)
+{
+	struct tevent *ev;
+	int ph, i;
+
+	if (!stats_file && !trace_file)
+		return;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&st_mutex);
+#endif
+	for (ph = 0; ph < ST_N; ph++) {
+		wk_tb[ph].n += st_tb[ph].n;
+		wk_tb[ph].wall += st_tb[ph].wall;
+		wk_tb[ph].cpu += st_tb[ph].cpu;
+	}
+	mem_merge(wk_mem, mem_tb);
+	for (i = 0; i < NSYMTYPES; i++)
+		wk_sym[i] += sym_tb[i];
+	wk_tunes += wk_ntunes;
+	wk_ntunes = 0;
+	if (tr_n > 0) {
+		if (wk_n + tr_n > wk_max) {
+			ev = realloc(wk_ev, (wk_n + tr_n) * sizeof *wk_ev);
+			if (ev) {
+				wk_ev = ev;
+				wk_max = wk_n + tr_n;
+			}
+		}
+		if (wk_n + tr_n <= wk_max) {
+			memcpy(&wk_ev[wk_n], tr_ev, tr_n * sizeof *tr_ev);
+			wk_n += tr_n;
+		}
+	}
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&st_mutex);
+#endif
+	free(tr_ev);
+	tr_ev = NULL;
+	tr_n = tr_max = 0;
+}
+
+/* -- output a JSON string -- */
+static void json_str(FILE *f, char *p)
+{
+	unsigned char c;
+
+	putc('"', f);
+	while ((c = *p++) != '\0') {
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			putc(c, f);
+	}
+	putc('"', f);
+}
+
+/* -- output the phases -- */
+static void json_phases(FILE *f, struct phase *tb, int all)
+{
+	char *sep;
+	int ph;
+
+	fprintf(f, "{");
+	sep = "";
+	for (ph = 0; ph < ST_N; ph++) {
+		if (!all && tb[ph].n == 0)
+			continue;
+		fprintf(f, "%s\n\t\t\"%s\": {\"n\": %lu, \"wall\": %.6f, \"cpu\": %.6f}",
+			sep, ph_name[ph], tb[ph].n, tb[ph].wall, tb[ph].cpu);
+		sep = ",";
+	}
+	fprintf(f, "}");
+}
+
+/* -- output the memory usage -- */
+static void json_mem(FILE *f, struct mem_st *mem, int run)
+{
+	char *sep;
+	int m;
+
+	fprintf(f, "{");
+	sep = "";
+	for (m = 0; m < MEM_N; m++, mem++) {
+		if (run)
+			fprintf(f, "%s\n\t\t\"%s\": {\"peak\": %ld, \"sys\": %ld",
+				sep, mem_name[m], mem->max, mem->sys);
+		else if (mem->tmax > mem->tstart)
+			fprintf(f, "%s\n\t\t\"%s\": {\"peak\": %ld",
+				sep, mem_name[m], mem->tmax - mem->tstart);
+		else
+			continue;
+		if (m <= MEM_ARENA2) {
+			fprintf(f, ", \"big\": %ld",
+				run ? mem->big : mem->tbig);
+			if (run)
+				fprintf(f, ", \"near_limit\": %ld", mem->near);
+		}
+		fprintf(f, "}");
+		sep = ",";
+	}
+	fprintf(f, "}");
+}
+
+/* -- output the number of symbols by type -- */
+static void json_sym(FILE *f, unsigned long *sym)
+{
+	char *sep;
+	int i;
+
+	fprintf(f, "{");
+	sep = "";
+	for (i = 0; i < NSYMTYPES; i++) {
+		if (sym[i] == 0)
+			continue;
+		fprintf(f, "%s\"%s\": %lu", sep, sym_name[i], sym[i]);
+		sep = ", ";
+	}
+	fprintf(f, "}");
+}
+
+/* -- output the trace events -- */
+static void trace_out(FILE *f, struct tevent *ev, int n, char **sep)
+{
+	for ( ; --n >= 0; ev++) {
+		fprintf(f, "%s\n{\"name\": \"%s\", \"cat\": \"abcm2ps\","
+			" \"ph\": \"%c\", \"ts\": %.3f,",
+			*sep, ev->name, ev->ph, ev->ts * 1e6);
+		if (ev->ph == 'X')
+			fprintf(f, " \"dur\": %.3f,", ev->dur * 1e6);
+		else
+			fprintf(f, " \"s\": \"t\",");
+		fprintf(f, " \"pid\": 1, \"tid\": %d, \"args\": {\"X\": ",
+			ev->tid);
+		json_str(f, ev->x);
+		fprintf(f, ", \"%s\": %d}}", ev->aname, ev->arg);
+		*sep = ",";
+	}
+}
+
+/* -- write the trace and free it (main thread) -- */
+static void trace_write(void)
+{
+	FILE *f;
+	char *sep;
+	int i;
+
+	f = fopen(trace_file, "w");
+	if (!f) {
+		error(1, NULL, "Cannot create the trace file '%s'",
+			trace_file);
+	} else {
+		fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+		sep = "";
+		for (i = 0; i <= tr_ntid; i++) {
+			if (i == 0)
+				fprintf(f, "\n{\"name\": \"thread_name\", \"ph\": \"M\","
+					" \"pid\": 1, \"tid\": 0,"
+					" \"args\": {\"name\": \"main\"}},"
+					"\n{\"name\": \"thread_name\", \"ph\": \"M\","
+					" \"pid\": 1, \"tid\": %d,"
+					" \"args\": {\"name\": \"pages\"}}",
+					TID_PAGES);
+			else
+				fprintf(f, ",\n{\"name\": \"thread_name\", \"ph\": \"M\","
+					" \"pid\": 1, \"tid\": %d,"
+					" \"args\": {\"name\": \"worker %d\"}}",
+					i, i);
+			sep = ",";
+		}
+		trace_out(f, tr_ev, tr_n, &sep);
+#ifdef HAVE_PTHREAD
+		pthread_mutex_lock(&st_mutex);
+#endif
+		trace_out(f, wk_ev, wk_n, &sep);
+#ifdef HAVE_PTHREAD
+		pthread_mutex_unlock(&st_mutex);
+#endif
+		fprintf(f, "\n]}\n");
+		fclose(f);
+	}
+	free(tr_ev);
+	tr_ev = NULL;
+	tr_n = tr_max = 0;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&st_mutex);
+#endif
+	free(wk_ev);
+	wk_ev = NULL;
+	wk_n = wk_max = 0;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&st_mutex);
+#endif
+}
+
+/* -- write the statistics and free them (main thread) -- */
+void stats_write(void)
+{
+	FILE *f;
+	struct tstats *t;
+	char *sep;
+	double wall, cpu;
+	long tot, big;
+	int ph, i;
+
+	if (trace_file)
+		trace_write();
+	if (!stats_file)
+		return;
+	get_times(&wall, &cpu);
+	wall -= run_wall;
+	cpu = proc_cpu() - run_cpu;		/* all the threads */
+
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&st_mutex);
+#endif
+	for (ph = 0; ph < ST_N; ph++) {		/* (rounding errors) */
+		if (wk_tb[ph].wall < 0)
+			wk_tb[ph].wall = 0;
+		if (wk_tb[ph].cpu < 0)
+			wk_tb[ph].cpu = 0;
+	}
+	mem_merge(wk_mem, mem_tb);
+	memcpy(mem_tb, wk_mem, sizeof mem_tb);
+	memset(wk_mem, 0, sizeof wk_mem);
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&st_mutex);
+#endif
+
+	f = fopen(stats_file, "w");
+	if (!f) {
+		error(1, NULL, "Cannot create the statistics file '%s'",
+			stats_file);
+	} else {
+		fprintf(f, "{\n\t\"version\": \"%s\",\n\t\"threads\": %d,\n"
+			"\t\"wall\": %.6f,\n\t\"cpu\": %.6f,\n\t\"phases\": ",
+			VERSION, jobs, wall, cpu);
+		json_phases(f, st_tb, 1);
+		fprintf(f, ",\n\t\"arena_limit\": %d,\n\t\"memory\": ",
+			MAXAREANASZ);
+		json_mem(f, mem_tb, 1);
+		fprintf(f, ",\n\t\"symbols\": ");
+		json_sym(f, sym_tb);
+		if (jobs > 1) {
+#ifdef HAVE_PTHREAD
+			pthread_mutex_lock(&st_mutex);
+#endif
+			fprintf(f, ",\n\t\"speculative\": {\"tunes\": %d,"
+				" \"replayed\": %d,\n\t\"phases\": ",
+				wk_tunes, wk_nrep);
+			json_phases(f, wk_tb, 0);
+			fprintf(f, ",\n\t\"symbols\": ");
+			json_sym(f, wk_sym);
+			fprintf(f, "}");
+#ifdef HAVE_PTHREAD
+			pthread_mutex_unlock(&st_mutex);
+#endif
+		}
+		fprintf(f, ",\n\t\"tunes\": [");
+		sep = "";
+		for (t = tune_head; t; t = t->next) {
+			fprintf(f, "%s\n\t{\"file\": ", sep);
+			json_str(f, t->file);
+			fprintf(f, ", \"line\": %d, \"X\": ", t->linenum);
+			json_str(f, t->x);
+			fprintf(f, ", \"title\": ");
+			json_str(f, t->title);
+			fprintf(f, ",\n\t\t\"wall\": %.6f, \"cpu\": %.6f,"
+				" \"phases\": ",
+				t->wall, t->cpu);
+			json_phases(f, t->ph, 0);
+			fprintf(f, ",\n\t\t\"memory\": ");
+			json_mem(f, t->mem, 0);
+			fprintf(f, ",\n\t\t\"symbols\": ");
+			json_sym(f, t->sym);
+			fprintf(f, "}");
+			sep = ",";
+		}
+		fprintf(f, "\n\t]\n}\n");
+		fclose(f);
+	}
+
+	while ((t = tune_head) != NULL) {
+		tune_head = t->next;
+		free(t);
+	}
+	tune_last = NULL;
+	memset(st_tb, 0, sizeof st_tb);
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&st_mutex);
+#endif
+	wk_tunes = wk_nrep = 0;
+	memset(wk_tb, 0, sizeof wk_tb);
+	memset(wk_sym, 0, sizeof wk_sym);
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&st_mutex);
+#endif
+
+	if (!quiet) {
+		tot = big = 0;
+		for (i = 0; i < MEM_N; i++) {
+			tot += mem_tb[i].sys;
+			if (mem_tb[i].big > big)
+				big = mem_tb[i].big;
+		}
+		fprintf(err_out(), "Memory: %ld KiB - peaks (KiB):", tot / 1024);
+		for (i = 0; i < MEM_N; i++)
+			fprintf(err_out(), " %s %ld", mem_name[i],
+				(mem_tb[i].max + 1023) / 1024);
+		fprintf(err_out(), "\n"
+			"Biggest arena request: %ld bytes (limit %d)\n",
+			big, MAXAREANASZ);
+	}
+	memset(mem_tb, 0, sizeof mem_tb);
+	memset(sym_tb, 0, sizeof sym_tb);
+}
@@ -25,18 +25,34 @@
 
 #include "abcm2ps.h" 
 
-char tex_buf[TEX_BUF_SZ];	/* result of tex_str() */
-int outft = -1;			/* last font in the output file */
-
-static char *strop;		/* current string output operation */
-static float strlw;		/* line width */
-static int curft;		/* current (wanted) font */
-static int defft;		/* default font */
-static char strtx;		/* PostScript text outputing (bits) */
+TLS char tex_buf[TEX_BUF_SZ];	/* result of tex_str() */
+TLS int outft = -1;			/* last font in the output file */
+
+static TLS char *strop;		/* current string output operation */
+static TLS float strlw;		/* line width */
+static TLS int curft;		/* current (wanted) font */
+static TLS int defft;		/* default font */
+static TLS char strtx;		/* PostScript text outputing (bits) */
 #define TX_STR 1			/* string started */
 #define TX_ARR 2			/* glyph/string array started */
 #define TX_EXT 4			/* glyph/string array needed */
 
+/* cache of the results of tex_str() */
+#define TXC_HSZ 1024			/* size of the hash table */
+#define TXC_MAXLEN 64			/* max length of the cached strings */
+#define TXC_MAX 8192			/* max number of cached strings */
+struct txc {
+	struct txc *next;
+	float swfac;			/* width factor of the font */
+	float w;			/* width of the string */
+	char mode;			/* XML characters kept (svg || epsf > 1) */
+	unsigned char slen;		/* length of the string */
+	char s[1];			/* string, EOS, converted string */
+};
+static TLS struct txc **txc_tb;
+static TLS int txc_n;			/* number of cached strings */
+static TLS char txc_nok;		/* error - don't cache */
+
 /* width of characters according to the encoding */
 /* these are the widths for Times-Roman, extracted from the 'a2ps' package */
 /*fixme-hack: set 500 to control characters for utf-8*/
@@ -59,7 +75,7 @@ static short cw_tb[] = {
 	500,500,444,480,200,480,541,500,
 };
 
-static struct u_ps {
+static TLS struct u_ps {
 	struct u_ps *next;
 	char text[2];
 } *user_ps;
@@ -69,10 +85,11 @@ void bug(char *msg, int fatal)
 {
 	error(1, NULL, "Internal error: %s.", msg);
 	if (fatal) {
-		fprintf(stderr, "Emergency stop.\n\n");
-		exit(EXIT_FAILURE);
+		fprintf(err_out(), "Emergency stop.\n\n");
+		fatal_exit(EXIT_FAILURE);
 	}
-	fprintf(stderr, "Trying to continue...\n");
+	if (!job_quiet())
+		fprintf(err_out(), "Trying to continue...\n");
 }
 
 /* -- print an error message -- */
@@ -82,17 +99,40 @@ void error(int sev,	/* 0: warning, 1: error */
 {
 	va_list args;
 
-	if (s) {
-		if (s->fn)
-			fprintf(stderr, "%s:%d:%d: ", s->fn,
-					s->linenum, s->colnum);
+	PROBE4(error, sev, s ? s->fn : NULL, s ? s->linenum : 0, fmt);
+	if (s)
 		s->flags |= ABC_F_ERROR;
+	if (job_mode) {			/* message output by the main thread */
+		char buf[256];
+		int l;
+
+		if (job_mode != JOB_CAPT)
+			return;
+		l = 0;
+		if (s && s->fn)
+			l = snprintf(buf, sizeof buf, "%s:%d:%d: ", s->fn,
+					s->linenum, s->colnum);
+		l += snprintf(buf + l, sizeof buf - l,
+				sev == 0 ? "warning: " : "error: ");
+		va_start(args, fmt);
+		l += vsnprintf(buf + l, sizeof buf - l, fmt, args);
+		va_end(args);
+		if (l >= (int) sizeof buf - 1) {
+			job_invalid();
+			return;
+		}
+		strcpy(buf + l, "\n");
+		job_msg(sev, buf);
+		return;
 	}
-	fprintf(stderr, sev == 0 ? "warning: " : "error: ");
+	if (s && s->fn)
+		fprintf(err_out(), "%s:%d:%d: ", s->fn,
+				s->linenum, s->colnum);
+	fprintf(err_out(), sev == 0 ? "warning: " : "error: ");
 	va_start(args, fmt);
-	vfprintf(stderr, fmt, args);
+	vfprintf(err_out(), fmt, args);
 	va_end(args);
-	fprintf(stderr, "\n");
+	fprintf(err_out(), "\n");
 	if (sev > severity)
 		severity = sev;
 }
@@ -139,7 +179,7 @@ float cwid(unsigned char c)
 
 /* -- change string taking care of some tex-style codes -- */
 /* Return an estimated width of the string. */
-float tex_str(char *s)
+static float tex_conv(char *s)
 {
 	char *d, *p;
 	unsigned char c1;
@@ -213,6 +253,7 @@ float tex_str(char *s)
 					i = sscanf(s, "#%ld;%n", &v, &j);
 				if (i != 1) {
 					error(0, NULL, "Bad XML char reference");
+					txc_nok = 1;
 					break;
 				}
 				if (v < 0x80) {	/* convert to UTF-8 */
@@ -303,19 +344,110 @@ float tex_str(char *s)
 	return w;
 }
 
+/* -- free the cache of tex_str() -- */
+static void txc_free(void)
+{
+	struct txc *c;
+	int i;
+
+	if (!txc_tb)
+		return;
+	for (i = 0; i < TXC_HSZ; i++) {
+		while ((c = txc_tb[i]) != NULL) {
+			txc_tb[i] = c->next;
+			free(c);
+		}
+	}
+	free(txc_tb);
+	txc_tb = NULL;
+	txc_n = 0;
+}
+
+/* -- tex_str() with a cache of the short strings -- */
+/* The strings with font changes ('$n') are not cached. */
+float tex_str(char *s)
+{
+	struct txc *c, **p_c;
+	char *p, mode;
+	unsigned h;
+	int i, l;
+	float w, swfac;
+
+	h = 2166136261u;
+	for (p = s; *p != '\0'; p++) {
+		if (*p == '$')
+			return tex_conv(s);
+		h = (h ^ (unsigned char) *p) * 16777619;
+	}
+	l = p - s;
+	if (l >= TXC_MAXLEN)
+		return tex_conv(s);
+	if ((i = curft) <= 0)
+		i = defft;
+	swfac = cfmt.font_tb[i].swfac;
+	mode = svg || epsf > 1;
+	if (txc_n >= TXC_MAX)
+		txc_free();
+	if (!txc_tb) {
+		txc_tb = calloc(TXC_HSZ, sizeof *txc_tb);
+		if (!txc_tb)
+			return tex_conv(s);
+	}
+	p_c = &txc_tb[h % TXC_HSZ];
+	for (c = *p_c; c; c = c->next) {
+		if (c->slen == l && c->swfac == swfac && c->mode == mode
+		 && memcmp(c->s, s, l) == 0) {
+			strcpy(tex_buf, &c->s[l + 1]);
+			return c->w;
+		}
+	}
+
+	txc_nok = 0;
+	w = tex_conv(s);
+	if (txc_nok)
+		return w;
+	c = malloc(sizeof *c + l + strlen(tex_buf) + 1);
+	if (!c)
+		return w;
+	c->swfac = swfac;
+	c->w = w;
+	c->mode = mode;
+	c->slen = l;
+	memcpy(c->s, s, l);
+	c->s[l] = '\0';
+	strcpy(&c->s[l + 1], tex_buf);
+	c->next = *p_c;
+	*p_c = c;
+	txc_n++;
+	return w;
+}
+
 #ifdef HAVE_PANGO
 #define PG_SCALE (PANGO_SCALE * 72 / 96)	/* 96 DPI */
 
-static PangoFontDescription *desc_tb[MAXFONTS];
-static PangoLayout *layout = (PangoLayout *) -1;
-static PangoAttrList *attrs;
-static int out_pg_ft = -1;		/* current pango font */
-static GString *pg_str;
+static TLS PangoFontDescription *desc_tb[MAXFONTS];
+static TLS PangoLayout *layout = (PangoLayout *) -1;
+static TLS PangoAttrList *attrs;
+static TLS int out_pg_ft = -1;		/* current pango font */
+static TLS GString *pg_str;
+
+/* cache of the pango layouts of the short strings */
+#define PGC_HSZ 256			/* size of the hash table */
+#define PGC_MAX 1024			/* max number of cached layouts */
+struct pgc {
+	struct pgc *next;
+	PangoLayout *layout;
+	int fnum;
+	float size;
+	char s[1];
+};
+static TLS struct pgc **pgc_tb;
+static TLS int pgc_n;			/* number of cached layouts */
 
 /* -- initialize the pango mechanism -- */
 void pg_init(void)
 {
-	static PangoContext *context;
+	static TLS PangoContext *context;
 
 	context = pango_font_map_create_context(
 			pango_cairo_font_map_get_default());
@@ -488,9 +620,91 @@ static void str_set_font(char *p)
 	pg_str = str;
 }
 
+/* -- free the cached pango layouts -- */
+static void pgc_free(void)
+{
+	struct pgc *c;
+	int i;
+
+	if (!pgc_tb)
+		return;
+	for (i = 0; i < PGC_HSZ; i++) {
+		while ((c = pgc_tb[i]) != NULL) {
+			pgc_tb[i] = c->next;
+			g_object_unref(c->layout);
+			free(c);
+		}
+	}
+	free(pgc_tb);
+	pgc_tb = NULL;
+	pgc_n = 0;
+}
+
+/* -- get the cached layout of a string -- */
+/* The strings with font changes ('$n') are not cached. */
+static PangoLayout *pgc_get(char *p)
+{
+	struct pgc *c, **p_c;
+	struct FONTSPEC *f;
+	char *q;
+	unsigned h;
+	int l;
+
+	f = &cfmt.font_tb[curft];
+	if (f->size == 0)
+		return NULL;
+	h = 2166136261u;
+	for (q = p; *q != '\0'; q++) {
+		if (*q == '$')
+			return NULL;
+		h = (h ^ (unsigned char) *q) * 16777619;
+	}
+	l = q - p;
+	if (l >= TXC_MAXLEN)
+		return NULL;
+	h ^= f->fnum;
+	if (pgc_n >= PGC_MAX)
+		pgc_free();
+	if (!pgc_tb) {
+		pgc_tb = calloc(PGC_HSZ, sizeof *pgc_tb);
+		if (!pgc_tb)
+			return NULL;
+	}
+	p_c = &pgc_tb[h % PGC_HSZ];
+	for (c = *p_c; c; c = c->next) {
+		if (c->fnum == f->fnum && c->size == f->size
+		 && strcmp(c->s, p) == 0)
+			return c->layout;
+	}
+
+	c = malloc(sizeof *c + l);
+	if (!c)
+		return NULL;
+	c->layout = pango_layout_new(pango_layout_get_context(layout));
+	if (!c->layout) {
+		free(c);
+		return NULL;
+	}
+	c->fnum = f->fnum;
+	c->size = f->size;
+	strcpy(c->s, p);
+	c->next = *p_c;
+	*p_c = c;
+	pgc_n++;
+
+	attrs = pango_attr_list_new();
+	str_set_font(p);
+	pango_layout_set_text(c->layout, pg_str->str, pg_str->len);
+	pango_layout_set_attributes(c->layout, attrs);
+	pg_str = g_string_truncate(pg_str, 0);
+	pango_attr_list_unref(attrs);
+	return c->layout;
+}
+
 /* -- output a string using the pango and freetype libraries -- */
 static void str_pg_out(char *p, int action)
 {
+	PangoLayout *lo;
 	PangoLayoutLine *line;
 	int wi;
 	float w;
@@ -521,18 +735,22 @@ static void str_pg_out(char *p, int action)
 		}
 	}
 
-	attrs = pango_attr_list_new();
-	str_set_font(p);
+	lo = pgc_get(p);
+	if (!lo) {
+		attrs = pango_attr_list_new();
+		str_set_font(p);
 
-	pango_layout_set_text(layout, pg_str->str, pg_str->len);
-	pango_layout_set_attributes(layout, attrs);
+		pango_layout_set_text(layout, pg_str->str, pg_str->len);
+		pango_layout_set_attributes(layout, attrs);
+		lo = layout;
+	}
 
 	/* only one line */
-	line = pango_layout_get_line_readonly(layout, 0);
+	line = pango_layout_get_line_readonly(lo, 0);
 	switch (action) {
 	case A_CENTER:
 	case A_RIGHT:
-		pango_layout_get_size(layout, &wi, NULL);
+		pango_layout_get_size(lo, &wi, NULL);
 		if (action == A_CENTER)
 			wi /= 2;
 //		w = (float) wi / PG_SCALE;
@@ -541,6 +759,8 @@ static void str_pg_out(char *p, int action)
 		break;
 	}
 	pg_line_output(line);
+	if (lo != layout)
+		return;
 	pango_layout_set_attributes(layout, NULL);
 	pg_str = g_string_truncate(pg_str, 0);
 	pango_attr_list_unref(attrs);
@@ -727,6 +947,15 @@ static int is_latin(unsigned char *p)
 }
 #endif /* HAVE_PANGO */
 
+/* -- free the text caches -- */
+void free_tex_cache(void)
+{
+	txc_free();
+#ifdef HAVE_PANGO
+	pgc_free();
+#endif
+}
+
 /* -- set the default font of a string -- */
 void str_font(int ft)
 {
@@ -777,10 +1006,25 @@ static int non_ascii_p(char *p)
 	return 0;
 }
 
+/* -- check if the output font must be changed -- */
+static int ft_chg(void)
+{
+	if (outft <= -2			/* output font unknown (jobs.c) */
+	 && (outft == OUTFT_UNKNOWN || OUTFT_UNSURE(curft) == outft)) {
+		if (strtx || !job_capt()) {
+			job_invalid();
+		} else {
+			job_font(curft, EV_STRFT);	/* change at replay time */
+			return 0;
+		}
+	}
+	return curft != outft;
+}
+
 /* -- output one string -- */
 static void str_ft_out1(char *p, int l)
 {
-	if (curft != outft) {
+	if (ft_chg()) {
 		str_end(1);
 		a2b(" ");
 		set_font(curft);
@@ -811,7 +1055,7 @@ static void str_ft_out(char *p, int end)
 	use_glyph = !svg && epsf <= 1 &&	/* not SVG */
 		get_font_encoding(curft) == 0;	/* utf-8 font */
 	if (use_glyph && non_ascii_p(p)) {
-		if (curft != outft) {
+		if (ft_chg()) {
 			str_end(1);
 			a2b(" ");
 			set_font(curft);
@@ -834,7 +1078,7 @@ static void str_ft_out(char *p, int end)
 //				set_font(curft);
 			}
 			str_end(0);
-			if (curft != outft) {
+			if (ft_chg()) {
 				str_end(1);
 				a2b(" ");
 				set_font(curft);
@@ -1380,7 +1624,7 @@ void put_history(void)
 char *trim_title(char *p, struct SYMBOL *title)
 {
 	char *b, *q, *r;
-static char buf[STRL1];
+static TLS char buf[STRL1];
 
 	q = NULL;
 	if (cfmt.titletrim) {
@@ -1875,3 +2119,31 @@ void user_ps_write(void)
 		fputc('\n', fout);
 	}
 }
+
+/* -- scan the user PostScript sequences for the used definitions -- */
+void user_ps_used(void)
+{
+	struct u_ps *t;
+	char *p;
+
+	for (t = user_ps; t; t = t->next) {
+		p = t->text;
+		switch (*p) {
+		case '\001': {		/* PS file */
+			FILE *f;
+			char line[BSIZE];
+
+			if ((f = fopen(p + 1, "r")) == NULL)
+				continue;
+			while (fgets(line, sizeof line, f))
+				ps_used(line, strlen(line));
+			fclose(f);
+			continue;
+		    }
+		case '%':		/* "%svg " = SVG code */
+			p += 4;
+			break;
+		}
+		ps_used(p + 1, strlen(p + 1));
+	}
+}
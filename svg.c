@@ -35,6 +35,10 @@ enum elt_t {			/* element types */
 struct elt_s {
 	struct elt_s *next;
 	char type;
+	short op;		/* STR: built-in operator (enum op_e),
+				 * -1 if none, OP_N if not searched yet */
+	int ref;		/* first element of a {..} or [..] body:
+				 * number of other containers sharing it */
 	union {
 		float v;
 		char *s;
@@ -50,17 +54,152 @@ struct ps_sym_s {
 /* -- PostScript tiny interpreter -- */
 #define NELTS 2048	/* number of elements per block */
 #define NSYMS 512	/* max number of symbols */
-static struct elt_s *elts;
-static struct elt_s *stack, *free_elt;
-static struct ps_sym_s ps_sym[NSYMS];
-static int n_sym;
-static int ps_error;
-static int in_cnt;			/* in [..] or {..} */
-static char *path;
-static char path_buf[256];
+#define SYM_HSZ 1024	/* size of the symbol hash table (power of 2) */
+static TLS struct elt_s *elts;
+static TLS int elts_nb;			/* number of blocks (--stats) */
+static TLS struct elt_s *stack, *free_elt;
+static TLS struct ps_sym_s ps_sym[NSYMS];
+static TLS int n_sym;
+static TLS short sym_htb[SYM_HSZ];	/* index + 1 in ps_sym[] - 0 if free */
+static TLS struct spool_s {		/* pool of strings */
+	struct sblk_s *head, *cur;
+	int used;			/* used bytes in the current block */
+} str_page, str_file;			/* released on new page / new file */
+struct sblk_s {
+	struct sblk_s *next;
+	int size;
+	char s[1];
+};
+#define SBLK_SZ 8192
+static TLS char **str_htb;		/* interned strings of the definitions */
+static TLS int str_hsz, str_hn;
+static TLS int ps_error;
+static TLS int in_cnt;			/* in [..] or {..} */
+
+enum op_e {			/* built-in operators (sorted as op_tb[]) */
+	OP_bang, OP_C, OP_HD, OP_HDD, OP_Hd, OP_L, OP_M, OP_RC, OP_RL,
+	OP_RM, OP_SL, OP_SLW, OP_T, OP_abs, OP_accent, OP_add, OP_and,
+	OP_anshow, OP_arc, OP_arcn, OP_arp, OP_atan, OP_bar, OP_bclef,
+	OP_bdef, OP_bind, OP_bitshift, OP_bm, OP_bnum, OP_bnumb,
+	OP_box, OP_boxdraw, OP_boxend, OP_boxmark, OP_brace,
+	OP_bracket, OP_breve, OP_brth, OP_cclef, OP_closepath, OP_coda,
+	OP_composefont, OP_copy, OP_cos, OP_cpu, OP_crdc, OP_cresc,
+	OP_csig, OP_ctsig, OP_currentgray, OP_currentpoint, OP_curveto,
+	OP_custos, OP_cvi, OP_cvx, OP_dSL, OP_dacs, OP_def, OP_dft0,
+	OP_dim, OP_div, OP_dnb, OP_dotbar, OP_dplus, OP_dsh0, OP_dt,
+	OP_dup, OP_emb, OP_eofill, OP_eq, OP_exch, OP_exec, OP_false,
+	OP_fill, OP_findfont, OP_fng, OP_for, OP_forall, OP_ft0,
+	OP_ft1, OP_ft4, OP_ft513, OP_gcshow, OP_gd, OP_gda, OP_ge,
+	OP_get, OP_getinterval, OP_ghd, OP_ghl, OP_glisq, OP_gliss,
+	OP_grestore, OP_grm, OP_gsave, OP_gsl, OP_gt, OP_gu, OP_gua,
+	OP_gxshow, OP_hd, OP_hl, OP_hl1, OP_hl2, OP_hld, OP_hyph,
+	OP_iMsig, OP_idiv, OP_if, OP_ifelse, OP_imsig, OP_index,
+	OP_jshow, OP_le, OP_length, OP_lineto, OP_lmrd, OP_load,
+	OP_longa, OP_lphr, OP_lt, OP_ltr, OP_lyshow, OP_marcato,
+	OP_mod, OP_moveto, OP_mphr, OP_mrep, OP_mrep2, OP_mrest,
+	OP_mul, OP_ne, OP_neg, OP_newpath, OP_nt0, OP_oct, OP_opend,
+	OP_or, OP_pMsig, OP_pclef, OP_pdfthd, OP_pdshhd, OP_pf,
+	OP_pfthd, OP_pmsig, OP_pop, OP_pshhd, OP_r0, OP_r00, OP_r1,
+	OP_r128, OP_r16, OP_r2, OP_r32, OP_r4, OP_r64, OP_r8,
+	OP_rcurveto, OP_rdots, OP_repbra, OP_repeat, OP_rlineto,
+	OP_rmoveto, OP_roll, OP_rotate, OP_sbclef, OP_scale,
+	OP_scalefont, OP_scclef, OP_sd, OP_search, OP_selectfont,
+	OP_sep0, OP_setdash, OP_setfont, OP_setgray, OP_setlinewidth,
+	OP_setrgbcolor, OP_sfd, OP_sfs, OP_sfu, OP_sfz, OP_sgd,
+	OP_sgno, OP_sgs, OP_sgu, OP_sh0, OP_sh1, OP_sh4, OP_sh513,
+	OP_show, OP_showb, OP_showc, OP_showerror, OP_showr, OP_sld,
+	OP_snap, OP_spclef, OP_sphr, OP_srep, OP_staff, OP_stc,
+	OP_stclef, OP_stringwidth, OP_stroke, OP_stsig, OP_su, OP_sub,
+	OP_svg, OP_tclef, OP_thbar, OP_thumb, OP_translate, OP_trem,
+	OP_trl, OP_true, OP_tsig, OP_tubr, OP_tubrl, OP_turn, OP_turnx,
+	OP_umrd, OP_upb, OP_wedge, OP_where, OP_wln, OP_xydef,
+	OP_xymove,
+	OP_N
+};
+
+static const char *op_tb[OP_N] = {
+	"!", "C", "HD", "HDD", "Hd", "L", "M", "RC", "RL", "RM", "SL",
+	"SLW", "T", "abs", "accent", "add", "and", "anshow", "arc",
+	"arcn", "arp", "atan", "bar", "bclef", "bdef", "bind",
+	"bitshift", "bm", "bnum", "bnumb", "box", "boxdraw", "boxend",
+	"boxmark", "brace", "bracket", "breve", "brth", "cclef",
+	"closepath", "coda", "composefont", "copy", "cos", "cpu",
+	"crdc", "cresc", "csig", "ctsig", "currentgray",
+	"currentpoint", "curveto", "custos", "cvi", "cvx", "dSL",
+	"dacs", "def", "dft0", "dim", "div", "dnb", "dotbar", "dplus",
+	"dsh0", "dt", "dup", "emb", "eofill", "eq", "exch", "exec",
+	"false", "fill", "findfont", "fng", "for", "forall", "ft0",
+	"ft1", "ft4", "ft513", "gcshow", "gd", "gda", "ge", "get",
+	"getinterval", "ghd", "ghl", "glisq", "gliss", "grestore",
+	"grm", "gsave", "gsl", "gt", "gu", "gua", "gxshow", "hd", "hl",
+	"hl1", "hl2", "hld", "hyph", "iMsig", "idiv", "if", "ifelse",
+	"imsig", "index", "jshow", "le", "length", "lineto", "lmrd",
+	"load", "longa", "lphr", "lt", "ltr", "lyshow", "marcato",
+	"mod", "moveto", "mphr", "mrep", "mrep2", "mrest", "mul", "ne",
+	"neg", "newpath", "nt0", "oct", "opend", "or", "pMsig",
+	"pclef", "pdfthd", "pdshhd", "pf", "pfthd", "pmsig", "pop",
+	"pshhd", "r0", "r00", "r1", "r128", "r16", "r2", "r32", "r4",
+	"r64", "r8", "rcurveto", "rdots", "repbra", "repeat",
+	"rlineto", "rmoveto", "roll", "rotate", "sbclef", "scale",
+	"scalefont", "scclef", "sd", "search", "selectfont", "sep0",
+	"setdash", "setfont", "setgray", "setlinewidth", "setrgbcolor",
+	"sfd", "sfs", "sfu", "sfz", "sgd", "sgno", "sgs", "sgu", "sh0",
+	"sh1", "sh4", "sh513", "show", "showb", "showc", "showerror",
+	"showr", "sld", "snap", "spclef", "sphr", "srep", "staff",
+	"stc", "stclef", "stringwidth", "stroke", "stsig", "su", "sub",
+	"svg", "tclef", "thbar", "thumb", "translate", "trem", "trl",
+	"true", "tsig", "tubr", "tubrl", "turn", "turnx", "umrd",
+	"upb", "wedge", "where", "wln", "xydef", "xymove"
+};
+
+/* perfect hash of the built-in operators (see op_find())
+ * the slot of an operator is
+ *	((h >> 8) + op_disp[h % OPH_G] * ((h >> 20) | 1)) % OPH_SZ
+ * where 'h' is the FNV-1a hash of its name,
+ * op_ph[slot] is the operator index + 1 (0: no operator).
+ * The displacements are searched bucket by bucket, the biggest ones first.
+ * These tables must be regenerated when op_tb[] is changed. */
+#define OPH_G 64
+#define OPH_SZ 256
+static const unsigned char op_disp[OPH_G] = {
+	 20,   0,   3,   0,   0,   8,  22,   7, 107,   2,   0,   9,
+	 11,   0,   0,  29,   8,  33,   2,  12,   7,  12,  73,   7,
+	  3,  35,  23,   4,   8,   1,  44,   1,   1,  14,   7,   0,
+	  2,   9,   0,  39,   0,  14,   2,   0,   2,  96, 192,   3,
+	  6,  82,   2,   4,   6,  15,  18,  19,  49,  49,   1,  60,
+	 79,   6, 124,  41
+};
+
+static const unsigned char op_ph[OPH_SZ] = {
+	  0,  29,  10,   3, 215, 190,   0, 222,  61, 174, 121,  13,
+	 55,  98,   0,   1, 109,  76, 115, 181,  52, 144,  86,   4,
+	103, 225,  23,  97, 148,  64, 142,  26,  91,  90, 129,  45,
+	 53,  58, 172, 149,  68, 138, 227, 159, 145, 123, 177, 183,
+	158,  38, 176, 163,   0, 135,  24, 166, 113,   0,  96, 228,
+	 88, 188, 167,  66, 195, 105, 117, 154,  16, 127, 136, 147,
+	186,  22,   0,   0, 155,  12,  92,  71, 143, 164, 171, 196,
+	 47, 204, 114,  74, 122,  39,   0, 193, 124, 110, 157, 207,
+	 79,  18,   0,  80,   0,   0,  41,  89, 226, 198,  70,   0,
+	218,   0,  87, 211,  82, 160, 125, 170, 134, 208,  34,   0,
+	179, 152,  85, 102, 126, 185, 111,  54,   7, 137,   0,  36,
+	 78,   5,  51, 150,  62, 116, 128, 101,  30, 202, 224, 217,
+	 69, 141,   0,  94,   0,   0,  15,   0,  31, 221, 212, 213,
+	 42,  20,  93, 153,   0, 214,   8, 120,   0, 104,  35, 118,
+	 63, 112,  44,  99,  73,  50,  14, 133, 168,  27, 182,   0,
+	140,  37,  28,  21, 223, 201,   0,   2, 107,   0,   0,  56,
+	205,  95,  17, 108, 216, 194,  19, 189, 199,  49,  57, 130,
+	 59, 132,  84,  83, 187,  32,  72,  48, 219,  25, 203, 100,
+	162, 180, 161, 184,  65, 191, 173,  46, 169,  60, 206,  40,
+	139, 106, 200, 220, 197, 119,  43, 178,  81, 131,   0, 156,
+	175,  33,  67,  75, 209,   0, 210, 146,  11, 151,   0,  77,
+	192, 165,   6,   9
+};
+static TLS char op_redef[OP_N];		/* built-in operator redefined */
+static TLS char *path;
+static TLS char path_buf[256];
 
 /* graphical context */
-static struct gc {
+static TLS struct gc {
 	float cx, cy;		// current point (volatile)
 	float xscale, yscale;	// scale
 	float xoffs, yoffs;	// translate
@@ -72,18 +211,21 @@ static struct gc {
 	int rgb;
 	char dash[64];
 } gcur, gold, gsave[8];
-static int nsave;
-static float x_rot, y_rot;	/* save x and y offset when rotate != 0 */
-static int g;			/* current container */
-static int boxend;
-static char *defs;		// SVG ID's from %%beginsvg
-static int defssz;
+static TLS int nsave;
+static TLS float x_rot, y_rot;	/* save x and y offset when rotate != 0 */
+static TLS int g;			/* current container */
+static TLS int boxend;
+static TLS char *defs;		// SVG ID's from %%beginsvg
+static TLS int defssz;
+
+TLS char *svg_sprite;			/* shared symbol file (--sprite) */
 
 /* abcm2ps definitions */
-static struct {
+static TLS struct {
 	char *def;
 	char use;
 	char defined;
+	char sprite;			/* in the shared symbol file */
 } def_tb[] = {
 #define D_brace 0
 {	"<path id=\"brace\" class=\"fill\" d=\"m-2.5 101\n"
@@ -614,6 +756,7 @@ static struct {
 
 /* PS functions */
 static void ps_exec(char *op);
+static void str_exec(struct elt_s *e);
 
 static void elts_link(struct elt_s *e)
 {
@@ -622,8 +765,6 @@ static void elts_link(struct elt_s *e)
 	/* set the linkages - the first element is the link to the next block */
 	for (i = 1; i < NELTS - 1; i++) {
 		e[i].next = &e[i + 1];
-		if (e[i].type == STR)
-			free(e[i].u.s);
 		e[i].type = VAL;
 	}
 	e[NELTS - 1].next = NULL;
@@ -634,8 +775,11 @@ static void elts_reset(void)
 {
 	struct elt_s *e;
 
-	if (!elts)
+	if (!elts) {
 		elts = calloc(sizeof *elts, NELTS);
+		elts_nb = 1;
+		stats_mem(MEM_SVG, NELTS * sizeof *elts, NELTS * sizeof *elts);
+	}
 	elts_link(elts);
 	free_elt = elts + 1;
 
@@ -654,18 +798,23 @@ static struct elt_s *elt_new(void)
 	if (!e) {
 		e = calloc(sizeof *e, NELTS);
 		if (!e) {
-			fprintf(stderr, "svg: elt_new out of memory\n");
+			fprintf(job_err(), "svg: elt_new out of memory\n");
 			ps_error = 1;
 			return e;
 		}
 		elts_link(e);
 		e->u.e = elts;
 		elts = e;
+		elts_nb++;
+		stats_mem(MEM_SVG, elts_nb * NELTS * sizeof *e,
+				elts_nb * NELTS * sizeof *e);
 		e++;
 	}
 	free_elt = e->next;
 	e->next = NULL;
 	e->type = VAL;
+	e->op = OP_N;
+	e->ref = 0;
 	return e;
 }
 
@@ -677,7 +826,6 @@ static void elt_free(struct elt_s *e)
 	free_elt = e;
 	switch (e->type) {
 	case STR:
-		free(e->u.s);
 		e->type = VAL;
 		e->u.v = 0;
 		break;
@@ -686,6 +834,10 @@ static void elt_free(struct elt_s *e)
 		e2 = e->u.e;
 		e->type = VAL;
 		e->u.v = 0;
+		if (e2 && e2->ref > 0) {	/* body still used */
+			e2->ref--;
+			break;
+		}
 		while (e2) {
 			e = e2->next;
 			elt_free(e2);
@@ -695,9 +847,10 @@ static void elt_free(struct elt_s *e)
 	}
 }
 
+/* the strings are shared, and so are the bodies of the {..} and [..] */
 static struct elt_s *elt_dup(struct elt_s *e)
 {
-	struct elt_s *e2, *e3, *e4;
+	struct elt_s *e2;
 
 	e2 = elt_new();
 	if (!e2)
@@ -708,32 +861,145 @@ static struct elt_s *elt_dup(struct elt_s *e)
 		e2->u.v = e->u.v;
 		break;
 	case STR:
-		e2->u.s = strdup(e->u.s);
+		e2->u.s = e->u.s;
+		e2->op = e->op;
 		break;
 	case SEQ:
 	case BRK:
-		e = e->u.e;
-		if (!e) {
-			e2->u.e = NULL;
-			break;
+		e2->u.e = e->u.e;
+		if (e2->u.e)
+			e2->u.e->ref++;
+		break;
+	}
+	return e2;
+}
+
+/* -- string pools -- */
+static char *spool_alloc(struct spool_s *sp, int len)
+{
+	struct sblk_s *b, **pb;
+	char *p;
+
+	b = sp->cur;
+	if (b && sp->used + len <= b->size) {
+		p = &b->s[sp->used];
+		sp->used += len;
+		return p;
+	}
+
+	/* go to the next block, creating it if needed */
+	pb = b ? &b->next : &sp->head;
+	for (;;) {
+		b = *pb;
+		if (!b) {
+			b = malloc(sizeof *b - 1
+					+ (len > SBLK_SZ ? len : SBLK_SZ));
+			if (!b) {
+				fprintf(job_err(), "svg: Out of memory\n");
+				ps_error = 1;
+				return NULL;
+			}
+			b->next = NULL;
+			b->size = len > SBLK_SZ ? len : SBLK_SZ;
+			*pb = b;
 		}
-		e3 = e2->u.e = elt_dup(e);
-		if (!e3)
+		if (len <= b->size)
 			break;
-		for (;;) {
-			e = e->next;
-			if (!e)
-				break;
-			e4 = elt_dup(e);
-			if (!e4)
-				break;
-			e3->next = e4;
-			e3 = e4;
+		pb = &b->next;		/* (too small block kept for later) */
+	}
+	sp->cur = b;
+	sp->used = len;
+	return b->s;
+}
+
+/* release all the strings of a pool, keeping its memory */
+static void spool_reset(struct spool_s *sp)
+{
+	sp->cur = sp->head;
+	sp->used = 0;
+}
+
+/* copy a string in the page pool */
+static char *str_new(char *s, int len)
+{
+	char *p;
+
+	p = spool_alloc(&str_page, len + 1);
+	if (!p)
+		return p;
+	memcpy(p, s, len);
+	p[len] = '\0';
+	return p;
+}
+
+static unsigned str_hash(char *s)
+{
+	unsigned h;
+
+	h = 0;
+	while (*s != '\0')
+		h = h * 31 + (unsigned char) *s++;
+	return h;
+}
+
+/* get the unique copy of a string in the file pool */
+static char *str_intern(char *s)
+{
+	char **htb, *p;
+	unsigned h;
+	int i, l;
+
+	if (str_hn * 2 >= str_hsz) {		/* grow the table */
+		i = str_hsz ? str_hsz * 2 : 256;
+		htb = calloc(i, sizeof *htb);
+		if (!htb) {
+			fprintf(job_err(), "svg: Out of memory\n");
+			ps_error = 1;
+			return s;
 		}
-		e3->next = NULL;
+		for (l = 0; l < str_hsz; l++) {
+			p = str_htb[l];
+			if (!p)
+				continue;
+			h = str_hash(p);
+			while (htb[h & (i - 1)])
+				h++;
+			htb[h & (i - 1)] = p;
+		}
+		free(str_htb);
+		str_htb = htb;
+		str_hsz = i;
+	}
+	for (h = str_hash(s); ; h++) {
+		p = str_htb[h & (str_hsz - 1)];
+		if (!p)
+			break;
+		if (strcmp(p, s) == 0)
+			return p;
+	}
+	l = strlen(s) + 1;
+	p = spool_alloc(&str_file, l);
+	if (!p)
+		return s;
+	memcpy(p, s, l);
+	str_htb[h & (str_hsz - 1)] = p;
+	str_hn++;
+	return p;
+}
+
+/* move the strings of a defined value to the file pool */
+static void str_keep(struct elt_s *e)
+{
+	switch (e->type) {
+	case STR:
+		e->u.s = str_intern(e->u.s);
+		break;
+	case SEQ:
+	case BRK:
+		for (e = e->u.e; e; e = e->next)
+			str_keep(e);
 		break;
 	}
-	return e2;
 }
 
 static void elt_dump(struct elt_s *e)
@@ -743,22 +1009,22 @@ static void elt_dump(struct elt_s *e)
 	type = e->type;
 	switch (type) {
 	case VAL:
-		fprintf(stderr, " %.2f", e->u.v);
+		fprintf(job_err(), " %.2f", e->u.v);
 		break;
 	case STR:
-		fprintf(stderr, " %s", e->u.s);
+		fprintf(job_err(), " %s", e->u.s);
 		if (e->u.s[0] == '(')
-			fprintf(stderr, ")");
+			fprintf(job_err(), ")");
 		break;
 	case SEQ:
 	case BRK:
-		fprintf(stderr, type == SEQ ? " {" : " [");
+		fprintf(job_err(), type == SEQ ? " {" : " [");
 		e = e->u.e;
 		while (e) {
 			elt_dump(e);
 			e = e->next;
 		}
-		fprintf(stderr, type == SEQ ? " }" : " ]");
+		fprintf(job_err(), type == SEQ ? " }" : " ]");
 	}
 }
 
@@ -770,39 +1036,75 @@ static void elt_lst_dump(struct elt_s *e)
 	} while (e);
 }
 
+/* get the index of a built-in operator - -1 if not found */
+static int op_find(char *name)
+{
+	unsigned h;
+	int i;
+	char *p;
+
+	h = 2166136261;				/* FNV-1a */
+	for (p = name; *p != '\0'; p++)
+		h = (h ^ (unsigned char) *p) * 16777619;
+	i = op_ph[((h >> 8) + op_disp[h % OPH_G] * ((h >> 20) | 1))
+			% OPH_SZ];
+	if (i == 0 || strcmp(name, op_tb[i - 1]) != 0)
+		return -1;
+	return i - 1;
+}
+
+/* get the slot of a symbol in the hash table */
+static short *sym_slot(char *name)
+{
+	unsigned h;
+	short *slot;
+
+	h = str_hash(name);
+	for (;;) {
+		slot = &sym_htb[h & (SYM_HSZ - 1)];
+		if (*slot == 0
+		 || strcmp(ps_sym[*slot - 1].n, name) == 0)
+			return slot;
+		h++;
+	}
+}
+
 static struct ps_sym_s *ps_sym_lookup(char *name)
 {
-	struct ps_sym_s *ps;
+	short *slot;
 
 	if (n_sym == 0)
 		return NULL;
-	ps = &ps_sym[n_sym];
-	for (;;) {
-		ps--;
-		if (strcmp(ps->n, name) == 0)
-			break;
-		if (ps == ps_sym)
-			return NULL;
-	}
-	return ps;
+	slot = sym_slot(name);
+	if (*slot == 0)
+		return NULL;
+	return &ps_sym[*slot - 1];
 }
 
 static struct ps_sym_s *ps_sym_def(char *name, struct elt_s *e)
 {
 	struct ps_sym_s *ps;
+	short *slot;
+	int i;
 
-	ps = ps_sym_lookup(name);
-	if (ps) {
+	slot = sym_slot(name);
+	if (*slot != 0) {
+		ps = &ps_sym[*slot - 1];
 		elt_free(ps->e);
 	} else {
 		if (n_sym >= NSYMS) {
-			fprintf(stderr, "svg: Too many PS symbols\n");
+			fprintf(job_err(), "svg: Too many PS symbols\n");
 			ps_error = 1;
 			return NULL;
 		}
 		ps = &ps_sym[n_sym++];
-		ps->n = strdup(name);
+		ps->n = str_intern(name);
+		*slot = n_sym;
+		i = op_find(name);
+		if (i >= 0)
+			op_redef[i] = 1;
 	}
+	str_keep(e);
 	ps->e = e;
 	ps->exec = 0;
 	return ps;
@@ -816,12 +1118,12 @@ static void push(struct elt_s *e)
 
 static void stack_dump(void)
 {
-	fprintf(stderr, "stack:");
+	fprintf(job_err(), "stack:");
 	if (stack)
 		elt_lst_dump(stack);
 	else
-		fprintf(stderr, "(empty)");
-	fprintf(stderr, "\n");
+		fprintf(job_err(), "(empty)");
+	fprintf(job_err(), "\n");
 }
 
 static struct elt_s *pop(int type)
@@ -830,12 +1132,12 @@ static struct elt_s *pop(int type)
 
 	e = stack;
 	if (!e) {
-		fprintf(stderr, "svg pop: Stack empty\n");
+		fprintf(job_err(), "svg pop: Stack empty\n");
 		ps_error = 1;
 		return NULL;
 	}
 	if (e->type != type) {
-		fprintf(stderr, "svg pop: Bad element type %d != %d\n",
+		fprintf(job_err(), "svg pop: Bad element type %d != %d\n",
 			e->type, type);
 		stack_dump();
 		ps_error = 1;
@@ -885,7 +1187,7 @@ static void cond(int type)
 	char *s, *s2;
 
 	if (!stack || !stack->next) {
-		fprintf(stderr, "svg: Stack underflow in condition\n");
+		fprintf(job_err(), "svg: Stack underflow in condition\n");
 		ps_error = 1;
 		return;
 	}
@@ -902,11 +1204,9 @@ static void cond(int type)
 			stack->u.v = strcmp(s2, s) != 0;
 			break;
 		default:
-			fprintf(stderr, "svg: String condition not treated\n");
+			fprintf(job_err(), "svg: String condition not treated\n");
 			break;
 		}
-		free(s);
-		free(s2);
 		stack->type = VAL;
 		return;
 	}
@@ -915,18 +1215,16 @@ static void cond(int type)
 	if (stack->type == STR) {
 		s = stack->u.s;
 		stack->u.v = s[1];
-		free(s);
 		stack->type = VAL;
 	}
 	if (stack->next->type == STR) {
 		s = stack->next->u.s;
 		stack->next->u.v = s[1];
-		free(s);
 		stack->next->type = VAL;
 	}
 	v = pop_free_val();
 	if (stack->type != VAL) {
-		fprintf(stderr, "svg: Bad type for condition\n");
+		fprintf(job_err(), "svg: Bad type for condition\n");
 		ps_error = 1;
 		return;
 	}
@@ -991,14 +1289,15 @@ static void gen_info(void)
 {
 	unsigned i;
 	time_t ltime;
+	struct tm tm;
 
 	time(&ltime);
 #ifndef WIN32
-	strftime(tex_buf, TEX_BUF_SZ, "%b %e, %Y %H:%M", localtime(&ltime));
+	strftime(tex_buf, TEX_BUF_SZ, "%b %e, %Y %H:%M", localtime_r(&ltime, &tm));
 #else
-	strftime(tex_buf, TEX_BUF_SZ, "%b %#d, %Y %H:%M", localtime(&ltime));
+	strftime(tex_buf, TEX_BUF_SZ, "%b %#d, %Y %H:%M", localtime_r(&ltime, &tm));
 #endif
-	fprintf(fout, "<!-- CreationDate: %s -->\n"
+	fmt_fprintf(fout, "<!-- CreationDate: %s -->\n"
 			"<!-- CommandLine:",
 			tex_buf);
 
@@ -1056,13 +1355,13 @@ void define_svg_symbols(char *title, int num, float w, float h)
 				"<meta name=\"generator\" content=\"abcm2ps-" VERSION "\"/>\n",
 				fout);
 			gen_info();
-			fprintf(fout,
+			fmt_fprintf(fout,
 				"<style type=\"text/css\">\n"
 				"\tbody {margin:0; padding:0; border:0;");
 			if (cfmt.bgcolor && cfmt.bgcolor[0] != '\0')
-				fprintf(fout, " background-color:%s",
+				fmt_fprintf(fout, " background-color:%s",
 						cfmt.bgcolor);
-			fprintf(fout,
+			fmt_fprintf(fout,
 				"}\n"
 				"\t@page {margin:0;}\n"
 //				"\tdiv.nobrk {page-break-inside: avoid}\n"
@@ -1078,16 +1377,18 @@ void define_svg_symbols(char *title, int num, float w, float h)
 			fputs("<br/>\n", fout);
 		}
 //		fputs("<p>\n", fout);
-		fprintf(fout, svg_head1, w, h);
+		fmt_fprintf(fout, svg_head1, w, h);
 		xml_str_out(title);
-		fprintf(fout, svg_head2, "page", num);
+		fmt_fprintf(fout, svg_head2, "page", num);
 //		if (cfmt.bgcolor && cfmt.bgcolor[0] != '\0')
-//			fprintf(fout,
+//			fmt_fprintf(fout,
 //				"<rect width=\"100%%\" height=\"100%%\" fill=\"%s\"/>\n",
 //				cfmt.bgcolor);
+	} else if (svg == 3) {			/* -P: drawn directly */
+		pdf_page(w, h, cfmt.bgcolor);
 	} else {				/* -g, -v or -z */
 		if (epsf != 3) {
-			if (fout != stdout)
+			if (fout != stdout && fout != lib_out)
 				fputs("<?xml version=\"1.0\" standalone=\"no\"?>\n"
 					"<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\"\n"
 					"\t\"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n",
@@ -1095,13 +1396,13 @@ void define_svg_symbols(char *title, int num, float w, float h)
 //			else if (svg)
 //				fputs("<p>\n", fout);
 		}
-		fprintf(fout, svg_head1, w, h);
+		fmt_fprintf(fout, svg_head1, w, h);
 		xml_str_out(title);
-		fprintf(fout, svg_head2, epsf ? "tune" : "page", num);
+		fmt_fprintf(fout, svg_head2, epsf ? "tune" : "page", num);
 		fputs("<!-- Creator: abcm2ps-" VERSION " -->\n", fout);
 		gen_info();
 		if (cfmt.bgcolor && cfmt.bgcolor[0] != '\0')
-			fprintf(fout,
+			fmt_fprintf(fout,
 				"<rect width=\"100%%\" height=\"100%%\" fill=\"%s\"/>\n",
 				cfmt.bgcolor);
 	}
@@ -1127,6 +1428,13 @@ void define_svg_symbols(char *title, int num, float w, float h)
 
 	elts_reset();
 	n_sym = 0;
+	memset(sym_htb, 0, sizeof sym_htb);
+	memset(op_redef, 0, sizeof op_redef);
+	spool_reset(&str_page);
+	spool_reset(&str_file);
+	if (str_htb)
+		memset(str_htb, 0, str_hsz * sizeof *str_htb);
+	str_hn = 0;
 
 	in_cnt = 0;
 	path = NULL;
@@ -1179,28 +1487,28 @@ static void output_font(int back)
 		flags |= 8;
 	}
 	if (flags == 0) {
-		fprintf(fout, " font-family=\"%s\" font-size=\"%.2f\"",
+		fmt_fprintf(fout, " font-family=\"%s\" font-size=\"%.2f\"",
 			fn, gcur.font_s);
 	} else {
-		fprintf(fout, " font-family=\"%.*s\" font-size=\"%.2f\"",
+		fmt_fprintf(fout, " font-family=\"%.*s\" font-size=\"%.2f\"",
 			imin, fn, gcur.font_s);
 		if (flags & 2)
-			fprintf(fout, " font-weight=\"bold\"");
+			fmt_fprintf(fout, " font-weight=\"bold\"");
 		if (flags & 4)
-			fprintf(fout, " font-style=\"italic\"");
+			fmt_fprintf(fout, " font-style=\"italic\"");
 		if (flags & 8)
-			fprintf(fout, " font-style=\"oblique\"");
+			fmt_fprintf(fout, " font-style=\"oblique\"");
 	}
 
 	if (!back)
 		return;
 	if (!(flags & 2)
 	 && strstr(gcur.font_n_old, "Bold") != NULL)
-		fprintf(fout, " font-weight=\"normal\"");
+		fmt_fprintf(fout, " font-weight=\"normal\"");
 	if (!(flags & 12)
 	 && (strstr(gcur.font_n_old, "Italic") != NULL
 	  || strstr(gcur.font_n_old, "Oblique") != NULL))
-		fprintf(fout, " font-style=\"normal\"");
+		fmt_fprintf(fout, " font-style=\"normal\"");
 }
 
 static float strw(char *s)
@@ -1222,45 +1530,61 @@ static float strw(char *s)
 static void setg(int newg);
 static void defg1(void)
 {
+	float x, y;
+	int tr;
+
 	setg(0);
-	fprintf(fout, "<g stroke-width=\"%.2f\"", gcur.linewidth);
+	x = y = 0;
+	tr = gcur.rotate != 0 && (gcur.xoffs != 0 || gcur.yoffs != 0);
+	if (tr) {
+		float	xtmp = gcur.xoffs,
+			_sin = gcur.sin,
+			_cos = gcur.cos;
+
+		y = gcur.yoffs;
+		x = xtmp * _cos - y * _sin;
+		y = xtmp * _sin + y * _cos;
+		x_rot = gcur.xoffs;
+		y_rot = gcur.yoffs;
+		gcur.xoffs = 0;
+		gcur.yoffs = 0;
+	}
+	if (svg == 3) {				/* PDF */
+		pdf_g(gcur.linewidth, gcur.xscale, gcur.yscale,
+			x, y, gcur.rotate, gcur.rgb,
+			gcur.font_n[0] == '/' ? gcur.font_n + 1 : gcur.font_n,
+			gcur.font_s);
+		g = 1;
+		memcpy(&gold, &gcur, sizeof gold);
+		return;
+	}
+	fmt_fprintf(fout, "<g stroke-width=\"%.2f\"", gcur.linewidth);
 	if (gcur.xscale != 1 || gcur.yscale != 1 || gcur.rotate != 0) {
-		fprintf(fout, " transform=\"");
+		fmt_fprintf(fout, " transform=\"");
 		if (gcur.xscale != 1 || gcur.yscale != 1) {
 			if (gcur.xscale == gcur.yscale)
-				fprintf(fout, "scale(%.3f)", gcur.xscale);
+				fmt_fprintf(fout, "scale(%.3f)", gcur.xscale);
 			else
-				fprintf(fout, "scale(%.3f,%.3f)",
+				fmt_fprintf(fout, "scale(%.3f,%.3f)",
 						gcur.xscale, gcur.yscale);
 		}
 		if (gcur.rotate != 0) {
-			if (gcur.xoffs != 0 || gcur.yoffs != 0) {
-				float	x, xtmp = gcur.xoffs,
-					y = gcur.yoffs,
-					_sin = gcur.sin,
-					_cos = gcur.cos;
-				x = xtmp * _cos - y * _sin;
-				y = xtmp * _sin + y * _cos;
-				fprintf(fout, " translate(%.2f, %.2f)", x, y);
-				x_rot = gcur.xoffs;
-				y_rot = gcur.yoffs;
-				gcur.xoffs = 0;
-				gcur.yoffs = 0;
-			}
-			fprintf(fout, " rotate(%.2f)", gcur.rotate);
+			if (tr)
+				fmt_fprintf(fout, " translate(%.2f, %.2f)", x, y);
+			fmt_fprintf(fout, " rotate(%.2f)", gcur.rotate);
 		}
 		fputs("\"", fout);
 	}
 	output_font(0);
 	if (gcur.rgb != 0) {
-		fprintf(fout, " style=\"");
+		fmt_fprintf(fout, " style=\"");
 		if (gcur.rgb != 0)
-			fprintf(fout, "color:#%06x;", gcur.rgb);
-		fprintf(fout, "\"");
+			fmt_fprintf(fout, "color:#%06x;", gcur.rgb);
+		fmt_fprintf(fout, "\"");
 	}
 //jfm test
-//	fprintf(fout, "%s>\n", gcur.dash);
-	fprintf(fout, ">\n");
+//	fmt_fprintf(fout, "%s>\n", gcur.dash);
+	fmt_fprintf(fout, ">\n");
 	g = 1;
 	memcpy(&gold, &gcur, sizeof gold);
 }
@@ -1283,7 +1607,10 @@ static void setg(int newg)
 	}
 	if (newg == 0) {
 		if (g != 0) {
-			fputs("</g>\n", fout);
+			if (svg == 3)
+				pdf_g_end();
+			else
+				fputs("</g>\n", fout);
 			if (gcur.rotate != 0) {
 				gcur.xoffs = x_rot;
 				gcur.yoffs = y_rot;
@@ -1308,7 +1635,7 @@ static void path_print(char *fmt, ...)
 	char *p;
 
 	va_start(args, fmt);
-	vsnprintf(path_buf, sizeof path_buf, fmt, args);
+	vfmt(path_buf, sizeof path_buf, fmt, args);
 	va_end(args);
 	if (!path) {
 		path = malloc(strlen(path_buf) + 1);
@@ -1318,30 +1645,123 @@ static void path_print(char *fmt, ...)
 		p = path + strlen(path);
 	}
 	if (!path) {
-		fprintf(stderr, "Out of memory.\n");
-		exit(EXIT_FAILURE);
+		fprintf(job_err(), "Out of memory.\n");
+		fatal_exit(EXIT_FAILURE);
 	}
 	strcpy(p, path_buf);
 }
 
 static void path_def(void)
 {
+	float v[2];
+
 	if (path)
 		return;
 	setg(1);
+	if (svg == 3) {			/* PDF: the path is in pdf.c */
+		v[0] = gcur.xoffs + gcur.cx;
+		v[1] = gcur.yoffs - gcur.cy;
+		pdf_path(CR_MOVE, 2, v);
+		path = path_buf;
+		return;
+	}
 	path_print("<path d=\"m%.2f %.2f\n",
 		gcur.xoffs + gcur.cx, gcur.yoffs - gcur.cy);
 }
 
-static void path_end(void)
+/* paint the path (op = CR_FILL, CR_EOFILL or CR_STROKE) */
+static void path_end(int op)
 {
 	setg(1);
+	if (svg == 3) {
+		pdf_paint(op, -1, op == CR_STROKE ? gcur.dash : NULL);
+		path = NULL;
+		return;
+	}
 	fputs(path, fout);
 	free(path);
 	path = NULL;
+	switch (op) {
+	case CR_EOFILL:
+		fmt_fprintf(fout, "\t\" fill-rule=\"evenodd\" class=\"fill\"/>\n");
+		break;
+	case CR_FILL:
+		fmt_fprintf(fout, "\t\" class=\"fill\"/>\n");
+		break;
+	default:
+		fmt_fprintf(fout, "\t\" class=\"stroke\"%s/>\n",
+				gcur.dash);
+		break;
+	}
+}
+
+/* add a segment to the path (PDF) */
+static void path_pdf(int op, float x, float y)
+{
+	float v[2];
+
+	v[0] = gcur.xoffs + x;
+	v[1] = gcur.yoffs - y;
+	pdf_path(op, 2, v);
+}
+
+/* check if a shape may be drawn directly in PDF */
+/* (the PDF path is shared with the PostScript path) */
+static int pdf_shape(void)
+{
+	return svg == 3 && !path;
+}
+
+/* draw a line (PDF) */
+static void line_pdf(float x, float y, float dx, float dy, float lw)
+{
+	float v[2];
+
+	v[0] = x;
+	v[1] = y;
+	pdf_path(CR_MOVE, 2, v);
+	v[0] += dx;
+	v[1] += dy;
+	pdf_path(CR_LINE, 2, v);
+	pdf_paint(CR_STROKE, lw, NULL);
+}
+
+/* draw a stem with 'n' flags, up (dir = 1) or down (dir = -1) (PDF) */
+static void flag_pdf(float x, float y, float h, int n, int dir)
+{
+	static const float fl1[12] = {		/* one flag */
+		0.6, 5.6, 9.6, 9, 5.6, 18.4,
+		7.2, 12.4, 4.3, 6.8, 0, 5.6
+	};
+	static const float fl2[12] = {		/* many flags */
+		0.9, 3.7, 9.1, 6.4, 6, 12.4,
+		7, 7, 1.8, 4, 0, 4
+	};
+	const float *fl;
+	float v[6];
+	int i;
+
+	line_pdf(x, y, 0, -h, -1);
+	y -= h;
+	fl = n == 1 ? fl1 : fl2;
+	while (--n >= 0) {
+		v[0] = x;
+		v[1] = y;
+		pdf_path(CR_MOVE, 2, v);
+		for (i = 0; i < 12; i += 2) {
+			v[i % 6] = x + fl[i];
+			v[i % 6 + 1] = y + dir * fl[i + 1];
+			if (i % 6 == 4)
+				pdf_path(CR_CURVE, 6, v);
+		}
+		y += dir * 5.4;
+	}
+	pdf_paint(CR_FILL, -1, NULL);
 }
 
-static void def_use(int def)
+/* -- define a symbol -- */
+/* return the file where the symbol is defined ("" if inline) */
+static char *def_use(int def)
 {
 	int i;
 
@@ -1352,9 +1772,37 @@ static void def_use(int def)
 //	} else {
 		setg(1);
 //	}
+
+	/* with --sprite, refer to the shared file
+	 * unless the symbol or a dependency is defined by the user */
+	if (svg_sprite && (svg == 1 || epsf == 2)) {
+		for (i = def; ; i = def_tb[i].use) {
+			if (def_tb[i].defined == 2)
+				break;
+			if (def_tb[i].use == 0) {
+				for (i = def; ; i = def_tb[i].use) {
+					def_tb[i].sprite = 1;
+					if (def_tb[i].use == 0)
+						break;
+				}
+				return svg_sprite;
+			}
+		}
+	}
+
 	if (def_tb[def].defined)
-		return;
+		return "";
 	def_tb[def].defined = 1;
+	if (svg == 3) {				/* PDF */
+		i = def_tb[def].use;
+		while (i != 0 && !def_tb[i].defined) {
+			def_tb[i].defined = 1;
+			pdf_defs(def_tb[i].def);
+			i = def_tb[i].use;
+		}
+		pdf_defs(def_tb[def].def);
+		return "";
+	}
 	fputs("<defs>\n", fout);
 	i = def_tb[def].use;
 	while (i != 0 && !def_tb[i].defined) {
@@ -1364,6 +1812,55 @@ static void def_use(int def)
 	}
 	fputs(def_tb[def].def, fout);
 	fputs("</defs>\n", fout);
+	return "";
+}
+
+/* -- write the shared symbol file (--sprite) -- */
+void svg_sprite_write(void)
+{
+	FILE *f;
+	char fn[FILENAME_MAX], *p;
+	unsigned i;
+
+	if (!svg_sprite)
+		return;
+	for (i = 0; i < sizeof def_tb / sizeof def_tb[0]; i++) {
+		if (def_tb[i].sprite)
+			break;
+	}
+	if (i >= sizeof def_tb / sizeof def_tb[0])
+		return;				/* no symbol */
+
+	/* the file is in the directory of the output files */
+	p = strrchr(outfn, DIRSEP);
+	if (p && svg_sprite[0] != DIRSEP
+	 && p - outfn + 1 + strlen(svg_sprite) < sizeof fn)
+		sprintf(fn, "%.*s%s", (int) (p - outfn + 1), outfn, svg_sprite);
+	else
+		snprintf(fn, sizeof fn, "%s", svg_sprite);
+	f = fopen(fn, "w");
+	if (!f) {
+		error(1, NULL, "Cannot create the symbol file %s", fn);
+		return;
+	}
+	fputs("<?xml version=\"1.0\" standalone=\"no\"?>\n"
+		"<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\"\n"
+		"\txmlns:xlink=\"http://www.w3.org/1999/xlink\">\n"
+		"<style type=\"text/css\">\n"
+		".fill {fill: currentColor}\n"
+		".stroke {stroke: currentColor; fill: none;}\n"
+		"</style>\n"
+		"<defs>\n", f);
+	for ( ; i < sizeof def_tb / sizeof def_tb[0]; i++) {
+		if (def_tb[i].sprite)
+			fputs(def_tb[i].def, f);
+	}
+	fputs("</defs>\n"
+		"</svg>\n", f);
+	if (fclose(f) != 0)
+		error(1, NULL, "Cannot write the symbol file %s", fn);
+	else if (!quiet)
+		fprintf(err_out(), "Symbols written on %s\n", fn);
 }
 
 // SVG definition found in %%beginsvg
@@ -1395,16 +1892,30 @@ void svg_def_id(char *id, int idsz)
 	defs[i + idsz] = '\0';
 }
 
+static void xysym_v(char *op, int use, float x, float y)
+{
+	char *href;
+
+	href = use >= 0 ? def_use(use) : "";
+	if (svg == 3) {
+		if (g == 2) {		/* (no direct drawing inside a text) */
+			fputs("</text>\n", fout);
+			g = 1;
+		}
+		pdf_use(op, gcur.xoffs + x, gcur.yoffs - y);
+		return;
+	}
+	fmt_fprintf(fout, "<use x=\"%.2f\" y=\"%.2f\" xlink:href=\"%s#%s\"/>\n",
+		gcur.xoffs + x, gcur.yoffs - y, href, op);
+}
+
 static void xysym(char *op, int use)
 {
 	float x, y;
 
-	if (use >= 0)
-		def_use(use);
-	y = gcur.yoffs - pop_free_val();
-	x = gcur.xoffs + pop_free_val();
-	fprintf(fout, "<use x=\"%.2f\" y=\"%.2f\" xlink:href=\"#%s\"/>\n",
-		x, y, op);
+	y = pop_free_val();
+	x = pop_free_val();
+	xysym_v(op, use, x, y);
 }
 
 static void setxory(char *s, float v)
@@ -1425,17 +1936,28 @@ static void setxory(char *s, float v)
 	sym->e->u.v = v;
 }
 
+static void setxysym_v(char *op, int use, float x, float y)
+{
+	char *href;
+
+	setxory("x", x);
+	setxory("y", y);
+	href = def_use(use);
+	if (svg == 3) {
+		pdf_use(op, gcur.xoffs + x, gcur.yoffs - y);
+		return;
+	}
+	fmt_fprintf(fout, "<use x=\"%.2f\" y=\"%.2f\" xlink:href=\"%s#%s\"/>\n",
+		gcur.xoffs + x, gcur.yoffs - y, href, op);
+}
+
 static void setxysym(char *op, int use)
 {
 	float x, y;
 
 	y = pop_free_val();
 	x = pop_free_val();
-	setxory("x", x);
-	setxory("y", y);
-	def_use(use);
-	fprintf(fout, "<use x=\"%.2f\" y=\"%.2f\" xlink:href=\"#%s\"/>\n",
-		gcur.xoffs + x, gcur.yoffs - y, op);
+	setxysym_v(op, use, x, y);
 }
 
 /*  gua gda (acciaccatura) */
@@ -1458,7 +1980,11 @@ static void acciac(char *op)
 		x -= 5;
 		y += 4;
 	}
-	fprintf(fout,
+	if (pdf_shape()) {
+		line_pdf(x, y, dx, -dy, -1);
+		return;
+	}
+	fmt_fprintf(fout,
 		"<path d=\"M%.2f %.2fl%.2f %.2f\" class=\"stroke\"/>\n",
 		x, y, dx, -dy);
 }
@@ -1467,62 +1993,64 @@ static void acciac(char *op)
 static void arp_ltr(char type)
 {
 	float x, y, t;
+	char *href;
 	int n;
 
-	def_use(D_ltr);
+	href = def_use(D_ltr);
 	y = gcur.yoffs - pop_free_val();
 	x = gcur.xoffs + pop_free_val();
 	n = (pop_free_val() + 5) / 6;
 	if (type == 'a') {
-		fprintf(fout, "<g transform=\"rotate(270)\">\n");
+		fmt_fprintf(fout, "<g transform=\"rotate(270)\">\n");
 		t = x;
 		x = -y;
 		y = t;
 	}
 	y -= 4;
 	while (--n >= 0) {
-		fprintf(fout, "<use x=\"%.2f\" y=\"%.2f\" xlink:href=\"#ltr\"/>\n",
-			x, y);
+		fmt_fprintf(fout, "<use x=\"%.2f\" y=\"%.2f\" xlink:href=\"%s#ltr\"/>\n",
+			x, y, href);
 		x += 6;
 	}
 	if (type == 'a')
-		fprintf(fout, "</g>\n");
+		fmt_fprintf(fout, "</g>\n");
 }
 
 // glissando with squiggly line
 static void glisq(void)
 {
 	float x1, y1, x2, y2, a;
+	char *href;
 	int n;
 
-	def_use(D_ltr);
+	href = def_use(D_ltr);
 	y1 = gcur.yoffs - pop_free_val();
 	x1 = gcur.xoffs + pop_free_val() + 1;
 	y2 = gcur.yoffs - pop_free_val();
 	x2 = gcur.xoffs + pop_free_val();
 	a = atan((y2 - y1) / (x2 - x1)) / M_PI * 180;
 	n = (x2 - x1 + 3) / 6;
-	fprintf(fout,
+	fmt_fprintf(fout,
 		"<g transform=\"translate(%.2f,%.2f) rotate(%.2f)\">\n",
 		x1, y1, a);
 	x1 = 0;
 	while (--n >= 0) {
-		fprintf(fout, "<use x=\"%.2f\" xlink:href=\"#ltr\"/>\n", x1);
+		fmt_fprintf(fout, "<use x=\"%.2f\" xlink:href=\"%s#ltr\"/>\n",
+			x1, href);
 		x1 += 6;
 	}
-	fprintf(fout, "</g>\n");
+	fmt_fprintf(fout, "</g>\n");
 }
 
 /* sd su gd gu */
-static void stem(char *op)
+static void stem_v(char *op, float h)
 {
 	struct ps_sym_s *sym;
-	float x, y, dx, h;
+	float x, y, dx;
 
 	ps_exec("dlw");
 
 	setg(1);
-	h = pop_free_val();
 	if (op[0] == 's')
 		dx = 3.5;
 	else
@@ -1534,11 +2062,83 @@ static void stem(char *op)
 	sym = ps_sym_lookup("y");
 	y = gcur.yoffs - sym->e->u.v;
 
-	fprintf(fout,
+	if (pdf_shape()) {
+		line_pdf(x, y, 0, -h, -1);
+		return;
+	}
+	fmt_fprintf(fout,
 		"<path d=\"M%.2f %.2fv%.2f\" class=\"stroke\"/>\n",
 		x, y, -h);
 }
 
+static void stem(char *op)
+{
+	stem_v(op, pop_free_val());
+}
+
+/* dt */
+static void dot(float dx, float dy)
+{
+	struct ps_sym_s *sym;
+	float x, y;
+
+	setg(1);
+	sym = ps_sym_lookup("x");
+	x = gcur.xoffs + sym->e->u.v;
+	sym = ps_sym_lookup("y");
+	y = gcur.yoffs - sym->e->u.v;
+	y -= dy;
+	x += dx;
+	if (pdf_shape()) {
+		pdf_circle(x, y, 1.2);
+		pdf_paint(CR_FILL, -1, NULL);
+		return;
+	}
+	fmt_fprintf(fout,
+		"<circle class=\"fill\" cx=\"%.2f\" cy=\"%.2f\" r=\"1.2\"/>\n",
+		x, y);
+}
+
+/* bar */
+static void bar(float h, float x, float y)
+{
+	setg(1);
+	if (pdf_shape()) {
+		line_pdf(gcur.xoffs + x, gcur.yoffs - y, 0, -h, 1);
+		return;
+	}
+	fmt_fprintf(fout, "<path class=\"stroke\" stroke-width=\"1\"\n"
+		"	d=\"M%.2f %.2fv%.2f\"/>\n",
+		gcur.xoffs + x, gcur.yoffs - y, -h);
+}
+
+/* bm */
+static void beam(float h, float dx, float dy, float x, float y)
+{
+	float v[2];
+
+	setg(1);
+	if (pdf_shape()) {
+		v[0] = gcur.xoffs + x;
+		v[1] = gcur.yoffs - y;
+		pdf_path(CR_MOVE, 2, v);
+		v[0] += dx;
+		v[1] -= dy;
+		pdf_path(CR_LINE, 2, v);
+		v[1] += h;
+		pdf_path(CR_LINE, 2, v);
+		v[0] -= dx;
+		v[1] += dy;
+		pdf_path(CR_LINE, 2, v);
+		pdf_paint(CR_FILL, -1, NULL);
+		return;
+	}
+	fmt_fprintf(fout,
+		"<path class=\"fill\"\n"
+		"	d=\"M%.2f %.2fl%.2f %.2fv%.2fl%.2f %.2f\"/>\n",
+		gcur.xoffs + x, gcur.yoffs - y, dx, -dy, h, -dx, dy);
+}
+
 /*
  * types:
  *	s show / c showc / r showr / j jshow / b showb /x gxshow
@@ -1571,7 +2171,7 @@ static void show(char type)
 		if (stack->type == STR) {
 			s = pop_free_str();
 			if (!s || s[0] != '(') {
-				fprintf(stderr, "svg: No string\n");
+				fprintf(job_err(), "svg: No string\n");
 				ps_error = 1;
 				return;
 			}
@@ -1585,34 +2185,35 @@ static void show(char type)
 		w = strw(p);
 		if (type == 'x') {		/* gxshow */
 			w = pop_free_val();	/* inter TAB width */
+			p = str_new(p, strlen(p));	/* (shared string) */
 			q = strchr(p, '\t');
 			*q = '\0';		/* string after the 1st one */
 		}
 		break;
 	}
 	if (span) {
-		fprintf(fout, "<tspan\n\t");
+		fmt_fprintf(fout, "<tspan\n\t");
 		output_font(1);
-		fprintf(fout, ">");
+		fmt_fprintf(fout, ">");
 	} else if (g != 2) {
-		fprintf(fout, "<text x=\"%.2f\" y=\"%.2f\"",
+		fmt_fprintf(fout, "<text x=\"%.2f\" y=\"%.2f\"",
 				gcur.xoffs + x, gcur.yoffs - y);
 		switch (type) {
 		case 'c':
-			fprintf(fout, " text-anchor=\"middle\"");
+			fmt_fprintf(fout, " text-anchor=\"middle\"");
 			w /= 2;
 			break;
 		case 'r':
-			fprintf(fout, " text-anchor=\"end\"");
+			fmt_fprintf(fout, " text-anchor=\"end\"");
 			w = 0;
 			break;
 		case 'j':
-			fprintf(fout, " textLength=\"%.2f\"", w);
+			fmt_fprintf(fout, " textLength=\"%.2f\"", w);
 			break;
 		}
 
 //		if (gcur.rgb != 0)
-//			fprintf(fout, " class=\"fill\"");
+//			fmt_fprintf(fout, " class=\"fill\"");
 		fputs(">", fout);
 		g = 2;
 	}
@@ -1620,7 +2221,7 @@ static void show(char type)
 back:
 	xml_str_out(p);
 	if (span)
-		fprintf(fout, "</tspan>");
+		fmt_fprintf(fout, "</tspan>");
 
 	if (type == 'x') {
 		p = p + strlen(p) + 1;		/* next string of gxshow */
@@ -1633,21 +2234,19 @@ back:
 			w = free_elt->u.v;
 			type = 's';
 		}
-		fprintf(fout, "<tspan dx=\"%.2f\">", w);
+		fmt_fprintf(fout, "<tspan dx=\"%.2f\">", w);
 		span = 1;
 		goto back;
 	}
 	if (type == 'b') {
 		setg(1);
-		fprintf(fout,
+		fmt_fprintf(fout,
 			"<rect class=\"stroke\" stroke-width=\"0.6\"\n"
 			"	x=\"%.2f\" y=\"%.2f\" width=\"%.2f\" height=\"%.2f\"/>\n",
 			gcur.xoffs + gcur.cx - 2, gcur.yoffs - y - gcur.font_s + 2,
 			w + 4, gcur.font_s + 1);
 	}
 	gcur.cx = x + w;
-	if (s)
-		free(s);
 }
 
 /* execute a sequence
@@ -1662,7 +2261,7 @@ static int seq_exec(struct elt_s *e)
 		 && e->u.s[0] != '(') {
 			if (strcmp(e->u.s, "exit") == 0)
 				return 1;
-			ps_exec(e->u.s);
+			str_exec(e);
 			return 0;
 		}
 		/* fall thru */
@@ -1682,7 +2281,7 @@ static int seq_exec(struct elt_s *e)
 			if (strcmp(e->u.s, "exit") == 0)
 				return 1;
 			if (e->u.s[0] != '(' && e->u.s[0] != '/') {
-				ps_exec(e->u.s);
+				str_exec(e);
 				break;
 			}
 			/* fall thru */
@@ -1698,2473 +2297,2238 @@ static int seq_exec(struct elt_s *e)
 	return 0;
 }
 
-/* execute a command */
+/* execute an operator - 'id' is the built-in operator or -1 */
 /* (in case of error, a string may be not freed, but this is not important!) */
-static void ps_exec(char *op)
+static void op_exec(char *op, int id)
 {
 	struct ps_sym_s *sym;
 	struct elt_s *e, *e2;
 	float x, y, w, h;
 	int n;
-	char *s;
+	char *s, *href;
 
 	if (ps_error)
 		return;
 #if 0
-fprintf(stderr, "%s ", op);
+fprintf(job_err(), "%s ", op);
 stack_dump();
 #endif
-	sym = ps_sym_lookup(op);
-	if (sym) {
-		if (++sym->exec > 2) {
-			fprintf(stderr, "svg: Too many recursions\n");
-			ps_error = 1;
+	if (id < 0 || op_redef[id]) {
+		sym = ps_sym_lookup(op);
+		if (sym) {
+			if (++sym->exec > 2) {
+				fprintf(job_err(), "svg: Too many recursions\n");
+				ps_error = 1;
+				return;
+			}
+			seq_exec(sym->e);
+			sym->exec--;
 			return;
 		}
-		seq_exec(sym->e);
-		sym->exec--;
-		return;
 	}
 
-	if (*op == ' ')				/* load */
+	if (*op == ' ') {			/* load */
 		op++;
+		id = op_find(op);
+	}
 
-	switch (*op) {
-	case '!':				/* def */
-		if (op[1] == '\0') {
-			if (!stack) {
-				fprintf(stderr, "svg def: Stack empty\n");
-				ps_error = 1;
-				return;
-			}
-			e = pop(stack->type);	/* value */
-			s = pop_free_str();	/* symbol */
-			if (!s || *s != '/') {
-				fprintf(stderr, "svg def: No / bad symbol\n");
-				if (s)
-					free(s);
-				ps_error = 1;
-				return;
-			}
-			ps_sym_def(&s[1], e);
-			free(s);
+	switch (id) {
+	case OP_bang:
+		if (!stack) {
+			fprintf(job_err(), "svg def: Stack empty\n");
+			ps_error = 1;
 			return;
 		}
-		break;
-	case 'a':
-		if (strcmp(op, "accent") == 0) {
-			xysym(op, D_accent);
+		e = pop(stack->type);	/* value */
+		s = pop_free_str();	/* symbol */
+		if (!s || *s != '/') {
+			fprintf(job_err(), "svg def: No / bad symbol\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "abs") == 0) {
-			if (!stack || stack->type != VAL) {
-				fprintf(stderr, "svg abs: Bad value\n");
-				ps_error = 1;
-				return;
-			}
-			if (stack->u.v < 0)
-				stack->u.v = -stack->u.v;
+		ps_sym_def(&s[1], e);
+		return;
+	case OP_accent:
+		xysym(op, D_accent);
+		return;
+	case OP_abs:
+		if (!stack || stack->type != VAL) {
+			fprintf(job_err(), "svg abs: Bad value\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "add") == 0) {
-			x = pop_free_val();
-			if (!stack || stack->type != VAL) {
-				fprintf(stderr, "svg add: Bad value\n");
-				ps_error = 1;
-				return;
-			}
-			stack->u.v += x;
+		if (stack->u.v < 0)
+			stack->u.v = -stack->u.v;
+		return;
+	case OP_add:
+		x = pop_free_val();
+		if (!stack || stack->type != VAL) {
+			fprintf(job_err(), "svg add: Bad value\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "and") == 0) {
-			x = pop_free_val();
-			if (!stack || stack->type != VAL) {
-				fprintf(stderr, "svg and: Bad value\n");
-				ps_error = 1;
-				return;
-			}
-			stack->u.v = (int) x & (int) stack->u.v;
+		stack->u.v += x;
+		return;
+	case OP_and:
+		x = pop_free_val();
+		if (!stack || stack->type != VAL) {
+			fprintf(job_err(), "svg and: Bad value\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "anshow") == 0) {
-			show('s');
+		stack->u.v = (int) x & (int) stack->u.v;
+		return;
+	case OP_anshow:
+		show('s');
+		return;
+	case OP_arc:
+	case OP_arcn: {
+		float r, a1, a2, x1, y1, x2, y2;
+
+		a2 = pop_free_val();
+		a1 = pop_free_val();
+		r = pop_free_val();
+		if (r < 0) {
+			fprintf(job_err(), "svg arc: Bad value\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "arc") == 0
-		 || strcmp(op, "arcn") == 0) {
-			float r, a1, a2, x1, y1, x2, y2;
-
-			a2 = pop_free_val();
-			a1 = pop_free_val();
-			r = pop_free_val();
-			if (r < 0) {
-				fprintf(stderr, "svg arc: Bad value\n");
-				ps_error = 1;
-				return;
-			}
-			if (a1 >= 360)
-				a1 -= 360;
-			if (a2 >= 360)
-				a2 -= 360;
-			y = pop_free_val();
-			x = pop_free_val();
-			x1 = x + r * cos(a1 * M_PI / 180);
-			y1 = y + r * sinf(a1 * M_PI / 180);
-			if (gcur.cx != NaN) {		// if no newpath
-				if (path) {
-					path_print("\n\t%c%.2f %.2f",
-						x1 != gcur.cx || y1 != gcur.cy ? 'l'
-										: 'm',
-						x1 - gcur.cx, -(y1 - gcur.cy));
-				} else {
-					gcur.cx = x1;
-					gcur.cy = y1;
-					path_def();
-				}
+		if (a1 >= 360)
+			a1 -= 360;
+		if (a2 >= 360)
+			a2 -= 360;
+		y = pop_free_val();
+		x = pop_free_val();
+		x1 = x + r * cos(a1 * M_PI / 180);
+		y1 = y + r * sinf(a1 * M_PI / 180);
+		if (gcur.cx != NaN) {		// if no newpath
+			if (path && svg == 3) {
+				path_pdf(x1 != gcur.cx || y1 != gcur.cy ?
+						CR_LINE : CR_MOVE,
+					x1, y1);
+			} else if (path) {
+				path_print("\n\t%c%.2f %.2f",
+					x1 != gcur.cx || y1 != gcur.cy ? 'l'
+									: 'm',
+					x1 - gcur.cx, -(y1 - gcur.cy));
 			} else {
 				gcur.cx = x1;
 				gcur.cy = y1;
 				path_def();
 			}
-			if (a1 == a2) {			/* circle */
-				a2 = 180 - a1;
-				x2 = x + r * cosf(a2 * M_PI / 180);
-				y2 = y + r * sinf(a2 * M_PI / 180);
+		} else {
+			gcur.cx = x1;
+			gcur.cy = y1;
+			path_def();
+		}
+		if (a1 == a2) {			/* circle */
+			a2 = 180 - a1;
+			x2 = x + r * cosf(a2 * M_PI / 180);
+			y2 = y + r * sinf(a2 * M_PI / 180);
+			if (svg == 3) {
+				pdf_arc(gcur.xoffs + x1, gcur.yoffs - y1,
+					r, op[3] == 'n',
+					gcur.xoffs + x2, gcur.yoffs - y2);
+				pdf_arc(gcur.xoffs + x2, gcur.yoffs - y2,
+					r, op[3] == 'n',
+					gcur.xoffs + x1, gcur.yoffs - y1);
+			} else {
 				path_print("\n\ta%.2f %.2f 0 0 %d %.2f %.2f "
 					"%.2f %.2f 0 0 %d %.2f %.2f\n",
 					r, r, op[3] == 'n', x2 - x1, -(y2 - y1),
 					r, r, op[3] == 'n', x1 - x2, -(y1 - y2));
-				gcur.cx = x1;
-				gcur.cy = y1;
-			} else {
-				x2 = x + r * cosf(a2 * M_PI / 180);
-				y2 = y + r * sinf(a2 * M_PI / 180);
+			}
+			gcur.cx = x1;
+			gcur.cy = y1;
+		} else {
+			x2 = x + r * cosf(a2 * M_PI / 180);
+			y2 = y + r * sinf(a2 * M_PI / 180);
+			if (svg == 3)
+				pdf_arc(gcur.xoffs + x1, gcur.yoffs - y1,
+					r, op[3] == 'n',
+					gcur.xoffs + x2, gcur.yoffs - y2);
+			else
 				path_print("\n\ta%.2f %.2f 0 0 %d %.2f %.2f\n",
 					r, r, op[3] == 'n', x2 - x1, -(y2 - y1));
-				gcur.cx = x2;
-				gcur.cy = y2;
-			}
-			return;
-		}
-		if (strcmp(op, "arp") == 0) {
-			arp_ltr('a');
-			return;
-		}
-		if (strcmp(op, "atan") == 0) {
-			x = pop_free_val();	/* den */
-			if (!stack || stack->type != VAL || x == 0) {
-				fprintf(stderr, "svg atan: Bad value\n");
-				ps_error = 1;
-				return;
-			}
-			y = stack->u.v;		/* num */
-			stack->u.v = atan(y / x) / M_PI * 180;
-			return;
+			gcur.cx = x2;
+			gcur.cy = y2;
 		}
-		break;
-	case 'b':
-		if (strcmp(op, "bar") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val();
-			h = pop_free_val();
-			fprintf(fout, "<path class=\"stroke\" stroke-width=\"1\"\n"
-				"	d=\"M%.2f %.2fv%.2f\"/>\n",
-				x, y, -h);
+		return;
+	    }
+	case OP_arp:
+		arp_ltr('a');
+		return;
+	case OP_atan:
+		x = pop_free_val();	/* den */
+		if (!stack || stack->type != VAL || x == 0) {
+			fprintf(job_err(), "svg atan: Bad value\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "bclef") == 0) {
-			xysym(op, D_bclef);
+		y = stack->u.v;		/* num */
+		stack->u.v = atan(y / x) / M_PI * 180;
+		return;
+	case OP_bar:
+		y = pop_free_val();
+		x = pop_free_val();
+		h = pop_free_val();
+		bar(h, x, y);
+		return;
+	case OP_bclef:
+		xysym(op, D_bclef);
+		return;
+	case OP_bdef:
+		ps_exec("!");
+		return;
+	case OP_bind:
+		return;
+	case OP_bitshift: {
+		int shift;
+
+		shift = pop_free_val();
+		if (!stack || stack->type != VAL
+		 || shift >= 32  || shift < -32) {
+			fprintf(job_err(), "svg: Bad value for bitshift\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "bdef") == 0) {
-			ps_exec("!");
+		if (shift > 0)
+			n = (int) stack->u.v << shift;
+		else
+			n = (int) stack->u.v >> -shift;
+		stack->u.v = n;
+		return;
+	    }
+	case OP_bm: {
+		float dx, dy;
+
+		y = pop_free_val();
+		x = pop_free_val();
+		dy = pop_free_val();
+		dx = pop_free_val();
+		h = pop_free_val();
+		beam(h, dx, dy, x, y);
+		return;
+	    }
+	case OP_bnum:
+	case OP_bnumb:
+		setg(1);
+		y = gcur.yoffs - pop_free_val();
+		x = gcur.xoffs + pop_free_val();
+		s = pop_free_str();
+		if (!s) {
+			fprintf(job_err(), "svg: No string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "bind") == 0) {
-			return;
+		if (op[4] == 'b') {
+			w = 7 * strlen(s);
+			fmt_fprintf(fout,
+				"<rect x=\"%.2f\" y=\"%.2f\" width=\"%.2f\" height=\"12\" fill=\"white\"/>\n",
+				x - w / 2, y - 10, w);
 		}
-		if (strcmp(op, "bitshift") == 0) {
-			int shift;
+		fmt_fprintf(fout,
+			"<text font-family=\"serif\" font-size=\"12\" font-style=\"italic\" font-weight=\"normal\"\n"
+			"	x=\"%.2f\" y=\"%.2f\" text-anchor=\"middle\">%s</text>\n",
+			x, y, s + 1);
+		return;
+	case OP_box:
+		setg(1);
+		h = pop_free_val();
+		w = pop_free_val();
+		y = gcur.yoffs - pop_free_val();
+		x = gcur.xoffs + pop_free_val();
+		fmt_fprintf(fout,
+			"<rect class=\"stroke\"\n"
+			"	x=\"%.2f\" y=\"%.2f\" width=\"%.2f\" height=\"%.2f\"/>\n",
+			x, y - h, w, h);
+		return;
+	case OP_boxdraw:
+		setg(1);
+		h = pop_free_val();
+		y = gcur.yoffs - pop_free_val();
+		x = gcur.xoffs + pop_free_val();
+		fmt_fprintf(fout,
+			"<rect class=\"stroke\"\n"
+			"	x=\"%.2f\" y=\"%.2f\" width=\"%.2f\" height=\"%.2f\"/>\n",
+			x, y - h, boxend - (x - gcur.xoffs) + 2, h);
+		return;
+	case OP_boxmark:
+		if (gcur.cx > boxend)
+			boxend = gcur.cx;
+		return;
+	case OP_boxend:
+		boxend = gcur.cx;
+		return;
+	case OP_brace:
+		href = def_use(D_brace);
+		y = gcur.yoffs - pop_free_val();
+		x = gcur.xoffs + pop_free_val();
+		h = pop_free_val() * 0.01;
+		fmt_fprintf(fout,
+			"<g transform=\"translate(%.2f,%.2f) scale(1,%.2f)\">\n"
+			"	<use xlink:href=\"%s#brace\"/>\n"
+			"</g>\n",
+			x, y, h, href);
+		return;
+	case OP_bracket:
+		setg(1);
+		y = gcur.yoffs - pop_free_val() - 3;
+		x = gcur.xoffs + pop_free_val() - 5;
+		h = pop_free_val() + 2;
+		fmt_fprintf(fout,
+			"<path class=\"fill\"\n"
+			"	d=\"M%.2f %.2f\n"
+			"	c10.5 1 12 -4.5 12 -3.5c0 1 -3.5 5.5 -8.5 5.5\n"
+			"	v%.2f\n"
+			"	c5 0 8.5 4.5 8.5 5.5c0 1 -1.5 -4.5 -12 -3.5\"/>\n",
+			x, y, h);
+		return;
+	case OP_breve:
+		setxysym(op, D_breve);
+		return;
+	case OP_brth:
+		setg(1);
+		y = gcur.yoffs - pop_free_val() - 6;
+		x = gcur.xoffs + pop_free_val();
+		fmt_fprintf(fout, "<text x=\"%.2f\" y=\"%.2f\" font-family=\"serif\" font-size=\"30\"\n"
+			"	font-weight=\"bold\" font-style=\"italic\">,</text>\n",
+			x, y);
+		return;
+	case OP_C: {
+		float c1, c2, c3, c4;
 
-			shift = pop_free_val();
-			if (!stack || stack->type != VAL
-			 || shift >= 32  || shift < -32) {
-				fprintf(stderr, "svg: Bad value for bitshift\n");
-				ps_error = 1;
-				return;
-			}
-			if (shift > 0)
-				n = (int) stack->u.v << shift;
+curveto:
+		path_def();
+		y = pop_free_val();
+		x = pop_free_val();
+		c4 = gcur.yoffs - pop_free_val();
+		c3 = gcur.xoffs + pop_free_val();
+		c2 = gcur.yoffs - pop_free_val();
+		c1 = gcur.xoffs + pop_free_val();
+		if (svg == 3) {
+			float v[6];
+
+			v[0] = c1;
+			v[1] = c2;
+			v[2] = c3;
+			v[3] = c4;
+			v[4] = gcur.xoffs + x;
+			v[5] = gcur.yoffs - y;
+			pdf_path(CR_CURVE, 6, v);
+		} else {
+			path_print("\tC%.2f %.2f %.2f %.2f %.2f %.2f\n",
+				c1, c2, c3, c4,
+				gcur.xoffs + x, gcur.yoffs - y);
+		}
+		gcur.cx = x;
+		gcur.cy = y;
+		return;
+	    }
+	case OP_cclef:
+		xysym(op, D_cclef);
+		return;
+	case OP_csig:
+		xysym(op, D_csig);
+		return;
+	case OP_ctsig:
+		xysym(op, D_ctsig);
+		return;
+	case OP_coda:
+		xysym(op, D_coda);
+		return;
+	case OP_closepath:
+		if (path) {
+//				path_def();
+			if (svg == 3)
+				pdf_path(CR_CLOSE, 0, NULL);
 			else
-				n = (int) stack->u.v >> -shift;
-			stack->u.v = n;
-			return;
+				path_print("\tz");
 		}
-		if (strcmp(op, "bm") == 0) {
-			float dx, dy;
+		return;
+	case OP_composefont:
+		pop(BRK);
+		pop(STR);
+		return;
+	case OP_copy: {
+		struct elt_s *e3;
 
-			setg(1);
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val();
-			dy = pop_free_val();
-			dx = pop_free_val();
-			h = pop_free_val();
-			fprintf(fout,
-				"<path class=\"fill\"\n"
-				"	d=\"M%.2f %.2fl%.2f %.2fv%.2fl%.2f %.2f\"/>\n",
-				x, y, dx, -dy, h,-dx, dy);
+		n = pop_free_val();
+		if ((unsigned) n > 10) {
+			fprintf(job_err(), "svg copy: Too wide\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "bnum") == 0
-		 || strcmp(op, "bnumb") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val();
-			s = pop_free_str();
-			if (!s) {
-				fprintf(stderr, "svg: No string\n");
-				ps_error = 1;
+		e = stack;
+		e2 = NULL;
+		while (--n >= 0) {
+			if (!e)
+				break;
+			e3 = elt_dup(e);
+			if (!e3)
 				return;
-			}
-			if (op[4] == 'b') {
-				w = 7 * strlen(s);
-				fprintf(fout,
-					"<rect x=\"%.2f\" y=\"%.2f\" width=\"%.2f\" height=\"12\" fill=\"white\"/>\n",
-					x - w / 2, y - 10, w);
-			}
-			fprintf(fout,
-				"<text font-family=\"serif\" font-size=\"12\" font-style=\"italic\" font-weight=\"normal\"\n"
-				"	x=\"%.2f\" y=\"%.2f\" text-anchor=\"middle\">%s</text>\n",
-				x, y, s + 1);
-			free(s);
-			return;
+			e3->next = e2;
+			e2 = e3;
+			e = e->next;
 		}
-		if (strcmp(op, "box") == 0) {
-			setg(1);
-			h = pop_free_val();
-			w = pop_free_val();
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val();
-			fprintf(fout,
-				"<rect class=\"stroke\"\n"
-				"	x=\"%.2f\" y=\"%.2f\" width=\"%.2f\" height=\"%.2f\"/>\n",
-				x, y - h, w, h);
+		if (n >= 0) {
+			fprintf(job_err(), "svg copy: Stack empty\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "boxdraw") == 0) {
-			setg(1);
-			h = pop_free_val();
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val();
-			fprintf(fout,
-				"<rect class=\"stroke\"\n"
-				"	x=\"%.2f\" y=\"%.2f\" width=\"%.2f\" height=\"%.2f\"/>\n",
-				x, y - h, boxend - (x - gcur.xoffs) + 2, h);
-			return;
+		while (e2) {
+			e3 = e2->next;
+			push(e2);
+			e2 = e3;
 		}
-		if (strcmp(op, "boxmark") == 0) {
-			if (gcur.cx > boxend)
-				boxend = gcur.cx;
+		return;
+	    }
+	case OP_cos:
+		if (!stack || stack->type != VAL) {
+			fprintf(job_err(), "svg cos: Bad value\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "boxend") == 0) {
-			boxend = gcur.cx;
+		stack->u.v = cos(stack->u.v * M_PI / 180);
+		return;
+	case OP_cpu:
+		xysym(op, D_cpu);
+		return;
+	case OP_crdc:
+		setg(1);
+		y = gcur.yoffs - pop_free_val() - 5;
+		x = gcur.xoffs + pop_free_val();
+		s = pop_free_str();
+		if (!s) {
+			fprintf(job_err(), "svg crdc: No string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "brace") == 0) {
-			def_use(D_brace);
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val();
-			h = pop_free_val() * 0.01;
-			fprintf(fout,
-				"<g transform=\"translate(%.2f,%.2f) scale(1,%.2f)\">\n"
-				"	<use xlink:href=\"#brace\"/>\n"
-				"</g>\n",
-				x, y, h);
+		fmt_fprintf(fout, "<text font-family=\"serif\" font-size=\"16\" font-weight=\"normal\" font-style=\"italic\"\n"
+			"	x=\"%.2f\" y=\"%.2f\" text-anchor=\"left\">%s</text>\n",
+			x, y, s + 1);
+		return;
+	case OP_cresc:
+		setg(1);
+		y = gcur.yoffs - pop_free_val() - 5;
+		x = gcur.xoffs + pop_free_val();
+		w = pop_free_val();
+		sym = ps_sym_lookup("defl");
+		x += w;
+		if ((int) sym->e->u.v & 1)
+			fmt_fprintf(fout, "<path class=\"stroke\"\n"
+				"d=\"M%.2f %.2fl%.2f -2.2m0 -3.6l%.2f -2.2\"/>\n",
+				x, y, -w, w);
+		else
+			fmt_fprintf(fout, "<path class=\"stroke\"\n"
+				"d=\"M%.2f %.2fl%.2f -4l%.2f -4\"/>\n",
+				x, y, -w, w);
+		return;
+	case OP_custos:
+		xysym(op, D_custos);
+		return;
+	case OP_currentgray:
+		e = elt_new();
+		if (!e)
+			return;
+		e->type = VAL;
+		e->u.v = (float) gcur.rgb / 0xffffff;
+		push(e);
+		return;
+	case OP_currentpoint:
+		e = elt_new();
+		if (!e)
+			return;
+		e->type = VAL;
+		e->u.v = gcur.cx;
+		push(e);
+		e = elt_new();
+		if (!e)
+			return;
+		e->type = VAL;
+		e->u.v = gcur.cy;
+		push(e);
+		return;
+	case OP_curveto:
+		goto curveto;
+	case OP_cvi:
+		if (!stack || stack->type != VAL) {
+			fprintf(job_err(), "svg cvi: Bad value\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "bracket") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val() - 3;
-			x = gcur.xoffs + pop_free_val() - 5;
-			h = pop_free_val() + 2;
-			fprintf(fout,
-				"<path class=\"fill\"\n"
-				"	d=\"M%.2f %.2f\n"
-				"	c10.5 1 12 -4.5 12 -3.5c0 1 -3.5 5.5 -8.5 5.5\n"
-				"	v%.2f\n"
-				"	c5 0 8.5 4.5 8.5 5.5c0 1 -1.5 -4.5 -12 -3.5\"/>\n",
-				x, y, h);
+		n = stack->u.v;
+		stack->u.v = n;
+		return;
+	case OP_cvx:
+		s = pop_free_str();
+		if (!s || ((*s != '/') && (*s != '('))) {
+			fprintf(job_err(), "svg cvx: No / bad string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "breve") == 0) {
-			setxysym(op, D_breve);
+		svg_write("{", 1);
+		svg_write(s + 1, strlen(s + 1));
+		svg_write("}", 1);
+		return;
+	case OP_dacs:
+		setg(1);
+		y = gcur.yoffs - pop_free_val() - 3;
+		x = gcur.xoffs + pop_free_val();
+		s = pop_free_str();
+		if (!s) {
+			fprintf(job_err(), "svg dacs: No string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "brth") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val() - 6;
-			x = gcur.xoffs + pop_free_val();
-			fprintf(fout, "<text x=\"%.2f\" y=\"%.2f\" font-family=\"serif\" font-size=\"30\"\n"
-				"	font-weight=\"bold\" font-style=\"italic\">,</text>\n",
-				x, y);
+		fmt_fprintf(fout, "<text font-family=\"serif\" font-size=\"16\" font-weight=\"normal\" font-style=\"normal\"\n"
+			"	x=\"%.2f\" y=\"%.2f\" text-anchor=\"middle\">%s</text>\n",
+			x, y, s + 1);
+		return;
+	case OP_def:
+		ps_exec("!");
+		return;
+	case OP_dim:
+		setg(1);
+		y = gcur.yoffs - pop_free_val() - 5;
+		x = gcur.xoffs + pop_free_val();
+		w = pop_free_val();
+		sym = ps_sym_lookup("defl");
+		if ((int) sym->e->u.v & 2)
+			fmt_fprintf(fout, "<path class=\"stroke\"\n"
+				"d=\"M%.2f %.2fl%.2f -2.2m0 -3.6l%.2f -2.2\"/>\n",
+				x, y, w, -w);
+		else
+			fmt_fprintf(fout, "<path class=\"stroke\"\n"
+				"d=\"M%.2f %.2fl%.2f -4l%.2f -4\"/>\n",
+				x, y, w, -w);
+		return;
+	case OP_div:
+		x = pop_free_val();
+		if (!stack || stack->type != VAL || x == 0) {
+			fprintf(job_err(), "svg: Bad value for div\n");
+			ps_error = 1;
 			return;
 		}
-		break;
-	case 'C':
-		if (strcmp(op, "C") == 0) {
-			float c1, c2, c3, c4;
+		stack->u.v /= x;
+		return;
+	case OP_dnb:
+		xysym(op, D_dnb);
+		return;
+	case OP_dplus:
+		xysym(op, D_dplus);
+		return;
+	case OP_dSL: {
+		float a1, a2, a3, a4, a5, a6, m1, m2;
 
-curveto:
-			path_def();
-			y = pop_free_val();
-			x = pop_free_val();
-			c4 = gcur.yoffs - pop_free_val();
-			c3 = gcur.xoffs + pop_free_val();
-			c2 = gcur.yoffs - pop_free_val();
-			c1 = gcur.xoffs + pop_free_val();
-			path_print("\tC%.2f %.2f %.2f %.2f %.2f %.2f\n",
-				c1, c2, c3, c4, gcur.xoffs + x, gcur.yoffs - y);
-			gcur.cx = x;
-			gcur.cy = y;
+		setg(1);
+		m2 = gcur.yoffs - pop_free_val();
+		m1 = gcur.xoffs + pop_free_val();
+		a6 = pop_free_val();
+		a5 = pop_free_val();
+		a4 = pop_free_val();
+		a3 = pop_free_val();
+		a2 = pop_free_val();
+		a1 = pop_free_val();
+		fmt_fprintf(fout,
+			"<path class=\"stroke\" stroke-dasharray=\"5,5\"\n"
+			"	d=\"M%.2f %.2fc%.2f %.2f %.2f %.2f %.2f %.2f\"/>\n",
+				m1, m2, a1, -a2, a3, -a4, a5, -a6);
+		return;
+	    }
+	case OP_dt:
+		y = pop_free_val();
+		x = pop_free_val();
+		dot(x, y);
+		return;
+	case OP_dotbar:
+		setg(1);
+		y = gcur.yoffs - pop_free_val();
+		x = gcur.xoffs + pop_free_val();
+		h = pop_free_val();
+		fmt_fprintf(fout,
+			"<path class=\"stroke\" stroke-dasharray=\"5,5\"\n"
+			"	d=\"M%.2f %.2fv%.2f\"/>\n",
+			x, y, -h);
+		return;
+	case OP_dup:
+		if (!stack) {
+			fprintf(job_err(), "svg dup: Stack empty\n");
+			ps_error = 1;
 			return;
 		}
-		break;
-	case 'c':
-		if (strcmp(op, "cclef") == 0) {
-			xysym(op, D_cclef);
+		e = elt_dup(stack);
+		if (e)
+			push(e);
+		return;
+	case OP_dft0:
+		xysym(op, D_dft0);
+		return;
+	case OP_dsh0:
+		xysym(op, D_dsh0);
+		return;
+	case OP_emb:
+		xysym(op, D_emb);
+		return;
+	case OP_eofill:
+		if (!path) {
+			fprintf(job_err(), "svg eofill: No path\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "csig") == 0) {
-			xysym(op, D_csig);
+		path_end(CR_EOFILL);
+		return;
+	case OP_eq:
+		cond(C_EQ);
+		return;
+	case OP_exch:
+		if (!stack || !stack->next) {
+			fprintf(job_err(), "svg exch: Stack empty\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "ctsig") == 0) {
-			xysym(op, D_ctsig);
+		e = stack->next;
+		stack->next = e->next;
+		e->next = stack;
+		stack = e;
+		return;
+	case OP_exec:
+		e = pop(SEQ);
+		if (!e)
 			return;
-		}
-		if (strcmp(op, "coda") == 0) {
-			xysym(op, D_coda);
+		seq_exec(e);
+		elt_free(e);
+		return;
+	case OP_false:
+		e = elt_new();
+		if (!e)
+			return;
+		e->type = VAL;
+		e->u.v = 0;
+		push(e);
+		return;
+	case OP_fill:
+		if (!path) {
+			fprintf(job_err(), "svg fill: No path\n");
+//				ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "closepath") == 0) {
-			if (path) {
-//				path_def();
-				path_print("\tz");
-			}
+		path_end(CR_FILL);
+		return;
+	case OP_findfont:
+		s = pop_free_str();
+		if (!s
+		 || *s != '/') {
+			fprintf(job_err(), "svg findfont: No / bad font\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "composefont") == 0) {
-			pop(BRK);
-			pop(STR);
+		if (strcmp(s, gcur.font_n) != 0) {
+			free(gcur.font_n_old);
+			gcur.font_n_old = gcur.font_n;
+			gcur.font_n = strdup(s);
+		} else {
+		}
+		return;
+	case OP_fng:
+		setg(1);
+		y = gcur.yoffs - pop_free_val() - 1;
+		x = gcur.xoffs + pop_free_val() - 3;
+		s = pop_free_str();
+		if (!s) {
+			fprintf(job_err(), "svg fng: No string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "copy") == 0) {
-			struct elt_s *e3;
+		fmt_fprintf(fout, "<text font-family=\"Bookman\" font-size=\"8\" font-weight=\"normal\" font-style=\"normal\"\n"
+			"	x=\"%.2f\" y=\"%.2f\">%s</text>\n",
+			x, y, s + 1);
+		return;
+	case OP_for: {
+		float init, incr, limit;
 
-			n = pop_free_val();
-			if ((unsigned) n > 10) {
-				fprintf(stderr, "svg copy: Too wide\n");
-				ps_error = 1;
-				return;
+		e = pop(SEQ);			/* proc */
+		if (!e)
+			return;
+		limit = pop_free_val();
+		incr = pop_free_val();
+		init = pop_free_val();
+		if (incr == 0
+		 || (limit - init) / incr > 100) {
+			fprintf(job_err(), "svg for: Bad values\n");
+			ps_error = 1;
+			return;
+		}
+		if (incr > 0) {
+			while (init <= limit) {
+				e2 = elt_new();
+				if (!e2)
+					break;
+				e2->type = VAL;
+				e2->u.v = init;
+				push(e2);
+				if (seq_exec(e) != 0)
+					break;
+				init += incr;
 			}
-			e = stack;
-			e2 = NULL;
-			while (--n >= 0) {
-				if (!e)
+		} else {
+			while (init >= limit) {
+				e2 = elt_new();
+				if (!e2)
+					break;
+				e2->type = VAL;
+				e2->u.v = init;
+				push(e2);
+				if (seq_exec(e) != 0)
 					break;
-				e3 = elt_dup(e);
+				init += incr;
+			}
+		}
+		elt_free(e);
+		return;
+	    }
+	case OP_forall: {
+		struct elt_s *e3;
+		unsigned char *p;
+
+		e = pop(SEQ);			/* proc */
+		if (!e)
+			return;
+		e2 = stack;			/* array/string */
+		if (!e2) {
+			fprintf(job_err(), "svg forall: Stack empty\n");
+			ps_error = 1;
+			return;
+		}
+		stack = e2->next;
+		switch (e2->type) {
+		case STR:
+			p = (unsigned char *) &e2->u.s[1];
+			while (*p != '\0') {
+				e3 = elt_new();
 				if (!e3)
 					return;
-				e3->next = e2;
-				e2 = e3;
-				e = e->next;
-			}
-			if (n >= 0) {
-				fprintf(stderr, "svg copy: Stack empty\n");
-				ps_error = 1;
-				return;
+				e3->u.v = *p++;
+				push(e3);
+				if (seq_exec(e) != 0)
+					break;
 			}
-			while (e2) {
-				e3 = e2->next;
-				push(e2);
-				e2 = e3;
+			break;
+		case BRK:
+			for (e3 = e2->u.e; e3; e3 = e3->next) {
+				struct elt_s *e4;
+
+				e4 = elt_dup(e3);
+				push(e4);
+				if (seq_exec(e) != 0)
+					break;
 			}
+			break;
+		default:
+			fprintf(job_err(), "svg forall: Bad any\n");
+			ps_error = 1;
+			return;
+		}
+		elt_free(e);
+		elt_free(e2);
+		return;
+	    }
+	case OP_ft0:
+		xysym(op, D_ft0);
+		return;
+	case OP_ft1:
+		xysym(op, D_ft1);
+		return;
+	case OP_ft4:
+		n = pop_free_val();
+		switch (n) {
+		case 1:
+			xysym("ft1", D_ft1);
+			break;
+		case 2:
+			xysym("ft0", D_ft0);
+			break;
+		case 3:
+			xysym("ft513", D_ft513);
+			break;
+		default:
+			xysym("dft0", D_dft0);
+			break;
+		}
+		return;
+	case OP_ft513:
+		xysym(op, D_ft513);
+		return;
+	case OP_gcshow:
+		show('s');
+		return;
+	case OP_ge:
+		cond(C_GE);
+		return;
+	case OP_get:
+		n = pop_free_val();
+		if (!stack) {
+			fprintf(job_err(), "svg get: Stack empty\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "cos") == 0) {
-			if (!stack || stack->type != VAL) {
-				fprintf(stderr, "svg cos: Bad value\n");
+		switch (stack->type) {
+		case VAL:
+			if (n != 0) {
+				fprintf(job_err(), "svg get: Out of bounds\n");
 				ps_error = 1;
 				return;
 			}
-			stack->u.v = cos(stack->u.v * M_PI / 180);
-			return;
-		}
-		if (strcmp(op, "cpu") == 0) {
-			xysym(op, D_cpu);
 			return;
-		}
-		if (strcmp(op, "crdc") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val() - 5;
-			x = gcur.xoffs + pop_free_val();
-			s = pop_free_str();
-			if (!s) {
-				fprintf(stderr, "svg crdc: No string\n");
+		case STR:
+			s = stack->u.s;
+			if (!s || *s != '(') {
+				fprintf(job_err(), "svg get: Not a string\n");
+				ps_error = 1;
+				return;
+			}
+			if ((unsigned) n >= strlen(s) - 1) {
+				fprintf(job_err(), "svg get: Out of bounds\n");
 				ps_error = 1;
 				return;
 			}
-			fprintf(fout, "<text font-family=\"serif\" font-size=\"16\" font-weight=\"normal\" font-style=\"italic\"\n"
-				"	x=\"%.2f\" y=\"%.2f\" text-anchor=\"left\">%s</text>\n",
-				x, y, s + 1);
-			free(s);
+			stack->type = VAL;
+			stack->u.v = s[n + 1];
 			return;
 		}
-		if (strcmp(op, "cresc") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val() - 5;
-			x = gcur.xoffs + pop_free_val();
-			w = pop_free_val();
-			sym = ps_sym_lookup("defl");
-			x += w;
-			if ((int) sym->e->u.v & 1)
-				fprintf(fout, "<path class=\"stroke\"\n"
-					"d=\"M%.2f %.2fl%.2f -2.2m0 -3.6l%.2f -2.2\"/>\n",
-					x, y, -w, w);
-			else
-				fprintf(fout, "<path class=\"stroke\"\n"
-					"d=\"M%.2f %.2fl%.2f -4l%.2f -4\"/>\n",
-					x, y, -w, w);
-			return;
+		e = stack->u.e;
+		while (--n >= 0) {
+			if (!e)
+				break;
+			e = e->next;
 		}
-		if (strcmp(op, "custos") == 0) {
-			xysym(op, D_custos);
+		if (!e) {
+			fprintf(job_err(), "svg get: Out of bounds\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "currentgray") == 0) {
-			e = elt_new();
-			if (!e)
-				return;
-			e->type = VAL;
-			e->u.v = (float) gcur.rgb / 0xffffff;
-			push(e);
-			return;
-		}
-		if (strcmp(op, "currentpoint") == 0) {
-			e = elt_new();
-			if (!e)
-				return;
-			e->type = VAL;
-			e->u.v = gcur.cx;
-			push(e);
-			e = elt_new();
-			if (!e)
-				return;
-			e->type = VAL;
-			e->u.v = gcur.cy;
-			push(e);
-			return;
-		}
-		if (strcmp(op, "curveto") == 0)
-			goto curveto;
-		if (strcmp(op, "cvi") == 0) {
-			if (!stack || stack->type != VAL) {
-				fprintf(stderr, "svg cvi: Bad value\n");
-				ps_error = 1;
-				return;
-			}
-			n = stack->u.v;
-			stack->u.v = n;
-			return;
-		}
-		if (strcmp(op, "cvx") == 0) {
-			s = pop_free_str();
-			if (!s || ((*s != '/') && (*s != '('))) {
-				fprintf(stderr, "svg cvx: No / bad string\n");
-				if (s)
-					free(s);
-				ps_error = 1;
-				return;
-			}
-			*s = '{';
-			svg_write(s, strlen(s));
-			svg_write("}", 1);
-			free(s);
-			return;
-		}
-		break;
-	case 'd':
-		if (strcmp(op, "dacs") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val() - 3;
-			x = gcur.xoffs + pop_free_val();
-			s = pop_free_str();
-			if (!s) {
-				fprintf(stderr, "svg dacs: No string\n");
-				ps_error = 1;
-				return;
-			}
-			fprintf(fout, "<text font-family=\"serif\" font-size=\"16\" font-weight=\"normal\" font-style=\"normal\"\n"
-				"	x=\"%.2f\" y=\"%.2f\" text-anchor=\"middle\">%s</text>\n",
-				x, y, s + 1);
-			free(s);
-			return;
-		}
-		if (strcmp(op, "def") == 0) {
-			ps_exec("!");
-			return;
-		}
-		if (strcmp(op, "dim") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val() - 5;
-			x = gcur.xoffs + pop_free_val();
-			w = pop_free_val();
-			sym = ps_sym_lookup("defl");
-			if ((int) sym->e->u.v & 2)
-				fprintf(fout, "<path class=\"stroke\"\n"
-					"d=\"M%.2f %.2fl%.2f -2.2m0 -3.6l%.2f -2.2\"/>\n",
-					x, y, w, -w);
-			else
-				fprintf(fout, "<path class=\"stroke\"\n"
-					"d=\"M%.2f %.2fl%.2f -4l%.2f -4\"/>\n",
-					x, y, w, -w);
-			return;
-		}
-		if (strcmp(op, "div") == 0) {
-			x = pop_free_val();
-			if (!stack || stack->type != VAL || x == 0) {
-				fprintf(stderr, "svg: Bad value for div\n");
-				ps_error = 1;
-				return;
-			}
-			stack->u.v /= x;
-			return;
-		}
-		if (strcmp(op, "dnb") == 0) {
-			xysym(op, D_dnb);
+		e = elt_dup(e);		/* (the body may be shared) */
+		if (!e)
 			return;
-		}
-		if (strcmp(op, "dplus") == 0) {
-			xysym(op, D_dplus);
+		e2 = stack;
+		stack = e2->next;
+		elt_free(e2);
+		push(e);
+		return;
+	case OP_getinterval: {
+		int count;
+
+		count = pop_free_val();
+		n = pop_free_val();
+		s = pop_free_str();
+		if (!s || *s != '(') {
+			fprintf(job_err(), "svg getinterval: No string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "dSL") == 0) {
-			float a1, a2, a3, a4, a5, a6, m1, m2;
-
-			setg(1);
-			m2 = gcur.yoffs - pop_free_val();
-			m1 = gcur.xoffs + pop_free_val();
-			a6 = pop_free_val();
-			a5 = pop_free_val();
-			a4 = pop_free_val();
-			a3 = pop_free_val();
-			a2 = pop_free_val();
-			a1 = pop_free_val();
-			fprintf(fout,
-				"<path class=\"stroke\" stroke-dasharray=\"5,5\"\n"
-				"	d=\"M%.2f %.2fc%.2f %.2f %.2f %.2f %.2f %.2f\"/>\n",
-					m1, m2, a1, -a2, a3, -a4, a5, -a6);
+		if ((unsigned) n >= strlen(s)
+		 || (unsigned) count >= strlen(s) - n) {
+			fprintf(job_err(), "svg getinterval: Out of bounds\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "dt") == 0) {
-			setg(1);
-			sym = ps_sym_lookup("x");
-			x = gcur.xoffs + sym->e->u.v;
-			sym = ps_sym_lookup("y");
-			y = gcur.yoffs - sym->e->u.v;
-			y -= pop_free_val();
-			x += pop_free_val();
-			fprintf(fout,
-				"<circle class=\"fill\" cx=\"%.2f\" cy=\"%.2f\" r=\"1.2\"/>\n",
-				x, y);
+		e = elt_new();
+		if (!e)
 			return;
-		}
-		if (strcmp(op, "dotbar") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val();
-			h = pop_free_val();
-			fprintf(fout,
-				"<path class=\"stroke\" stroke-dasharray=\"5,5\"\n"
-				"	d=\"M%.2f %.2fv%.2f\"/>\n",
-				x, y, -h);
+		e->type = STR;
+		e->u.s = str_new(&s[n], count + 1);
+		e->u.s[0] = '(';
+		push(e);
+		return;
+	    }
+	case OP_ghd:
+		setxysym(op, D_ghd);
+		return;
+	case OP_ghl:
+		xysym(op, D_ghl);
+		return;
+	case OP_glisq:
+		glisq();
+		return;
+	case OP_gliss: {
+		float x2, y2;
+
+		setg(1);
+		y = gcur.yoffs - pop_free_val();
+		x = gcur.xoffs + pop_free_val() + 2;
+		y2 = gcur.yoffs - pop_free_val();
+		x2 = gcur.xoffs + pop_free_val();
+		fmt_fprintf(fout, "<path class=\"stroke\" stroke-width=\"1\"\n"
+			"	d=\"M%.2f %.2fL%.2f %.2f\"/>\n",
+			x, y, x2, y2);
+		return;
+	    }
+	case OP_gt:
+		cond(C_GT);
+		return;
+	case OP_gu:
+	case OP_gd:
+		stem(op);
+		return;
+	case OP_gua:
+	case OP_gda:
+		acciac(op);
+		return;
+	case OP_grestore:
+		if (nsave <= 0) {
+			fprintf(job_err(), "svg grestore: No gsave\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "dup") == 0) {
-			if (!stack) {
-				fprintf(stderr, "svg dup: Stack empty\n");
-				ps_error = 1;
-				return;
-			}
-			e = elt_dup(stack);
-			if (e)
-				push(e);
+		setg(1);
+		free(gcur.font_n);
+		free(gcur.font_n_old);
+		memcpy(&gcur, &gsave[--nsave], sizeof gcur);
+		return;
+	case OP_grm:
+		xysym(op, D_grm);
+		return;
+	case OP_gsave:
+		if (nsave >= (int) (sizeof gsave / sizeof gsave[0])) {
+			fprintf(job_err(), "svg grestore: Too many gsave's\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "dft0") == 0) {
-			xysym(op, D_dft0);
+//			setg(1);
+		memcpy(&gsave[nsave++], &gcur, sizeof gsave[0]);
+		gcur.font_n = strdup(gcur.font_n);
+		gcur.font_n_old = strdup(gcur.font_n_old);
+		return;
+	case OP_gsl: {
+		float a1, a2, a3, a4, a5, a6, m1, m2;
+
+		setg(1);
+		m2 = gcur.yoffs - pop_free_val();
+		m1 = gcur.xoffs + pop_free_val();
+		a6 = pop_free_val();
+		a5 = pop_free_val();
+		a4 = pop_free_val();
+		a3 = pop_free_val();
+		a2 = pop_free_val();
+		a1 = pop_free_val();
+		fmt_fprintf(fout,
+			"<path class=\"stroke\"\n"
+			"	d=\"M%.2f %.2fc%.2f %.2f %.2f %.2f %.2f %.2f\"/>\n",
+				m1, m2, a1, -a2, a3, -a4, a5, -a6);
+		return;
+	    }
+	case OP_gxshow:
+		show('x');
+		return;
+	case OP_Hd:
+		setxysym(op, D_Hd);
+		return;
+	case OP_HD:
+		setxysym(op, D_HD);
+		return;
+	case OP_HDD:
+		setxysym(op, D_HDD);
+		return;
+	case OP_hd:
+		setxysym(op, D_hd);
+		return;
+	case OP_hl:
+		xysym(op, D_hl);
+		return;
+	case OP_hl1:
+		xysym(op, D_hl1);
+		return;
+	case OP_hl2:
+		xysym(op, D_hl2);
+		return;
+	case OP_hld:
+		xysym(op, D_hld);
+		return;
+	case OP_hyph: {
+		int d;
+
+		setg(1);
+		y = pop_free_val();
+		x = pop_free_val();
+		w = pop_free_val();
+		d = 25 + (int) w / 20 * 3;
+		n = (w - 15.) / d;
+		x += (w - d * n - 5) / 2;
+		fmt_fprintf(fout, "<path class=\"stroke\" stroke-width=\"1.2\"\n"
+			"	stroke-dasharray=\"5,%d\"\n"
+			"	d=\"M%.2f %.2fh%d\"/>\n",
+			d - 5,
+			gcur.xoffs + x, gcur.yoffs - y - gcur.font_s * 0.3,
+			d * n + 5);
+		return;
+	    }
+	case OP_idiv:
+		n = pop_free_val();
+		if (!stack || stack->type != VAL || n == 0) {
+			fprintf(job_err(), "svg idiv: Bad value\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "dsh0") == 0) {
-			xysym(op, D_dsh0);
+		n = (int) stack->u.v / n;
+		stack->u.v = n;
+		return;
+	case OP_if:
+		e = pop(SEQ);		/* sequence */
+		if (!e)
 			return;
-		}
-		break;
-	case 'e':
-		if (strcmp(op, "emb") == 0) {
-			xysym(op, D_emb);
+		n = pop_free_val();	/* condition */
+		if (n != 0)
+			seq_exec(e);
+		elt_free(e);
+		return;
+	case OP_ifelse:
+		e2 = pop(SEQ);		/* sequence 2 */
+		e = pop(SEQ);		/* sequence 1 */
+		if (!e || !e2)
 			return;
+		n = pop_free_val();	/* condition */
+		if (n != 0)
+			seq_exec(e);
+		else
+			seq_exec(e2);
+		elt_free(e);
+		elt_free(e2);
+		return;
+	case OP_imsig:
+		xysym(op, D_imsig);
+		return;
+	case OP_iMsig:
+		xysym(op, D_iMsig);
+		return;
+	case OP_index:
+		n = pop_free_val();
+		e = stack;
+		while (--n >= 0) {
+			if (!e)
+				break;
+			e = e->next;
 		}
-		if (strcmp(op, "eofill") == 0) {
-			if (!path) {
-				fprintf(stderr, "svg eofill: No path\n");
-				ps_error = 1;
-				return;
-			}
-			path_end();
-			fprintf(fout, "\t\" fill-rule=\"evenodd\" class=\"fill\"/>\n");
+		if (!e) {
+			fprintf(job_err(), "svg index: Stack empty\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "eq") == 0) {
-			cond(C_EQ);
+		e = elt_dup(e);
+		if (!e)
 			return;
-		}
-		if (strcmp(op, "exch") == 0) {
-			if (!stack || !stack->next) {
-				fprintf(stderr, "svg exch: Stack empty\n");
-				ps_error = 1;
-				return;
-			}
-			e = stack->next;
-			stack->next = e->next;
-			e->next = stack;
-			stack = e;
+		push(e);
+		return;
+	case OP_jshow:
+		show('j');
+		return;
+	case OP_L:
+lineto:
+		path_def();
+		y = pop_free_val();
+		x = pop_free_val();
+		if (svg == 3)
+			path_pdf(CR_LINE, x, y);
+		else if (x == gcur.cx)
+			path_print("\tv%.2f\n", gcur.cy - y);
+		else if (y == gcur.cy)
+			path_print("\th%.2f\n", x - gcur.cx);
+		else
+			path_print("\tl%.2f %.2f\n",
+				x - gcur.cx, gcur.cy - y);
+		gcur.cx = x;
+		gcur.cy = y;
+		return;
+	case OP_le:
+		cond(C_LE);
+		return;
+	case OP_lt:
+		cond(C_LT);
+		return;
+	case OP_length:
+		s = pop_free_str();
+		if (!s || *s != '(') {
+			fprintf(job_err(), "svg length: No string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "exec") == 0) {
-			e = pop(SEQ);
-			if (!e)
-				return;
-			seq_exec(e);
-			elt_free(e);
+		e = elt_new();
+		if (!e)
 			return;
-		}
-		break;
-	case 'F':
-		if (sscanf(op, "F%d", &n) == 1) {
-			h = pop_free_val();
-			if (gcur.font_s != h
-			 || strcmp(fontnames[n], gcur.font_n) != 0) {
-				free(gcur.font_n_old);
-				gcur.font_n_old = gcur.font_n;
-				gcur.font_n = strdup(fontnames[n]);
-				gcur.font_s = h;
-			}
+		e->type = VAL;
+		e->u.v = strlen(s + 1);
+		push(e);
+		return;
+	case OP_lineto:
+		goto lineto;
+	case OP_lmrd:
+		xysym(op, D_lmrd);
+		return;
+	case OP_load:
+		s = pop_free_str();
+		if (!s || *s != '/') {
+			fprintf(job_err(), "svg load: No / bad symbol\n");
+			ps_error = 1;
 			return;
 		}
-		break;
-	case 'f':
-		if (strcmp(op, "false") == 0) {
+		sym = ps_sym_lookup(s + 1);
+		if (!sym) {
 			e = elt_new();
 			if (!e)
 				return;
-			e->type = VAL;
-			e->u.v = 0;
-			push(e);
-			return;
-		}
-		if (strcmp(op, "fill") == 0) {
-			if (!path) {
-				fprintf(stderr, "svg fill: No path\n");
-//				ps_error = 1;
-				return;
-			}
-			path_end();
-			fprintf(fout, "\t\" class=\"fill\"/>\n");
-			return;
-		}
-		if (strcmp(op, "findfont") == 0) {
-			s = pop_free_str();
-			if (!s
-			 || *s != '/') {
-				fprintf(stderr, "svg findfont: No / bad font\n");
-				if (s)
-					free(s);
-				ps_error = 1;
-				return;
-			}
-			if (strcmp(s, gcur.font_n) != 0) {
-				free(gcur.font_n_old);
-				gcur.font_n_old = gcur.font_n;
-				gcur.font_n = s;
-			} else {
-				free(s);
-			}
-			return;
-		}
-		if (strcmp(op, "fng") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val() - 1;
-			x = gcur.xoffs + pop_free_val() - 3;
-			s = pop_free_str();
-			if (!s) {
-				fprintf(stderr, "svg fng: No string\n");
-				ps_error = 1;
-				return;
-			}
-			fprintf(fout, "<text font-family=\"Bookman\" font-size=\"8\" font-weight=\"normal\" font-style=\"normal\"\n"
-				"	x=\"%.2f\" y=\"%.2f\">%s</text>\n",
-				x, y, s + 1);
-			free(s);
-			return;
-		}
-		if (strcmp(op, "for") == 0) {
-			float init, incr, limit;
-
-			e = pop(SEQ);			/* proc */
+			e->type = STR;
+			e->u.s = str_new(s, strlen(s));
+			e->u.s[0] = ' ';	/* internal */
+		} else {
+			e = elt_dup(sym->e);
 			if (!e)
 				return;
-			limit = pop_free_val();
-			incr = pop_free_val();
-			init = pop_free_val();
-			if (incr == 0
-			 || (limit - init) / incr > 100) {
-				fprintf(stderr, "svg for: Bad values\n");
-				ps_error = 1;
-				return;
-			}
-			if (incr > 0) {
-				while (init <= limit) {
-					e2 = elt_new();
-					if (!e2)
-						break;
-					e2->type = VAL;
-					e2->u.v = init;
-					push(e2);
-					if (seq_exec(e) != 0)
-						break;
-					init += incr;
-				}
-			} else {
-				while (init >= limit) {
-					e2 = elt_new();
-					if (!e2)
-						break;
-					e2->type = VAL;
-					e2->u.v = init;
-					push(e2);
-					if (seq_exec(e) != 0)
-						break;
-					init += incr;
-				}
-			}
-			elt_free(e);
-			return;
 		}
-		if (strcmp(op, "forall") == 0) {
-			struct elt_s *e3;
-			unsigned char *p;
-
-			e = pop(SEQ);			/* proc */
-			if (!e)
-				return;
-			e2 = stack;			/* array/string */
-			if (!e2) {
-				fprintf(stderr, "svg forall: Stack empty\n");
-				ps_error = 1;
-				return;
-			}
-			stack = e2->next;
-			switch (e2->type) {
-			case STR:
-				p = (unsigned char *) &e2->u.s[1];
-				while (*p != '\0') {
-					e3 = elt_new();
-					if (!e3)
-						return;
-					e3->u.v = *p++;
-					push(e3);
-					if (seq_exec(e) != 0)
-						break;
-				}
-				break;
-			case BRK:
-				for (e3 = e2->u.e; e3; e3 = e3->next) {
-					struct elt_s *e4;
-
-					e4 = elt_dup(e3);
-					push(e4);
-					if (seq_exec(e) != 0)
-						break;
-				}
-				break;
-			default:
-				fprintf(stderr, "svg forall: Bad any\n");
-				ps_error = 1;
-				return;
-			}
-			elt_free(e);
-			elt_free(e2);
-			return;
+		push(e);
+		return;
+	case OP_longa:
+		setxysym(op, D_longa);
+		return;
+	case OP_lphr:
+		xysym(op, D_lphr);
+		return;
+	case OP_ltr:
+		arp_ltr('l');
+		return;
+	case OP_lyshow:
+		show('s');
+		return;
+	case OP_M:
+moveto:
+		gcur.cy = pop_free_val();
+		gcur.cx = pop_free_val();
+		if (path) {
+			if (svg == 3)
+				path_pdf(CR_MOVE, gcur.cx, gcur.cy);
+			else
+				path_print("\tM%.2f %.2f\n",
+					gcur.xoffs + gcur.cx,
+					gcur.yoffs - gcur.cy);
+		} else if (g == 2) {
+			fputs("</text>\n", fout);
+			g = 1;
 		}
-		if (strcmp(op, "ft0") == 0) {
-			xysym(op, D_ft0);
+		return;
+	case OP_marcato:
+		xysym(op, D_marcato);
+		return;
+	case OP_moveto:
+		goto moveto;
+	case OP_mphr:
+		xysym(op, D_mphr);
+		return;
+	case OP_mod:
+		x = pop_free_val();
+		if (!stack || stack->type != VAL || x == 0) {
+			fprintf(job_err(), "svg: Bad value for mod\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "ft1") == 0) {
-			xysym(op, D_ft1);
+		n = (int) stack->u.v % (int) x;
+		stack->u.v = n;
+		return;
+	case OP_mrep:
+		xysym(op, D_mrep);
+		return;
+	case OP_mrep2:
+		xysym(op, D_mrep2);
+		return;
+	case OP_mrest:
+		href = def_use(D_mrest);
+		y = gcur.yoffs - pop_free_val();
+		x = gcur.xoffs + pop_free_val();
+		s = pop_free_str();
+		if (!s) {
+			fprintf(job_err(), "svg: No string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "ft4") == 0) {
-			n = pop_free_val();
-			switch (n) {
-			case 1:
-				xysym("ft1", D_ft1);
-				break;
-			case 2:
-				xysym("ft0", D_ft0);
-				break;
-			case 3:
-				xysym("ft513", D_ft513);
-				break;
-			default:
-				xysym("dft0", D_dft0);
-				break;
-			}
+		fmt_fprintf(fout, "<use x=\"%.2f\" y=\"%.2f\" xlink:href=\"%s#mrest\"/>\n"
+			"<text font-family=\"serif\" font-size=\"15\" font-weight=\"bold\" font-style=\"normal\"\n"
+			"	x=\"%.2f\" y=\"%.2f\" text-anchor=\"middle\">%s</text>\n",
+			x, y, href, x, y - 28, s + 1);
+		return;
+	case OP_mul:
+		x = pop_free_val();
+		if (!stack || stack->type != VAL) {
+			fprintf(job_err(), "svg: Bad value for mul\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "ft513") == 0) {
-			xysym(op, D_ft513);
+		stack->u.v *= x;
+		return;
+	case OP_ne:
+		cond(C_NE);
+		return;
+	case OP_neg:
+		if (!stack || stack->type != VAL) {
+			fprintf(job_err(), "svg: Bad value for neg\n");
+			ps_error = 1;
 			return;
 		}
-		break;
-	case 'g':
-		if (strcmp(op, "gcshow") == 0) {
-			show('s');
+		stack->u.v = -stack->u.v;
+		return;
+	case OP_newpath:
+//			path_def();
+		gcur.cx = NaN;
+		return;
+	case OP_nt0:
+		xysym(op, D_nt0);
+		return;
+	case OP_oct:
+		setg(1);
+		y = gcur.yoffs - pop_free_val();
+		x = gcur.xoffs + pop_free_val();
+		fmt_fprintf(fout, "<text font-family=\"serif\" font-size=\"12\" font-weight=\"normal\" font-style=\"normal\"\n"
+			"	x=\"%.2f\" y=\"%.2f\">8</text>\n",
+			x, y);
+		return;
+	case OP_opend:
+		xysym(op, D_opend);
+		return;
+	case OP_or:
+		x = pop_free_val();
+		if (!stack || stack->type != VAL) {
+			fprintf(job_err(), "svg or: Bad value\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "ge") == 0) {
-			cond(C_GE);
+		stack->u.v = (int) x & (int) stack->u.v;
+		return;
+	case OP_pclef:
+		xysym(op, D_pclef);
+		return;
+	case OP_pf:
+		setg(1);
+		y = gcur.yoffs - pop_free_val() - 5;
+		x = gcur.xoffs + pop_free_val();
+		s = pop_free_str();
+		if (!s) {
+			fprintf(job_err(), "svg pf: No string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "get") == 0) {
-			n = pop_free_val();
-			if (!stack) {
-				fprintf(stderr, "svg get: Stack empty\n");
-				ps_error = 1;
-				return;
-			}
-			switch (stack->type) {
-			case VAL:
-				if (n != 0) {
-					fprintf(stderr, "svg get: Out of bounds\n");
-					ps_error = 1;
-					return;
-				}
-				return;
-			case STR:
-				s = stack->u.s;
-				if (!s || *s != '(') {
-					fprintf(stderr, "svg get: Not a string\n");
-					if (s)
-						free(s);
-					ps_error = 1;
-					return;
-				}
-				if ((unsigned) n >= strlen(s) - 1) {
-					fprintf(stderr, "svg get: Out of bounds\n");
-					ps_error = 1;
-					return;
-				}
-				stack->type = VAL;
-				stack->u.v = s[n + 1];
-				free(s);
-				return;
-			}
-			e = stack->u.e;
-			e2 = NULL;
-			while (--n >= 0) {
-				if (!e)
-					break;
-				e2 = e;
-				e = e->next;
-			}
-			if (!e) {
-				fprintf(stderr, "svg get: Out of bounds\n");
-				ps_error = 1;
-				return;
-			}
-			if (!e2)
-				stack->u.e = e->next;
-			else
-				e2->next = e->next;
-			e->next = stack->next;
-			elt_free(stack);
-			stack = e;
-			return;
-		}
-		if (strcmp(op, "getinterval") == 0) {
-			int count;
-
-			count = pop_free_val();
-			n = pop_free_val();
-			s = pop_free_str();
-			if (!s || *s != '(') {
-				fprintf(stderr, "svg getinterval: No string\n");
-				if (s)
-					free(s);
-				ps_error = 1;
-				return;
-			}
-			if ((unsigned) n >= strlen(s)
-			 || (unsigned) count >= strlen(s) - n) {
-				fprintf(stderr, "svg getinterval: Out of bounds\n");
-				ps_error = 1;
-				return;
-			}
-			e = elt_new();
-			if (!e)
-				return;
-			e->type = STR;
-			e->u.s = malloc(count + 2);
-			e->u.s[0] = '(';
-			memcpy(&e->u.s[1], &s[n + 1], count);
-			e->u.s[count + 1] = '\0';
-			push(e);
-			free(s);
-			return;
-		}
-		if (strcmp(op, "ghd") == 0) {
-			setxysym(op, D_ghd);
-			return;
-		}
-		if (strcmp(op, "ghl") == 0) {
-			xysym(op, D_ghl);
-			return;
-		}
-		if (strcmp(op, "glisq") == 0) {
-			glisq();
-			return;
-		}
-		if (strcmp(op, "gliss") == 0) {
-			float x2, y2;
-
-			setg(1);
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val() + 2;
-			y2 = gcur.yoffs - pop_free_val();
-			x2 = gcur.xoffs + pop_free_val();
-			fprintf(fout, "<path class=\"stroke\" stroke-width=\"1\"\n"
-				"	d=\"M%.2f %.2fL%.2f %.2f\"/>\n",
-				x, y, x2, y2);
-			return;
-		}
-		if (strcmp(op, "gt") == 0) {
-			cond(C_GT);
-			return;
-		}
-		if (strcmp(op, "gu") == 0
-		 || strcmp(op, "gd") == 0) {
-			stem(op);
-			return;
-		}
-		if (strcmp(op, "gua") == 0
-		 || strcmp(op, "gda") == 0) {
-			acciac(op);
-			return;
-		}
-		if (strcmp(op, "grestore") == 0) {
-			if (nsave <= 0) {
-				fprintf(stderr, "svg grestore: No gsave\n");
-				ps_error = 1;
-				return;
-			}
-			setg(1);
-			free(gcur.font_n);
-			free(gcur.font_n_old);
-			memcpy(&gcur, &gsave[--nsave], sizeof gcur);
-			return;
-		}
-		if (strcmp(op, "grm") == 0) {
-			xysym(op, D_grm);
-			return;
-		}
-		if (strcmp(op, "gsave") == 0) {
-			if (nsave >= (int) (sizeof gsave / sizeof gsave[0])) {
-				fprintf(stderr, "svg grestore: Too many gsave's\n");
-				ps_error = 1;
-				return;
-			}
-//			setg(1);
-			memcpy(&gsave[nsave++], &gcur, sizeof gsave[0]);
-			gcur.font_n = strdup(gcur.font_n);
-			gcur.font_n_old = strdup(gcur.font_n_old);
-			return;
-		}
-		if (strcmp(op, "gsl") == 0) {
-			float a1, a2, a3, a4, a5, a6, m1, m2;
-
-			setg(1);
-			m2 = gcur.yoffs - pop_free_val();
-			m1 = gcur.xoffs + pop_free_val();
-			a6 = pop_free_val();
-			a5 = pop_free_val();
-			a4 = pop_free_val();
-			a3 = pop_free_val();
-			a2 = pop_free_val();
-			a1 = pop_free_val();
-			fprintf(fout,
-				"<path class=\"stroke\"\n"
-				"	d=\"M%.2f %.2fc%.2f %.2f %.2f %.2f %.2f %.2f\"/>\n",
-					m1, m2, a1, -a2, a3, -a4, a5, -a6);
-			return;
-		}
-		if (strcmp(op, "gxshow") == 0) {
-			show('x');
-			return;
-		}
-		break;
-	case 'H':
-		if (strcmp(op, "Hd") == 0) {
-			setxysym(op, D_Hd);
-			return;
-		}
-		if (strcmp(op, "HD") == 0) {
-			setxysym(op, D_HD);
-			return;
-		}
-		if (strcmp(op, "HDD") == 0) {
-			setxysym(op, D_HDD);
-			return;
-		}
-		break;
-	case 'h':
-		if (strcmp(op, "hd") == 0) {
-			setxysym(op, D_hd);
-			return;
-		}
-		if (strcmp(op, "hl") == 0) {
-			xysym(op, D_hl);
-			return;
-		}
-		if (strcmp(op, "hl1") == 0) {
-			xysym(op, D_hl1);
-			return;
-		}
-		if (strcmp(op, "hl2") == 0) {
-			xysym(op, D_hl2);
-			return;
-		}
-		if (strcmp(op, "hld") == 0) {
-			xysym(op, D_hld);
-			return;
-		}
-		if (strcmp(op, "hyph") == 0) {
-			int d;
-
-			setg(1);
-			y = pop_free_val();
-			x = pop_free_val();
-			w = pop_free_val();
-			d = 25 + (int) w / 20 * 3;
-			n = (w - 15.) / d;
-			x += (w - d * n - 5) / 2;
-			fprintf(fout, "<path class=\"stroke\" stroke-width=\"1.2\"\n"
-				"	stroke-dasharray=\"5,%d\"\n"
-				"	d=\"M%.2f %.2fh%d\"/>\n",
-				d - 5,
-				gcur.xoffs + x, gcur.yoffs - y - gcur.font_s * 0.3,
-				d * n + 5);
-			return;
-		}
-		break;
-	case 'i':
-		if (strcmp(op, "idiv") == 0) {
-			n = pop_free_val();
-			if (!stack || stack->type != VAL || n == 0) {
-				fprintf(stderr, "svg idiv: Bad value\n");
-				ps_error = 1;
-				return;
-			}
-			n = (int) stack->u.v / n;
-			stack->u.v = n;
-			return;
-		}
-		if (strcmp(op, "if") == 0) {
-			e = pop(SEQ);		/* sequence */
-			if (!e)
-				return;
-			n = pop_free_val();	/* condition */
-			if (n != 0)
-				seq_exec(e);
-			elt_free(e);
-			return;
-		}
-		if (strcmp(op, "ifelse") == 0) {
-			e2 = pop(SEQ);		/* sequence 2 */
-			e = pop(SEQ);		/* sequence 1 */
-			if (!e || !e2)
-				return;
-			n = pop_free_val();	/* condition */
-			if (n != 0)
-				seq_exec(e);
-			else
-				seq_exec(e2);
-			elt_free(e);
-			elt_free(e2);
-			return;
-		}
-		if (strcmp(op, "imsig") == 0) {
-			xysym(op, D_imsig);
-			return;
-		}
-		if (strcmp(op, "iMsig") == 0) {
-			xysym(op, D_iMsig);
-			return;
-		}
-		if (strcmp(op, "index") == 0) {
-			n = pop_free_val();
-			e = stack;
-			while (--n >= 0) {
-				if (!e)
-					break;
-				e = e->next;
-			}
-			if (!e) {
-				fprintf(stderr, "svg index: Stack empty\n");
-				ps_error = 1;
-				return;
-			}
-			e = elt_dup(e);
-			if (!e)
-				return;
-			push(e);
-			return;
-		}
-		break;
-	case 'j':
-		if (strcmp(op, "jshow") == 0) {
-			show('j');
-			return;
-		}
-		break;
-	case 'L':
-		if (strcmp(op, "L") == 0) {
-lineto:
-			path_def();
-			y = pop_free_val();
-			x = pop_free_val();
-			if (x == gcur.cx)
-				path_print("\tv%.2f\n", gcur.cy - y);
-			else if (y == gcur.cy)
-				path_print("\th%.2f\n", x - gcur.cx);
-			else
-				path_print("\tl%.2f %.2f\n",
-					x - gcur.cx, gcur.cy - y);
-			gcur.cx = x;
-			gcur.cy = y;
-			return;
-		}
-	case 'l':
-		if (strcmp(op, "le") == 0) {
-			cond(C_LE);
-			return;
-		}
-		if (strcmp(op, "lt") == 0) {
-			cond(C_LT);
-			return;
-		}
-		if (strcmp(op, "length") == 0) {
-			s = pop_free_str();
-			if (!s || *s != '(') {
-				fprintf(stderr, "svg length: No string\n");
-				if (s)
-					free(s);
-				ps_error = 1;
-				return;
-			}
-			e = elt_new();
-			if (!e)
-				return;
-			e->type = VAL;
-			e->u.v = strlen(s + 1);
-			push(e);
-			free(s);
-			return;
-		}
-		if (strcmp(op, "lineto") == 0)
-			goto lineto;
-		if (strcmp(op, "lmrd") == 0) {
-			xysym(op, D_lmrd);
-			return;
-		}
-		if (strcmp(op, "load") == 0) {
-			s = pop_free_str();
-			if (!s || *s != '/') {
-				fprintf(stderr, "svg load: No / bad symbol\n");
-				if (s)
-					free(s);
-				ps_error = 1;
-				return;
-			}
-			sym = ps_sym_lookup(s + 1);
-			if (!sym) {
-				e = elt_new();
-				if (!e)
-					return;
-				e->type = STR;
-				e->u.s = strdup(s);
-				e->u.s[0] = ' ';	/* internal */
-			} else {
-				e = elt_dup(sym->e);
-				if (!e)
-					return;
-			}
-			free(s);
-			push(e);
-			return;
-		}
-		if (strcmp(op, "longa") == 0) {
-			setxysym(op, D_longa);
-			return;
-		}
-		if (strcmp(op, "lphr") == 0) {
-			xysym(op, D_lphr);
-			return;
-		}
-		if (strcmp(op, "ltr") == 0) {
-			arp_ltr('l');
-			return;
-		}
-		if (strcmp(op, "lyshow") == 0) {
-			show('s');
-			return;
-		}
-		break;
-	case 'M':
-		if (strcmp(op, "M") == 0) {
-moveto:
-			gcur.cy = pop_free_val();
-			gcur.cx = pop_free_val();
-			if (path) {
-				path_print("\tM%.2f %.2f\n",
-					gcur.xoffs + gcur.cx, gcur.yoffs - gcur.cy);
-			} else if (g == 2) {
-				fputs("</text>\n", fout);
-				g = 1;
-			}
-			return;
-		}
-		break;
-	case 'm':
-		if (strcmp(op, "marcato") == 0) {
-			xysym(op, D_marcato);
-			return;
-		}
-		if (strcmp(op, "moveto") == 0)
-			goto moveto;
-		if (strcmp(op, "mphr") == 0) {
-			xysym(op, D_mphr);
-			return;
-		}
-		if (strcmp(op, "mod") == 0) {
-			x = pop_free_val();
-			if (!stack || stack->type != VAL || x == 0) {
-				fprintf(stderr, "svg: Bad value for mod\n");
-				ps_error = 1;
-				return;
-			}
-			n = (int) stack->u.v % (int) x;
-			stack->u.v = n;
-			return;
-		}
-		if (strcmp(op, "mrep") == 0) {
-			xysym(op, D_mrep);
-			return;
-		}
-		if (strcmp(op, "mrep2") == 0) {
-			xysym(op, D_mrep2);
-			return;
-		}
-		if (strcmp(op, "mrest") == 0) {
-			def_use(D_mrest);
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val();
-			s = pop_free_str();
-			if (!s) {
-				fprintf(stderr, "svg: No string\n");
-				ps_error = 1;
-				return;
-			}
-			fprintf(fout, "<use x=\"%.2f\" y=\"%.2f\" xlink:href=\"#mrest\"/>\n"
-				"<text font-family=\"serif\" font-size=\"15\" font-weight=\"bold\" font-style=\"normal\"\n"
-				"	x=\"%.2f\" y=\"%.2f\" text-anchor=\"middle\">%s</text>\n",
-				x, y, x, y - 28, s + 1);
-			free(s);
-			return;
-		}
-		if (strcmp(op, "mul") == 0) {
-			x = pop_free_val();
-			if (!stack || stack->type != VAL) {
-				fprintf(stderr, "svg: Bad value for mul\n");
-				ps_error = 1;
-				return;
-			}
-			stack->u.v *= x;
-			return;
-		}
-		break;
-	case 'n':
-		if (strcmp(op, "ne") == 0) {
-			cond(C_NE);
-			return;
-		}
-		if (strcmp(op, "neg") == 0) {
-			if (!stack || stack->type != VAL) {
-				fprintf(stderr, "svg: Bad value for neg\n");
-				ps_error = 1;
-				return;
-			}
-			stack->u.v = -stack->u.v;
-			return;
-		}
-		if (strcmp(op, "newpath") == 0) {
-//			path_def();
-			gcur.cx = NaN;
-			return;
-		}
-		if (strcmp(op, "nt0") == 0) {
-			xysym(op, D_nt0);
-			return;
-		}
-		break;
-	case 'o':
-		if (strcmp(op, "oct") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val();
-			fprintf(fout, "<text font-family=\"serif\" font-size=\"12\" font-weight=\"normal\" font-style=\"normal\"\n"
-				"	x=\"%.2f\" y=\"%.2f\">8</text>\n",
-				x, y);
-			return;
-		}
-		if (strcmp(op, "opend") == 0) {
-			xysym(op, D_opend);
-			return;
-		}
-		if (strcmp(op, "or") == 0) {
-			x = pop_free_val();
-			if (!stack || stack->type != VAL) {
-				fprintf(stderr, "svg or: Bad value\n");
-				ps_error = 1;
-				return;
-			}
-			stack->u.v = (int) x & (int) stack->u.v;
-			return;
-		}
-		break;
-	case 'p':
-		if (strcmp(op, "pclef") == 0) {
-			xysym(op, D_pclef);
-			return;
-		}
-		if (strcmp(op, "pf") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val() - 5;
-			x = gcur.xoffs + pop_free_val();
-			s = pop_free_str();
-			if (!s) {
-				fprintf(stderr, "svg pf: No string\n");
-				ps_error = 1;
-				return;
-			}
-			fprintf(fout, "<text font-family=\"serif\" font-size=\"16\" font-weight=\"bold\" font-style=\"italic\"\n"
-				"	x=\"%.2f\" y=\"%.2f\">%s</text>\n",
-				x, y, s + 1);
-			free(s);
-			return;
-		}
-		if (strcmp(op, "pmsig") == 0) {
-			xysym(op, D_pmsig);
-			return;
-		}
-		if (strcmp(op, "pMsig") == 0) {
-			xysym(op, D_pMsig);
-			return;
-		}
-		if (strcmp(op, "pop") == 0) {
-			if (!stack) {
-				fprintf(stderr, "svg pop: Stack empty\n");
-				ps_error = 1;
-				return;
-			}
-			e = pop(stack->type);
-			elt_free(e);
-			return;
-		}
-		if (strcmp(op, "pshhd") == 0) {
-			setxysym(op, D_pshhd);
-			return;
-		}
-		if (strcmp(op, "pdshhd") == 0) {
-			setxysym("pshhd", D_pshhd);
-			return;
-		}
-		if (strcmp(op, "pfthd") == 0) {
-			setxysym(op, D_pfthd);
-			return;
-		}
-		if (strcmp(op, "pdfthd") == 0) {
-			setxysym("pfthd", D_pfthd);
-			return;
-		}
-#if 0
-//fixme: cannot work because duplication...
-		if (strcmp(op, "put") == 0) {
-			int v;
-
-			v = pop_free_val();
-			n = pop_free_val();
-			if (!stack) {
-				fprintf(stderr, "svg put: Stack empty\n");
-				ps_error = 1;
-				return;
-			}
-			s = pop_free_str();
-			if (!s || *s != '(') {
-				fprintf(stderr, "svg put: No string\n");
-				if (s)
-					free(s);
-				ps_error = 1;
-				return;
-			}
-			if ((unsigned) n >= strlen(s) - 1) {
-				fprintf(stderr, "svg put: Out of bounds\n");
-				if (s)
-					free(s);
-				ps_error = 1;
-				return;
-			}
-//fixme: should keep the original string...
-			s[n + 1] = v;
-			free(s);
-			return;
-		}
-#endif
-		break;
-	case 'R':
-		if (strcmp(op, "RC") == 0) {
-			float c1, c2, c3, c4;
-
-rcurveto:
-			path_def();
-			y = pop_free_val();
-			x = pop_free_val();
-			c4 = pop_free_val();
-			c3 = pop_free_val();
-			c2 = pop_free_val();
-			c1 = pop_free_val();
-			path_print("\tc%.2f %.2f %.2f %.2f %.2f %.2f\n",
-				c1, -c2, c3, -c4, x, -y);
-			gcur.cx += x;
-			gcur.cy += y;
-			return;
-		}
-		if (strcmp(op, "RL") == 0) {
-rlineto:
-			path_def();
-			y = pop_free_val();
-			x = pop_free_val();
-			if (x == 0)
-				path_print("\tv%.2f\n", -y);
-			else if (y == 0)
-				path_print("\th%.2f\n", x);
-			else
-				path_print("\tl%.2f %.2f\n", x, -y);
-			gcur.cx += x;
-			gcur.cy += y;
-			return;
-		}
-		if (strcmp(op, "RM") == 0) {
-rmoveto:
-			y = pop_free_val();
-			x = pop_free_val();
-			if (path) {
-				path_print("\tm%.2f %.2f\n", x, -y);
-			} else if (g == 2) {
-				fputs("</text>\n", fout);
-				g = 1;
-			}
-			gcur.cx += x;
-			gcur.cy += y;
-			return;
-		}
-		break;
-	case 'r':
-		if (strcmp(op, "r00") == 0) {
-			setxysym(op, D_r00);
-			return;
-		}
-		if (strcmp(op, "r0") == 0) {
-			setxysym(op, D_r0);
-			return;
-		}
-		if (strcmp(op, "r1") == 0) {
-			setxysym(op, D_r1);
+		fmt_fprintf(fout, "<text font-family=\"serif\" font-size=\"16\" font-weight=\"bold\" font-style=\"italic\"\n"
+			"	x=\"%.2f\" y=\"%.2f\">%s</text>\n",
+			x, y, s + 1);
+		return;
+	case OP_pmsig:
+		xysym(op, D_pmsig);
+		return;
+	case OP_pMsig:
+		xysym(op, D_pMsig);
+		return;
+	case OP_pop:
+		if (!stack) {
+			fprintf(job_err(), "svg pop: Stack empty\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "r2") == 0) {
-			setxysym(op, D_r2);
+		e = pop(stack->type);
+		elt_free(e);
+		return;
+	case OP_pshhd:
+		setxysym(op, D_pshhd);
+		return;
+	case OP_pdshhd:
+		setxysym("pshhd", D_pshhd);
+		return;
+	case OP_pfthd:
+		setxysym(op, D_pfthd);
+		return;
+	case OP_pdfthd:
+		setxysym("pfthd", D_pfthd);
+		return;
+#if 0
+//fixme: cannot work because duplication...
+	case OP_put: {
+		int v;
+
+		v = pop_free_val();
+		n = pop_free_val();
+		if (!stack) {
+			fprintf(job_err(), "svg put: Stack empty\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "r4") == 0) {
-			setxysym(op, D_r4);
+		s = pop_free_str();
+		if (!s || *s != '(') {
+			fprintf(job_err(), "svg put: No string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "r8") == 0) {
-			setxysym(op, D_r8);
+		if ((unsigned) n >= strlen(s) - 1) {
+			fprintf(job_err(), "svg put: Out of bounds\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "r16") == 0) {
-			setxysym(op, D_r16);
-			return;
+//fixme: should keep the original string...
+		s[n + 1] = v;
+		return;
+	    }
+#endif
+	case OP_RC: {
+		float c1, c2, c3, c4;
+
+rcurveto:
+		path_def();
+		y = pop_free_val();
+		x = pop_free_val();
+		c4 = pop_free_val();
+		c3 = pop_free_val();
+		c2 = pop_free_val();
+		c1 = pop_free_val();
+		if (svg == 3) {
+			float v[6];
+
+			v[0] = gcur.xoffs + gcur.cx + c1;
+			v[1] = gcur.yoffs - gcur.cy - c2;
+			v[2] = gcur.xoffs + gcur.cx + c3;
+			v[3] = gcur.yoffs - gcur.cy - c4;
+			v[4] = gcur.xoffs + gcur.cx + x;
+			v[5] = gcur.yoffs - gcur.cy - y;
+			pdf_path(CR_CURVE, 6, v);
+		} else {
+			path_print("\tc%.2f %.2f %.2f %.2f %.2f %.2f\n",
+				c1, -c2, c3, -c4, x, -y);
 		}
-		if (strcmp(op, "r32") == 0) {
-			setxysym(op, D_r32);
-			return;
+		gcur.cx += x;
+		gcur.cy += y;
+		return;
+	    }
+	case OP_RL:
+rlineto:
+		path_def();
+		y = pop_free_val();
+		x = pop_free_val();
+		if (svg == 3)
+			path_pdf(CR_LINE, gcur.cx + x, gcur.cy + y);
+		else if (x == 0)
+			path_print("\tv%.2f\n", -y);
+		else if (y == 0)
+			path_print("\th%.2f\n", x);
+		else
+			path_print("\tl%.2f %.2f\n", x, -y);
+		gcur.cx += x;
+		gcur.cy += y;
+		return;
+	case OP_RM:
+rmoveto:
+		y = pop_free_val();
+		x = pop_free_val();
+		if (path) {
+			if (svg == 3)
+				path_pdf(CR_MOVE, gcur.cx + x, gcur.cy + y);
+			else
+				path_print("\tm%.2f %.2f\n", x, -y);
+		} else if (g == 2) {
+			fputs("</text>\n", fout);
+			g = 1;
 		}
-		if (strcmp(op, "r64") == 0) {
-			setxysym(op, D_r64);
+		gcur.cx += x;
+		gcur.cy += y;
+		return;
+	case OP_r00:
+		setxysym(op, D_r00);
+		return;
+	case OP_r0:
+		setxysym(op, D_r0);
+		return;
+	case OP_r1:
+		setxysym(op, D_r1);
+		return;
+	case OP_r2:
+		setxysym(op, D_r2);
+		return;
+	case OP_r4:
+		setxysym(op, D_r4);
+		return;
+	case OP_r8:
+		setxysym(op, D_r8);
+		return;
+	case OP_r16:
+		setxysym(op, D_r16);
+		return;
+	case OP_r32:
+		setxysym(op, D_r32);
+		return;
+	case OP_r64:
+		setxysym(op, D_r64);
+		return;
+	case OP_r128:
+		setxysym(op, D_r128);
+		return;
+	case OP_rdots:
+		xysym(op, D_rdots);
+		return;
+	case OP_rcurveto:
+		goto rcurveto;
+	case OP_rlineto:
+		goto rlineto;
+	case OP_rmoveto:
+		goto rmoveto;
+	case OP_roll: {
+		int i, j;
+
+		j = pop_free_val();
+		n = pop_free_val();
+		if (n <= 0) {
+			fprintf(job_err(), "svg roll: Invalid value\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "r128") == 0) {
-			setxysym(op, D_r128);
-			return;
+		if (j > 0) {
+			j = j % n;
+			if (j > n / 2)
+				j -= n;
+		} else if (j < 0) {
+			j = -(-j % n);
+			if (j < -n / 2)
+				j += n;
 		}
-		if (strcmp(op, "rdots") == 0) {
-			xysym(op, D_rdots);
+		if (j == 0)
 			return;
-		}
-		if (strcmp(op, "rcurveto") == 0)
-			goto rcurveto;
-		if (strcmp(op, "rlineto") == 0)
-			goto rlineto;
-		if (strcmp(op, "rmoveto") == 0)
-			goto rmoveto;
-		if (strcmp(op, "roll") == 0) {
-			int i, j;
-
-			j = pop_free_val();
-			n = pop_free_val();
-			if (n <= 0) {
-				fprintf(stderr, "svg roll: Invalid value\n");
+		e2 = stack;		/* check the stack */
+		i = n;
+		for (;;) {
+			if (!e2) {
+				fprintf(job_err(), "svg roll: Stack empty\n");
 				ps_error = 1;
 				return;
 			}
-			if (j > 0) {
-				j = j % n;
-				if (j > n / 2)
-					j -= n;
-			} else if (j < 0) {
-				j = -(-j % n);
-				if (j < -n / 2)
-					j += n;
-			}
-			if (j == 0)
-				return;
-			e2 = stack;		/* check the stack */
-			i = n;
-			for (;;) {
-				if (!e2) {
-					fprintf(stderr, "svg roll: Stack empty\n");
-					ps_error = 1;
-					return;
-				}
-				if (--i <= 0)
-					break;
-				e2 = e2->next;
-			}
-			if (j > 0) {
-				while (j-- > 0) {
-					e = stack;
-					stack = e->next;
-					e->next = e2->next;
-					e2->next = e;
-					e2 = e;
-				}
-				return;
-			}
-			while (j++ < 0) {
+			if (--i <= 0)
+				break;
+			e2 = e2->next;
+		}
+		if (j > 0) {
+			while (j-- > 0) {
 				e = stack;
-				for (i = 0; i < n - 2; i++)
-					e = e->next;
-				e2 = e->next;
+				stack = e->next;
 				e->next = e2->next;
-				e2->next = stack;
-				stack = e2;
-			}
-			return;
-		}
-		if (strcmp(op, "repbra") == 0) {
-			int i;
-
-			setg(1);
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val();
-			w = pop_free_val();
-			i = pop_free_val();
-			h = pop_free_val();
-			s = pop_free_str();
-			if (!s) {
-				fprintf(stderr, "svg repbra: No string\n");
-				ps_error = 1;
-				return;
+				e2->next = e;
+				e2 = e;
 			}
-			fprintf(fout,
-				"<text x=\"%.2f\" y=\"%.2f\">",
-				x + 4, y - h);
-			xml_str_out(s + 1);
-			fprintf(fout,
-				"</text>\n"
-				"<path class=\"stroke\"\n"
-				"	d=\"M%.2f %.2f",
-				x, y);
-			if (i & 1)
-				fprintf(fout, "m0 20v-20");
-			fprintf(fout, "h%.2f", w);
-			if (i & 2)
-				fprintf(fout, "v20");
-			fprintf(fout, "\"/>\n");
-			free(s);
 			return;
 		}
-		if (strcmp(op, "repeat") == 0) {
-			e = pop(SEQ);		/* sequence */
-			if (!e)
-				return;
-			n = pop_free_val();	/* n times */
-			if ((unsigned) n >= 100) {
-				fprintf(stderr, "svg repeat: Too high value\n");
-				ps_error = 1;
-			}
-			while (--n >= 0) {
-				if (seq_exec(e))
-					break;		/* exit */
-				if (ps_error)
-					break;
-			}
-			elt_free(e);
-			return;
+		while (j++ < 0) {
+			e = stack;
+			for (i = 0; i < n - 2; i++)
+				e = e->next;
+			e2 = e->next;
+			e->next = e2->next;
+			e2->next = stack;
+			stack = e2;
 		}
-		if (strcmp(op, "rotate") == 0) {
-			float x, xtmp, y, _sin, _cos;
-
-			setg(0);
+		return;
+	    }
+	case OP_repbra: {
+		int i;
 
-			// convert orig and currentpoint coord to absolute coord
-			xtmp = gcur.xoffs;
-			y = gcur.yoffs;
-			_sin = gcur.sin;
-			_cos = gcur.cos;
-			x = xtmp * _cos - y * _sin;
-			y = xtmp * _sin + y * _cos;
-			gcur.xoffs = x / gcur.xscale;
-			gcur.yoffs = y / gcur.yscale;
-
-			xtmp = gcur.cx;
-			y = gcur.cy;
-			x = xtmp * _cos - y * _sin;
-			y = xtmp * _sin + y * _cos;
-			gcur.cx = x / gcur.xscale;
-			gcur.cy = y / gcur.yscale;
-
-			// rotate
-			gcur.rotate -= pop_free_val();
-			if (gcur.rotate > 180)
-				gcur.rotate -= 360;
-			else if (gcur.rotate <= -180)
-				gcur.rotate += 360;
-			h = gcur.rotate * M_PI / 180;
-			gcur.sin = _sin = sin(h);
-			gcur.cos = _cos = cos(h);
-			x = gcur.cx;
-			gcur.cx = (x * _cos + gcur.cy * _sin) *
-					gcur.xscale;
-			gcur.cy = (-x * _sin + gcur.cy * _cos) *
-					gcur.yscale;
-			x = gcur.xoffs;
-			gcur.xoffs = (x * _cos + gcur.yoffs * _sin) *
-					gcur.xscale;
-			gcur.yoffs = (-x * _sin + gcur.yoffs * _cos) *
-					gcur.yscale;
-			return;
-		}
-		break;
-	case 'S':
-		if (strcmp(op, "SL") == 0) {
-			float c1, c2, c3, c4, c5, c6, l2;
-			float a1, a2, a3, a4, a5, a6, m1, m2;
-
-			setg(1);
-			m2 = gcur.yoffs - pop_free_val();
-			m1 = gcur.xoffs + pop_free_val();
-			a6 = pop_free_val();
-			a5 = pop_free_val();
-			a4 = pop_free_val();
-			a3 = pop_free_val();
-			a2 = pop_free_val();
-			a1 = pop_free_val();
-			l2 = pop_free_val();
-			pop_free_val();		// always '0'
-			c6 = pop_free_val();
-			c5 = pop_free_val();
-			c4 = pop_free_val();
-			c3 = pop_free_val();
-			c2 = pop_free_val();
-			c1 = pop_free_val();
-			fprintf(fout,
-				"<path class=\"fill\"\n"
-				"	d=\"M%.2f %.2fc%.2f %.2f %.2f %.2f %.2f %.2f\n"
-				"	v%.2fc%.2f %.2f %.2f %.2f %.2f %.2f\"/>\n",
-				m1, m2, a1, -a2, a3, -a4, a5, -a6,
-				-l2, c1, -c2, c3, -c4, c5, -c6);
+		setg(1);
+		y = gcur.yoffs - pop_free_val();
+		x = gcur.xoffs + pop_free_val();
+		w = pop_free_val();
+		i = pop_free_val();
+		h = pop_free_val();
+		s = pop_free_str();
+		if (!s) {
+			fprintf(job_err(), "svg repbra: No string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "SLW") == 0) {
-			gcur.linewidth = pop_free_val();
+		fmt_fprintf(fout,
+			"<text x=\"%.2f\" y=\"%.2f\">",
+			x + 4, y - h);
+		xml_str_out(s + 1);
+		fmt_fprintf(fout,
+			"</text>\n"
+			"<path class=\"stroke\"\n"
+			"	d=\"M%.2f %.2f",
+			x, y);
+		if (i & 1)
+			fmt_fprintf(fout, "m0 20v-20");
+		fmt_fprintf(fout, "h%.2f", w);
+		if (i & 2)
+			fmt_fprintf(fout, "v20");
+		fmt_fprintf(fout, "\"/>\n");
+		return;
+	    }
+	case OP_repeat:
+		e = pop(SEQ);		/* sequence */
+		if (!e)
 			return;
+		n = pop_free_val();	/* n times */
+		if ((unsigned) n >= 100) {
+			fprintf(job_err(), "svg repeat: Too high value\n");
+			ps_error = 1;
 		}
-		break;
-	case 's':
-		if (strcmp(op, "scale") == 0) {
-			y = pop_free_val();
-			x = pop_free_val();
-			gcur.xoffs /= x;
-			gcur.yoffs /= y;
-			gcur.cx /= x;
-			gcur.cy /= y;
-			gcur.xscale *= x;
-			gcur.yscale *= y;
-			return;
+		while (--n >= 0) {
+			if (seq_exec(e))
+				break;		/* exit */
+			if (ps_error)
+				break;
 		}
-		if (strcmp(op, "scalefont") == 0) {
-			gcur.font_s = pop_free_val();
+		elt_free(e);
+		return;
+	case OP_rotate: {
+		float x, xtmp, y, _sin, _cos;
+
+		setg(0);
+
+		// convert orig and currentpoint coord to absolute coord
+		xtmp = gcur.xoffs;
+		y = gcur.yoffs;
+		_sin = gcur.sin;
+		_cos = gcur.cos;
+		x = xtmp * _cos - y * _sin;
+		y = xtmp * _sin + y * _cos;
+		gcur.xoffs = x / gcur.xscale;
+		gcur.yoffs = y / gcur.yscale;
+
+		xtmp = gcur.cx;
+		y = gcur.cy;
+		x = xtmp * _cos - y * _sin;
+		y = xtmp * _sin + y * _cos;
+		gcur.cx = x / gcur.xscale;
+		gcur.cy = y / gcur.yscale;
+
+		// rotate
+		gcur.rotate -= pop_free_val();
+		if (gcur.rotate > 180)
+			gcur.rotate -= 360;
+		else if (gcur.rotate <= -180)
+			gcur.rotate += 360;
+		h = gcur.rotate * M_PI / 180;
+		gcur.sin = _sin = sin(h);
+		gcur.cos = _cos = cos(h);
+		x = gcur.cx;
+		gcur.cx = (x * _cos + gcur.cy * _sin) *
+				gcur.xscale;
+		gcur.cy = (-x * _sin + gcur.cy * _cos) *
+				gcur.yscale;
+		x = gcur.xoffs;
+		gcur.xoffs = (x * _cos + gcur.yoffs * _sin) *
+				gcur.xscale;
+		gcur.yoffs = (-x * _sin + gcur.yoffs * _cos) *
+				gcur.yscale;
+		return;
+	    }
+	case OP_SL: {
+		float c1, c2, c3, c4, c5, c6, l2;
+		float a1, a2, a3, a4, a5, a6, m1, m2;
+
+		setg(1);
+		m2 = gcur.yoffs - pop_free_val();
+		m1 = gcur.xoffs + pop_free_val();
+		a6 = pop_free_val();
+		a5 = pop_free_val();
+		a4 = pop_free_val();
+		a3 = pop_free_val();
+		a2 = pop_free_val();
+		a1 = pop_free_val();
+		l2 = pop_free_val();
+		pop_free_val();		// always '0'
+		c6 = pop_free_val();
+		c5 = pop_free_val();
+		c4 = pop_free_val();
+		c3 = pop_free_val();
+		c2 = pop_free_val();
+		c1 = pop_free_val();
+		fmt_fprintf(fout,
+			"<path class=\"fill\"\n"
+			"	d=\"M%.2f %.2fc%.2f %.2f %.2f %.2f %.2f %.2f\n"
+			"	v%.2fc%.2f %.2f %.2f %.2f %.2f %.2f\"/>\n",
+			m1, m2, a1, -a2, a3, -a4, a5, -a6,
+			-l2, c1, -c2, c3, -c4, c5, -c6);
+		return;
+	    }
+	case OP_SLW:
+		gcur.linewidth = pop_free_val();
+		return;
+	case OP_scale:
+		y = pop_free_val();
+		x = pop_free_val();
+		gcur.xoffs /= x;
+		gcur.yoffs /= y;
+		gcur.cx /= x;
+		gcur.cy /= y;
+		gcur.xscale *= x;
+		gcur.yscale *= y;
+		return;
+	case OP_scalefont:
+		gcur.font_s = pop_free_val();
+		return;
+	case OP_search: {
+		char *p;
+
+		e = pop(STR);			/* seek */
+		e2 = pop(STR);			/* string */
+		if (!e || !e2
+		 || e->u.s[0] != '(' || e2->u.s[0] != '(') {
+			fprintf(job_err(), "svg search: No string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "search") == 0) {
-			char *p;
+		p = strstr(&e2->u.s[1], &e->u.s[1]);
+		if (p) {
+			struct elt_s *e3;
+			int l1, l2, l3;
 
-			e = pop(STR);			/* seek */
-			e2 = pop(STR);			/* string */
-			if (!e || !e2
-			 || e->u.s[0] != '(' || e2->u.s[0] != '(') {
-				fprintf(stderr, "svg search: No string\n");
-				ps_error = 1;
+			l1 = p - e2->u.s;
+			l2 = strlen(e->u.s);
+			l3 = strlen(e2->u.s) - l2 - l1 + 2;
+			e3 = elt_new();
+			if (!e3)
 				return;
-			}
-			p = strstr(&e2->u.s[1], &e->u.s[1]);
-			if (p) {
-				struct elt_s *e3;
-				int l1, l2, l3;
-
-				l1 = p - e2->u.s;
-				l2 = strlen(e->u.s);
-				l3 = strlen(e2->u.s) - l2 - l1 + 2;
-				e3 = elt_new();
-				if (!e3)
-					return;
-				e3->type = STR;
-				e3->u.s = malloc(l3);
-				e3->u.s[0] = '(';
-				memcpy(&e3->u.s[1],
-					&e2->u.s[l1 + l2 - 2],
-					l3 - 1);
-				e3->u.s[l1 + l2 - 1] = '\0';
-				push(e3);
-				push(e);
-				e2->u.s[l1] = '\0';
-				push (e2);
-				e = elt_new();
-				if (!e)
-					return;
-				e->type = VAL;
-				e->u.v = 1;
-			} else {
-				push(e2);
-				free(e->u.s);
-				e->type = VAL;
-				e->u.v = 0;
-			}
+			e3->type = STR;
+			e3->u.s = spool_alloc(&str_page, l3);
+			e3->u.s[0] = '(';
+			memcpy(&e3->u.s[1],
+				&e2->u.s[l1 + l2 - 2],
+				l3 - 1);
+			e3->u.s[l1 + l2 - 1] = '\0';
+			push(e3);
 			push(e);
+			e2->u.s = str_new(e2->u.s, l1);
+			push (e2);
+			e = elt_new();
+			if (!e)
+				return;
+			e->type = VAL;
+			e->u.v = 1;
+		} else {
+			push(e2);
+			e->type = VAL;
+			e->u.v = 0;
+		}
+		push(e);
+		return;
+	    }
+	case OP_selectfont:
+		h = pop_free_val();
+		s = pop_free_str();
+		if (!s
+		 || *s != '/') {
+			fprintf(job_err(), "svg selectfont: No / bad font\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "selectfont") == 0) {
-			h = pop_free_val();
-			s = pop_free_str();
-			if (!s
-			 || *s != '/') {
-				fprintf(stderr, "svg selectfont: No / bad font\n");
-				if (s)
-					free(s);
-				ps_error = 1;
-				return;
-			}
-			if (gcur.font_s != h
-			 || strcmp(s, gcur.font_n) != 0) {
-				free(gcur.font_n_old);
-				gcur.font_n_old = gcur.font_n;
-				gcur.font_n = strdup(s);
-				gcur.font_s = h;
-			} else {
-				free(s);
-			}
+		if (gcur.font_s != h
+		 || strcmp(s, gcur.font_n) != 0) {
+			free(gcur.font_n_old);
+			gcur.font_n_old = gcur.font_n;
+			gcur.font_n = strdup(s);
+			gcur.font_s = h;
+		} else {
+		}
+		return;
+	case OP_sep0:
+		x = pop_free_val();
+		w = pop_free_val();
+		fmt_fprintf(fout,
+			"<path class=\"stroke\"\n"
+			"	d=\"M%.2f %.2fh%.2f\"/>\n",
+				gcur.xoffs + x, gcur.yoffs, w);
+		return;
+	case OP_setdash: {
+		char *p;
+
+		n = pop_free_val();
+		e = pop(BRK);
+		if (!e) {
+			fprintf(job_err(), "svg setdash: Bad pattern\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "sep0") == 0) {
-			x = pop_free_val();
-			w = pop_free_val();
-			fprintf(fout,
-				"<path class=\"stroke\"\n"
-				"	d=\"M%.2f %.2fh%.2f\"/>\n",
-					gcur.xoffs + x, gcur.yoffs, w);
+		e = e->u.e;
+		if (!e) {
+			gcur.dash[0] = '\0';
 			return;
 		}
-		if (strcmp(op, "setdash") == 0) {
-			char *p;
-
-			n = pop_free_val();
-			e = pop(BRK);
-			if (!e) {
-				fprintf(stderr, "svg setdash: Bad pattern\n");
+		p = gcur.dash;
+		if (n != 0)
+			p += sprintf(p, " stroke-dashoffset=\"%d\"", n);
+		p += sprintf(p, " stroke-dasharray=\"");
+		do {
+			if (e->type != VAL) {
+				fprintf(job_err(), "svg setdash: Bad pattern type\n");
 				ps_error = 1;
 				return;
 			}
-			e = e->u.e;
-			if (!e) {
-				gcur.dash[0] = '\0';
+			if (p >= &gcur.dash[sizeof gcur.dash] - 10) {
+				fprintf(job_err(), "svg setdash: Pattern too wide\n");
+				ps_error = 1;
 				return;
 			}
-			p = gcur.dash;
-			if (n != 0)
-				p += sprintf(p, " stroke-dashoffset=\"%d\"", n);
-			p += sprintf(p, " stroke-dasharray=\"");
-			do {
-				if (e->type != VAL) {
-					fprintf(stderr, "svg setdash: Bad pattern type\n");
-					ps_error = 1;
-					return;
-				}
-				if (p >= &gcur.dash[sizeof gcur.dash] - 10) {
-					fprintf(stderr, "svg setdash: Pattern too wide\n");
-					ps_error = 1;
-					return;
-				}
-				p += sprintf(p, "%d,", (int) e->u.v);
-				e = e->next;
-			} while (e);
-			p--;
-			sprintf(p, "\"");
-			return;
-		}
-		if (strcmp(op, "setfont") == 0) {
-			return;
-		}
-		if (strcmp(op, "setgray") == 0) {
-			n = pop_free_val() * 255;
-			gcur.rgb = (n << 16) | (n << 8) | n;
-			return;
-		}
-		if (strcmp(op, "setlinewidth") == 0) {
-			gcur.linewidth = pop_free_val();
-			return;
-		}
+			p += sprintf(p, "%d,", (int) e->u.v);
+			e = e->next;
+		} while (e);
+		p--;
+		sprintf(p, "\"");
+		return;
+	    }
+	case OP_setfont:
+		return;
+	case OP_setgray:
+		n = pop_free_val() * 255;
+		gcur.rgb = (n << 16) | (n << 8) | n;
+		return;
+	case OP_setlinewidth:
+		gcur.linewidth = pop_free_val();
+		return;
 //fixme: use 'use' for flags
-		if (strcmp(op, "sfu") == 0) {
-			setg(1);
-			h = pop_free_val();
-			n = pop_free_val();
-			sym = ps_sym_lookup("x");
-			x = gcur.xoffs + sym->e->u.v + 3.5;
-			sym = ps_sym_lookup("y");
-			y = gcur.yoffs - sym->e->u.v;
-			fprintf(fout,
-				"<path d=\"M%.2f %.2fv%.2f\" class=\"stroke\"/>\n"
-				"<path class=\"fill\"\n"
-				"	d=\"",
-				x, y, -h);
-			y -= h;
-			if (n == 1) {
-				fprintf(fout,
-					"M%.2f %.2fc0.6 5.6 9.6 9 5.6 18.4\n"
-					"	1.6 -6 -1.3 -11.6 -5.6 -12.8\n",
+	case OP_sfu:
+		setg(1);
+		h = pop_free_val();
+		n = pop_free_val();
+		sym = ps_sym_lookup("x");
+		x = gcur.xoffs + sym->e->u.v + 3.5;
+		sym = ps_sym_lookup("y");
+		y = gcur.yoffs - sym->e->u.v;
+		if (pdf_shape()) {
+			flag_pdf(x, y, h, n, 1);
+			return;
+		}
+		fmt_fprintf(fout,
+			"<path d=\"M%.2f %.2fv%.2f\" class=\"stroke\"/>\n"
+			"<path class=\"fill\"\n"
+			"	d=\"",
+			x, y, -h);
+		y -= h;
+		if (n == 1) {
+			fmt_fprintf(fout,
+				"M%.2f %.2fc0.6 5.6 9.6 9 5.6 18.4\n"
+				"	1.6 -6 -1.3 -11.6 -5.6 -12.8\n",
+				x, y);
+		} else {
+			while (--n >= 0) {
+				fmt_fprintf(fout,
+					"M%.2f %.2fc0.9 3.7 9.1 6.4 6 12.4\n"
+					"	1 -5.4 -4.2 -8.4 -6 -8.4\n",
 					x, y);
-			} else {
-				while (--n >= 0) {
-					fprintf(fout,
-						"M%.2f %.2fc0.9 3.7 9.1 6.4 6 12.4\n"
-						"	1 -5.4 -4.2 -8.4 -6 -8.4\n",
-						x, y);
-					y += 5.4;
-				}
+				y += 5.4;
 			}
-			fprintf(fout, "\"/>\n");
-			return;
 		}
-		if (strcmp(op, "sfd") == 0) {
-			setg(1);
-			h = pop_free_val();
-			n = pop_free_val();
-			sym = ps_sym_lookup("x");
-			x = gcur.xoffs + sym->e->u.v - 3.5;
-			sym = ps_sym_lookup("y");
-			y = gcur.yoffs - sym->e->u.v;
-			fprintf(fout,
-				"<path d=\"M%.2f %.2fv%.2f\" class=\"stroke\"/>\n"
-				"<path class=\"fill\"\n"
-				"	d=\"",
-				x, y, -h);
-			y -= h;
-			if (n == 1) {
-				fprintf(fout,
-					"M%.2f %.2fc0.6 -5.6 9.6 -9 5.6 -18.4\n"
-					"	1.6 6 -1.3 11.6 -5.6 12.8\n",
+		fmt_fprintf(fout, "\"/>\n");
+		return;
+	case OP_sfd:
+		setg(1);
+		h = pop_free_val();
+		n = pop_free_val();
+		sym = ps_sym_lookup("x");
+		x = gcur.xoffs + sym->e->u.v - 3.5;
+		sym = ps_sym_lookup("y");
+		y = gcur.yoffs - sym->e->u.v;
+		if (pdf_shape()) {
+			flag_pdf(x, y, h, n, -1);
+			return;
+		}
+		fmt_fprintf(fout,
+			"<path d=\"M%.2f %.2fv%.2f\" class=\"stroke\"/>\n"
+			"<path class=\"fill\"\n"
+			"	d=\"",
+			x, y, -h);
+		y -= h;
+		if (n == 1) {
+			fmt_fprintf(fout,
+				"M%.2f %.2fc0.6 -5.6 9.6 -9 5.6 -18.4\n"
+				"	1.6 6 -1.3 11.6 -5.6 12.8\n",
+				x, y);
+		} else {
+			while (--n >= 0) {
+				fmt_fprintf(fout,
+					"M%.2f %.2fc0.9 -3.7 9.1 -6.4 6 -12.4\n"
+					"	1 5.4 -4.2 8.4 -6 8.4\n",
 					x, y);
-			} else {
-				while (--n >= 0) {
-					fprintf(fout,
-						"M%.2f %.2fc0.9 -3.7 9.1 -6.4 6 -12.4\n"
-						"	1 5.4 -4.2 8.4 -6 8.4\n",
-						x, y);
-					y -= 5.4;
-				}
-			}
-			fprintf(fout, "\"/>\n");
-			return;
-		}
-		if (strcmp(op, "sfs") == 0) {
-			setg(1);
-			h = pop_free_val();
-			n = pop_free_val();
-			sym = ps_sym_lookup("x");
-			x = gcur.xoffs + sym->e->u.v;
-			sym = ps_sym_lookup("y");
-			y = gcur.yoffs - sym->e->u.v - 1;
-			if (h > 0) {
-				x += 3.5;
-				y -= 1;
-				fprintf(fout,
-					"<path d=\"M%.2f %.2fv%.2f\" class=\"stroke\"/>\n"
-					"<path class=\"fill\"\n"
-					"	d=\"",
-					x, y, -h + 1);
-				y -= h - 1;
-				while (--n >= 0) {
-					fprintf(fout,
-						"M%.2f %.2fl7 3.2 0 3.2 -7 -3.2z\n",
-						x, y);
-					y += 5.4;
-				}
-			} else {
-				x -= 3.5;
-				y += 1;
-				fprintf(fout,
-					"<path d=\"M%.2f %.2fv%.2f\" class=\"stroke\"/>\n"
-					"<path class=\"fill\"\n"
-					"	d=\"",
-					x, y, -h - 1);
-				y -= h + 1;
-				while (--n >= 0) {
-					fprintf(fout,
-						"M%.2f %.2fl7 -3.2 0 -3.2 -7 3.2z\n",
-						x, y);
-					y -= 5.4;
-				}
+				y -= 5.4;
 			}
-			fprintf(fout, "\"/>\n");
-			return;
 		}
-		if (strcmp(op, "sgu") == 0) {
-			setg(1);
-			h = pop_free_val();
-			n = pop_free_val();
-			sym = ps_sym_lookup("x");
-			x = gcur.xoffs + sym->e->u.v + 1.6;
-			sym = ps_sym_lookup("y");
-			y = gcur.yoffs - sym->e->u.v;
-			fprintf(fout,
+		fmt_fprintf(fout, "\"/>\n");
+		return;
+	case OP_sfs:
+		setg(1);
+		h = pop_free_val();
+		n = pop_free_val();
+		sym = ps_sym_lookup("x");
+		x = gcur.xoffs + sym->e->u.v;
+		sym = ps_sym_lookup("y");
+		y = gcur.yoffs - sym->e->u.v - 1;
+		if (h > 0) {
+			x += 3.5;
+			y -= 1;
+			fmt_fprintf(fout,
 				"<path d=\"M%.2f %.2fv%.2f\" class=\"stroke\"/>\n"
 				"<path class=\"fill\"\n"
 				"	d=\"",
-				x, y, -h);
-			y -= h;
-			if (n == 1) {
-				fprintf(fout,
-					"M%.2f %.2fc0.6 3.4 5.6 3.8 3 10\n"
-					"	1.2 -4.4 -1.4 -7 -3 -7\n",
-					x, y);
-			} else {
-				while (--n >= 0) {
-					fprintf(fout,
-						"M%.2f %.2fc1 3.2 5.6 2.8 3.2 8\n"
-						"	1.4 -4.8 -2.4 -5.4 -3.2 -5.2\n",
+				x, y, -h + 1);
+			y -= h - 1;
+			while (--n >= 0) {
+				fmt_fprintf(fout,
+					"M%.2f %.2fl7 3.2 0 3.2 -7 -3.2z\n",
 					x, y);
-					y += 3.5;
-				}
+				y += 5.4;
 			}
-			fprintf(fout, "\"/>\n");
-			return;
-		}
-		if (strcmp(op, "sgd") == 0) {
-			setg(1);
-			h = pop_free_val();
-			n = pop_free_val();
-			sym = ps_sym_lookup("x");
-			x = gcur.xoffs + sym->e->u.v - 1.6;
-			sym = ps_sym_lookup("y");
-			y = gcur.yoffs - sym->e->u.v;
-			fprintf(fout,
+		} else {
+			x -= 3.5;
+			y += 1;
+			fmt_fprintf(fout,
 				"<path d=\"M%.2f %.2fv%.2f\" class=\"stroke\"/>\n"
 				"<path class=\"fill\"\n"
 				"	d=\"",
-				x, y, -h);
-			y -= h;
-			if (n == 1) {
-				fprintf(fout,
-					"M%.2f %.2fc0.6 -3.4 5.6 -3.8 3 -10\n"
-					"	1.2 4.4 -1.4 7 -3 7\n",
+				x, y, -h - 1);
+			y -= h + 1;
+			while (--n >= 0) {
+				fmt_fprintf(fout,
+					"M%.2f %.2fl7 -3.2 0 -3.2 -7 3.2z\n",
 					x, y);
-			} else {
-				while (--n >= 0) {
-					fprintf(fout,
-						"M%.2f %.2fc1 -3.2 5.6 -2.8 3.2 -8\n"
-						"	1.4 4.8 -2.4 5.4 -3.2 5.2\n",
-						x, y);
-					y -= 3.5;
-				}
+				y -= 5.4;
 			}
-			fprintf(fout, "\"/>\n");
-			return;
 		}
-		if (strcmp(op, "sgs") == 0) {
-			setg(1);
-			h = pop_free_val();
-			n = pop_free_val();
-			sym = ps_sym_lookup("x");
-			x = gcur.xoffs + sym->e->u.v + 1.6;
-			sym = ps_sym_lookup("y");
-			y = gcur.yoffs - sym->e->u.v;
-			fprintf(fout,
-				"<path d=\"M%.2f %.2fv%.2f\" class=\"stroke\"/>\n"
-				"<path class=\"fill\"\n"
-				"	d=\"",
-				x, y, -h);
-			y -= h;
+		fmt_fprintf(fout, "\"/>\n");
+		return;
+	case OP_sgu:
+		setg(1);
+		h = pop_free_val();
+		n = pop_free_val();
+		sym = ps_sym_lookup("x");
+		x = gcur.xoffs + sym->e->u.v + 1.6;
+		sym = ps_sym_lookup("y");
+		y = gcur.yoffs - sym->e->u.v;
+		fmt_fprintf(fout,
+			"<path d=\"M%.2f %.2fv%.2f\" class=\"stroke\"/>\n"
+			"<path class=\"fill\"\n"
+			"	d=\"",
+			x, y, -h);
+		y -= h;
+		if (n == 1) {
+			fmt_fprintf(fout,
+				"M%.2f %.2fc0.6 3.4 5.6 3.8 3 10\n"
+				"	1.2 -4.4 -1.4 -7 -3 -7\n",
+				x, y);
+		} else {
 			while (--n >= 0) {
-				fprintf(fout,
-					"M%.2f %.2fl3 1.5 0 2 -3 -1.5z\n",
-					x, y);
-				y += 3;
+				fmt_fprintf(fout,
+					"M%.2f %.2fc1 3.2 5.6 2.8 3.2 8\n"
+					"	1.4 -4.8 -2.4 -5.4 -3.2 -5.2\n",
+				x, y);
+				y += 3.5;
 			}
-			fprintf(fout, "\"/>\n");
-			return;
-		}
-		if (strcmp(op, "sfz") == 0) {
-			xysym(op, D_sfz);
-			s = pop_free_str();
-			if (s)
-				free(s);
-			return;
-		}
-		if (strcmp(op, "sgno") == 0) {
-			xysym(op, D_sgno);
-			return;
-		}
-		if (strcmp(op, "show") == 0) {
-			show('s');
-			return;
-		}
-		if (strcmp(op, "showb") == 0) {
-			show('b');
-			return;
-		}
-		if (strcmp(op, "showc") == 0) {
-			show('c');
-			return;
 		}
-		if (strcmp(op, "showr") == 0) {
-			show('r');
-			return;
-		}
-		if (strcmp(op, "showerror") == 0) {
-			xysym(op, D_showerror);
-			return;
-		}
-		if (strcmp(op, "sld") == 0) {
-			xysym(op, D_sld);
-			return;
-		}
-		if (strcmp(op, "snap") == 0) {
-			xysym(op, D_snap);
-			return;
-		}
-		if (strcmp(op, "sphr") == 0) {
-			xysym(op, D_sphr);
-			return;
+		fmt_fprintf(fout, "\"/>\n");
+		return;
+	case OP_sgd:
+		setg(1);
+		h = pop_free_val();
+		n = pop_free_val();
+		sym = ps_sym_lookup("x");
+		x = gcur.xoffs + sym->e->u.v - 1.6;
+		sym = ps_sym_lookup("y");
+		y = gcur.yoffs - sym->e->u.v;
+		fmt_fprintf(fout,
+			"<path d=\"M%.2f %.2fv%.2f\" class=\"stroke\"/>\n"
+			"<path class=\"fill\"\n"
+			"	d=\"",
+			x, y, -h);
+		y -= h;
+		if (n == 1) {
+			fmt_fprintf(fout,
+				"M%.2f %.2fc0.6 -3.4 5.6 -3.8 3 -10\n"
+				"	1.2 4.4 -1.4 7 -3 7\n",
+				x, y);
+		} else {
+			while (--n >= 0) {
+				fmt_fprintf(fout,
+					"M%.2f %.2fc1 -3.2 5.6 -2.8 3.2 -8\n"
+					"	1.4 4.8 -2.4 5.4 -3.2 5.2\n",
+					x, y);
+				y -= 3.5;
+			}
 		}
-		if (strcmp(op, "spclef") == 0) {
-			xysym(op + 1, D_pclef);		// same as 'pclef'
-			return;
+		fmt_fprintf(fout, "\"/>\n");
+		return;
+	case OP_sgs:
+		setg(1);
+		h = pop_free_val();
+		n = pop_free_val();
+		sym = ps_sym_lookup("x");
+		x = gcur.xoffs + sym->e->u.v + 1.6;
+		sym = ps_sym_lookup("y");
+		y = gcur.yoffs - sym->e->u.v;
+		fmt_fprintf(fout,
+			"<path d=\"M%.2f %.2fv%.2f\" class=\"stroke\"/>\n"
+			"<path class=\"fill\"\n"
+			"	d=\"",
+			x, y, -h);
+		y -= h;
+		while (--n >= 0) {
+			fmt_fprintf(fout,
+				"M%.2f %.2fl3 1.5 0 2 -3 -1.5z\n",
+				x, y);
+			y += 3;
 		}
-		if (strcmp(op, "setrgbcolor") == 0) {
-			int rgb;
+		fmt_fprintf(fout, "\"/>\n");
+		return;
+	case OP_sfz:
+		xysym(op, D_sfz);
+		s = pop_free_str();
+		return;
+	case OP_sgno:
+		xysym(op, D_sgno);
+		return;
+	case OP_show:
+		show('s');
+		return;
+	case OP_showb:
+		show('b');
+		return;
+	case OP_showc:
+		show('c');
+		return;
+	case OP_showr:
+		show('r');
+		return;
+	case OP_showerror:
+		xysym(op, D_showerror);
+		return;
+	case OP_sld:
+		xysym(op, D_sld);
+		return;
+	case OP_snap:
+		xysym(op, D_snap);
+		return;
+	case OP_sphr:
+		xysym(op, D_sphr);
+		return;
+	case OP_spclef:
+		xysym(op + 1, D_pclef);		// same as 'pclef'
+		return;
+	case OP_setrgbcolor: {
+		int rgb;
 
-			rgb = pop_free_val() * 255;
-			rgb += pop_free_val() * 255 * 256;
-			rgb += pop_free_val() * 255 * 256 * 256;
-			gcur.rgb = rgb;
-			return;
-		}
-		if (strcmp(op, "staff") == 0) {
-			ps_exec("dlw");
-			setg(1);
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val();
-			n = pop_free_val();
-			w = pop_free_val();
-			fprintf(fout,
-				"<path class=\"stroke\"\n"
-				"	d=\"M%.2f %.2f", x, y);
+		rgb = pop_free_val() * 255;
+		rgb += pop_free_val() * 255 * 256;
+		rgb += pop_free_val() * 255 * 256 * 256;
+		gcur.rgb = rgb;
+		return;
+	    }
+	case OP_staff:
+		ps_exec("dlw");
+		setg(1);
+		y = gcur.yoffs - pop_free_val();
+		x = gcur.xoffs + pop_free_val();
+		n = pop_free_val();
+		w = pop_free_val();
+		if (pdf_shape()) {
+			float v[2];
+
+			v[0] = x;
+			v[1] = y;
 			for (;;) {
-				fprintf(fout, "h%.2f", w);
+				pdf_path(CR_MOVE, 2, v);
+				v[0] += w;
+				pdf_path(CR_LINE, 2, v);
 				if (--n <= 0)
 					break;
-				fprintf(fout, "m-%.2f -6", w);
+				v[0] -= w;
+				v[1] -= 6;
 			}
-			fprintf(fout, "\"/>\n");
+			pdf_paint(CR_STROKE, -1, NULL);
 			return;
 		}
-		if (strcmp(op, "stc") == 0) {
-			xysym(op, D_stc);
-			return;
+		fmt_fprintf(fout,
+			"<path class=\"stroke\"\n"
+			"	d=\"M%.2f %.2f", x, y);
+		for (;;) {
+			fmt_fprintf(fout, "h%.2f", w);
+			if (--n <= 0)
+				break;
+			fmt_fprintf(fout, "m-%.2f -6", w);
 		}
-		if (strcmp(op, "stroke") == 0) {
-			if (!path) {
-				fprintf(stderr, "svg: 'stroke' with no path\n");
+		fmt_fprintf(fout, "\"/>\n");
+		return;
+	case OP_stc:
+		xysym(op, D_stc);
+		return;
+	case OP_stroke:
+		if (!path) {
+			fprintf(job_err(), "svg: 'stroke' with no path\n");
 //				ps_error = 1;
-				return;
-			}
-			path_end();
-			fprintf(fout, "\t\" class=\"stroke\"%s/>\n",
-					gcur.dash);
-			return;
-		}
-		if (strcmp(op, "su") == 0
-		 || strcmp(op, "sd") == 0) {
-			stem(op);
 			return;
 		}
-		if (strcmp(op, "stsig") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val();
-			s = pop_free_str();
-			if (!s) {
-				fprintf(stderr, "svg: No string\n");
-				ps_error = 1;
-				return;
-			}
-			fprintf(fout, "<g font-family=\"serif\" font-size=\"18\" font-weight=\"bold\" font-style=\"normal\"\n"
-				"	transform=\"translate(%.2f,%.2f) scale(1.2,1)\">\n"
-				"	<text y=\"-7\" text-anchor=\"middle\">%s</text>\n"
-				"</g>\n",
-				x, y, s + 1);
-			free(s);
-			return;
-		}
-		if (strcmp(op, "sub") == 0) {
-			x = pop_free_val();
-			if (!stack || stack->type != VAL) {
-				fprintf(stderr, "svg: Bad value for sub\n");
-				ps_error = 1;
-				return;
-			}
-			stack->u.v -= x;
-			return;
-		}
-		if (strcmp(op, "sbclef") == 0) {
-			xysym(op, D_sbclef);
-			return;
-		}
-		if (strcmp(op, "scclef") == 0) {
-			xysym(op, D_scclef);
-			return;
-		}
-		if (strcmp(op, "sh0") == 0) {
-			xysym(op, D_sh0);
-			return;
-		}
-		if (strcmp(op, "sh1") == 0) {
-			xysym(op, D_sh1);
+		path_end(CR_STROKE);
+		return;
+	case OP_su:
+	case OP_sd:
+		stem(op);
+		return;
+	case OP_stsig:
+		setg(1);
+		y = gcur.yoffs - pop_free_val();
+		x = gcur.xoffs + pop_free_val();
+		s = pop_free_str();
+		if (!s) {
+			fprintf(job_err(), "svg: No string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "sh4") == 0) {
-			n = pop_free_val();
-			switch (n) {
-			case 1:
-				xysym("sh1", D_sh1);
-				break;
-			case 2:
-				xysym("sh0", D_sh0);
-				break;
-			case 3:
-				xysym("sh513", D_sh513);
-				break;
-			default:
-				xysym("dsh0", D_dsh0);
-				break;
-			}
+		fmt_fprintf(fout, "<g font-family=\"serif\" font-size=\"18\" font-weight=\"bold\" font-style=\"normal\"\n"
+			"	transform=\"translate(%.2f,%.2f) scale(1.2,1)\">\n"
+			"	<text y=\"-7\" text-anchor=\"middle\">%s</text>\n"
+			"</g>\n",
+			x, y, s + 1);
+		return;
+	case OP_sub:
+		x = pop_free_val();
+		if (!stack || stack->type != VAL) {
+			fprintf(job_err(), "svg: Bad value for sub\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "sh513") == 0) {
-			xysym(op, D_sh513);
-			return;
+		stack->u.v -= x;
+		return;
+	case OP_sbclef:
+		xysym(op, D_sbclef);
+		return;
+	case OP_scclef:
+		xysym(op, D_scclef);
+		return;
+	case OP_sh0:
+		xysym(op, D_sh0);
+		return;
+	case OP_sh1:
+		xysym(op, D_sh1);
+		return;
+	case OP_sh4:
+		n = pop_free_val();
+		switch (n) {
+		case 1:
+			xysym("sh1", D_sh1);
+			break;
+		case 2:
+			xysym("sh0", D_sh0);
+			break;
+		case 3:
+			xysym("sh513", D_sh513);
+			break;
+		default:
+			xysym("dsh0", D_dsh0);
+			break;
 		}
-		if (strcmp(op, "srep") == 0) {
-			xysym(op, D_srep);
+		return;
+	case OP_sh513:
+		xysym(op, D_sh513);
+		return;
+	case OP_srep:
+		xysym(op, D_srep);
+		return;
+	case OP_stclef:
+		xysym(op, D_stclef);
+		return;
+	case OP_stringwidth:
+		s = pop_free_str();
+		if (!s || *s != '(') {
+			fprintf(job_err(), "svg stringwidth: No string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "stclef") == 0) {
-			xysym(op, D_stclef);
+		e = elt_new();
+		if (!e)
 			return;
-		}
-		if (strcmp(op, "stringwidth") == 0) {
-			s = pop_free_str();
-			if (!s || *s != '(') {
-				fprintf(stderr, "svg stringwidth: No string\n");
-				ps_error = 1;
-				return;
-			}
-			e = elt_new();
-			if (!e)
-				return;
-			e->type = VAL;
-			e->u.v = strw(s + 1);
-			push(e);
-			e = elt_new();
-			if (!e)
-				return;
-			e->type = VAL;
-			e->u.v = gcur.font_s;
-			push(e);
+		e->type = VAL;
+		e->u.v = strw(s + 1);
+		push(e);
+		e = elt_new();
+		if (!e)
 			return;
-		}
-		if (strcmp(op, "svg") == 0) {
-			e = elt_new();
-			if (!e)
-				return;
-			e->type = VAL;
-			e->u.v = 1;
-			push(e);
+		e->type = VAL;
+		e->u.v = gcur.font_s;
+		push(e);
+		return;
+	case OP_svg:
+		e = elt_new();
+		if (!e)
 			return;
-		}
-		break;
-	case 'T':
-		if (strcmp(op, "T") == 0) {
+		e->type = VAL;
+		e->u.v = 1;
+		push(e);
+		return;
+	case OP_T:
 translate:
 //fixme:test
 //			setg(1);
-			y = pop_free_val();
-			x = pop_free_val();
-			gcur.xoffs += x;
-			gcur.yoffs -= y;
-			gcur.cx -= x;
-			gcur.cy -= y;
-			return;
-		}
-		break;
-	case 't':
-		if (strcmp(op, "tclef") == 0) {
-			xysym(op, D_tclef);
-			return;
-		}
-		if (strcmp(op, "thbar") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val() + 1.5;
-			h = pop_free_val();
-			fprintf(fout,
-				"<path class=\"stroke\" stroke-width=\"3\"\n"
-				"	d=\"M%.2f %.2fv%.2f\"/>\n",
-				x, y, -h);
-			return;
-		}
-		if (strcmp(op, "thumb") == 0) {
-			xysym(op, D_thumb);
-			return;
-		}
-		if (strcmp(op, "translate") == 0)
-			goto translate;
-		if (strcmp(op, "trem") == 0) {
-			setg(1);
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val() - 4.5;
-			n = pop_free_val();
-			fprintf(fout, "<path class=\"fill\" d=\"m%.2f %.2f\n\t",
-				x, y);
-			for (;;) {
-				fputs("l9 -3v3l-9 3z", fout);
-				if (--n <= 0)
-					break;
-				fputs("m0 5.4", fout);
-			}
-			fputs("\"/>", fout);
-			return;
-		}
-		if (strcmp(op, "trl") == 0) {
-			xysym(op, D_trl);
-			return;
+		y = pop_free_val();
+		x = pop_free_val();
+		gcur.xoffs += x;
+		gcur.yoffs -= y;
+		gcur.cx -= x;
+		gcur.cy -= y;
+		return;
+	case OP_tclef:
+		xysym(op, D_tclef);
+		return;
+	case OP_thbar:
+		setg(1);
+		y = gcur.yoffs - pop_free_val();
+		x = gcur.xoffs + pop_free_val() + 1.5;
+		h = pop_free_val();
+		fmt_fprintf(fout,
+			"<path class=\"stroke\" stroke-width=\"3\"\n"
+			"	d=\"M%.2f %.2fv%.2f\"/>\n",
+			x, y, -h);
+		return;
+	case OP_thumb:
+		xysym(op, D_thumb);
+		return;
+	case OP_translate:
+		goto translate;
+	case OP_trem:
+		setg(1);
+		y = gcur.yoffs - pop_free_val();
+		x = gcur.xoffs + pop_free_val() - 4.5;
+		n = pop_free_val();
+		fmt_fprintf(fout, "<path class=\"fill\" d=\"m%.2f %.2f\n\t",
+			x, y);
+		for (;;) {
+			fputs("l9 -3v3l-9 3z", fout);
+			if (--n <= 0)
+				break;
+			fputs("m0 5.4", fout);
 		}
-		if (strcmp(op, "true") == 0) {
-			e = elt_new();
-			if (!e)
-				return;
-			e->type = VAL;
-			e->u.v = 1;
-			push(e);
+		fputs("\"/>", fout);
+		return;
+	case OP_trl:
+		xysym(op, D_trl);
+		return;
+	case OP_true:
+		e = elt_new();
+		if (!e)
 			return;
-		}
-		if (strcmp(op, "tsig") == 0) {
-			char *d;
+		e->type = VAL;
+		e->u.v = 1;
+		push(e);
+		return;
+	case OP_tsig: {
+		char *d;
 
-			setg(1);
-			y = gcur.yoffs - pop_free_val() - 0.5;
-			x = gcur.xoffs + pop_free_val();
-			d = pop_free_str();
-			s = pop_free_str();
-			if (!d || !s) {
-				fprintf(stderr, "svg: No string\n");
-				if (d)
-					free(d);
-				if (s)
-					free(s);
-				ps_error = 1;
-				return;
-			}
-			fprintf(fout, "<g font-family=\"serif\" font-size=\"16\" font-weight=\"bold\" font-style=\"normal\"\n"
-				"	transform=\"translate(%.2f,%.2f) scale(1.2,1)\">\n"
-				"	<text text-anchor=\"middle\">%s</text>\n"
-				"	<text y=\"-12\" text-anchor=\"middle\">%s</text>\n"
-				"</g>\n",
-				x, y, d + 1, s + 1);
-			free(d);
-			free(s);
-			return;
-		}
-		if (strcmp(op, "tubr") == 0
-		 || strcmp(op, "tubrl") == 0) {
-			float dx, dy;
-			int h;
-
-			setg(1);
-			y = gcur.yoffs - pop_free_val();
-			x = gcur.xoffs + pop_free_val();
-			dy = pop_free_val();
-			dx = pop_free_val();
-			if (op[4] == 'l') {
-				h = 3;
-				y -= 3;
-			} else {
-				h = -3;
-				y += 3;
-			}
-			fprintf(fout,
-				"<path class=\"stroke\"\n"
-				"	d=\"M%.2f %.2fv%dl%.2f %.2fv%d\"/>\n",
-				x, y, h, dx, -dy, -h);
-			return;
-		}
-		if (strcmp(op, "turn") == 0) {
-			xysym(op, D_turn);
-			return;
-		}
-		if (strcmp(op, "turnx") == 0) {
-			xysym(op, D_turnx);
-			return;
-		}
-		break;
-	case 'u':
-		if (strcmp(op, "upb") == 0) {
-			xysym(op, D_upb);
+		setg(1);
+		y = gcur.yoffs - pop_free_val() - 0.5;
+		x = gcur.xoffs + pop_free_val();
+		d = pop_free_str();
+		s = pop_free_str();
+		if (!d || !s) {
+			fprintf(job_err(), "svg: No string\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "umrd") == 0) {
-			xysym(op, D_umrd);
-			return;
+		fmt_fprintf(fout, "<g font-family=\"serif\" font-size=\"16\" font-weight=\"bold\" font-style=\"normal\"\n"
+			"	transform=\"translate(%.2f,%.2f) scale(1.2,1)\">\n"
+			"	<text text-anchor=\"middle\">%s</text>\n"
+			"	<text y=\"-12\" text-anchor=\"middle\">%s</text>\n"
+			"</g>\n",
+			x, y, d + 1, s + 1);
+		return;
+	    }
+	case OP_tubr:
+	case OP_tubrl: {
+		float dx, dy;
+		int h;
+
+		setg(1);
+		y = gcur.yoffs - pop_free_val();
+		x = gcur.xoffs + pop_free_val();
+		dy = pop_free_val();
+		dx = pop_free_val();
+		if (op[4] == 'l') {
+			h = 3;
+			y -= 3;
+		} else {
+			h = -3;
+			y += 3;
 		}
-		break;
-	case 'w':
-		if (strcmp(op, "wedge") == 0) {
-			xysym(op, D_wedge);
+		fmt_fprintf(fout,
+			"<path class=\"stroke\"\n"
+			"	d=\"M%.2f %.2fv%dl%.2f %.2fv%d\"/>\n",
+			x, y, h, dx, -dy, -h);
+		return;
+	    }
+	case OP_turn:
+		xysym(op, D_turn);
+		return;
+	case OP_turnx:
+		xysym(op, D_turnx);
+		return;
+	case OP_upb:
+		xysym(op, D_upb);
+		return;
+	case OP_umrd:
+		xysym(op, D_umrd);
+		return;
+	case OP_wedge:
+		xysym(op, D_wedge);
+		return;
+	case OP_wln:
+		setg(1);
+		y = pop_free_val();
+		x = pop_free_val();
+		w = pop_free_val();
+		fmt_fprintf(fout, "<path class=\"stroke\" stroke-width=\"0.8\"\n"
+			"	d=\"M%.2f %.2fh%.2f\"/>\n",
+			gcur.xoffs + x, gcur.yoffs - y, w);
+		return;
+	case OP_where:
+		s = pop_free_str();		/* symbol */
+		if (!s || *s != '/') {
+			fprintf(job_err(), "svg where: No / bad symbol\n");
+			ps_error = 1;
 			return;
 		}
-		if (strcmp(op, "wln") == 0) {
-			setg(1);
-			y = pop_free_val();
-			x = pop_free_val();
-			w = pop_free_val();
-			fprintf(fout, "<path class=\"stroke\" stroke-width=\"0.8\"\n"
-				"	d=\"M%.2f %.2fh%.2f\"/>\n",
-				gcur.xoffs + x, gcur.yoffs - y, w);
+		e = elt_new();
+		if (!e)
 			return;
-		}
-		if (strcmp(op, "where") == 0) {
-			s = pop_free_str();		/* symbol */
-			if (!s || *s != '/') {
-				fprintf(stderr, "svg where: No / bad symbol\n");
-				if (s)
-					free(s);
-				ps_error = 1;
-				return;
-			}
-			e = elt_new();
-			if (!e)
+		e->type = VAL;
+		sym = ps_sym_lookup(&s[1]);
+		if (!sym) {
+			e->u.v = 0;
+		} else {
+			e->u.v = 1;
+			e2 = elt_new();		/* dictionnary */
+			if (!e2)
 				return;
-			e->type = VAL;
-			sym = ps_sym_lookup(&s[1]);
-			if (!sym) {
-				e->u.v = 0;
-			} else {
-				e->u.v = 1;
-				e2 = elt_new();		/* dictionnary */
-				if (!e2)
-					return;
-				e2->type = VAL;
-				e2->u.v = 0;
-				push(e2);
-			}
-			free(s);
-			push(e);
-			return;
+			e2->type = VAL;
+			e2->u.v = 0;
+			push(e2);
 		}
+		push(e);
+		return;
+	case OP_xydef:
+		y = pop_free_val();
+		x = pop_free_val();
+		setxory("x", x);
+		setxory("y", y);
+		return;
+	case OP_xymove:
+		gcur.cy = y = pop_free_val();
+		gcur.cx = x = pop_free_val();
+		setxory("x", x);
+		setxory("y", y);
+		return;
+	default:
 		break;
-	case 'x':
-		if (strcmp(op, "xydef") == 0) {
-			y = pop_free_val();
-			x = pop_free_val();
-			setxory("x", x);
-			setxory("y", y);
-			return;
-		}
-		if (strcmp(op, "xymove") == 0) {
-			gcur.cy = y = pop_free_val();
-			gcur.cx = x = pop_free_val();
-			setxory("x", x);
-			setxory("y", y);
-			return;
+	}
+	if (sscanf(op, "F%d", &n) == 1) {	/* set font */
+		h = pop_free_val();
+		if (gcur.font_s != h
+		 || strcmp(fontnames[n], gcur.font_n) != 0) {
+			free(gcur.font_n_old);
+			gcur.font_n_old = gcur.font_n;
+			gcur.font_n = strdup(fontnames[n]);
+			gcur.font_s = h;
 		}
-		break;
+		return;
 	}
 	// check if already a SVG definition from %%beginsvg
 	if (defs) {
@@ -4174,16 +4538,127 @@ translate:
 			return;
 		}
 	}
-	fprintf(stderr, "svg: Symbol '%s' not defined\n", op);
+	fprintf(job_err(), "svg: Symbol '%s' not defined\n", op);
 	ps_error = 1;
 }
 
+/* execute an operator by name */
+static void ps_exec(char *op)
+{
+	op_exec(op, op_find(op));
+}
+
+/* execute a string element */
+/* the built-in operator is searched only once */
+static void str_exec(struct elt_s *e)
+{
+	if (e->op == OP_N)
+		e->op = op_find(e->u.s);
+	op_exec(e->u.s, e->op);
+}
+
+/* -- treat a native record (see draw.c) -- */
+/* 'len' is the length of the buffer after NV_MARK */
+static unsigned char *native(unsigned char *p, int len)
+{
+	struct elt_s *e;
+	char *op;
+	float v[NV_MAXVAL];
+	int nv, i, n;
+
+	static char *nv_name[NV_N] = {
+		"hd", "Hd", "HD", "HDD", "ghd",
+		"hl", "hl1", "hl2", "ghl",
+		"su", "sd", "gu", "gd",
+		"dt", "bar", "bm"
+	};
+	static const char nv_nval[NV_N] = {
+		2, 2, 2, 2, 2,
+		2, 2, 2, 2,
+		1, 1, 1, 1,
+		2, 3, 5
+	};
+	static const signed char nv_use[NV_N] = {
+		D_hd, D_Hd, D_HD, D_HDD, D_ghd,
+		D_hl, D_hl1, D_hl2, D_ghl
+	};
+	static const short nv_op[NV_N] = {
+		OP_hd, OP_Hd, OP_HD, OP_HDD, OP_ghd,
+		OP_hl, OP_hl1, OP_hl2, OP_ghl,
+		OP_su, OP_sd, OP_gu, OP_gd,
+		OP_dt, OP_bar, OP_bm
+	};
+
+	nv = *p - 'A';
+	if (nv < 0 || nv >= NV_N
+	 || len < 1 + nv_nval[nv] * (int) sizeof (float) + 1
+	 || p[1 + nv_nval[nv] * sizeof (float)] != '\n') {
+		fprintf(job_err(), "svg: Bad native record\n");
+		ps_error = 1;
+		return p;
+	}
+	p++;
+	n = nv_nval[nv];
+	memcpy(v, p, n * sizeof (float));
+	p += n * sizeof (float);
+	p++;
+	op = nv_name[nv];
+
+	/* redefined operator: use the PostScript interpreter */
+	if (op_redef[nv_op[nv]]) {
+		for (i = 0; i < n; i++) {
+			e = elt_new();
+			if (!e)
+				return p;
+			e->type = VAL;
+			e->u.v = v[i];
+			push(e);
+		}
+		op_exec(op, nv_op[nv]);
+		return p;
+	}
+
+	switch (nv) {
+	case NV_hd:
+	case NV_Hd:
+	case NV_HD:
+	case NV_HDD:
+	case NV_ghd:
+		setxysym_v(op, nv_use[nv], v[0], v[1]);
+		break;
+	case NV_hl:
+	case NV_hl1:
+	case NV_hl2:
+	case NV_ghl:
+		xysym_v(op, nv_use[nv], v[0], v[1]);
+		break;
+	case NV_su:
+	case NV_sd:
+	case NV_gu:
+	case NV_gd:
+		stem_v(op, v[0]);
+		break;
+	case NV_dt:
+		dot(v[0], v[1]);
+		break;
+	case NV_bar:
+		bar(v[0], v[1], v[2]);
+		break;
+	case NV_bm:
+		beam(v[0], v[1], v[2], v[3], v[4]);
+		break;
+	}
+	return p;
+}
+
 void svg_write(char *buf, int len)
 {
 	int l;
 	struct elt_s *e, *e2;
 	unsigned char c, *p, *q, *r;
 
+	stats_count(ST_SVG_WRITE);
+	PROBE1(svg__write, len);
 	if (ps_error)
 		return;
 
@@ -4204,6 +4679,13 @@ void svg_write(char *buf, int len)
 		case '\t':
 		case '\n':
 			continue;
+		case NV_MARK:
+			q = native(p, len);
+			len -= q - p;
+			p = q;
+			if (ps_error)
+				return;
+			continue;
 		case '{':
 		case '[':		/* treat '[' as '{' */
 			e = elt_new();
@@ -4211,7 +4693,7 @@ void svg_write(char *buf, int len)
 				return;
 			in_cnt++;
 			e->type = STR;
-			e->u.s = strdup(c == '{' ? "{" : "[");
+			e->u.s = c == '{' ? "{" : "[";
 			push(e);
 			break;
 		case '}':
@@ -4219,9 +4701,9 @@ void svg_write(char *buf, int len)
 			in_cnt--;
 			if (in_cnt < 0) {
 				if (c == '}')
-					fprintf(stderr, "svg: '}' without '{'\n");
+					fprintf(job_err(), "svg: '}' without '{'\n");
 				else
-					fprintf(stderr, "svg: ']' without '['\n");
+					fprintf(job_err(), "svg: ']' without '['\n");
 				ps_error = 1;
 				return;
 			}
@@ -4249,7 +4731,7 @@ void svg_write(char *buf, int len)
 				e->u.e = e2;
 			}
 			if (e2->u.s[0] != c) {
-				fprintf(stderr, "svg: '%c' found before '%c'\n",
+				fprintf(job_err(), "svg: '%c' found before '%c'\n",
 					e2->u.s[0], c);
 				ps_error = 1;
 				return;
@@ -4281,7 +4763,7 @@ void svg_write(char *buf, int len)
 						&row, &col, &x, &y);
 					w = h = 6;
 				}
-				fprintf(fout, "<abc type=\"%c\" row=\"%d\" col=\"%d\" x=\"%.2f\" y=\"%.2f\" width=\"%.2f\" height=\"%d\"/>\n",
+				fmt_fprintf(fout, "<abc type=\"%c\" row=\"%d\" col=\"%d\" x=\"%.2f\" y=\"%.2f\" width=\"%.2f\" height=\"%d\"/>\n",
 					type, row, col, gcur.xoffs + x, gcur.yoffs - y - h, w, h);
 				break;
 			}
@@ -4291,12 +4773,12 @@ void svg_write(char *buf, int len)
 				setg(1);
 				if (q[10] == 's') {		/* subtitle */
 					q += 14;
-					fprintf(fout, "<!-- subtitle: %.*s -->\n",
+					fmt_fprintf(fout, "<!-- subtitle: %.*s -->\n",
 							(int) (p - q - 1), q);
 					break;
 				}
 				q += 11;
-				fprintf(fout, "<!-- title: %.*s -->\n",
+				fmt_fprintf(fout, "<!-- title: %.*s -->\n",
 						(int) (p - q -1), q);
 				break;
 			}
@@ -4324,7 +4806,7 @@ void svg_write(char *buf, int len)
 			if (!e)
 				return;
 			e->type = STR;
-			r = malloc(l);
+			r = (unsigned char *) spool_alloc(&str_page, l);
 			e->u.s = (char *) r;
 			for (;;) {
 				c = *p++;
@@ -4358,6 +4840,7 @@ void svg_write(char *buf, int len)
 				case ']':
 				case '%':
 				case '/':
+				case NV_MARK:
 					break;
 				default:
 					continue;
@@ -4386,8 +4869,8 @@ void svg_write(char *buf, int len)
 					e->u.v = i;
 				} else {
 					if (sscanf((char *) q, "%f", &v) != 1) {
-						fprintf(stderr, "svg: Bad numeric value in '%s'\n",
-							buf);
+						fprintf(job_err(), "svg: Bad numeric value in '%s'\n",
+							(char *) q);
 						v = 0;
 					}
 					e->u.v = v;
@@ -4417,15 +4900,13 @@ void svg_write(char *buf, int len)
 					elt_free(e);
 					break;
 				}
-				l = p - q;
-				r = malloc(l + 1);
-				memcpy(r, q, l);
-				r[l] = '\0';
 				e = elt_new();
 				if (!e)
 					return;
 				e->type = STR;
-				e->u.s = (char *) r;
+				e->u.s = str_new((char *) q, p - q);
+				if (*q != '/')
+					e->op = op_find(e->u.s);
 			}
 			push(e);
 			break;
@@ -4439,7 +4920,7 @@ int svg_output(FILE *out, const char *fmt, ...)
 	char tmp[128];
 
 	va_start(args, fmt);
-	vsnprintf(tmp, sizeof tmp, fmt, args);
+	vfmt(tmp, sizeof tmp, fmt, args);
 	va_end(args);
 	svg_write(tmp, strlen(tmp));
 	return 0;
@@ -4450,17 +4931,19 @@ void svg_close(void)
 	struct elt_s *e, *e2;
 
 	setg(0);
-	fputs("</svg>\n", fout);
+	if (svg != 3)
+		fputs("</svg>\n", fout);
 	e = stack;
 	if (e) {
 		stack = NULL;
-		fprintf(stderr, "svg close: stack not empty ");
+		fprintf(job_err(), "svg close: stack not empty ");
 		elt_lst_dump(e);
-		fprintf(stderr, "\n");
+		fprintf(job_err(), "\n");
 		do {
 			e2 = e->next;
 			elt_free(e);
 			e = e2;
 		} while (e);
 	}
+	spool_reset(&str_page);		/* (the definitions are in str_file) */
 }
@@ -12,6 +12,7 @@
  * (at your option) any later version.
  */
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "abcm2ps.h"
@@ -820,21 +821,182 @@ void define_font(char name[],
 		fprintf(fout, "/F%d{/%s exch selectfont}!\n", num, name);
 }
 
-/* -- output the symbol definitions -- */
-void define_symbols(void)
+/* -- tree-shaking of the prologue -- */
+/* The prologue is split into the definitions starting by '/<name>'
+ * at the beginning of a line. With EPS, only the definitions whose
+ * name appears in the output are written (see ps_used_init()). */
+#define PS_NDEFS 256			/* max number of definitions */
+#define PS_HSZ 512			/* size of the name hash table */
+
+static TLS char *ps_prolog;		/* full prologue */
+static TLS int prolog_len, prolog_sz;	/* length and size of ps_prolog */
+static TLS struct ps_def {
+	char *text;			/* definition, starting with '/' */
+	short len;
+	short nlen;			/* length of the name - 0 if no def */
+	short next;			/* next definition of the same name */
+	char used;			/* 1: used, 2: dependencies scanned */
+} ps_defs[PS_NDEFS];
+static TLS int ps_ndefs;
+static TLS short ps_htb[PS_HSZ];	/* name hash (index + 1) */
+static TLS int ps_shake;		/* output only the used definitions */
+
+/* accidentals used by the font definitions (mkfont - see format.c) */
+static char font_deps[] = "usharp uflat unat udblesharp udbleflat";
+
+/* PostScript delimiters and white spaces */
+#define PS_DELIM(c) ((c) <= ' ' || strchr("()<>[]{}/%", (c)))
+
+static unsigned ps_hash(char *p, int len)
 {
-	fputs(ps_head, fout);
+	unsigned h;
+
+	h = 0;
+	while (--len >= 0)
+		h = h * 31 + (unsigned char) *p++;
+	return h & (PS_HSZ - 1);
+}
+
+/* -- find the first definition of a name -- */
+static int ps_lookup(char *p, int len)
+{
+	struct ps_def *d;
+	unsigned h;
+	int i;
+
+	h = ps_hash(p, len);
+	while ((i = ps_htb[h]) != 0) {
+		d = &ps_defs[i - 1];
+		if (d->nlen == len && memcmp(d->text + 1, p, len) == 0)
+			return i - 1;
+		h = (h + 1) & (PS_HSZ - 1);
+	}
+	return -1;
+}
+
+/* -- mark the definitions of the names found in some PostScript code -- */
+static void ps_scan(char *p, int len)
+{
+	char *e, *q;
+	int i;
+
+	e = p + len;
+	while (p < e) {
+		if (PS_DELIM(*p)) {
+			p++;
+			continue;
+		}
+		q = p;
+		while (p < e && !PS_DELIM(*p))
+			p++;
+		for (i = ps_lookup(q, p - q); i >= 0; i = ps_defs[i].next) {
+			if (!ps_defs[i].used)
+				ps_defs[i].used = 1;
+		}
+	}
+}
+
+/* -- split the prologue into definitions -- */
+static void prolog_index(char *p)
+{
+	struct ps_def *d;
+	char *q, *e;
+	unsigned h;
+	int i;
+
+	ps_ndefs = 0;
+	memset(ps_htb, 0, sizeof ps_htb);
+	while (*p != '\0') {
+		if (ps_ndefs >= PS_NDEFS) {
+			ps_ndefs = 0;		/* no tree-shaking */
+			return;
+		}
+		d = &ps_defs[ps_ndefs];
+		d->text = p;
+		d->next = -1;
+		for (;;) {			/* search the next line with '/' */
+			p = strchr(p, '\n');
+			if (!p) {
+				p = d->text + strlen(d->text);
+				break;
+			}
+			if (*++p == '/' || *p == '\0')
+				break;
+		}
+		d->len = p - d->text;
+
+		/* a definition ends with 'def' or '!' */
+		e = p;
+		while (e > d->text && e[-1] <= ' ')
+			e--;
+		d->nlen = 0;
+		if (*d->text == '/'
+		 && (e[-1] == '!'
+		  || (e - d->text > 4 && strncmp(e - 3, "def", 3) == 0
+		   && PS_DELIM(e[-4])))) {
+			q = d->text + 1;
+			while (!PS_DELIM(*q))
+				q++;
+			d->nlen = q - d->text - 1;
+		}
+		if (d->nlen != 0) {
+			i = ps_lookup(d->text + 1, d->nlen);
+			if (i >= 0) {		/* redefinition */
+				while (ps_defs[i].next >= 0)
+					i = ps_defs[i].next;
+				ps_defs[i].next = ps_ndefs;
+			} else {
+				h = ps_hash(d->text + 1, d->nlen);
+				while (ps_htb[h] != 0)
+					h = (h + 1) & (PS_HSZ - 1);
+				ps_htb[h] = ps_ndefs + 1;
+			}
+		}
+		ps_ndefs++;
+	}
+}
+
+/* -- build the prologue -- */
+/* -- add some formatted text to the prologue -- */
+static void prolog_add(const char *fmt, ...)
+{
+	va_list args;
+	char *p;
+	int l;
+
+	va_start(args, fmt);
+	l = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+	if (prolog_len + l + 1 > prolog_sz) {
+		prolog_sz = (prolog_len + l + 1) * 3 / 2;
+		p = realloc(ps_prolog, prolog_sz);
+		if (!p) {
+			error(1, NULL, "Out of memory for the prologue - abort");
+			fatal_exit(EXIT_FAILURE);
+		}
+		ps_prolog = p;
+	}
+	va_start(args, fmt);
+	vsnprintf(ps_prolog + prolog_len, prolog_sz - prolog_len, fmt, args);
+	va_end(args);
+	prolog_len += l;
+}
+
+static void prolog_build(void)
+{
+	prolog_len = prolog_sz = 0;
+	prolog_add("%s", ps_head);
 
 	/* len su - up stem */
-	fprintf(fout, "/su{dlw x y M %.1f %.1f RM %.1f sub 0 exch RL stroke}!\n",
+	prolog_add("/su{dlw x y M %.1f %.1f RM %.1f sub 0 exch RL stroke}!\n",
 		STEM_XOFF, STEM_YOFF, STEM_YOFF);
 
 	/* len sd - down stem */
-	fprintf(fout, "/sd{dlw x y M %.1f %.1f RM %.1f add 0 exch RL stroke}!\n",
+	prolog_add("/sd{dlw x y M %.1f %.1f RM %.1f add 0 exch RL stroke}!\n",
 		-STEM_XOFF, -STEM_YOFF, STEM_YOFF);
 
 	/* n len sfu - stem and n flags up */
-	fprintf(fout, "/sfu{	dlw x y M %.1f %.1f RM\n"
+	prolog_add("/sfu{	dlw x y M %.1f %.1f RM\n"
 		"	%.1f sub 0 exch RL currentpoint stroke\n"
 		"	M dup 1 eq{\n"
 		"		pop\n"
@@ -852,7 +1014,7 @@ void define_symbols(void)
 		STEM_XOFF, STEM_YOFF, STEM_YOFF);
 
 	/* n len sfd - stem and n flags down */
-	fprintf(fout, "/sfd{	dlw x y M %.1f %.1f RM\n"
+	prolog_add("/sfd{	dlw x y M %.1f %.1f RM\n"
 		"	%.1f add 0 exch RL currentpoint stroke\n"
 		"	M dup 1 eq{\n"
 		"		pop\n"
@@ -870,7 +1032,7 @@ void define_symbols(void)
 		-STEM_XOFF, -STEM_YOFF, STEM_YOFF);
 
 	/* n len sfs - stem and n straight flag down */
-	fprintf(fout, "/sfs{	dup 0 lt{\n"
+	prolog_add("/sfs{	dup 0 lt{\n"
 		"		dlw x y M -%.1f -%.1f RM\n"
 		"		%.1f add 0 exch RL currentpoint stroke\n"
 		"		M{	currentpoint\n"
@@ -895,7 +1057,7 @@ void define_symbols(void)
 		BEAM_DEPTH, BEAM_DEPTH, BEAM_DEPTH);
 
 	/* len gu - grace note stem up */
-	fprintf(fout, "/gu{	.6 SLW x y M\n"
+	prolog_add("/gu{	.6 SLW x y M\n"
 		"	%.1f 0 RM 0 exch RL stroke}!\n"
 
 	/* len gd - grace note stem down */
@@ -904,7 +1066,7 @@ void define_symbols(void)
 		GSTEM_XOFF, -GSTEM_XOFF);
 
 	/* n len sgu - gnote stem and n flag up */
-	fprintf(fout, "/sgu{	.6 SLW x y M %.1f 0 RM\n"
+	prolog_add("/sgu{	.6 SLW x y M %.1f 0 RM\n"
 		"	0 exch RL currentpoint stroke\n"
 		"	M dup 1 eq{\n"
 		"		pop\n"
@@ -920,7 +1082,7 @@ void define_symbols(void)
 		GSTEM_XOFF);
 
 	/* n len sgd - gnote stem and n flag down */
-	fprintf(fout, "/sgd{	.6 SLW x y M %.1f 0 RM\n"
+	prolog_add("/sgd{	.6 SLW x y M %.1f 0 RM\n"
 		"	0 exch RL currentpoint stroke\n"
 		"	M dup 1 eq{\n"
 		"		pop\n"
@@ -936,11 +1098,77 @@ void define_symbols(void)
 		-GSTEM_XOFF);
 
 	/* n len sgs - gnote stem and n straight flag up */
-	fprintf(fout, "/sgs{	.6 SLW x y M %.1f 0 RM\n"
+	prolog_add("/sgs{	.6 SLW x y M %.1f 0 RM\n"
 		"	0 exch RL currentpoint stroke\n"
 		"	M{	currentpoint\n"
 		"		3 -1.5 RL 0 -2 RL -3 1.5 RL\n"
 		"		closepath fill 3 sub M\n"
 		"	}repeat}!\n",
 		GSTEM_XOFF);
+
+	prolog_index(ps_prolog);
+}
+
+/* -- output the symbol definitions -- */
+/* when ps_used_init() has been called, output only the definitions
+ * which are used in the scanned PostScript code and their dependencies */
+void define_symbols(void)
+{
+	struct ps_def *d;
+	char *p;
+	int i, again;
+
+	if (!ps_prolog)
+		prolog_build();
+	if (!ps_shake) {
+		fputs(ps_prolog, fout);
+		return;
+	}
+	ps_shake = 0;
+	do {					/* add the dependencies */
+		again = 0;
+		for (i = 0, d = ps_defs; i < ps_ndefs; i++, d++) {
+			if (d->used == 1) {
+				d->used = 2;
+				p = d->text + 1 + d->nlen;
+				ps_scan(p, d->len - 1 - d->nlen);
+				again = 1;
+			}
+		}
+	} while (again);
+	for (i = 0, d = ps_defs; i < ps_ndefs; i++, d++) {
+		if (d->used)
+			fwrite(d->text, 1, d->len, fout);
+	}
+}
+
+/* -- start tracking the used definitions of the prologue -- */
+void ps_used_init(void)
+{
+	int i;
+
+	if (!ps_prolog)
+		prolog_build();
+	if (ps_ndefs == 0)
+		return;				/* (index overflow) */
+	for (i = 0; i < ps_ndefs; i++)
+		ps_defs[i].used = ps_defs[i].nlen == 0;	/* (always output) */
+	ps_shake = 1;
+	ps_scan(font_deps, sizeof font_deps - 1);
+}
+
+/* -- scan some PostScript code for the used definitions -- */
+void ps_used(char *p, int len)
+{
+	if (ps_shake)
+		ps_scan(p, len);
+}
+
+/* -- free the prologue -- */
+void free_symbols(void)
+{
+	free(ps_prolog);
+	ps_prolog = NULL;
+	ps_ndefs = 0;
+	ps_shake = 0;
 }
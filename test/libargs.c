@@ -0,0 +1,85 @@
+/*
+ * Check of the options of the library (make libtest).
+ *
+ * This file is part of abcm2ps.
+ *
+ * Copyright (C) 2016 Jean-François Moine
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libabcm2ps.h"
+
+static const char abc[] = "X:1\nT:Test\nM:4/4\nK:C\nCDEF GABc|\n";
+
+/* options which write or read files */
+static char *refused[][4] = {
+	{"--stats", "stats.json"},
+	{"--trace", "trace.txt"},
+	{"--sprite", "sprite.svg"},
+	{"--cairo", "png"},
+	{"--format", "/etc/passwd"},
+	{"-v", "--stats", "stats.json"},
+	{"-F", "landscape"},
+	{"-Dfmt"},
+	{"-O", "out.ps"},
+	{"-y"},
+	{"-z"},
+	{"file.abc"},
+	{"-"},
+	{NULL}
+};
+
+/* options which are accepted */
+static char *accepted[][4] = {
+	{"-v"},
+	{"-E"},
+	{"-g", "-j", "1"},
+	{"--titleformat", "T"},
+	{NULL}
+};
+
+static int sink(void *ctx, const char *buf, int len)
+{
+	(*(int *) ctx) += len;
+	return 0;
+}
+
+static int check(char **args, int expected)
+{
+	int r, len;
+
+	len = 0;
+	r = abcm2ps_render(abc, sizeof abc - 1, args, sink, NULL, &len);
+	if ((expected < 0 && r == -1)
+	 || (expected >= 0 && r == expected && len > 0))
+		return 0;
+	fprintf(stderr, "libargs: '%s%s%s' returned %d\n",
+		args[0],
+		args[1] ? " " : "",
+		args[1] ? args[1] : "",
+		r);
+	return 1;
+}
+
+int main(void)
+{
+	int i, err;
+
+	err = 0;
+	for (i = 0; refused[i][0]; i++)
+		err += check(refused[i], -1);
+	for (i = 0; accepted[i][0]; i++)
+		err += check(accepted[i], 0);
+	if (err) {
+		fprintf(stderr, "libargs: %d error(s)\n", err);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}